@@ -34,13 +34,23 @@
  * The cache can optionally store an ETag string with each tile. This is
  * useful to avoid redownloading old tiles that haven't changed (for example,
  * using the HTTP If-None-Match header).
+ *
+ * ## Storage
+ *
+ * By default, each tile is stored as its own file in the cache directory. With
+ * [property@FileCache:storage] set to %SHUMATE_FILE_CACHE_STORAGE_DATABASE,
+ * tile data is instead stored inside the cache's database, which avoids
+ * creating a file per tile. Tiles previously stored as files under the same
+ * cache key are moved into the database in the background.
  */
 
 #include "shumate-file-cache.h"
+#include "shumate-enum-types.h"
 
 #include <sqlite3.h>
 #include <errno.h>
 #include <glib.h>
+#include <glib/gstdio.h>
 #include <gio/gio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -51,6 +61,7 @@ enum
   PROP_SIZE_LIMIT,
   PROP_CACHE_DIR,
   PROP_CACHE_KEY,
+  PROP_STORAGE,
   N_PROPS
 };
 
@@ -63,16 +74,72 @@ struct _ShumateFileCache
   guint size_limit;
   char *cache_dir;
   char *cache_key;
+  ShumateFileCacheStorage storage;
 
+  /* Connection used for reads, on the main thread and on the GTask threads
+   * that read tiles. See init_cache(). */
   sqlite3 *db;
   sqlite3_stmt *stmt_select;
-  sqlite3_stmt *stmt_update;
 
-  int size_estimate;
-  gboolean have_size_estimate;
-  gboolean purge_in_progress;
+  /* Connection owned by the writer thread. All metadata writes and purges go
+   * through write_queue and are applied there, in batched transactions. */
+  sqlite3 *write_db;
+  sqlite3_stmt *stmt_store;
+  sqlite3_stmt *stmt_update;
+  sqlite3_stmt *stmt_mark;
+  sqlite3_stmt *stmt_delete;
+  sqlite3_stmt *stmt_get_size;
+  GAsyncQueue *write_queue;
+  GThread *writer_thread;
+
+  int purge_in_progress;
+
+  /* Cache hits not yet written to the database, as filename -> number of
+   * hits. Flushed to the writer thread by flush_source. */
+  GHashTable *pending_hits;
+  GSource *flush_source;
 };
 
+/* How long the writer thread waits for more operations before committing a
+ * batch, in microseconds, and the maximum number of operations per batch. */
+#define WRITE_BATCH_INTERVAL (50 * G_TIME_SPAN_MILLISECOND)
+#define WRITE_BATCH_SIZE 512
+
+typedef enum {
+  WRITE_OP_STORE,
+  WRITE_OP_MARK_UP_TO_DATE,
+  WRITE_OP_UPDATE_POPULARITY,
+  WRITE_OP_PURGE,
+  WRITE_OP_MIGRATE,
+  WRITE_OP_QUIT,
+} WriteOpType;
+
+typedef struct {
+  WriteOpType type;
+  GTask *task;
+  char *filename;
+  char *etag;
+  GBytes *bytes;
+  guint size;
+  /* For WRITE_OP_PURGE, the number of tiles removed so far */
+  guint n_removed;
+  /* For WRITE_OP_UPDATE_POPULARITY, filename -> number of hits */
+  GHashTable *hits;
+} WriteOp;
+
+/* Number of tiles moved from files into the database per transaction */
+#define MIGRATE_BATCH_SIZE 256
+
+/* How often buffered cache hits are written to the database, in ms */
+#define POPULARITY_FLUSH_INTERVAL 2000
+
+/* Maximum number of tiles evicted per transaction while purging */
+#define PURGE_BATCH_SIZE 256
+
+/* The cache is purged automatically once it grows this many bytes over the
+ * size limit */
+#define PURGE_THRESHOLD 5000000
+
 G_DEFINE_TYPE (ShumateFileCache, shumate_file_cache, G_TYPE_OBJECT);
 
 
@@ -88,7 +155,8 @@ static char *get_filename (ShumateFileCache *file_cache,
                            int               y,
                            int               zoom_level);
 static void delete_tile (ShumateFileCache *file_cache,
-                         const char       *filename);
+                         const char       *filename,
+                         gboolean          is_file);
 static gboolean create_cache_dir (const char *dir_name);
 
 static void on_tile_filled (ShumateFileCache *self,
@@ -96,6 +164,17 @@ static void on_tile_filled (ShumateFileCache *self,
                             int               y,
                             int               zoom_level);
 
+static gpointer writer_thread_func (ShumateFileCache *self);
+static void write_op_free (WriteOp *op);
+static void flush_popularity (ShumateFileCache *self);
+static void queue_write_op (ShumateFileCache *self,
+                            WriteOpType       type,
+                            GTask            *task,
+                            const char       *filename,
+                            const char       *etag,
+                            GBytes           *bytes,
+                            guint             size);
+
 static void
 shumate_file_cache_get_property (GObject    *object,
                                  guint       property_id,
@@ -118,6 +197,10 @@ shumate_file_cache_get_property (GObject    *object,
       g_value_set_string (value, shumate_file_cache_get_cache_key (self));
       break;
 
+    case PROP_STORAGE:
+      g_value_set_enum (value, shumate_file_cache_get_storage (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -148,6 +231,10 @@ shumate_file_cache_set_property (GObject      *object,
       self->cache_key = g_strdup (g_value_get_string (value));
       break;
 
+    case PROP_STORAGE:
+      self->storage = g_value_get_enum (value);
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -156,8 +243,47 @@ shumate_file_cache_set_property (GObject      *object,
 static void
 finalize_sql (ShumateFileCache *self)
 {
+  if (self->flush_source)
+    {
+      g_source_destroy (self->flush_source);
+      g_clear_pointer (&self->flush_source, g_source_unref);
+    }
+
+  if (self->writer_thread)
+    flush_popularity (self);
+
+  if (self->writer_thread)
+    {
+      queue_write_op (self, WRITE_OP_QUIT, NULL, NULL, NULL, NULL, 0);
+      g_thread_join (g_steal_pointer (&self->writer_thread));
+    }
+
+  if (self->write_queue)
+    {
+      WriteOp *op;
+
+      /* A migration may have requeued itself after the quit request */
+      while ((op = g_async_queue_try_pop (self->write_queue)))
+        write_op_free (op);
+    }
+
+  g_clear_pointer (&self->write_queue, g_async_queue_unref);
+
   g_clear_pointer (&self->stmt_select, sqlite3_finalize);
   g_clear_pointer (&self->stmt_update, sqlite3_finalize);
+  g_clear_pointer (&self->stmt_store, sqlite3_finalize);
+  g_clear_pointer (&self->stmt_mark, sqlite3_finalize);
+  g_clear_pointer (&self->pending_hits, g_hash_table_unref);
+  g_clear_pointer (&self->stmt_delete, sqlite3_finalize);
+  g_clear_pointer (&self->stmt_get_size, sqlite3_finalize);
+
+  if (self->write_db)
+    {
+      int error = sqlite3_close (self->write_db);
+      if (error != SQLITE_OK)
+        g_debug ("Sqlite returned error %d when closing cache.db", error);
+      self->write_db = NULL;
+    }
 
   if (self->db)
     {
@@ -203,7 +329,7 @@ create_cache_dir (const char *dir_name)
 static void
 init_cache (ShumateFileCache *self)
 {
-  char *filename = NULL;
+  g_autofree char *filename = NULL;
   char *error_msg = NULL;
   gint error;
 
@@ -212,22 +338,27 @@ init_cache (ShumateFileCache *self)
   filename = g_build_filename (self->cache_dir,
         "cache.db", NULL);
 
-  /* Make sure the database is opened in serialized mode (OPEN_FULLMUTEX)
-   * because shumate_file_cache_purge_cache_async() runs in a separate thread.
+  /* This connection is shared by the main thread and the threads that read
+   * tiles (see get_tile_from_db()), so it must be opened in serialized mode
+   * (OPEN_FULLMUTEX). Its queries are serialized by SQLite's mutex. Only the
+   * writer thread uses a separate connection, so it never holds that mutex.
    * See <https://sqlite.org/threadsafe.html> */
   error = sqlite3_open_v2 (filename, &self->db,
         SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE | SQLITE_OPEN_FULLMUTEX, NULL);
-  g_free (filename);
 
-  if (error == SQLITE_ERROR)
+  if (error != SQLITE_OK)
     {
       g_debug ("Sqlite returned error %d when opening cache.db", error);
       return;
     }
 
+  /* auto_vacuum must be set before WAL mode, since it can't be changed
+   * afterwards. WAL lets reads proceed while the writer thread is in the
+   * middle of a transaction or a purge. */
   sqlite3_exec (self->db,
       "PRAGMA synchronous=OFF;"
-      "PRAGMA auto_vacuum=INCREMENTAL;",
+      "PRAGMA auto_vacuum=INCREMENTAL;"
+      "PRAGMA journal_mode=WAL;",
       NULL, NULL, &error_msg);
   if (error_msg != NULL)
     {
@@ -250,6 +381,47 @@ init_cache (ShumateFileCache *self)
       return;
     }
 
+  /* Columns added after the table was first introduced. These fail harmlessly
+   * if the columns already exist. */
+  sqlite3_exec (self->db, "ALTER TABLE tiles ADD COLUMN modtime INT", NULL, NULL, NULL);
+  sqlite3_exec (self->db, "ALTER TABLE tiles ADD COLUMN data BLOB", NULL, NULL, NULL);
+
+  /* Let SQLite read the database through a memory map rather than with
+   * read() calls, which matters when tile data is stored in it */
+  sqlite3_exec (self->db, "PRAGMA mmap_size=268435456;", NULL, NULL, NULL);
+
+  /* The total size of the cache is kept up to date by triggers, so it never
+   * has to be computed by scanning the table. It's only computed from
+   * scratch once, for databases created before the metadata table existed.
+   *
+   * Rather than periodically decreasing the popularity of every tile, purging
+   * raises popularity_base, which new tiles start from. */
+  sqlite3_exec (self->db,
+      "BEGIN;"
+      "CREATE TABLE IF NOT EXISTS metadata ("
+      "key TEXT PRIMARY KEY, "
+      "value INT);"
+      "INSERT INTO metadata (key, value) "
+      "SELECT 'size', (SELECT COALESCE (SUM (size), 0) FROM tiles) "
+      "WHERE NOT EXISTS (SELECT 1 FROM metadata WHERE key = 'size');"
+      "INSERT OR IGNORE INTO metadata (key, value) VALUES ('popularity_base', 0);"
+      "CREATE TRIGGER IF NOT EXISTS tiles_size_insert AFTER INSERT ON tiles BEGIN "
+      "UPDATE metadata SET value = value + NEW.size WHERE key = 'size'; END;"
+      "CREATE TRIGGER IF NOT EXISTS tiles_size_delete AFTER DELETE ON tiles BEGIN "
+      "UPDATE metadata SET value = value - OLD.size WHERE key = 'size'; END;"
+      "CREATE TRIGGER IF NOT EXISTS tiles_size_update AFTER UPDATE OF size ON tiles BEGIN "
+      "UPDATE metadata SET value = value + NEW.size - OLD.size WHERE key = 'size'; END;"
+      "CREATE INDEX IF NOT EXISTS tiles_popularity ON tiles (popularity);"
+      "COMMIT;",
+      NULL, NULL, &error_msg);
+  if (error_msg != NULL)
+    {
+      g_debug ("Creating table 'metadata' failed: %s", error_msg);
+      sqlite3_free (error_msg);
+      sqlite3_exec (self->db, "ROLLBACK", NULL, NULL, NULL);
+      return;
+    }
+
   error = sqlite3_prepare_v2 (self->db,
         "SELECT etag FROM tiles WHERE filename = ?", -1,
         &self->stmt_select, NULL);
@@ -261,17 +433,91 @@ init_cache (ShumateFileCache *self)
       return;
     }
 
-  error = sqlite3_prepare_v2 (self->db,
-        "UPDATE tiles SET popularity = popularity + 1 WHERE filename = ?", -1,
+  /* Readers, including the main thread, should never wait long on the
+   * writer thread */
+  sqlite3_busy_timeout (self->db, 100);
+
+  error = sqlite3_open_v2 (filename, &self->write_db,
+        SQLITE_OPEN_READWRITE | SQLITE_OPEN_FULLMUTEX, NULL);
+  if (error != SQLITE_OK)
+    {
+      g_debug ("Sqlite returned error %d when opening cache.db for writing", error);
+      return;
+    }
+
+  /* recursive_triggers makes REPLACE fire the delete trigger for the row it
+   * replaces, which keeps the size total correct */
+  sqlite3_exec (self->write_db,
+      "PRAGMA synchronous=OFF;"
+      "PRAGMA recursive_triggers=ON;",
+      NULL, NULL, NULL);
+  sqlite3_busy_timeout (self->write_db, 5000);
+
+  error = sqlite3_prepare_v2 (self->write_db,
+        "REPLACE INTO tiles (filename, etag, size, modtime, data, popularity) "
+        "VALUES (?, ?, ?, ?, ?, (SELECT value FROM metadata WHERE key = 'popularity_base') + 1)", -1,
+        &self->stmt_store, NULL);
+  if (error != SQLITE_OK)
+    {
+      self->stmt_store = NULL;
+      g_debug ("Failed to prepare the store statement, error: %s",
+          sqlite3_errmsg (self->write_db));
+      return;
+    }
+
+  error = sqlite3_prepare_v2 (self->write_db,
+        "UPDATE tiles SET popularity = popularity + ? WHERE filename = ?", -1,
         &self->stmt_update, NULL);
   if (error != SQLITE_OK)
     {
       self->stmt_update = NULL;
       g_debug ("Failed to prepare the update popularity statement, error: %s",
-          sqlite3_errmsg (self->db));
+          sqlite3_errmsg (self->write_db));
       return;
     }
 
+  error = sqlite3_prepare_v2 (self->write_db,
+        "UPDATE tiles SET modtime = ? WHERE filename = ?", -1,
+        &self->stmt_mark, NULL);
+  if (error != SQLITE_OK)
+    {
+      self->stmt_mark = NULL;
+      g_debug ("Failed to prepare the mark up to date statement, error: %s",
+          sqlite3_errmsg (self->write_db));
+      return;
+    }
+
+  error = sqlite3_prepare_v2 (self->write_db,
+        "DELETE FROM tiles WHERE filename = ?", -1,
+        &self->stmt_delete, NULL);
+  if (error != SQLITE_OK)
+    {
+      self->stmt_delete = NULL;
+      g_debug ("Failed to prepare the delete statement, error: %s",
+          sqlite3_errmsg (self->write_db));
+      return;
+    }
+
+  error = sqlite3_prepare_v2 (self->write_db,
+        "SELECT value FROM metadata WHERE key = 'size'", -1,
+        &self->stmt_get_size, NULL);
+  if (error != SQLITE_OK)
+    {
+      self->stmt_get_size = NULL;
+      g_debug ("Failed to prepare the cache size statement, error: %s",
+          sqlite3_errmsg (self->write_db));
+      return;
+    }
+
+  self->write_queue = g_async_queue_new ();
+  self->writer_thread = g_thread_new ("shumate-file-cache",
+                                      (GThreadFunc) writer_thread_func,
+                                      self);
+
+  /* Move any tiles stored as files under this cache key into the database */
+  if (self->storage == SHUMATE_FILE_CACHE_STORAGE_DATABASE)
+    queue_write_op (self, WRITE_OP_MIGRATE, NULL, NULL, NULL, NULL, 0);
+
   g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_CACHE_DIR]);
 }
 
@@ -345,6 +591,21 @@ shumate_file_cache_class_init (ShumateFileCacheClass *klass)
                          NULL,
                          G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
 
+  /**
+   * ShumateFileCache:storage:
+   *
+   * Where tile data is stored. See [enum@FileCacheStorage].
+   *
+   * Since: 1.7
+   */
+  properties[PROP_STORAGE] =
+    g_param_spec_enum ("storage",
+                       "Storage",
+                       "Where tile data is stored",
+                       SHUMATE_TYPE_FILE_CACHE_STORAGE,
+                       SHUMATE_FILE_CACHE_STORAGE_FILES,
+                       G_PARAM_CONSTRUCT_ONLY | G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
@@ -354,12 +615,16 @@ shumate_file_cache_init (ShumateFileCache *self)
 {
   self->cache_dir = NULL;
   self->size_limit = 100000000;
-  self->size_estimate = 0;
-  self->have_size_estimate = FALSE;
   self->cache_dir = NULL;
   self->db = NULL;
   self->stmt_select = NULL;
   self->stmt_update = NULL;
+  self->write_db = NULL;
+  self->stmt_store = NULL;
+  self->stmt_mark = NULL;
+  self->stmt_delete = NULL;
+  self->stmt_get_size = NULL;
+  self->pending_hits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
 }
 
 
@@ -444,6 +709,25 @@ shumate_file_cache_get_cache_key (ShumateFileCache *self)
 }
 
 
+/**
+ * shumate_file_cache_get_storage:
+ * @self: a #ShumateFileCache
+ *
+ * Gets where the cache stores tile data.
+ *
+ * Returns: the storage backend
+ *
+ * Since: 1.7
+ */
+ShumateFileCacheStorage
+shumate_file_cache_get_storage (ShumateFileCache *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_FILE_CACHE (self), SHUMATE_FILE_CACHE_STORAGE_FILES);
+
+  return self->storage;
+}
+
+
 /**
  * shumate_file_cache_set_size_limit:
  * @self: a #ShumateFileCache
@@ -546,24 +830,46 @@ shumate_file_cache_mark_up_to_date (ShumateFileCache *self,
                                     int               zoom_level)
 {
   g_autofree char *filename = NULL;
-  g_autoptr(GFile) file = NULL;
-  g_autoptr(GFileInfo) info = NULL;
 
   g_return_if_fail (SHUMATE_IS_FILE_CACHE (self));
 
   filename = get_filename (self, x, y, zoom_level);
-  file = g_file_new_for_path (filename);
 
-  info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
-        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+  /* The tile's modification time is updated on the writer thread, so the
+   * main thread doesn't block on file I/O */
+  if (self->writer_thread != NULL)
+    queue_write_op (self, WRITE_OP_MARK_UP_TO_DATE, NULL, filename, NULL, NULL, 0);
+}
 
-  if (info)
-    {
-      g_autoptr(GDateTime) now = g_date_time_new_now_utc ();
 
-      g_file_info_set_modification_date_time (info, now);
-      g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, NULL);
-    }
+static gboolean
+on_flush_timeout (gpointer user_data)
+{
+  ShumateFileCache *self = user_data;
+
+  g_clear_pointer (&self->flush_source, g_source_unref);
+  flush_popularity (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+
+/* Hands the buffered cache hits to the writer thread, which applies them in
+ * its next transaction */
+static void
+flush_popularity (ShumateFileCache *self)
+{
+  WriteOp *op;
+
+  if (g_hash_table_size (self->pending_hits) == 0 || self->writer_thread == NULL)
+    return;
+
+  op = g_new0 (WriteOp, 1);
+  op->type = WRITE_OP_UPDATE_POPULARITY;
+  op->hits = g_steal_pointer (&self->pending_hits);
+  self->pending_hits = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  g_async_queue_push (self->write_queue, op);
 }
 
 
@@ -573,145 +879,157 @@ on_tile_filled (ShumateFileCache *self,
                 int               y,
                 int               zoom_level)
 {
-  int sql_rc = SQLITE_OK;
-  g_autofree char *filename = NULL;
-
-  filename = get_filename (self, x, y, zoom_level);
+  char *filename = get_filename (self, x, y, zoom_level);
+  gpointer hits = NULL;
 
   g_debug ("popularity of %s", filename);
 
-  sqlite3_reset (self->stmt_update);
-  sql_rc = sqlite3_bind_text (self->stmt_update, 1, filename, -1, SQLITE_STATIC);
-  if (sql_rc != SQLITE_OK)
-    {
-      g_debug ("Failed to set values to the popularity query of '%s', error: %s",
-          filename, sqlite3_errmsg (self->db));
-      return;
-    }
+  /* Rather than writing to the database on every hit, count hits in memory
+   * and write them out periodically */
+  if (g_hash_table_lookup_extended (self->pending_hits, filename, NULL, &hits))
+    g_hash_table_insert (self->pending_hits, filename, GUINT_TO_POINTER (GPOINTER_TO_UINT (hits) + 1));
+  else
+    g_hash_table_insert (self->pending_hits, filename, GUINT_TO_POINTER (1));
 
-  sql_rc = sqlite3_step (self->stmt_update);
-  if (sql_rc != SQLITE_DONE)
+  if (self->flush_source == NULL)
     {
-      /* may not be present in this cache */
-      return;
+      g_autoptr(GMainContext) context = g_main_context_ref_thread_default ();
+
+      self->flush_source = g_timeout_source_new (POPULARITY_FLUSH_INTERVAL);
+      g_source_set_callback (self->flush_source, on_flush_timeout, self, NULL);
+      g_source_set_static_name (self->flush_source, "[shumate] flush_popularity");
+      g_source_attach (self->flush_source, context);
     }
 }
 
 
 static void
 delete_tile (ShumateFileCache *self,
-             const char       *filename)
+             const char       *filename,
+             gboolean          is_file)
 {
   g_return_if_fail (SHUMATE_IS_FILE_CACHE (self));
-  g_autoptr(sqlite_str) query = NULL;
-  g_autoptr(sqlite_str) sql_error = NULL;
   g_autoptr(GError) gerror = NULL;
   g_autoptr(GFile) file = NULL;
 
-  file = g_file_new_for_path (filename);
-  if (!g_file_delete (file, NULL, &gerror))
+  if (is_file)
     {
-      g_debug ("Deleting tile from disk failed: %s", gerror->message);
+      file = g_file_new_for_path (filename);
+      if (!g_file_delete (file, NULL, &gerror))
+        {
+          g_debug ("Deleting tile from disk failed: %s", gerror->message);
+        }
     }
 
-  query = sqlite3_mprintf ("DELETE FROM tiles WHERE filename = %Q", filename);
-  sqlite3_exec (self->db, query, NULL, NULL, &sql_error);
-  if (sql_error != NULL)
+  sqlite3_reset (self->stmt_delete);
+  sqlite3_bind_text (self->stmt_delete, 1, filename, -1, SQLITE_STATIC);
+  if (sqlite3_step (self->stmt_delete) != SQLITE_DONE)
     {
-      g_debug ("Deleting tile from db failed: %s", sql_error);
+      g_debug ("Deleting tile from db failed: %s", sqlite3_errmsg (self->write_db));
     }
+  sqlite3_clear_bindings (self->stmt_delete);
 }
 
 
-static void
-purge_cache (GTask        *task,
-             gpointer      source_object,
-             gpointer      _task_data,
-             GCancellable *cancellable)
+/* Runs on the writer thread. Returns the total size of the cache in bytes, or
+ * -1 on error. */
+static gint64
+get_cache_size (ShumateFileCache *self)
 {
-  ShumateFileCache *self = (ShumateFileCache *) source_object;
+  gint64 size = -1;
+
+  sqlite3_reset (self->stmt_get_size);
+  if (sqlite3_step (self->stmt_get_size) == SQLITE_ROW)
+    size = sqlite3_column_int64 (self->stmt_get_size, 0);
+  else
+    g_warning ("Can't compute cache size %s", sqlite3_errmsg (self->write_db));
+  sqlite3_reset (self->stmt_get_size);
+
+  return size;
+}
+
 
-  char *query;
+/* Runs on the writer thread. Deletes up to PURGE_BATCH_SIZE of the least
+ * popular tiles in a single transaction, so that other writes aren't held up
+ * for long. Returns TRUE once the cache fits in the size limit, or if there
+ * is nothing more that can be done. */
+static gboolean
+purge_cache_batch (ShumateFileCache *self,
+                   guint            *n_removed)
+{
   g_autoptr(sqlite3_stmt) stmt = NULL;
-  int rc = 0;
-  guint original_size, current_size = 0;
-  guint highest_popularity = 0;
   g_autoptr(sqlite_str) error = NULL;
+  g_autoptr(sqlite_str) query = NULL;
+  gint64 original_size, current_size;
+  gint64 highest_popularity = 0;
+  guint count = 0;
+  int rc;
 
-  query = "SELECT SUM (size) FROM tiles";
-  rc = sqlite3_prepare (self->db, query, strlen (query), &stmt, NULL);
-  if (rc != SQLITE_OK)
-    {
-      g_warning ("Can't compute cache size %s", sqlite3_errmsg (self->db));
-      g_task_return_boolean (task, FALSE);
-      return;
-    }
+  current_size = get_cache_size (self);
+  if (current_size < 0)
+    return TRUE;
 
-  rc = sqlite3_step (stmt);
-  if (rc != SQLITE_ROW)
+  if (current_size <= self->size_limit)
     {
-      g_warning ("Failed to count the total cache consumption %s",
-          sqlite3_errmsg (self->db));
-      g_task_return_boolean (task, FALSE);
-      return;
+      g_debug ("Cache doesn't need to be purged at %" G_GINT64_FORMAT " bytes", current_size);
+      return TRUE;
     }
 
-  current_size = sqlite3_column_int (stmt, 0);
   original_size = current_size;
-  if (current_size < self->size_limit)
-    {
-      g_debug ("Cache doesn't need to be purged at %d bytes", current_size);
-      self->size_estimate = current_size;
-      g_task_return_boolean (task, FALSE);
-      return;
-    }
-
-  sqlite3_finalize (stmt);
 
   /* Ok, delete the less popular tiles until size_limit reached */
-  query = "SELECT filename, size, popularity FROM tiles ORDER BY popularity";
-  rc = sqlite3_prepare (self->db, query, strlen (query), &stmt, NULL);
+  rc = sqlite3_prepare_v2 (self->write_db,
+        "SELECT filename, size, popularity, data IS NULL FROM tiles "
+        "ORDER BY popularity LIMIT ?", -1,
+        &stmt, NULL);
   if (rc != SQLITE_OK)
     {
-      g_warning ("Can't fetch tiles to delete: %s", sqlite3_errmsg (self->db));
+      g_warning ("Can't fetch tiles to delete: %s", sqlite3_errmsg (self->write_db));
+      return TRUE;
     }
 
+  sqlite3_bind_int (stmt, 1, PURGE_BATCH_SIZE);
+
+  sqlite3_exec (self->write_db, "BEGIN", NULL, NULL, NULL);
+
   rc = sqlite3_step (stmt);
   while (rc == SQLITE_ROW && current_size > self->size_limit)
     {
       const char *filename;
       guint size;
+      gboolean is_file;
 
       filename = (const char *) sqlite3_column_text (stmt, 0);
       size = sqlite3_column_int (stmt, 1);
-      highest_popularity = sqlite3_column_int (stmt, 2);
+      highest_popularity = sqlite3_column_int64 (stmt, 2);
+      is_file = sqlite3_column_int (stmt, 3);
       g_debug ("Deleting %s of size %d", filename, size);
 
-      delete_tile (self, filename);
+      delete_tile (self, filename, is_file);
 
       current_size -= size;
+      count ++;
 
       rc = sqlite3_step (stmt);
     }
 
-  g_debug ("Cache size is now %d bytes (reduced by %d bytes)", current_size, original_size - current_size);
-  self->size_estimate = current_size;
-  self->have_size_estimate = TRUE;
+  sqlite3_reset (stmt);
 
-  query = sqlite3_mprintf ("UPDATE tiles SET popularity = popularity - %d",
-        highest_popularity);
-  sqlite3_exec (self->db, query, NULL, NULL, &error);
+  /* New tiles start just above the least popular tile that survived */
+  query = sqlite3_mprintf ("UPDATE metadata SET value = MAX (value, %" G_GINT64_FORMAT ") "
+                           "WHERE key = 'popularity_base'",
+                           highest_popularity);
+  sqlite3_exec (self->write_db, query, NULL, NULL, &error);
   if (error != NULL)
-    {
-      g_warning ("Updating popularity failed: %s", error);
-      sqlite3_free (error);
-    }
-  sqlite3_free (query);
+    g_warning ("Updating popularity failed: %s", error);
 
-  sqlite3_exec (self->db, "PRAGMA incremental_vacuum;", NULL, NULL, &error);
+  sqlite3_exec (self->write_db, "COMMIT", NULL, NULL, NULL);
 
-  self->purge_in_progress = FALSE;
-  g_task_return_boolean (task, TRUE);
+  g_debug ("Cache size is now %" G_GINT64_FORMAT " bytes (reduced by %" G_GINT64_FORMAT " bytes)",
+           current_size, original_size - current_size);
+
+  *n_removed += count;
+  return current_size <= self->size_limit || count == 0;
 }
 
 /**
@@ -738,14 +1056,16 @@ shumate_file_cache_purge_cache_async (ShumateFileCache    *self,
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, shumate_file_cache_purge_cache_async);
 
-  if (self->purge_in_progress)
+  if (self->writer_thread == NULL || !g_atomic_int_compare_and_exchange (&self->purge_in_progress, FALSE, TRUE))
     {
       g_task_return_boolean (task, FALSE);
       return;
     }
 
-  self->purge_in_progress = TRUE;
-  g_task_run_in_thread (task, purge_cache);
+  /* Make sure the purge sees recent hits */
+  flush_popularity (self);
+
+  queue_write_op (self, WRITE_OP_PURGE, task, NULL, NULL, NULL, 0);
 }
 
 /**
@@ -772,6 +1092,7 @@ shumate_file_cache_purge_cache_finish (ShumateFileCache  *self,
 
 
 typedef struct {
+  char *filename;
   char *etag;
   GDateTime *modtime;
 } GetTileData;
@@ -779,12 +1100,14 @@ typedef struct {
 static void
 get_tile_data_free (GetTileData *data)
 {
+  g_clear_pointer (&data->filename, g_free);
   g_clear_pointer (&data->etag, g_free);
   g_clear_pointer (&data->modtime, g_date_time_unref);
   g_free (data);
 }
 
 static void on_get_tile_file_loaded (GObject *source_object, GAsyncResult *res, gpointer user_data);
+static void get_tile_from_db (GTask *task, gpointer source_object, gpointer task_data, GCancellable *cancellable);
 
 
 /**
@@ -825,6 +1148,18 @@ shumate_file_cache_get_tile_async (ShumateFileCache    *self,
   g_task_set_task_data (task, task_data, (GDestroyNotify) get_tile_data_free);
 
   filename = get_filename (self, x, y, zoom_level);
+
+  if (self->storage == SHUMATE_FILE_CACHE_STORAGE_DATABASE)
+    {
+      task_data->filename = g_steal_pointer (&filename);
+
+      /* update tile popularity */
+      on_tile_filled (self, x, y, zoom_level);
+
+      g_task_run_in_thread (task, get_tile_from_db);
+      return;
+    }
+
   file = g_file_new_for_path (filename);
 
   /* Retrieve modification time */
@@ -878,6 +1213,84 @@ on_get_tile_file_loaded (GObject      *source_object,
 }
 
 
+static void
+get_tile_from_db (GTask        *task,
+                  gpointer      source_object,
+                  gpointer      task_data,
+                  GCancellable *cancellable)
+{
+  ShumateFileCache *self = source_object;
+  GetTileData *data = task_data;
+  g_autoptr(sqlite3_stmt) stmt = NULL;
+  GBytes *bytes;
+  int sql_rc;
+
+  /* The main connection is opened in serialized mode, so it can be used from
+   * this thread. A fresh statement is prepared since stmt_select belongs to
+   * the main thread. */
+  sql_rc = sqlite3_prepare_v2 (self->db,
+        "SELECT etag, modtime, data FROM tiles WHERE filename = ?", -1,
+        &stmt, NULL);
+  if (sql_rc != SQLITE_OK)
+    {
+      g_task_return_new_error (task, SHUMATE_FILE_CACHE_ERROR, SHUMATE_FILE_CACHE_ERROR_FAILED,
+                               "Failed to query the tile database: %s", sqlite3_errstr (sql_rc));
+      return;
+    }
+
+  sqlite3_bind_text (stmt, 1, data->filename, -1, SQLITE_STATIC);
+
+  sql_rc = sqlite3_step (stmt);
+  if (sql_rc == SQLITE_DONE)
+    {
+      g_task_return_pointer (task, NULL, NULL);
+      return;
+    }
+  else if (sql_rc != SQLITE_ROW)
+    {
+      g_task_return_new_error (task, SHUMATE_FILE_CACHE_ERROR, SHUMATE_FILE_CACHE_ERROR_FAILED,
+                               "Failed to query the tile database: %s", sqlite3_errstr (sql_rc));
+      return;
+    }
+
+  if (sqlite3_column_type (stmt, 2) == SQLITE_NULL)
+    {
+      /* The tile is still stored as a file and hasn't been migrated yet */
+      g_autoptr(GFile) file = g_file_new_for_path (data->filename);
+      g_autoptr(GFileInfo) info = NULL;
+      g_autoptr(GError) error = NULL;
+      char *contents;
+      gsize length;
+
+      info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                G_FILE_QUERY_INFO_NONE, cancellable, &error);
+      if (info == NULL || !g_file_load_contents (file, cancellable, &contents, &length, NULL, &error))
+        {
+          if (g_error_matches (error, G_IO_ERROR, G_IO_ERROR_NOT_FOUND))
+            g_task_return_pointer (task, NULL, NULL);
+          else
+            g_task_return_error (task, g_steal_pointer (&error));
+
+          return;
+        }
+
+      bytes = g_bytes_new_take (contents, length);
+      data->modtime = g_file_info_get_modification_date_time (info);
+    }
+  else
+    {
+      const void *blob = sqlite3_column_blob (stmt, 2);
+
+      bytes = g_bytes_new (blob, sqlite3_column_bytes (stmt, 2));
+      data->modtime = g_date_time_new_from_unix_utc (sqlite3_column_int64 (stmt, 1));
+    }
+
+  data->etag = g_strdup ((const char *) sqlite3_column_text (stmt, 0));
+
+  g_task_return_pointer (task, bytes, (GDestroyNotify) g_bytes_unref);
+}
+
+
 /**
  * shumate_file_cache_get_tile_finish:
  * @self: a #ShumateFileCache
@@ -978,10 +1391,24 @@ shumate_file_cache_store_tile_async (ShumateFileCache    *self,
   g_task_set_source_tag (task, shumate_file_cache_store_tile_async);
 
   filename = get_filename (self, x, y, zoom_level);
-  file = g_file_new_for_path (filename);
 
   g_debug ("Update of tile (%d %d zoom %d)", x, y, zoom_level);
 
+  if (self->storage == SHUMATE_FILE_CACHE_STORAGE_DATABASE)
+    {
+      if (self->writer_thread == NULL)
+        {
+          g_task_return_new_error (task, SHUMATE_FILE_CACHE_ERROR, SHUMATE_FILE_CACHE_ERROR_FAILED,
+                                   "Failed to insert tile into SQLite database: the database is not open");
+          return;
+        }
+
+      queue_write_op (self, WRITE_OP_STORE, task, filename, etag, bytes, g_bytes_get_size (bytes));
+      return;
+    }
+
+  file = g_file_new_for_path (filename);
+
   /* If needed, create the cache's dirs */
   path = g_path_get_dirname (filename);
   if (g_mkdir_with_parents (path, 0700) == -1)
@@ -1040,10 +1467,7 @@ on_file_written (GObject      *object,
 {
   g_autoptr(GTask) task = user_data;
   StoreTileData *data = g_task_get_task_data (task);
-  g_autoptr(sqlite_str) query = NULL;
-  g_autoptr(sqlite_str) sql_error = NULL;
   GError *error = NULL;
-  guint tile_size = g_bytes_get_size (data->bytes);
 
   g_output_stream_write_all_finish (G_OUTPUT_STREAM (object), res, NULL, &error);
   if (error != NULL)
@@ -1052,27 +1476,362 @@ on_file_written (GObject      *object,
       return;
     }
 
-  query = sqlite3_mprintf ("REPLACE INTO tiles (filename, etag, size) VALUES (%Q, %Q, %d)",
-                           data->filename, data->etag, tile_size);
-  sqlite3_exec (data->self->db, query, NULL, NULL, &sql_error);
-  if (sql_error != NULL)
+  if (data->self->writer_thread == NULL)
     {
       g_task_return_new_error (task, SHUMATE_FILE_CACHE_ERROR, SHUMATE_FILE_CACHE_ERROR_FAILED,
-                               "Failed to insert tile into SQLite database: %s", sql_error);
+                               "Failed to insert tile into SQLite database: the database is not open");
+      return;
+    }
+
+  /* The task is returned by the writer thread once the batch containing
+   * this tile has been committed */
+  queue_write_op (data->self, WRITE_OP_STORE, task,
+                  data->filename, data->etag, NULL, g_bytes_get_size (data->bytes));
+}
+
+
+static void
+write_op_free (WriteOp *op)
+{
+  g_clear_object (&op->task);
+  g_clear_pointer (&op->filename, g_free);
+  g_clear_pointer (&op->etag, g_free);
+  g_clear_pointer (&op->bytes, g_bytes_unref);
+  g_clear_pointer (&op->hits, g_hash_table_unref);
+  g_free (op);
+}
+
+
+static void
+queue_write_op (ShumateFileCache *self,
+                WriteOpType       type,
+                GTask            *task,
+                const char       *filename,
+                const char       *etag,
+                GBytes           *bytes,
+                guint             size)
+{
+  WriteOp *op = g_new0 (WriteOp, 1);
+
+  op->type = type;
+  op->task = task ? g_object_ref (task) : NULL;
+  op->filename = g_strdup (filename);
+  op->etag = g_strdup (etag);
+  op->bytes = bytes ? g_bytes_ref (bytes) : NULL;
+  op->size = size;
+
+  g_async_queue_push (self->write_queue, op);
+}
+
+
+static void
+exec_store (ShumateFileCache *self,
+            WriteOp          *op)
+{
+  int sql_rc;
+
+  sqlite3_reset (self->stmt_store);
+  sqlite3_bind_text (self->stmt_store, 1, op->filename, -1, SQLITE_STATIC);
+  sqlite3_bind_text (self->stmt_store, 2, op->etag, -1, SQLITE_STATIC);
+  sqlite3_bind_int (self->stmt_store, 3, op->size);
+  sqlite3_bind_int64 (self->stmt_store, 4, g_get_real_time () / G_USEC_PER_SEC);
+
+  /* Tiles stored as files have no data in the database */
+  if (op->bytes == NULL)
+    sqlite3_bind_null (self->stmt_store, 5);
+  else if (op->size == 0)
+    sqlite3_bind_zeroblob (self->stmt_store, 5, 0);
+  else
+    sqlite3_bind_blob (self->stmt_store, 5, g_bytes_get_data (op->bytes, NULL), op->size, SQLITE_STATIC);
+
+  sql_rc = sqlite3_step (self->stmt_store);
+  sqlite3_clear_bindings (self->stmt_store);
+
+  if (sql_rc != SQLITE_DONE)
+    {
+      if (op->task)
+        g_task_return_new_error (op->task, SHUMATE_FILE_CACHE_ERROR, SHUMATE_FILE_CACHE_ERROR_FAILED,
+                                 "Failed to insert tile into SQLite database: %s",
+                                 sqlite3_errmsg (self->write_db));
+      g_clear_object (&op->task);
+      return;
+    }
+
+}
+
+
+static void
+exec_update_popularity (ShumateFileCache *self,
+                        WriteOp          *op)
+{
+  GHashTableIter iter;
+  gpointer filename, hits;
+
+  g_hash_table_iter_init (&iter, op->hits);
+  while (g_hash_table_iter_next (&iter, &filename, &hits))
+    {
+      sqlite3_reset (self->stmt_update);
+      sqlite3_bind_int (self->stmt_update, 1, GPOINTER_TO_UINT (hits));
+      sqlite3_bind_text (self->stmt_update, 2, filename, -1, SQLITE_STATIC);
+
+      /* may not be present in this cache, so ignore the result */
+      sqlite3_step (self->stmt_update);
+      sqlite3_clear_bindings (self->stmt_update);
+    }
+}
+
+
+static void
+exec_mark_up_to_date (ShumateFileCache *self,
+                      WriteOp          *op)
+{
+  g_autoptr(GFile) file = NULL;
+  g_autoptr(GFileInfo) info = NULL;
+
+  sqlite3_reset (self->stmt_mark);
+  sqlite3_bind_int64 (self->stmt_mark, 1, g_get_real_time () / G_USEC_PER_SEC);
+  sqlite3_bind_text (self->stmt_mark, 2, op->filename, -1, SQLITE_STATIC);
+  sqlite3_step (self->stmt_mark);
+  sqlite3_clear_bindings (self->stmt_mark);
+
+  if (self->storage != SHUMATE_FILE_CACHE_STORAGE_FILES)
+    return;
+
+  file = g_file_new_for_path (op->filename);
+  info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+        G_FILE_QUERY_INFO_NONE, NULL, NULL);
+
+  if (info)
+    {
+      g_autoptr(GDateTime) now = g_date_time_new_now_utc ();
+
+      g_file_info_set_modification_date_time (info, now);
+      g_file_set_attributes_from_info (file, info, G_FILE_QUERY_INFO_NONE, NULL, NULL);
+    }
+}
+
+
+/* Returns FALSE if the purge isn't finished yet, in which case the operation
+ * should be requeued */
+static gboolean
+exec_purge (ShumateFileCache *self,
+            WriteOp          *op)
+{
+  if (!purge_cache_batch (self, &op->n_removed))
+    return FALSE;
+
+  if (op->n_removed > 0)
+    sqlite3_exec (self->write_db, "PRAGMA incremental_vacuum;", NULL, NULL, NULL);
+
+  g_atomic_int_set (&self->purge_in_progress, FALSE);
+
+  if (op->task)
+    g_task_return_boolean (op->task, op->n_removed > 0);
+  g_clear_object (&op->task);
+
+  return TRUE;
+}
+
+
+/* Moves up to MIGRATE_BATCH_SIZE tiles stored as files under this cache key
+ * into the database, and queues another migration if there may be more. */
+static void
+exec_migrate (ShumateFileCache *self)
+{
+  g_autoptr(sqlite3_stmt) stmt_select = NULL;
+  g_autoptr(sqlite3_stmt) stmt_update = NULL;
+  g_autoptr(GPtrArray) migrated = g_ptr_array_new_with_free_func (g_free);
+  g_autofree char *prefix = NULL;
+  int count = 0;
+
+  prefix = g_strdup_printf ("%s" G_DIR_SEPARATOR_S "%s" G_DIR_SEPARATOR_S,
+                            self->cache_dir, self->cache_key);
+
+  if (sqlite3_prepare_v2 (self->write_db,
+        "SELECT filename FROM tiles "
+        "WHERE data IS NULL AND substr (filename, 1, length (?1)) = ?1 LIMIT ?2", -1,
+        &stmt_select, NULL) != SQLITE_OK
+      || sqlite3_prepare_v2 (self->write_db,
+        "UPDATE tiles SET data = ?, size = ?, modtime = ? WHERE filename = ?", -1,
+        &stmt_update, NULL) != SQLITE_OK)
+    {
+      g_debug ("Failed to prepare the migration statements, error: %s",
+          sqlite3_errmsg (self->write_db));
+      return;
+    }
+
+  sqlite3_bind_text (stmt_select, 1, prefix, -1, SQLITE_STATIC);
+  sqlite3_bind_int (stmt_select, 2, MIGRATE_BATCH_SIZE);
+
+  sqlite3_exec (self->write_db, "BEGIN", NULL, NULL, NULL);
+
+  while (sqlite3_step (stmt_select) == SQLITE_ROW)
+    {
+      const char *filename = (const char *) sqlite3_column_text (stmt_select, 0);
+      g_autoptr(GFile) file = g_file_new_for_path (filename);
+      g_autoptr(GFileInfo) info = NULL;
+      g_autofree char *contents = NULL;
+      gsize length;
+
+      count ++;
+
+      info = g_file_query_info (file, G_FILE_ATTRIBUTE_TIME_MODIFIED,
+                                G_FILE_QUERY_INFO_NONE, NULL, NULL);
+      if (info == NULL || !g_file_load_contents (file, NULL, &contents, &length, NULL, NULL))
+        {
+          /* The file is gone, so forget about the tile */
+          delete_tile (self, filename, FALSE);
+          continue;
+        }
+
+      sqlite3_reset (stmt_update);
+      if (length == 0)
+        sqlite3_bind_zeroblob (stmt_update, 1, 0);
+      else
+        sqlite3_bind_blob (stmt_update, 1, contents, length, SQLITE_STATIC);
+      sqlite3_bind_int (stmt_update, 2, length);
+      sqlite3_bind_int64 (stmt_update, 3,
+                          g_file_info_get_attribute_uint64 (info, G_FILE_ATTRIBUTE_TIME_MODIFIED));
+      sqlite3_bind_text (stmt_update, 4, filename, -1, SQLITE_STATIC);
+
+      if (sqlite3_step (stmt_update) == SQLITE_DONE)
+        g_ptr_array_add (migrated, g_strdup (filename));
+    }
+
+  if (sqlite3_exec (self->write_db, "COMMIT", NULL, NULL, NULL) != SQLITE_OK)
+    {
+      g_debug ("Failed to commit tile migration, error: %s",
+          sqlite3_errmsg (self->write_db));
+      sqlite3_exec (self->write_db, "ROLLBACK", NULL, NULL, NULL);
       return;
     }
 
-  data->self->size_estimate += tile_size;
-  if (!data->self->have_size_estimate || data->self->size_estimate > data->self->size_limit + 5000000)
+  /* Only remove the files once their data is safely in the database */
+  for (guint i = 0; i < migrated->len; i ++)
+    g_unlink (g_ptr_array_index (migrated, i));
+
+  g_debug ("Moved %u tiles into the database", migrated->len);
+
+  /* Requeue rather than loop, so other writes aren't held up by a large
+   * migration */
+  if (count == MIGRATE_BATCH_SIZE)
+    queue_write_op (self, WRITE_OP_MIGRATE, NULL, NULL, NULL, NULL, 0);
+}
+
+
+static void
+commit_batch (ShumateFileCache *self,
+              GPtrArray        *batch)
+{
+  g_autoptr(sqlite_str) sql_error = NULL;
+
+  if (batch->len == 0)
+    return;
+
+  sqlite3_exec (self->write_db, "BEGIN", NULL, NULL, NULL);
+
+  for (guint i = 0; i < batch->len; i ++)
     {
-      /* automatically purge the cache if the size estimate is 5MB over
-       * the limit, or if there is no estimate of the cache size yet */
+      WriteOp *op = g_ptr_array_index (batch, i);
 
-      shumate_file_cache_purge_cache_async (data->self, NULL, NULL, NULL);
+      switch (op->type)
+        {
+        case WRITE_OP_STORE:
+          exec_store (self, op);
+          break;
+        case WRITE_OP_MARK_UP_TO_DATE:
+          exec_mark_up_to_date (self, op);
+          break;
+        case WRITE_OP_UPDATE_POPULARITY:
+          exec_update_popularity (self, op);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
     }
 
+  sqlite3_exec (self->write_db, "COMMIT", NULL, NULL, &sql_error);
 
-  g_task_return_boolean (task, TRUE);
+  for (guint i = 0; i < batch->len; i ++)
+    {
+      WriteOp *op = g_ptr_array_index (batch, i);
+
+      if (op->task == NULL)
+        continue;
+
+      if (sql_error != NULL)
+        g_task_return_new_error (op->task, SHUMATE_FILE_CACHE_ERROR, SHUMATE_FILE_CACHE_ERROR_FAILED,
+                                 "Failed to insert tile into SQLite database: %s", sql_error);
+      else
+        g_task_return_boolean (op->task, TRUE);
+    }
+
+  g_ptr_array_set_size (batch, 0);
+}
+
+
+static gpointer
+writer_thread_func (ShumateFileCache *self)
+{
+  g_autoptr(GPtrArray) batch = g_ptr_array_new_with_free_func ((GDestroyNotify) write_op_free);
+
+  while (TRUE)
+    {
+      WriteOp *op = g_async_queue_pop (self->write_queue);
+      gint64 deadline = g_get_monotonic_time () + WRITE_BATCH_INTERVAL;
+      gboolean quit = FALSE;
+
+      /* Collect operations until the batch is full or nothing new has arrived
+       * for a while, then apply them all in a single transaction. */
+      while (op != NULL)
+        {
+          if (op->type == WRITE_OP_QUIT)
+            {
+              write_op_free (op);
+              quit = TRUE;
+              break;
+            }
+          else if (op->type == WRITE_OP_PURGE)
+            {
+              commit_batch (self, batch);
+
+              /* Requeue unfinished purges rather than loop, so other writes
+               * get a chance to run between batches */
+              if (exec_purge (self, op))
+                write_op_free (op);
+              else
+                g_async_queue_push (self->write_queue, op);
+            }
+          else if (op->type == WRITE_OP_MIGRATE)
+            {
+              commit_batch (self, batch);
+              exec_migrate (self);
+              write_op_free (op);
+            }
+          else
+            {
+              g_ptr_array_add (batch, op);
+              if (batch->len >= WRITE_BATCH_SIZE)
+                break;
+            }
+
+          op = g_async_queue_timeout_pop (self->write_queue,
+                                          MAX (0, deadline - g_get_monotonic_time ()));
+        }
+
+      commit_batch (self, batch);
+
+      /* automatically purge the cache if it is 5MB over the limit */
+      if (!quit
+          && get_cache_size (self) > (gint64) self->size_limit + PURGE_THRESHOLD
+          && g_atomic_int_compare_and_exchange (&self->purge_in_progress, FALSE, TRUE))
+        queue_write_op (self, WRITE_OP_PURGE, NULL, NULL, NULL, NULL, 0);
+
+      if (quit)
+        break;
+    }
+
+  return NULL;
 }
 
 
@@ -50,6 +50,22 @@ typedef enum {
   SHUMATE_FILE_CACHE_ERROR_FAILED,
 } ShumateFileCacheError;
 
+/**
+ * ShumateFileCacheStorage:
+ * @SHUMATE_FILE_CACHE_STORAGE_FILES: Each tile is stored in its own file
+ *     inside the cache directory.
+ * @SHUMATE_FILE_CACHE_STORAGE_DATABASE: Tiles are stored inside the cache's
+ *     database file.
+ *
+ * Where a #ShumateFileCache keeps tile data.
+ *
+ * Since: 1.7
+ */
+typedef enum {
+  SHUMATE_FILE_CACHE_STORAGE_FILES,
+  SHUMATE_FILE_CACHE_STORAGE_DATABASE,
+} ShumateFileCacheStorage;
+
 #define SHUMATE_TYPE_FILE_CACHE shumate_file_cache_get_type ()
 G_DECLARE_FINAL_TYPE (ShumateFileCache, shumate_file_cache, SHUMATE, FILE_CACHE, GObject)
 
@@ -63,6 +79,7 @@ void shumate_file_cache_set_size_limit (ShumateFileCache *self,
 
 const char *shumate_file_cache_get_cache_dir (ShumateFileCache *self);
 const char *shumate_file_cache_get_cache_key (ShumateFileCache *self);
+ShumateFileCacheStorage shumate_file_cache_get_storage (ShumateFileCache *self);
 
 void shumate_file_cache_purge_cache_async (ShumateFileCache *self,
                                            GCancellable *cancellable,
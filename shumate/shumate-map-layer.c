@@ -17,13 +17,17 @@
  * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#include <pango/pangocairo.h>
+
 #include "shumate-map-layer.h"
 #include "shumate-marshal.h"
 #include "shumate-memory-cache-private.h"
 #include "shumate-tile-private.h"
+#include "shumate-tile-scheduler-private.h"
 #include "shumate-symbol-event.h"
 #include "shumate-profiling-private.h"
 #include "shumate-utils-private.h"
+#include "shumate-vector-renderer-private.h"
 #include "shumate-inspector-settings-private.h"
 #include "vector/shumate-vector-symbol-container-private.h"
 
@@ -51,6 +55,7 @@ struct _ShumateMapLayer
   float last_recompute_x, last_recompute_y;
 
   ShumateMemoryCache *memcache;
+  ShumateTileScheduler *scheduler;
 
   gint64 profile_all_tiles_filled_begin;
   gint64 profile_all_tiles_done_begin;
@@ -73,6 +78,7 @@ G_DEFINE_TYPE (ShumateMapLayer, shumate_map_layer, SHUMATE_TYPE_LAYER)
 enum
 {
   PROP_MAP_SOURCE = 1,
+  PROP_MEMORY_CACHE_LIMIT,
   N_PROPERTIES
 };
 
@@ -88,6 +94,11 @@ enum
 
 static guint signals[LAST_SIGNAL] = { 0, };
 
+/* The maximum number of tiles requested from a map source at once, shared by
+ * all the layers showing it. The rest wait in each layer's scheduler, ordered
+ * by distance from the center of that layer's view. */
+#define MAX_TILES_IN_FLIGHT 16
+
 /* This struct represents the location of a tile on the screen. It is the key
  * for the hash table tile_children which stores all visible tiles.
  *
@@ -178,7 +189,7 @@ on_tile_filled (GObject      *source_object,
   g_autoptr(GError) error = NULL;
   gboolean success;
 
-  success = shumate_map_source_fill_tile_finish (SHUMATE_MAP_SOURCE (source_object), res, &error);
+  success = shumate_tile_scheduler_fill_tile_finish (SHUMATE_TILE_SCHEDULER (source_object), res, &error);
 
   if (!success && g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
     return;
@@ -217,6 +228,7 @@ load_tile (ShumateMapLayer *self,
                                 tile_size,
                                 tile_child->pos.zoom);
   shumate_tile_set_scale_factor (tile, gtk_widget_get_scale_factor (GTK_WIDGET (self)));
+  shumate_tile_set_font_options (tile, pango_cairo_context_get_font_options (gtk_widget_get_pango_context (GTK_WIDGET (self))));
 
   g_cancellable_cancel (tile_child->cancellable);
   g_clear_object (&tile_child->cancellable);
@@ -242,7 +254,13 @@ load_tile (ShumateMapLayer *self,
       data->tile_child = tile_child;
       data->source_id = g_strdup (source_id);
 
-      shumate_map_source_fill_tile_async (self->map_source, tile, tile_child->cancellable, on_tile_filled, data);
+      shumate_tile_scheduler_fill_tile_async (self->scheduler,
+                                              self->map_source,
+                                              tile,
+                                              &tile_child->pos,
+                                              tile_child->cancellable,
+                                              on_tile_filled,
+                                              data);
     }
 }
 
@@ -426,6 +444,20 @@ recompute_grid (ShumateMapLayer *self)
 
   defer = should_defer (self);
 
+  /* Load the tiles closest to the center of the view first */
+  shumate_tile_scheduler_set_center (self->scheduler,
+                                     longitude_x / tile_size,
+                                     latitude_y / tile_size,
+                                     zoom_level);
+
+  /* Tiles that are already downloaded may still be waiting for a render
+   * thread, so reorder those too */
+  if (SHUMATE_IS_VECTOR_RENDERER (self->map_source))
+    shumate_vector_renderer_set_priority_center (SHUMATE_VECTOR_RENDERER (self->map_source),
+                                                 longitude_x / tile_size,
+                                                 latitude_y / tile_size,
+                                                 zoom_level);
+
   /* First, remove all the tiles that aren't in bounds, or that are on the
    * wrong zoom level and haven't finished loading */
   g_hash_table_iter_init (&iter, self->tile_children);
@@ -580,6 +612,10 @@ shumate_map_layer_set_property (GObject      *object,
       shumate_map_layer_set_map_source (self, g_value_get_object (value));
       break;
 
+    case PROP_MEMORY_CACHE_LIMIT:
+      shumate_map_layer_set_memory_cache_limit (self, g_value_get_uint (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -600,6 +636,10 @@ shumate_map_layer_get_property (GObject    *object,
       g_value_set_object (value, self->map_source);
       break;
 
+    case PROP_MEMORY_CACHE_LIMIT:
+      g_value_set_uint (value, shumate_map_layer_get_memory_cache_limit (self));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
       break;
@@ -618,9 +658,23 @@ shumate_map_layer_dispose (GObject *object)
     gtk_widget_unparent (child);
 
   g_clear_handle_id (&self->recompute_grid_idle_id, g_source_remove);
+
+  /* Cancel outstanding requests, so queued tiles are dropped rather than
+   * loaded for nothing */
+  if (self->tile_children != NULL)
+    {
+      GHashTableIter iter;
+      TileChild *tile_child;
+
+      g_hash_table_iter_init (&iter, self->tile_children);
+      while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&tile_child))
+        g_cancellable_cancel (tile_child->cancellable);
+    }
+
   g_clear_pointer (&self->tile_children, g_hash_table_unref);
   g_clear_object (&self->map_source);
   g_clear_object (&self->memcache);
+  g_clear_object (&self->scheduler);
   g_clear_object (&self->source_signal_group);
 
   G_OBJECT_CLASS (shumate_map_layer_parent_class)->dispose (object);
@@ -850,9 +904,11 @@ shumate_map_layer_get_debug_text (ShumateLayer *layer)
     }
 
   g_string_append_printf (string,
-                          "tiles: %d, %d loading\n",
+                          "tiles: %d, %d loading (%d requested, %d queued)\n",
                           g_hash_table_size (self->tile_children),
-                          n_loading);
+                          n_loading,
+                          shumate_tile_scheduler_get_n_in_flight (self->scheduler),
+                          shumate_tile_scheduler_get_n_pending (self->scheduler));
 
   symbol_debug = shumate_vector_symbol_container_get_debug_text (self->symbols);
   g_string_append (string, symbol_debug);
@@ -893,6 +949,21 @@ shumate_map_layer_class_init (ShumateMapLayerClass *klass)
                          SHUMATE_TYPE_MAP_SOURCE,
                          G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
 
+  /**
+   * ShumateMapLayer:memory-cache-limit:
+   *
+   * The maximum amount of memory, in megabytes, used by the layer's in-memory
+   * tile cache, or 0 to only limit the number of cached tiles.
+   *
+   * Since: 1.7
+   */
+  obj_properties[PROP_MEMORY_CACHE_LIMIT] =
+    g_param_spec_uint ("memory-cache-limit",
+                       "Memory cache limit",
+                       "Memory cache limit in megabytes",
+                       0, G_MAXUINT, 0,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
   g_object_class_install_properties (object_class,
                                      N_PROPERTIES,
                                      obj_properties);
@@ -976,6 +1047,7 @@ shumate_map_layer_init (ShumateMapLayer *self)
     (GDestroyNotify)tile_child_free
   );
   self->memcache = shumate_memory_cache_new_full (100);
+  self->scheduler = shumate_tile_scheduler_new (MAX_TILES_IN_FLIGHT);
 
   self->source_signal_group = g_signal_group_new (SHUMATE_TYPE_MAP_SOURCE);
   g_signal_group_connect_object (self->source_signal_group, "modified", G_CALLBACK (on_source_modified), self, G_CONNECT_SWAPPED);
@@ -1061,6 +1133,49 @@ shumate_map_layer_set_map_source (ShumateMapLayer *self,
   g_object_notify_by_pspec (G_OBJECT (self), obj_properties[PROP_MAP_SOURCE]);
 }
 
+/**
+ * shumate_map_layer_get_memory_cache_limit:
+ * @self: a [class@MapLayer]
+ *
+ * Gets the maximum amount of memory used by the layer's in-memory tile cache.
+ *
+ * Returns: the limit in megabytes, or 0 if only the number of tiles is limited
+ * Since: 1.7
+ */
+guint
+shumate_map_layer_get_memory_cache_limit (ShumateMapLayer *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_MAP_LAYER (self), 0);
+
+  return shumate_memory_cache_get_memory_limit (self->memcache);
+}
+
+/**
+ * shumate_map_layer_set_memory_cache_limit:
+ * @self: a [class@MapLayer]
+ * @limit: the limit in megabytes, or 0 for no memory limit
+ *
+ * Sets the maximum amount of memory used by the layer's in-memory tile cache.
+ *
+ * The size of each cached tile is estimated from its texture and symbols, so
+ * high resolution and vector tiles count for more than small raster tiles.
+ * When the limit is exceeded, the least recently used tiles are dropped.
+ *
+ * Since: 1.7
+ */
+void
+shumate_map_layer_set_memory_cache_limit (ShumateMapLayer *self,
+                                          guint            limit)
+{
+  g_return_if_fail (SHUMATE_IS_MAP_LAYER (self));
+
+  if (shumate_memory_cache_get_memory_limit (self->memcache) == limit)
+    return;
+
+  shumate_memory_cache_set_memory_limit (self->memcache, limit);
+  g_object_notify_by_pspec (G_OBJECT (self), obj_properties[PROP_MEMORY_CACHE_LIMIT]);
+}
+
 /**
  * shumate_map_layer_refresh:
  * @self: a [class@MapLayer]
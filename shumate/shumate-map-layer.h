@@ -39,6 +39,10 @@ ShumateMapSource *shumate_map_layer_get_map_source (ShumateMapLayer *self);
 void shumate_map_layer_set_map_source (ShumateMapLayer *self,
                                        ShumateMapSource *map_source);
 
+guint shumate_map_layer_get_memory_cache_limit (ShumateMapLayer *self);
+void shumate_map_layer_set_memory_cache_limit (ShumateMapLayer *self,
+                                               guint            limit);
+
 void shumate_map_layer_refresh (ShumateMapLayer *self);
 void shumate_map_layer_retry_failed (ShumateMapLayer *self);
 
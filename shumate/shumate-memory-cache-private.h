@@ -33,11 +33,31 @@ guint shumate_memory_cache_get_size_limit (ShumateMemoryCache *memory_cache);
 void shumate_memory_cache_set_size_limit (ShumateMemoryCache *memory_cache,
     guint size_limit);
 
+guint shumate_memory_cache_get_memory_limit (ShumateMemoryCache *memory_cache);
+void shumate_memory_cache_set_memory_limit (ShumateMemoryCache *memory_cache,
+    guint memory_limit);
+guint64 shumate_memory_cache_get_memory_used (ShumateMemoryCache *memory_cache);
+
 void shumate_memory_cache_clean (ShumateMemoryCache *memory_cache);
 
 gboolean shumate_memory_cache_try_fill_tile (ShumateMemoryCache *self,
                                              ShumateTile        *tile,
                                              const char         *source_id);
+
+gboolean shumate_memory_cache_lookup (ShumateMemoryCache  *self,
+                                      int                  x,
+                                      int                  y,
+                                      int                  zoom_level,
+                                      const char          *source_id,
+                                      GdkPaintable       **paintable,
+                                      GPtrArray          **symbols);
+void shumate_memory_cache_store (ShumateMemoryCache *self,
+                                 int                 x,
+                                 int                 y,
+                                 int                 zoom_level,
+                                 const char         *source_id,
+                                 GdkPaintable       *paintable,
+                                 GPtrArray          *symbols);
 void shumate_memory_cache_store_tile (ShumateMemoryCache *self,
                                       ShumateTile        *tile,
                                       const char         *source_id);
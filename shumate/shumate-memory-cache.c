@@ -27,14 +27,16 @@
 
 #include "shumate-memory-cache-private.h"
 #include "shumate-tile-private.h"
+#include "vector/shumate-vector-symbol-info-private.h"
 
 #include <glib.h>
-#include <string.h>
 
 enum
 {
   PROP_0,
   PROP_SIZE_LIMIT,
+  PROP_MEMORY_LIMIT,
+  PROP_MEMORY_USED,
   N_PROPS
 };
 
@@ -45,18 +47,59 @@ struct _ShumateMemoryCache
   GObject parent_instance;
 
   guint size_limit;
-  GQueue *queue;
+  guint memory_limit; /* in megabytes, 0 for no limit */
+  guint64 memory_used; /* in bytes */
+
+  /* Intrusive LRU list of QueueMembers, most recently used first */
+  struct _QueueMember *head;
+  struct _QueueMember *tail;
+  guint length;
+
+  /* QueueMember -> QueueMember, looked up with a stack-allocated TileKey */
   GHashTable *hash_table;
+  /* char * -> SourceId */
+  GHashTable *source_ids;
+  /* Used for a NULL source ID, which isn't in source_ids */
+  struct _SourceId *null_source;
+
+  /* The context notify::memory-used is emitted in, since the cache may be
+   * used from other threads. See notify_memory_used(). */
+  GMainContext *main_context;
+  gint memory_used_notify_pending;
 };
 
 G_DEFINE_TYPE (ShumateMemoryCache, shumate_memory_cache, G_TYPE_OBJECT);
 
+/* Source IDs are interned per cache, so that lookups compare pointers instead
+ * of strings. An ID is dropped when the last entry using it is evicted. */
+typedef struct _SourceId
+{
+  char *name;
+  guint n_members;
+} SourceId;
+
 typedef struct
 {
-  char *key;
+  guint64 tile;
+  SourceId *source;
+} TileKey;
+
+typedef struct _QueueMember QueueMember;
+
+struct _QueueMember
+{
+  /* Must be first, so a QueueMember can be used as its own hash table key */
+  TileKey key;
+
+  QueueMember *prev;
+  QueueMember *next;
+
   GdkPaintable *paintable;
   GPtrArray *symbols;
-} QueueMember;
+  gsize size;
+};
+
+static void delete_all_members (ShumateMemoryCache *self);
 
 
 static void
@@ -73,6 +116,14 @@ shumate_memory_cache_get_property (GObject    *object,
       g_value_set_uint (value, shumate_memory_cache_get_size_limit (memory_cache));
       break;
 
+    case PROP_MEMORY_LIMIT:
+      g_value_set_uint (value, shumate_memory_cache_get_memory_limit (memory_cache));
+      break;
+
+    case PROP_MEMORY_USED:
+      g_value_set_uint64 (value, shumate_memory_cache_get_memory_used (memory_cache));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -93,6 +144,10 @@ shumate_memory_cache_set_property (GObject      *object,
       shumate_memory_cache_set_size_limit (memory_cache, g_value_get_uint (value));
       break;
 
+    case PROP_MEMORY_LIMIT:
+      shumate_memory_cache_set_memory_limit (memory_cache, g_value_get_uint (value));
+      break;
+
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, property_id, pspec);
     }
@@ -103,9 +158,11 @@ shumate_memory_cache_finalize (GObject *object)
 {
   ShumateMemoryCache *self = SHUMATE_MEMORY_CACHE (object);
 
-  shumate_memory_cache_clean (self);
-  g_clear_pointer (&self->queue, g_queue_free);
+  delete_all_members (self);
   g_clear_pointer (&self->hash_table, g_hash_table_unref);
+  g_clear_pointer (&self->source_ids, g_hash_table_unref);
+  g_clear_pointer (&self->null_source, g_free);
+  g_clear_pointer (&self->main_context, g_main_context_unref);
 
   G_OBJECT_CLASS (shumate_memory_cache_parent_class)->finalize (object);
 }
@@ -129,6 +186,24 @@ shumate_memory_cache_class_init (ShumateMemoryCacheClass *klass)
                        100,
                        G_PARAM_CONSTRUCT | G_PARAM_READWRITE);
 
+  properties[PROP_MEMORY_LIMIT] =
+    g_param_spec_uint ("memory-limit",
+                       "Memory Limit",
+                       "Maximal memory used by stored tiles, in megabytes, or 0 for no limit",
+                       0,
+                       G_MAXUINT,
+                       0,
+                       G_PARAM_CONSTRUCT | G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY);
+
+  properties[PROP_MEMORY_USED] =
+    g_param_spec_uint64 ("memory-used",
+                         "Memory Used",
+                         "Estimated memory used by stored tiles, in bytes",
+                         0,
+                         G_MAXUINT64,
+                         0,
+                         G_PARAM_READABLE | G_PARAM_EXPLICIT_NOTIFY);
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
@@ -154,14 +229,54 @@ shumate_memory_cache_new_full (guint size_limit)
 }
 
 
+static guint
+tile_key_hash (gconstpointer key)
+{
+  const TileKey *tile_key = key;
+  guint64 h = tile_key->tile ^ GPOINTER_TO_SIZE (tile_key->source);
+
+  /* Mix the high bits into the low ones, since the tile index of nearby tiles
+   * differs mostly in the low bits */
+  h ^= h >> 33;
+  h *= G_GUINT64_CONSTANT (0xff51afd7ed558ccd);
+  h ^= h >> 33;
+
+  return (guint) h;
+}
+
+
+static gboolean
+tile_key_equal (gconstpointer a,
+                gconstpointer b)
+{
+  const TileKey *key_a = a;
+  const TileKey *key_b = b;
+
+  return key_a->tile == key_b->tile && key_a->source == key_b->source;
+}
+
+
+static void
+source_id_free (SourceId *source_id)
+{
+  g_free (source_id->name);
+  g_free (source_id);
+}
+
+
 static void
 shumate_memory_cache_init (ShumateMemoryCache *self)
 {
-  self->queue = g_queue_new ();
-  self->hash_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  self->hash_table = g_hash_table_new (tile_key_hash, tile_key_equal);
+  self->source_ids = g_hash_table_new_full (g_str_hash, g_str_equal, NULL, (GDestroyNotify) source_id_free);
+  self->null_source = g_new0 (SourceId, 1);
+  self->main_context = g_main_context_ref_thread_default ();
 }
 
 
+static void evict_and_notify (ShumateMemoryCache *self);
+
+
 guint
 shumate_memory_cache_get_size_limit (ShumateMemoryCache *self)
 {
@@ -179,128 +294,427 @@ shumate_memory_cache_set_size_limit (ShumateMemoryCache *self,
 
   self->size_limit = size_limit;
   g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_SIZE_LIMIT]);
+
+  evict_and_notify (self);
 }
 
 
-static char *
-generate_queue_key (ShumateMemoryCache *self,
-                    ShumateTile        *tile,
-                    const char         *source_id)
+guint
+shumate_memory_cache_get_memory_limit (ShumateMemoryCache *self)
 {
-  g_return_val_if_fail (SHUMATE_IS_MEMORY_CACHE (self), NULL);
-  g_return_val_if_fail (SHUMATE_IS_TILE (tile), NULL);
+  g_return_val_if_fail (SHUMATE_IS_MEMORY_CACHE (self), 0);
+
+  return self->memory_limit;
+}
+
+
+void
+shumate_memory_cache_set_memory_limit (ShumateMemoryCache *self,
+                                       guint               memory_limit)
+{
+  g_return_if_fail (SHUMATE_IS_MEMORY_CACHE (self));
+
+  if (self->memory_limit == memory_limit)
+    return;
 
-  char *key;
+  self->memory_limit = memory_limit;
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_MEMORY_LIMIT]);
 
-  key = g_strdup_printf ("%d/%d/%d/%s",
-        shumate_tile_get_zoom_level (tile),
-        shumate_tile_get_x (tile),
-        shumate_tile_get_y (tile),
-        source_id);
-  return key;
+  evict_and_notify (self);
+}
+
+
+guint64
+shumate_memory_cache_get_memory_used (ShumateMemoryCache *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_MEMORY_CACHE (self), 0);
+
+  return self->memory_used;
+}
+
+
+/* Packs a tile position into a single integer. Each zoom level gets its own
+ * range, starting after the 4^0 + 4^1 + ... + 4^(zoom - 1) tiles of the levels
+ * above it, so every (x, y, zoom) maps to a unique index. Zoom levels up to
+ * 30 fit in 62 bits. */
+static inline guint64
+pack_tile (int x,
+           int y,
+           int zoom_level)
+{
+  guint64 level_offset = ((G_GUINT64_CONSTANT (1) << (2 * zoom_level)) - 1) / 3;
+  return level_offset + ((guint64) y << zoom_level) + (guint64) x;
+}
+
+
+static gboolean
+is_valid_position (int x,
+                   int y,
+                   int zoom_level)
+{
+  return zoom_level >= 0 && zoom_level <= 30
+         && x >= 0 && (guint64) x < (G_GUINT64_CONSTANT (1) << zoom_level)
+         && y >= 0 && (guint64) y < (G_GUINT64_CONSTANT (1) << zoom_level);
 }
 
 
 static void
-move_queue_member_to_head (GQueue *queue, GList *link)
+unlink_queue_member (ShumateMemoryCache *self,
+                     QueueMember        *member)
 {
-  g_queue_unlink (queue, link);
-  g_queue_push_head_link (queue, link);
+  if (member->prev)
+    member->prev->next = member->next;
+  else
+    self->head = member->next;
+
+  if (member->next)
+    member->next->prev = member->prev;
+  else
+    self->tail = member->prev;
+
+  member->prev = member->next = NULL;
+  self->length --;
 }
 
 
 static void
-delete_queue_member (QueueMember *member, gpointer user_data)
+push_queue_member_to_head (ShumateMemoryCache *self,
+                           QueueMember        *member)
 {
-  if (member)
+  member->prev = NULL;
+  member->next = self->head;
+
+  if (self->head)
+    self->head->prev = member;
+  else
+    self->tail = member;
+
+  self->head = member;
+  self->length ++;
+}
+
+
+static void
+move_queue_member_to_head (ShumateMemoryCache *self,
+                           QueueMember        *member)
+{
+  if (self->head == member)
+    return;
+
+  unlink_queue_member (self, member);
+  push_queue_member_to_head (self, member);
+}
+
+
+static void
+free_queue_member (QueueMember *member)
+{
+  g_clear_object (&member->paintable);
+  g_clear_pointer (&member->symbols, g_ptr_array_unref);
+  g_free (member);
+}
+
+
+/* Unlinks a member from the list and the hash table, and frees it */
+static void
+delete_queue_member (ShumateMemoryCache *self,
+                     QueueMember        *member)
+{
+  SourceId *source = member->key.source;
+
+  unlink_queue_member (self, member);
+  g_hash_table_remove (self->hash_table, &member->key);
+  self->memory_used -= member->size;
+
+  if (--source->n_members == 0 && source != self->null_source)
+    g_hash_table_remove (self->source_ids, source->name);
+
+  free_queue_member (member);
+}
+
+
+static void
+delete_all_members (ShumateMemoryCache *self)
+{
+  QueueMember *member = self->head;
+
+  while (member != NULL)
     {
-      g_clear_object (&member->paintable);
-      g_clear_pointer (&member->symbols, g_ptr_array_unref);
-      g_clear_pointer (&member->key, g_free);
-      g_free (member);
+      QueueMember *next = member->next;
+      free_queue_member (member);
+      member = next;
     }
+
+  self->head = self->tail = NULL;
+  self->length = 0;
+
+  g_hash_table_remove_all (self->hash_table);
+  g_hash_table_remove_all (self->source_ids);
+  self->null_source->n_members = 0;
+}
+
+
+static gsize
+get_member_size (QueueMember *member)
+{
+  gsize size = sizeof (QueueMember);
+
+  /* Textures are counted as 4 bytes per pixel, which is what both the raster
+   * and vector renderers produce. */
+  if (GDK_IS_TEXTURE (member->paintable))
+    size += (gsize) gdk_texture_get_width (GDK_TEXTURE (member->paintable))
+            * (gsize) gdk_texture_get_height (GDK_TEXTURE (member->paintable))
+            * 4;
+  else if (member->paintable != NULL)
+    size += (gsize) gdk_paintable_get_intrinsic_width (member->paintable)
+            * (gsize) gdk_paintable_get_intrinsic_height (member->paintable)
+            * 4;
+
+  if (member->symbols != NULL)
+    {
+      size += member->symbols->len * sizeof (gpointer);
+
+      for (guint i = 0; i < member->symbols->len; i ++)
+        size += shumate_vector_symbol_info_get_memory_size (member->symbols->pdata[i]);
+    }
+
+  return size;
+}
+
+
+static gboolean
+is_over_limit (ShumateMemoryCache *self)
+{
+  if (self->length > self->size_limit)
+    return TRUE;
+
+  return self->memory_limit > 0
+         && self->memory_used > (guint64) self->memory_limit * 1024 * 1024;
+}
+
+
+static void
+evict (ShumateMemoryCache *self)
+{
+  /* Always keep the most recently used tile, even if it alone is over the
+   * memory limit */
+  while (self->length > 1 && is_over_limit (self))
+    delete_queue_member (self, self->tail);
+}
+
+
+static gboolean
+notify_memory_used_cb (gpointer user_data)
+{
+  ShumateMemoryCache *self = user_data;
+
+  g_atomic_int_set (&self->memory_used_notify_pending, FALSE);
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_MEMORY_USED]);
+
+  return G_SOURCE_REMOVE;
+}
+
+/* Caches like the vector renderer's are used from its render threads, but
+ * signal handlers expect to run in the context the cache was created in.
+ * Notifications made while one is already on its way are merged into it. */
+static void
+notify_memory_used (ShumateMemoryCache *self)
+{
+  g_autoptr(GSource) source = NULL;
+
+  if (g_main_context_is_owner (self->main_context))
+    {
+      g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_MEMORY_USED]);
+      return;
+    }
+
+  if (!g_atomic_int_compare_and_exchange (&self->memory_used_notify_pending, FALSE, TRUE))
+    return;
+
+  /* Not g_main_context_invoke(), which would run the callback right here if
+   * no other thread happens to be iterating the context */
+  source = g_idle_source_new ();
+  g_source_set_callback (source, notify_memory_used_cb, g_object_ref (self), g_object_unref);
+  g_source_attach (source, self->main_context);
+}
+
+
+static void
+evict_and_notify (ShumateMemoryCache *self)
+{
+  guint64 memory_used = self->memory_used;
+
+  evict (self);
+
+  if (self->memory_used != memory_used)
+    notify_memory_used (self);
 }
 
 
 void
 shumate_memory_cache_clean (ShumateMemoryCache *self)
 {
-  g_queue_foreach (self->queue, (GFunc) delete_queue_member, NULL);
-  g_queue_clear (self->queue);
-  g_hash_table_unref (self->hash_table);
-  self->hash_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  delete_all_members (self);
+
+  if (self->memory_used != 0)
+    {
+      self->memory_used = 0;
+      notify_memory_used (self);
+    }
+}
+
+
+/* Returns the interned SourceId for @source_id, creating it if @create is
+ * TRUE. Tiles from a renderer without a source ID are still cached, under an
+ * ID of their own that can't clash with any source's name. */
+static SourceId *
+get_source_id (ShumateMemoryCache *self,
+               const char         *source_id,
+               gboolean            create)
+{
+  SourceId *source;
+
+  if (source_id == NULL)
+    return self->null_source;
+
+  source = g_hash_table_lookup (self->source_ids, source_id);
+  if (source == NULL && create)
+    {
+      source = g_new0 (SourceId, 1);
+      source->name = g_strdup (source_id);
+      g_hash_table_insert (self->source_ids, source->name, source);
+    }
+
+  return source;
 }
 
 
+/* Looks up an entry without needing a ShumateTile, and marks it as recently
+ * used. The paintable and symbols are returned with a new reference. The
+ * cache is not thread safe; callers that share it between threads must lock
+ * it themselves. */
 gboolean
-shumate_memory_cache_try_fill_tile (ShumateMemoryCache *self,
-                                    ShumateTile        *tile,
-                                    const char         *source_id)
+shumate_memory_cache_lookup (ShumateMemoryCache  *self,
+                             int                  x,
+                             int                  y,
+                             int                  zoom_level,
+                             const char          *source_id,
+                             GdkPaintable       **paintable,
+                             GPtrArray          **symbols)
 {
-  ShumateMemoryCache *memory_cache = (ShumateMemoryCache *) self;
-  GList *link;
   QueueMember *member;
-  g_autofree char *key = NULL;
+  TileKey key;
 
   g_return_val_if_fail (SHUMATE_IS_MEMORY_CACHE (self), FALSE);
-  g_return_val_if_fail (SHUMATE_IS_TILE (tile), FALSE);
+  g_return_val_if_fail (is_valid_position (x, y, zoom_level), FALSE);
 
-  key = generate_queue_key (memory_cache, tile, source_id);
+  key.source = get_source_id (self, source_id, FALSE);
+  if (key.source == NULL)
+    return FALSE;
+
+  key.tile = pack_tile (x, y, zoom_level);
 
-  link = g_hash_table_lookup (self->hash_table, key);
-  if (link == NULL)
+  member = g_hash_table_lookup (self->hash_table, &key);
+  if (member == NULL)
     return FALSE;
 
-  member = link->data;
+  move_queue_member_to_head (self, member);
 
-  move_queue_member_to_head (self->queue, link);
+  if (paintable != NULL)
+    *paintable = member->paintable ? g_object_ref (member->paintable) : NULL;
+  if (symbols != NULL)
+    *symbols = member->symbols ? g_ptr_array_ref (member->symbols) : NULL;
 
-  shumate_tile_set_symbols (tile, member->symbols);
-  shumate_tile_set_paintable (tile, member->paintable);
-  shumate_tile_set_fade_in (tile, FALSE);
-  shumate_tile_set_state (tile, SHUMATE_STATE_DONE);
   return TRUE;
 }
 
+
+/* Stores an entry without needing a ShumateTile. If an entry with the same key
+ * already exists, it is only marked as recently used. */
 void
-shumate_memory_cache_store_tile (ShumateMemoryCache *self,
-                                 ShumateTile        *tile,
-                                 const char         *source_id)
+shumate_memory_cache_store (ShumateMemoryCache *self,
+                            int                 x,
+                            int                 y,
+                            int                 zoom_level,
+                            const char         *source_id,
+                            GdkPaintable       *paintable,
+                            GPtrArray          *symbols)
 {
-  GList *link;
-  char *key;
+  QueueMember *member;
+  TileKey key;
 
   g_return_if_fail (SHUMATE_IS_MEMORY_CACHE (self));
-  g_return_if_fail (SHUMATE_IS_TILE (tile));
+  g_return_if_fail (paintable == NULL || GDK_IS_PAINTABLE (paintable));
+  g_return_if_fail (is_valid_position (x, y, zoom_level));
 
-  key = generate_queue_key (self, tile, source_id);
-  link = g_hash_table_lookup (self->hash_table, key);
-  if (link)
-    {
-      move_queue_member_to_head (self->queue, link);
-      g_free (key);
-    }
-  else
-    {
-      QueueMember *member;
-      GdkPaintable *paintable;
-      GPtrArray *symbols;
+  key.source = get_source_id (self, source_id, TRUE);
 
-      if (self->queue->length >= self->size_limit)
-        {
-          member = g_queue_pop_tail (self->queue);
-          g_hash_table_remove (self->hash_table, member->key);
-          delete_queue_member (member, NULL);
-        }
+  key.tile = pack_tile (x, y, zoom_level);
 
+  member = g_hash_table_lookup (self->hash_table, &key);
+  if (member)
+    move_queue_member_to_head (self, member);
+  else
+    {
       member = g_new0 (QueueMember, 1);
       member->key = key;
-      if ((paintable = shumate_tile_get_paintable (tile)))
+      if (paintable)
         member->paintable = g_object_ref (paintable);
-      if ((symbols = shumate_tile_get_symbols (tile)))
+      if (symbols)
         member->symbols = g_ptr_array_ref (symbols);
+      member->size = get_member_size (member);
+
+      key.source->n_members ++;
+      push_queue_member_to_head (self, member);
+      g_hash_table_add (self->hash_table, member);
 
-      g_queue_push_head (self->queue, member);
-      g_hash_table_insert (self->hash_table, g_strdup (key), g_queue_peek_head_link (self->queue));
+      self->memory_used += member->size;
+      evict (self);
+      notify_memory_used (self);
     }
 }
+
+
+gboolean
+shumate_memory_cache_try_fill_tile (ShumateMemoryCache *self,
+                                    ShumateTile        *tile,
+                                    const char         *source_id)
+{
+  g_autoptr(GdkPaintable) paintable = NULL;
+  g_autoptr(GPtrArray) symbols = NULL;
+
+  g_return_val_if_fail (SHUMATE_IS_MEMORY_CACHE (self), FALSE);
+  g_return_val_if_fail (SHUMATE_IS_TILE (tile), FALSE);
+
+  if (!shumate_memory_cache_lookup (self,
+                                    shumate_tile_get_x (tile),
+                                    shumate_tile_get_y (tile),
+                                    shumate_tile_get_zoom_level (tile),
+                                    source_id,
+                                    &paintable,
+                                    &symbols))
+    return FALSE;
+
+  shumate_tile_set_symbols (tile, symbols);
+  shumate_tile_set_paintable (tile, paintable);
+  shumate_tile_set_fade_in (tile, FALSE);
+  shumate_tile_set_state (tile, SHUMATE_STATE_DONE);
+  return TRUE;
+}
+
+void
+shumate_memory_cache_store_tile (ShumateMemoryCache *self,
+                                 ShumateTile        *tile,
+                                 const char         *source_id)
+{
+  g_return_if_fail (SHUMATE_IS_MEMORY_CACHE (self));
+  g_return_if_fail (SHUMATE_IS_TILE (tile));
+
+  shumate_memory_cache_store (self,
+                              shumate_tile_get_x (tile),
+                              shumate_tile_get_y (tile),
+                              shumate_tile_get_zoom_level (tile),
+                              source_id,
+                              shumate_tile_get_paintable (tile),
+                              shumate_tile_get_symbols (tile));
+}
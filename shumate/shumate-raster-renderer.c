@@ -26,6 +26,8 @@ struct _ShumateRasterRenderer
   ShumateMapSource parent_instance;
 
   ShumateDataSource *data_source;
+
+  GThreadPool *thread_pool;
 };
 
 G_DEFINE_TYPE (ShumateRasterRenderer, shumate_raster_renderer, SHUMATE_TYPE_MAP_SOURCE)
@@ -182,6 +184,9 @@ shumate_raster_renderer_finalize (GObject *object)
 
   g_clear_object (&self->data_source);
 
+  if (self->thread_pool)
+    g_thread_pool_free (self->thread_pool, FALSE, FALSE);
+
   G_OBJECT_CLASS (shumate_raster_renderer_parent_class)->finalize (object);
 }
 
@@ -266,37 +271,188 @@ shumate_raster_renderer_init (ShumateRasterRenderer *self)
 }
 
 
+/* An item in the thread pool queue to decode a tile from received data. */
+typedef struct {
+  GTask *task;
+  GCancellable *cancellable;
+  gulong cancellable_handle;
+  GBytes *data;
+
+  GdkTexture *texture;
+  GError *error;
+} DecodeJob;
+
+
 static void
-on_request_notify (ShumateDataSourceRequest *req,
-                   GParamSpec               *pspec,
-                   gpointer                  user_data)
+decode_job_free (DecodeJob *job)
 {
-  GTask *task = user_data;
-  GBytes *data;
-  ShumateTile *tile = g_task_get_task_data (task);
+  if (job->cancellable_handle != 0)
+    g_cancellable_disconnect (g_task_get_cancellable (job->task), job->cancellable_handle);
+  g_clear_object (&job->cancellable);
+  g_clear_object (&job->task);
+  g_clear_pointer (&job->data, g_bytes_unref);
+  g_clear_object (&job->texture);
+  g_clear_error (&job->error);
+  g_free (job);
+}
 
-  if ((data = shumate_data_source_request_get_data (req)))
+/* The data associated with a shumate_raster_renderer_fill_tile_async() task. */
+typedef struct {
+  ShumateTile *tile;
+  DecodeJob *current_job;
+  ShumateDataSourceRequest *req;
+  guint8 completed : 1;
+} TaskData;
+
+static void
+task_data_free (TaskData *data)
+{
+  g_clear_object (&data->tile);
+  g_clear_object (&data->req);
+  g_free (data);
+}
+
+
+static void
+return_from_task (GTask                    *task,
+                  ShumateDataSourceRequest *req)
+{
+  GError *error;
+  TaskData *data = g_task_get_task_data (task);
+
+  shumate_tile_set_state (data->tile, SHUMATE_STATE_DONE);
+
+  if ((error = shumate_data_source_request_get_error (req)))
+    g_task_return_error (task, g_error_copy (error));
+  else
+    g_task_return_boolean (task, TRUE);
+}
+
+static gboolean
+decode_job_finish (DecodeJob *job)
+{
+  TaskData *data = g_task_get_task_data (job->task);
+
+  if (!g_cancellable_is_cancelled (job->cancellable))
+    {
+      if (job->error != NULL)
+        g_warning ("Failed to create texture from tile data (%d, %d @ %d): %s",
+                   shumate_tile_get_x (data->tile),
+                   shumate_tile_get_y (data->tile),
+                   shumate_tile_get_zoom_level (data->tile),
+                   job->error->message);
+      else if (job->texture != NULL)
+        shumate_tile_set_paintable (data->tile, GDK_PAINTABLE (job->texture));
+    }
+
+  if (data->current_job == job)
+    {
+      data->current_job = NULL;
+
+      if (data->completed)
+        return_from_task (job->task, data->req);
+    }
+
+  decode_job_free (job);
+  return G_SOURCE_REMOVE;
+}
+
+static void
+thread_func (DecodeJob *job)
+{
+  /* Tiles that scrolled out of view while the job was queued are dropped
+   * here, before any decoding work is done. */
+  if (!g_cancellable_is_cancelled (job->cancellable))
     {
-      g_autoptr(GError) error = NULL;
-      g_autoptr(GdkPixbuf) pixbuf = NULL;
       g_autoptr(GInputStream) stream = NULL;
-      g_autoptr(GdkTexture) texture = NULL;
+      g_autoptr(GdkPixbuf) pixbuf = NULL;
+
+      stream = g_memory_input_stream_new_from_bytes (job->data);
+      pixbuf = gdk_pixbuf_new_from_stream (stream, job->cancellable, &job->error);
+
+      if (pixbuf != NULL)
+        job->texture = gdk_texture_new_for_pixbuf (pixbuf);
+    }
+
+  g_idle_add ((GSourceFunc)decode_job_finish, job);
+}
+
+static void
+chain_cancel (GCancellable *source,
+              DecodeJob    *job)
+{
+  g_cancellable_cancel (job->cancellable);
+}
+
+static gboolean
+begin_decode (ShumateRasterRenderer *self,
+              GTask                 *task,
+              GBytes                *tile_data)
+{
+  g_autoptr(GError) error = NULL;
+  DecodeJob *job;
+  TaskData *data = g_task_get_task_data (task);
+
+  if (data->current_job != NULL)
+    g_cancellable_cancel (data->current_job->cancellable);
+
+  job = g_new0 (DecodeJob, 1);
+  job->cancellable = g_cancellable_new ();
+  job->task = g_object_ref (task);
+  job->data = g_bytes_ref (tile_data);
+  data->current_job = job;
+
+  /* If the input cancellable is cancelled, stop the decode job. */
+  if (g_task_get_cancellable (task) != NULL)
+    {
+      job->cancellable_handle = g_cancellable_connect (
+        g_task_get_cancellable (task),
+        G_CALLBACK (chain_cancel),
+        job, NULL
+      );
+    }
 
-      stream = g_memory_input_stream_new_from_bytes (data);
-      pixbuf = gdk_pixbuf_new_from_stream (stream, NULL, &error);
-      if (error)
+  if (self->thread_pool == NULL)
+    {
+      self->thread_pool = g_thread_pool_new_full (
+        (GFunc)thread_func,
+        NULL,
+        (GDestroyNotify)decode_job_free,
+        MAX (1, (int)g_get_num_processors () - 1),
+        FALSE,
+        &error
+      );
+      if (self->thread_pool == NULL)
         {
-          g_warning ("Failed to create texture from tile data (%d, %d @ %d): %s",
-                     shumate_tile_get_x (tile),
-                     shumate_tile_get_y (tile),
-                     shumate_tile_get_zoom_level (tile),
-                     error->message);
-          return;
+          g_critical ("Failed to create thread pool: %s", error->message);
+          data->current_job = NULL;
+          decode_job_free (job);
+          return FALSE;
         }
+    }
 
-      texture = gdk_texture_new_for_pixbuf (pixbuf);
-      shumate_tile_set_paintable (tile, GDK_PAINTABLE (texture));
+  if (!g_thread_pool_push (self->thread_pool, job, &error))
+    {
+      g_critical ("Failed to push job to thread pool: %s", error->message);
+      data->current_job = NULL;
+      decode_job_free (job);
+      return FALSE;
     }
+
+  return TRUE;
+}
+
+static void
+on_request_notify (ShumateDataSourceRequest *req,
+                   GParamSpec               *pspec,
+                   gpointer                  user_data)
+{
+  GTask *task = user_data;
+  GBytes *data;
+  ShumateRasterRenderer *self = g_task_get_source_object (task);
+
+  if ((data = shumate_data_source_request_get_data (req)))
+    begin_decode (self, task, data);
 }
 
 static void
@@ -305,15 +461,12 @@ on_request_notify_completed (ShumateDataSourceRequest *req,
                              gpointer                  user_data)
 {
   g_autoptr(GTask) task = user_data;
-  GError *error;
-  ShumateTile *tile = g_task_get_task_data (task);
-
-  shumate_tile_set_state (tile, SHUMATE_STATE_DONE);
+  TaskData *data = g_task_get_task_data (task);
 
-  if ((error = shumate_data_source_request_get_error (req)))
-    g_task_return_error (task, g_error_copy (error));
+  if (data->current_job != NULL)
+    data->completed = TRUE;
   else
-    g_task_return_boolean (task, TRUE);
+    return_from_task (task, req);
 }
 
 static void
@@ -326,6 +479,7 @@ shumate_raster_renderer_fill_tile_async (ShumateMapSource    *map_source,
   ShumateRasterRenderer *self = (ShumateRasterRenderer *)map_source;
   g_autoptr(GTask) task = NULL;
   g_autoptr(ShumateDataSourceRequest) req = NULL;
+  TaskData *task_data;
 
   g_return_if_fail (SHUMATE_IS_RASTER_RENDERER (self));
   g_return_if_fail (SHUMATE_IS_TILE (tile));
@@ -334,13 +488,16 @@ shumate_raster_renderer_fill_tile_async (ShumateMapSource    *map_source,
   task = g_task_new (self, cancellable, callback, user_data);
   g_task_set_source_tag (task, shumate_raster_renderer_fill_tile_async);
 
-  g_task_set_task_data (task, g_object_ref (tile), (GDestroyNotify)g_object_unref);
+  task_data = g_new0 (TaskData, 1);
+  task_data->tile = g_object_ref (tile);
+  g_task_set_task_data (task, task_data, (GDestroyNotify)task_data_free);
 
   req = shumate_data_source_start_request (self->data_source,
                                            shumate_tile_get_x (tile),
                                            shumate_tile_get_y (tile),
                                            shumate_tile_get_zoom_level (tile),
                                            cancellable);
+  task_data->req = g_object_ref (req);
 
   if (shumate_data_source_request_is_completed (req))
     {
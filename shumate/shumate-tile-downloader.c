@@ -16,6 +16,7 @@
  */
 
 #include <libsoup/soup.h>
+#include <string.h>
 #include "shumate-tile-downloader.h"
 #include "shumate-file-cache.h"
 #include "shumate-user-agent.h"
@@ -29,6 +30,11 @@
  * service using a given template.
  *
  * It contains an internal [class@FileCache] to cache the tiles on the system.
+ *
+ * Tiles are downloaded over a small pool of connections, configured with
+ * [property@TileDownloader:max-connections] and
+ * [property@TileDownloader:max-connections-per-host]. When the server supports
+ * HTTP/2, requests to the same host are multiplexed over a single connection.
  */
 
 struct _ShumateTileDownloader
@@ -37,6 +43,14 @@ struct _ShumateTileDownloader
 
   char *url_template;
 
+  /* Alternatives for a "{a,b,c}" pattern in the URL template, if any */
+  char *alternatives_pattern;
+  char **alternatives;
+  guint n_alternatives;
+
+  guint max_connections;
+  guint max_connections_per_host;
+
   SoupSession *soup_session;
   ShumateFileCache *cache;
 };
@@ -46,6 +60,8 @@ G_DEFINE_TYPE (ShumateTileDownloader, shumate_tile_downloader, SHUMATE_TYPE_DATA
 enum {
   PROP_0,
   PROP_URL_TEMPLATE,
+  PROP_MAX_CONNECTIONS,
+  PROP_MAX_CONNECTIONS_PER_HOST,
   N_PROPS
 };
 static GParamSpec *properties [N_PROPS];
@@ -76,12 +92,41 @@ shumate_tile_downloader_new (const char *url_template)
                        NULL);
 }
 
+/* Finds the first "{...}" in the URL template that contains a comma, such as
+ * "{a,b,c}", and splits it into its alternatives */
+static void
+parse_url_alternatives (ShumateTileDownloader *self)
+{
+  const char *start = self->url_template;
+  const char *end;
+
+  if (start == NULL)
+    return;
+
+  while ((start = strchr (start, '{')) != NULL && (end = strchr (start, '}')) != NULL)
+    {
+      if (memchr (start, ',', end - start) != NULL)
+        {
+          g_autofree char *inner = g_strndup (start + 1, end - start - 1);
+
+          self->alternatives_pattern = g_strndup (start, end - start + 1);
+          self->alternatives = g_strsplit (inner, ",", -1);
+          self->n_alternatives = g_strv_length (self->alternatives);
+          return;
+        }
+
+      start = end;
+    }
+}
+
 static void
 shumate_tile_downloader_constructed (GObject *object)
 {
   ShumateTileDownloader *self = (ShumateTileDownloader *)object;
   g_autofree char *cache_key = NULL;
 
+  parse_url_alternatives (self);
+
   cache_key = g_strcanon (g_strdup (self->url_template), "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", '_');
   self->cache = shumate_file_cache_new_full (100 * 1000 * 1000, cache_key, NULL);
 
@@ -94,6 +139,8 @@ shumate_tile_downloader_finalize (GObject *object)
   ShumateTileDownloader *self = (ShumateTileDownloader *)object;
 
   g_clear_pointer (&self->url_template, g_free);
+  g_clear_pointer (&self->alternatives_pattern, g_free);
+  g_clear_pointer (&self->alternatives, g_strfreev);
   g_clear_object (&self->soup_session);
   g_clear_object (&self->cache);
 
@@ -113,6 +160,12 @@ shumate_tile_downloader_get_property (GObject    *object,
     case PROP_URL_TEMPLATE:
       g_value_set_string (value, self->url_template);
       break;
+    case PROP_MAX_CONNECTIONS:
+      g_value_set_uint (value, self->max_connections);
+      break;
+    case PROP_MAX_CONNECTIONS_PER_HOST:
+      g_value_set_uint (value, self->max_connections_per_host);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -131,6 +184,12 @@ shumate_tile_downloader_set_property (GObject      *object,
     case PROP_URL_TEMPLATE:
       self->url_template = g_strdup (g_value_get_string (value));
       break;
+    case PROP_MAX_CONNECTIONS:
+      shumate_tile_downloader_set_max_connections (self, g_value_get_uint (value));
+      break;
+    case PROP_MAX_CONNECTIONS_PER_HOST:
+      shumate_tile_downloader_set_max_connections_per_host (self, g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -178,18 +237,148 @@ shumate_tile_downloader_class_init (ShumateTileDownloaderClass *klass)
    * - "{z}": The zoom level of the tile
    * - "{tmsy}": The inverted Y coordinate (i.e. tile numbering starts with 0 at
    * the bottom, rather than top, of the map)
+   * - "{a,b,c}": One of the comma-separated values, for servers that spread
+   * tiles across several subdomains. Each tile always uses the same value.
    */
   properties[PROP_URL_TEMPLATE] =
     g_param_spec_string ("url-template", "URL template", "URL template",
                          NULL,
                          G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY | G_PARAM_STATIC_STRINGS);
 
+  /**
+   * ShumateTileDownloader:max-connections:
+   *
+   * The maximum number of simultaneous connections used to download tiles.
+   *
+   * Make sure to respect the tile server's usage policy. The default of 2 is
+   * what tile.openstreetmap.org allows.
+   *
+   * Since: 1.7
+   */
+  properties[PROP_MAX_CONNECTIONS] =
+    g_param_spec_uint ("max-connections", "Max connections", "Maximum number of connections",
+                       1, G_MAXINT, MAX_CONNS_DEFAULT,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
+  /**
+   * ShumateTileDownloader:max-connections-per-host:
+   *
+   * The maximum number of simultaneous connections to a single host. This is
+   * useful with a "{a,b,c}" URL template, to use more connections in total
+   * while keeping the load on each host limited.
+   *
+   * Since: 1.7
+   */
+  properties[PROP_MAX_CONNECTIONS_PER_HOST] =
+    g_param_spec_uint ("max-connections-per-host", "Max connections per host", "Maximum number of connections per host",
+                       1, G_MAXINT, MAX_CONNS_DEFAULT,
+                       G_PARAM_READWRITE | G_PARAM_STATIC_STRINGS | G_PARAM_EXPLICIT_NOTIFY);
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
 static void
 shumate_tile_downloader_init (ShumateTileDownloader *self)
 {
+  self->max_connections = MAX_CONNS_DEFAULT;
+  self->max_connections_per_host = MAX_CONNS_DEFAULT;
+}
+
+
+/**
+ * shumate_tile_downloader_get_max_connections:
+ * @self: a [class@TileDownloader]
+ *
+ * Gets the maximum number of simultaneous connections used to download tiles.
+ *
+ * Returns: the maximum number of connections
+ *
+ * Since: 1.7
+ */
+guint
+shumate_tile_downloader_get_max_connections (ShumateTileDownloader *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_TILE_DOWNLOADER (self), 0);
+
+  return self->max_connections;
+}
+
+
+/**
+ * shumate_tile_downloader_set_max_connections:
+ * @self: a [class@TileDownloader]
+ * @max_connections: the maximum number of connections
+ *
+ * Sets the maximum number of simultaneous connections used to download tiles.
+ *
+ * Downloads that are already in progress are not affected.
+ *
+ * Since: 1.7
+ */
+void
+shumate_tile_downloader_set_max_connections (ShumateTileDownloader *self,
+                                             guint                  max_connections)
+{
+  g_return_if_fail (SHUMATE_IS_TILE_DOWNLOADER (self));
+  g_return_if_fail (max_connections > 0);
+
+  if (self->max_connections == max_connections)
+    return;
+
+  self->max_connections = max_connections;
+
+  /* The connection limits of a SoupSession can't be changed, so a new session
+   * will be created for the next download */
+  g_clear_object (&self->soup_session);
+
+  g_object_notify_by_pspec ((GObject *)self, properties[PROP_MAX_CONNECTIONS]);
+}
+
+
+/**
+ * shumate_tile_downloader_get_max_connections_per_host:
+ * @self: a [class@TileDownloader]
+ *
+ * Gets the maximum number of simultaneous connections to a single host.
+ *
+ * Returns: the maximum number of connections per host
+ *
+ * Since: 1.7
+ */
+guint
+shumate_tile_downloader_get_max_connections_per_host (ShumateTileDownloader *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_TILE_DOWNLOADER (self), 0);
+
+  return self->max_connections_per_host;
+}
+
+
+/**
+ * shumate_tile_downloader_set_max_connections_per_host:
+ * @self: a [class@TileDownloader]
+ * @max_connections_per_host: the maximum number of connections per host
+ *
+ * Sets the maximum number of simultaneous connections to a single host.
+ *
+ * Downloads that are already in progress are not affected.
+ *
+ * Since: 1.7
+ */
+void
+shumate_tile_downloader_set_max_connections_per_host (ShumateTileDownloader *self,
+                                                      guint                  max_connections_per_host)
+{
+  g_return_if_fail (SHUMATE_IS_TILE_DOWNLOADER (self));
+  g_return_if_fail (max_connections_per_host > 0);
+
+  if (self->max_connections_per_host == max_connections_per_host)
+    return;
+
+  self->max_connections_per_host = max_connections_per_host;
+  g_clear_object (&self->soup_session);
+
+  g_object_notify_by_pspec ((GObject *)self, properties[PROP_MAX_CONNECTIONS_PER_HOST]);
 }
 
 
@@ -258,6 +447,12 @@ get_tile_uri (ShumateTileDownloader *self,
   g_string_replace (string, "{z}", z_str, 0);
   g_string_replace (string, "{tmsy}", tmsy_str, 0);
 
+  /* Pick the alternative from the tile's position rather than a counter, so
+   * a tile is always fetched from the same host and stays in HTTP caches */
+  if (self->n_alternatives > 0)
+    g_string_replace (string, self->alternatives_pattern,
+                      self->alternatives[(guint) (x + y) % self->n_alternatives], 0);
+
   return g_string_free (string, FALSE);
 }
 
@@ -432,12 +627,15 @@ fetch_from_network (FillTileData *data_arg)
       soup_message_headers_append (headers, "If-Modified-Since", modtime_string);
     }
 
+  /* libsoup negotiates HTTP/2 when the server supports it, in which case
+   * requests to a host are multiplexed over one connection regardless of the
+   * per-host limit */
   if (data->self->soup_session == NULL)
     {
       data->self->soup_session =
         soup_session_new_with_options ("user-agent", "libshumate/" SHUMATE_VERSION,
-                                       "max-conns-per-host", MAX_CONNS_DEFAULT,
-                                       "max-conns", MAX_CONNS_DEFAULT,
+                                       "max-conns-per-host", data->self->max_connections_per_host,
+                                       "max-conns", data->self->max_connections,
                                        NULL);
     }
 
@@ -462,7 +660,9 @@ on_message_sent (GObject *source_object, GAsyncResult *res, gpointer user_data)
   SoupStatus status;
   SoupMessageHeaders *headers;
 
-  input_stream = soup_session_send_finish (data->self->soup_session, res, &error);
+  /* Use the session the message was sent with, since self->soup_session may
+   * have been replaced in the meantime */
+  input_stream = soup_session_send_finish (SOUP_SESSION (source_object), res, &error);
   if (error != NULL)
     {
       if (shumate_data_source_request_get_data (data->req))
@@ -27,6 +27,14 @@ G_DECLARE_FINAL_TYPE (ShumateTileDownloader, shumate_tile_downloader, SHUMATE, T
 
 ShumateTileDownloader *shumate_tile_downloader_new (const char *url_template);
 
+guint shumate_tile_downloader_get_max_connections (ShumateTileDownloader *self);
+void  shumate_tile_downloader_set_max_connections (ShumateTileDownloader *self,
+                                                   guint                  max_connections);
+
+guint shumate_tile_downloader_get_max_connections_per_host (ShumateTileDownloader *self);
+void  shumate_tile_downloader_set_max_connections_per_host (ShumateTileDownloader *self,
+                                                            guint                  max_connections_per_host);
+
 
 /**
  * SHUMATE_TILE_DOWNLOADER_ERROR:
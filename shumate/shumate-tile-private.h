@@ -23,3 +23,8 @@ void shumate_tile_set_symbols (ShumateTile *self,
                                GPtrArray   *symbols);
 
 GPtrArray *shumate_tile_get_symbols (ShumateTile *self);
+
+void shumate_tile_set_font_options (ShumateTile                *self,
+                                    const cairo_font_options_t *font_options);
+
+const cairo_font_options_t *shumate_tile_get_font_options (ShumateTile *self);
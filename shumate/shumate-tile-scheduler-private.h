@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib-object.h>
+#include <shumate/shumate-map-source.h>
+#include <shumate/shumate-tile.h>
+#include "shumate-utils-private.h"
+
+G_BEGIN_DECLS
+
+#define SHUMATE_TYPE_TILE_SCHEDULER shumate_tile_scheduler_get_type ()
+G_DECLARE_FINAL_TYPE (ShumateTileScheduler, shumate_tile_scheduler, SHUMATE, TILE_SCHEDULER, GObject)
+
+ShumateTileScheduler *shumate_tile_scheduler_new (guint max_in_flight);
+
+guint shumate_tile_scheduler_get_max_in_flight (ShumateTileScheduler *self);
+guint shumate_tile_scheduler_get_n_pending (ShumateTileScheduler *self);
+guint shumate_tile_scheduler_get_n_in_flight (ShumateTileScheduler *self);
+
+void shumate_tile_scheduler_set_center (ShumateTileScheduler *self,
+                                        double                x,
+                                        double                y,
+                                        int                   zoom_level);
+
+void shumate_tile_scheduler_fill_tile_async (ShumateTileScheduler      *self,
+                                             ShumateMapSource          *map_source,
+                                             ShumateTile               *tile,
+                                             const ShumateGridPosition *pos,
+                                             GCancellable              *cancellable,
+                                             GAsyncReadyCallback        callback,
+                                             gpointer                   user_data);
+gboolean shumate_tile_scheduler_fill_tile_finish (ShumateTileScheduler  *self,
+                                                  GAsyncResult          *result,
+                                                  GError               **error);
+
+G_END_DECLS
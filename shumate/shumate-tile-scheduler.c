@@ -0,0 +1,422 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * ShumateTileScheduler sits between a map layer and its map source. Rather
+ * than starting every tile request immediately, in whatever order the layer
+ * happens to walk its grid, requests are queued and started a few at a time,
+ * most important first.
+ *
+ * Importance is the distance from the center of the viewport, with tiles on
+ * the viewport's zoom level always ahead of tiles on other zoom levels. The
+ * layer updates the center whenever the viewport changes, which reorders
+ * everything that hasn't started yet.
+ *
+ * Requests are started from an idle callback, so that all the tiles added
+ * during one grid update are ordered together rather than the first few
+ * starting as soon as they are added.
+ *
+ * The limit on requests in flight is per map source rather than per
+ * scheduler, so that several maps showing the same source don't multiply
+ * the load on it. Each map layer still has its own scheduler, since each
+ * orders its tiles around its own view. Schedulers that are held back by
+ * another one's requests wait for one of those to finish.
+ */
+
+#include "shumate-tile-scheduler-private.h"
+
+#include <math.h>
+
+struct _ShumateTileScheduler
+{
+  GObject parent_instance;
+
+  guint max_in_flight;
+  /* Requests started by this scheduler, which may be fewer than the number
+   * in flight for the map source */
+  guint n_in_flight;
+
+  /* Requests that haven't been started yet. When needs_sort is FALSE, they
+   * are sorted so that the most important one is last. */
+  GPtrArray *pending;
+  gboolean needs_sort;
+
+  double center_x, center_y;
+  int center_zoom;
+
+  guint dispatch_idle_id;
+};
+
+G_DEFINE_TYPE (ShumateTileScheduler, shumate_tile_scheduler, G_TYPE_OBJECT)
+
+
+/* Attached to a map source, and shared by every scheduler requesting tiles
+ * from it */
+typedef struct {
+  guint n_in_flight;
+  /* Schedulers that have requests waiting for a free slot */
+  GPtrArray *waiting;
+} SourceSlots;
+
+static void
+source_slots_free (SourceSlots *slots)
+{
+  g_clear_pointer (&slots->waiting, g_ptr_array_unref);
+  g_free (slots);
+}
+
+static SourceSlots *
+get_source_slots (ShumateMapSource *map_source)
+{
+  SourceSlots *slots = g_object_get_data (G_OBJECT (map_source), "shumate-tile-scheduler-slots");
+
+  if (slots == NULL)
+    {
+      slots = g_new0 (SourceSlots, 1);
+      slots->waiting = g_ptr_array_new_with_free_func (g_object_unref);
+      g_object_set_data_full (G_OBJECT (map_source), "shumate-tile-scheduler-slots",
+                              slots, (GDestroyNotify)source_slots_free);
+    }
+
+  return slots;
+}
+
+
+typedef struct {
+  GTask *task;
+  ShumateMapSource *map_source;
+  ShumateTile *tile;
+  ShumateGridPosition pos;
+
+  guint zoom_distance;
+  double distance;
+} Request;
+
+static void
+request_free (Request *request)
+{
+  g_clear_object (&request->task);
+  g_clear_object (&request->map_source);
+  g_clear_object (&request->tile);
+  g_free (request);
+}
+
+
+static void
+shumate_tile_scheduler_dispose (GObject *object)
+{
+  ShumateTileScheduler *self = (ShumateTileScheduler *)object;
+
+  g_clear_handle_id (&self->dispatch_idle_id, g_source_remove);
+
+  G_OBJECT_CLASS (shumate_tile_scheduler_parent_class)->dispose (object);
+}
+
+static void
+shumate_tile_scheduler_finalize (GObject *object)
+{
+  ShumateTileScheduler *self = (ShumateTileScheduler *)object;
+
+  /* Every pending request holds a reference to the scheduler through its
+   * task, so there can't be any left at this point */
+  g_assert (self->pending->len == 0);
+  g_clear_pointer (&self->pending, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (shumate_tile_scheduler_parent_class)->finalize (object);
+}
+
+static void
+shumate_tile_scheduler_class_init (ShumateTileSchedulerClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->dispose = shumate_tile_scheduler_dispose;
+  object_class->finalize = shumate_tile_scheduler_finalize;
+}
+
+static void
+shumate_tile_scheduler_init (ShumateTileScheduler *self)
+{
+  self->pending = g_ptr_array_new_with_free_func ((GDestroyNotify)request_free);
+}
+
+
+/* @max_in_flight is the number of requests that may be in flight for each
+ * map source, counting those started by other schedulers */
+ShumateTileScheduler *
+shumate_tile_scheduler_new (guint max_in_flight)
+{
+  ShumateTileScheduler *self;
+
+  g_return_val_if_fail (max_in_flight > 0, NULL);
+
+  self = g_object_new (SHUMATE_TYPE_TILE_SCHEDULER, NULL);
+  self->max_in_flight = max_in_flight;
+  return self;
+}
+
+
+guint
+shumate_tile_scheduler_get_max_in_flight (ShumateTileScheduler *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_TILE_SCHEDULER (self), 0);
+
+  return self->max_in_flight;
+}
+
+
+guint
+shumate_tile_scheduler_get_n_pending (ShumateTileScheduler *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_TILE_SCHEDULER (self), 0);
+
+  return self->pending->len;
+}
+
+
+guint
+shumate_tile_scheduler_get_n_in_flight (ShumateTileScheduler *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_TILE_SCHEDULER (self), 0);
+
+  return self->n_in_flight;
+}
+
+
+static void
+update_priority (ShumateTileScheduler *self,
+                 Request              *request)
+{
+  /* Convert the center to the request's zoom level, and measure from the
+   * center of the tile */
+  double scale = ldexp (1.0, request->pos.zoom - self->center_zoom);
+  double dx = request->pos.x + 0.5 - self->center_x * scale;
+  double dy = request->pos.y + 0.5 - self->center_y * scale;
+
+  request->zoom_distance = ABS (request->pos.zoom - self->center_zoom);
+  request->distance = dx * dx + dy * dy;
+}
+
+static int
+compare_requests (gconstpointer a,
+                  gconstpointer b)
+{
+  const Request *request_a = *(Request **)a;
+  const Request *request_b = *(Request **)b;
+
+  /* Sort in descending order of distance, so the closest request is last */
+  if (request_a->zoom_distance != request_b->zoom_distance)
+    return request_a->zoom_distance < request_b->zoom_distance ? 1 : -1;
+
+  if (request_a->distance != request_b->distance)
+    return request_a->distance < request_b->distance ? 1 : -1;
+
+  return 0;
+}
+
+/* Returns requests that were cancelled before they started */
+static void
+prune_cancelled (ShumateTileScheduler *self)
+{
+  for (int i = self->pending->len - 1; i >= 0; i --)
+    {
+      Request *request = g_ptr_array_index (self->pending, i);
+
+      if (g_task_return_error_if_cancelled (request->task))
+        g_ptr_array_remove_index (self->pending, i);
+    }
+}
+
+
+static void queue_dispatch (ShumateTileScheduler *self);
+
+static void
+on_tile_filled (GObject      *source_object,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GTask) task = user_data;
+  ShumateTileScheduler *self = g_task_get_source_object (task);
+  SourceSlots *slots = get_source_slots (SHUMATE_MAP_SOURCE (source_object));
+  g_autoptr(GPtrArray) waiting = NULL;
+  GError *error = NULL;
+
+  self->n_in_flight --;
+  slots->n_in_flight --;
+  queue_dispatch (self);
+
+  /* Let the other schedulers that are waiting for this source go ahead.
+   * Any that are still held back will wait again. */
+  waiting = g_steal_pointer (&slots->waiting);
+  slots->waiting = g_ptr_array_new_with_free_func (g_object_unref);
+  for (guint i = 0; i < waiting->len; i ++)
+    queue_dispatch (g_ptr_array_index (waiting, i));
+
+  if (shumate_map_source_fill_tile_finish (SHUMATE_MAP_SOURCE (source_object), res, &error))
+    g_task_return_boolean (task, TRUE);
+  else
+    g_task_return_error (task, error);
+}
+
+static void
+dispatch (ShumateTileScheduler *self)
+{
+  prune_cancelled (self);
+
+  if (self->needs_sort)
+    {
+      g_ptr_array_sort (self->pending, compare_requests);
+      self->needs_sort = FALSE;
+    }
+
+  while (self->pending->len > 0)
+    {
+      Request *request = g_ptr_array_index (self->pending, self->pending->len - 1);
+      SourceSlots *slots = get_source_slots (request->map_source);
+
+      if (slots->n_in_flight >= self->max_in_flight)
+        {
+          if (!g_ptr_array_find (slots->waiting, self, NULL))
+            g_ptr_array_add (slots->waiting, g_object_ref (self));
+          break;
+        }
+
+      g_ptr_array_steal_index (self->pending, self->pending->len - 1);
+      self->n_in_flight ++;
+      slots->n_in_flight ++;
+      shumate_map_source_fill_tile_async (request->map_source,
+                                          request->tile,
+                                          g_task_get_cancellable (request->task),
+                                          on_tile_filled,
+                                          g_steal_pointer (&request->task));
+      request_free (request);
+    }
+}
+
+static gboolean
+dispatch_in_idle_cb (gpointer user_data)
+{
+  ShumateTileScheduler *self = user_data;
+
+  self->dispatch_idle_id = 0;
+  dispatch (self);
+
+  return G_SOURCE_REMOVE;
+}
+
+static void
+queue_dispatch (ShumateTileScheduler *self)
+{
+  if (self->dispatch_idle_id > 0)
+    return;
+
+  self->dispatch_idle_id = g_idle_add (dispatch_in_idle_cb, self);
+  g_source_set_name_by_id (self->dispatch_idle_id, "[shumate] dispatch_in_idle_cb");
+}
+
+
+/*
+ * shumate_tile_scheduler_set_center:
+ * @self: a #ShumateTileScheduler
+ * @x: the X coordinate of the center of the viewport, in tiles
+ * @y: the Y coordinate of the center of the viewport, in tiles
+ * @zoom_level: the zoom level @x and @y are measured at
+ *
+ * Sets the point that tiles are prioritized around, and reorders all the
+ * requests that haven't started yet.
+ */
+void
+shumate_tile_scheduler_set_center (ShumateTileScheduler *self,
+                                   double                x,
+                                   double                y,
+                                   int                   zoom_level)
+{
+  g_return_if_fail (SHUMATE_IS_TILE_SCHEDULER (self));
+
+  if (self->center_x == x && self->center_y == y && self->center_zoom == zoom_level)
+    return;
+
+  self->center_x = x;
+  self->center_y = y;
+  self->center_zoom = zoom_level;
+
+  prune_cancelled (self);
+
+  for (guint i = 0; i < self->pending->len; i ++)
+    update_priority (self, g_ptr_array_index (self->pending, i));
+
+  self->needs_sort = TRUE;
+}
+
+
+/*
+ * shumate_tile_scheduler_fill_tile_async:
+ * @self: a #ShumateTileScheduler
+ * @map_source: the map source to fill the tile from
+ * @tile: the tile to fill
+ * @pos: the tile's position on the grid, which unlike the tile's coordinates
+ *   is not wrapped around the antimeridian
+ * @cancellable: (nullable): a #GCancellable
+ * @callback: a #GAsyncReadyCallback to execute upon completion
+ * @user_data: closure data for @callback
+ *
+ * Queues a call to shumate_map_source_fill_tile_async(). If the request is
+ * cancelled before it starts, the map source is never asked for the tile.
+ */
+void
+shumate_tile_scheduler_fill_tile_async (ShumateTileScheduler      *self,
+                                        ShumateMapSource          *map_source,
+                                        ShumateTile               *tile,
+                                        const ShumateGridPosition *pos,
+                                        GCancellable              *cancellable,
+                                        GAsyncReadyCallback        callback,
+                                        gpointer                   user_data)
+{
+  Request *request;
+
+  g_return_if_fail (SHUMATE_IS_TILE_SCHEDULER (self));
+  g_return_if_fail (SHUMATE_IS_MAP_SOURCE (map_source));
+  g_return_if_fail (SHUMATE_IS_TILE (tile));
+  g_return_if_fail (pos != NULL);
+  g_return_if_fail (cancellable == NULL || G_IS_CANCELLABLE (cancellable));
+
+  request = g_new0 (Request, 1);
+  request->task = g_task_new (self, cancellable, callback, user_data);
+  g_task_set_source_tag (request->task, shumate_tile_scheduler_fill_tile_async);
+  request->map_source = g_object_ref (map_source);
+  request->tile = g_object_ref (tile);
+  request->pos = *pos;
+
+  update_priority (self, request);
+
+  g_ptr_array_add (self->pending, request);
+  self->needs_sort = TRUE;
+
+  queue_dispatch (self);
+}
+
+
+gboolean
+shumate_tile_scheduler_fill_tile_finish (ShumateTileScheduler  *self,
+                                         GAsyncResult          *result,
+                                         GError               **error)
+{
+  g_return_val_if_fail (SHUMATE_IS_TILE_SCHEDULER (self), FALSE);
+  g_return_val_if_fail (g_task_is_valid (result, self), FALSE);
+
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
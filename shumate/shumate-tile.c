@@ -48,6 +48,9 @@ struct _ShumateTile
   gboolean fade_in;
 
   double scale_factor;
+  /* The font options of the widget the tile's labels are shown in. See
+   * shumate_tile_set_font_options(). */
+  cairo_font_options_t *font_options;
 
   GdkPaintable *paintable;
   GPtrArray *symbols;
@@ -173,6 +176,7 @@ shumate_tile_dispose (GObject *object)
 
   g_clear_object (&self->paintable);
   g_clear_pointer (&self->symbols, g_ptr_array_unref);
+  g_clear_pointer (&self->font_options, cairo_font_options_destroy);
 
   G_OBJECT_CLASS (shumate_tile_parent_class)->dispose (object);
 }
@@ -669,3 +673,27 @@ shumate_tile_get_symbols (ShumateTile *self)
 
   return self->symbols;
 }
+
+
+/* Sets the cairo font options, such as hinting and antialiasing, that the
+ * tile's labels are laid out with. Hinting changes glyph metrics, so these
+ * should match the widget the labels are drawn in. */
+void
+shumate_tile_set_font_options (ShumateTile                *self,
+                               const cairo_font_options_t *font_options)
+{
+  g_return_if_fail (SHUMATE_IS_TILE (self));
+
+  g_clear_pointer (&self->font_options, cairo_font_options_destroy);
+  if (font_options != NULL)
+    self->font_options = cairo_font_options_copy (font_options);
+}
+
+
+const cairo_font_options_t *
+shumate_tile_get_font_options (ShumateTile *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_TILE (self), NULL);
+
+  return self->font_options;
+}
@@ -19,12 +19,14 @@
 
 #include <glib-object.h>
 #include "shumate-vector-reader-iter.h"
-#include "vector/vector_tile.pb-c.h"
+#include "vector/shumate-vector-mvt-private.h"
 
 G_BEGIN_DECLS
 
-VectorTile__Tile__Layer *shumate_vector_reader_iter_get_layer_struct (ShumateVectorReaderIter *self);
-VectorTile__Tile__Feature *shumate_vector_reader_iter_get_feature_struct (ShumateVectorReaderIter *self);
+ShumateVectorMvtLayer *shumate_vector_reader_iter_get_layer_struct (ShumateVectorReaderIter *self);
+ShumateVectorMvtFeature *shumate_vector_reader_iter_get_feature_struct (ShumateVectorReaderIter *self);
+const guint32 *shumate_vector_reader_iter_get_feature_geometry (ShumateVectorReaderIter *self,
+                                                                guint                   *n_geometry);
 
 int shumate_vector_reader_iter_get_layer_index (ShumateVectorReaderIter *self);
 int shumate_vector_reader_iter_get_feature_index (ShumateVectorReaderIter *self);
@@ -54,9 +54,19 @@ struct _ShumateVectorReaderIter
 
   ShumateVectorReader *reader;
 
-  VectorTile__Tile__Layer *layer;
-  VectorTile__Tile__Feature *feature;
+  ShumateVectorMvtLayer *layer;
+  int layer_index;
+
+  /* Points to feature_data when there is a current feature */
+  ShumateVectorMvtFeature *feature;
+  ShumateVectorMvtFeature feature_data;
   int feature_index;
+
+  /* Decoded tags and geometry of the current feature. The geometry is only
+   * decoded when it is needed. */
+  GArray *tags;
+  GArray *geometry;
+  gboolean geometry_decoded;
 };
 
 enum {
@@ -111,6 +121,8 @@ shumate_vector_reader_iter_finalize (GObject *object)
   ShumateVectorReaderIter *self = SHUMATE_VECTOR_READER_ITER (object);
 
   g_clear_object (&self->reader);
+  g_clear_pointer (&self->tags, g_array_unref);
+  g_clear_pointer (&self->geometry, g_array_unref);
 
   G_OBJECT_CLASS (shumate_vector_reader_iter_parent_class)->finalize (object);
 }
@@ -144,6 +156,9 @@ shumate_vector_reader_iter_class_init (ShumateVectorReaderIterClass *klass)
 static void
 shumate_vector_reader_iter_init (ShumateVectorReaderIter *self)
 {
+  self->layer_index = -1;
+  self->tags = g_array_new (FALSE, FALSE, sizeof (guint32));
+  self->geometry = g_array_new (FALSE, FALSE, sizeof (guint32));
 }
 
 /**
@@ -178,7 +193,7 @@ shumate_vector_reader_iter_get_layer_count (ShumateVectorReaderIter *self)
 {
   g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), 0);
 
-  return self->reader->tile->n_layers;
+  return shumate_vector_mvt_get_n_layers (self->reader->tile);
 }
 
 /**
@@ -196,9 +211,10 @@ shumate_vector_reader_iter_read_layer (ShumateVectorReaderIter *self, int index)
   g_return_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self));
 
   g_return_if_fail (index >= 0);
-  g_return_if_fail (index < self->reader->tile->n_layers);
+  g_return_if_fail (index < shumate_vector_mvt_get_n_layers (self->reader->tile));
 
-  self->layer = self->reader->tile->layers[index];
+  self->layer = shumate_vector_mvt_get_layer (self->reader->tile, index);
+  self->layer_index = index;
   self->feature = NULL;
 }
 
@@ -224,22 +240,22 @@ gboolean
 shumate_vector_reader_iter_read_layer_by_name (ShumateVectorReaderIter *self,
                                                const char              *name)
 {
+  int index;
+
   g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), FALSE);
+  g_return_val_if_fail (name != NULL, FALSE);
 
   self->layer = NULL;
+  self->layer_index = -1;
   self->feature = NULL;
 
-  for (int i = 0; i < self->reader->tile->n_layers; i++)
-    {
-      if (strcmp (self->reader->tile->layers[i]->name, name) == 0)
-        {
-          self->layer = self->reader->tile->layers[i];
-          self->feature = NULL;
-          return TRUE;
-        }
-    }
+  index = shumate_vector_mvt_find_layer (self->reader->tile, name);
+  if (index < 0)
+    return FALSE;
 
-  return FALSE;
+  self->layer = shumate_vector_mvt_get_layer (self->reader->tile, index);
+  self->layer_index = index;
+  return TRUE;
 }
 
 /*< private >
@@ -257,15 +273,7 @@ shumate_vector_reader_iter_get_layer_index (ShumateVectorReaderIter *self)
 {
   g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), -1);
 
-  for (int i = 0; i < self->reader->tile->n_layers; i++)
-  {
-    if (self->layer == self->reader->tile->layers[i])
-    {
-      return i;
-    }
-  }
-
-  return -1;
+  return self->layer_index;
 }
 
 /**
@@ -338,6 +346,15 @@ shumate_vector_reader_iter_get_layer_extent (ShumateVectorReaderIter *self)
   return self->layer->extent;
 }
 
+static void
+read_current_feature (ShumateVectorReaderIter *self)
+{
+  /* A malformed feature is read as an empty one */
+  shumate_vector_mvt_layer_read_feature (self->layer, self->feature_index, &self->feature_data, self->tags);
+  self->feature = &self->feature_data;
+  self->geometry_decoded = FALSE;
+}
+
 /**
  * shumate_vector_reader_iter_read_feature:
  * @self: A #ShumateVectorReader.
@@ -360,8 +377,8 @@ shumate_vector_reader_iter_read_feature (ShumateVectorReaderIter *self,
   g_return_if_fail (self->layer != NULL);
   g_return_if_fail (index < self->layer->n_features);
 
-  self->feature = self->layer->features[index];
   self->feature_index = index;
+  read_current_feature (self);
 }
 
 /**
@@ -390,8 +407,8 @@ shumate_vector_reader_iter_next_feature (ShumateVectorReaderIter *self)
 
   if (next_index < self->layer->n_features)
     {
-      self->feature = self->layer->features[next_index];
       self->feature_index = next_index;
+      read_current_feature (self);
       return TRUE;
     }
   else
@@ -461,44 +478,50 @@ shumate_vector_reader_iter_get_feature_tag (ShumateVectorReaderIter *self,
 
   for (int i = 0; i + 1 < self->feature->n_tags; i += 2)
     {
-      if (strcmp (self->layer->keys[self->feature->tags[i]], key) == 0)
-        {
-          VectorTile__Tile__Value *v = self->layer->values[self->feature->tags[i + 1]];
+      guint key_idx = self->feature->tags[i];
+      ShumateVectorMvtValue v;
+
+      if (key_idx >= self->layer->n_keys)
+        continue;
 
-          if (v->has_int_value)
+      if (strcmp (self->layer->keys[key_idx], key) == 0)
+        {
+          if (!shumate_vector_mvt_layer_get_value (self->layer, self->feature->tags[i + 1], &v))
+            g_value_unset (value);
+          else if (v.has_int_value)
             {
               g_value_init (value, G_TYPE_INT64);
-              g_value_set_int64 (value, v->int_value);
+              g_value_set_int64 (value, v.int_value);
             }
-          else if (v->has_uint_value)
+          else if (v.has_uint_value)
             {
               g_value_init (value, G_TYPE_UINT64);
-              g_value_set_uint64 (value, v->uint_value);
+              g_value_set_uint64 (value, v.uint_value);
             }
-          else if (v->has_sint_value)
+          else if (v.has_sint_value)
             {
               g_value_init (value, G_TYPE_INT64);
-              g_value_set_int64 (value, v->sint_value);
+              g_value_set_int64 (value, v.sint_value);
             }
-          else if (v->has_float_value)
+          else if (v.has_float_value)
             {
               g_value_init (value, G_TYPE_FLOAT);
-              g_value_set_float (value, v->float_value);
+              g_value_set_float (value, v.float_value);
             }
-          else if (v->has_double_value)
+          else if (v.has_double_value)
             {
               g_value_init (value, G_TYPE_DOUBLE);
-              g_value_set_double (value, v->double_value);
+              g_value_set_double (value, v.double_value);
             }
-          else if (v->has_bool_value)
+          else if (v.has_bool_value)
             {
               g_value_init (value, G_TYPE_BOOLEAN);
-              g_value_set_boolean (value, v->bool_value);
+              g_value_set_boolean (value, v.bool_value);
             }
-          else if (v->string_value != NULL)
+          else if (v.has_string_value)
             {
               g_value_init (value, G_TYPE_STRING);
-              g_value_set_string (value, v->string_value);
+              g_value_take_string (value, g_strndup (v.string_value, v.string_len));
             }
           else
             g_value_unset (value);
@@ -530,10 +553,13 @@ shumate_vector_reader_iter_get_feature_keys (ShumateVectorReaderIter *self)
 
   g_return_val_if_fail (self->feature != NULL, NULL);
 
-  n_keys = self->feature->n_tags / 2;
-  keys = g_new (const char *, n_keys + 1);
-  for (int i = 0; i < n_keys; i ++)
-    keys[i] = self->layer->keys[self->feature->tags[i * 2]];
+  n_keys = 0;
+  keys = g_new (const char *, self->feature->n_tags / 2 + 1);
+  for (int i = 0; i + 1 < self->feature->n_tags; i += 2)
+    {
+      if (self->feature->tags[i] < self->layer->n_keys)
+        keys[n_keys++] = self->layer->keys[self->feature->tags[i]];
+    }
   keys[n_keys] = NULL;
 
   return keys;
@@ -556,6 +582,8 @@ shumate_vector_reader_iter_get_feature_geometry_type (ShumateVectorReaderIter *s
      we do, so this function contains a bunch of extra logic to determine whether
      the geometry data contains multiple geometries. */
 
+  guint n_geometry;
+
   g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), SHUMATE_GEOMETRY_TYPE_UNKNOWN);
 
   g_return_val_if_fail (self->feature != NULL, SHUMATE_GEOMETRY_TYPE_UNKNOWN);
@@ -566,15 +594,18 @@ shumate_vector_reader_iter_get_feature_geometry_type (ShumateVectorReaderIter *s
       return SHUMATE_GEOMETRY_TYPE_UNKNOWN;
 
     case VECTOR_TILE__TILE__GEOM_TYPE__POINT:
-      if (self->feature->n_geometry == 3)
+      shumate_vector_reader_iter_get_feature_geometry (self, &n_geometry);
+      if (n_geometry == 3)
         return SHUMATE_GEOMETRY_TYPE_POINT;
       else
         return SHUMATE_GEOMETRY_TYPE_MULTIPOINT;
 
     case VECTOR_TILE__TILE__GEOM_TYPE__LINESTRING:
       {
-        ShumateVectorGeometryIter iter = { .feature = self->feature };
+        ShumateVectorGeometryIter iter = { 0 };
         int move_tos = 0;
+
+        iter.geometry = shumate_vector_reader_iter_get_feature_geometry (self, &iter.n_geometry);
         while (shumate_vector_geometry_iter (&iter))
           {
             if (iter.op == 1)
@@ -594,11 +625,13 @@ shumate_vector_reader_iter_get_feature_geometry_type (ShumateVectorReaderIter *s
            in addition to its exterior ring; a multipolygon has multiple
            exterior rings. */
 
-        ShumateVectorGeometryIter iter = { .feature = self->feature };
+        ShumateVectorGeometryIter iter = { 0 };
         int prev_x = 0, prev_y = 0;
         double area = 0;
         int exterior_rings = 0;
 
+        iter.geometry = shumate_vector_reader_iter_get_feature_geometry (self, &iter.n_geometry);
+
         while (shumate_vector_geometry_iter (&iter))
           {
             /* See https://en.wikipedia.org/wiki/Shoelace_formula#Triangle_formula */
@@ -659,16 +692,21 @@ shumate_vector_reader_iter_get_feature_point (ShumateVectorReaderIter *self,
                                               double                  *x,
                                               double                  *y)
 {
+  const guint32 *geometry;
+  guint n_geometry;
+
   g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), FALSE);
 
   g_return_val_if_fail (self->feature != NULL, FALSE);
   g_return_val_if_fail (self->feature->type == VECTOR_TILE__TILE__GEOM_TYPE__POINT, FALSE);
-  g_return_val_if_fail (self->feature->n_geometry == 3, FALSE);
+
+  geometry = shumate_vector_reader_iter_get_feature_geometry (self, &n_geometry);
+  g_return_val_if_fail (n_geometry == 3, FALSE);
 
   if (x != NULL)
-    *x = zigzag (self->feature->geometry[1]);
+    *x = zigzag (geometry[1]);
   if (y != NULL)
-    *y = zigzag (self->feature->geometry[2]);
+    *y = zigzag (geometry[2]);
 
   return TRUE;
 }
@@ -709,7 +747,7 @@ shumate_vector_reader_iter_feature_contains_point (ShumateVectorReaderIter *self
   if (self->feature->type != VECTOR_TILE__TILE__GEOM_TYPE__POLYGON)
     return FALSE;
 
-  iter.feature = self->feature;
+  iter.geometry = shumate_vector_reader_iter_get_feature_geometry (self, &iter.n_geometry);
 
   /* See <https://web.archive.org/web/20130126163405/http://geomalgorithms.com/a03-_inclusion.html>.
      I chose the winding algorithm because it has fewer edge cases. */
@@ -766,11 +804,11 @@ shumate_vector_reader_iter_new (ShumateVectorReader *reader)
  * shumate_vector_reader_iter_get_layer_struct:
  * @self: A [class@VectorReaderIter]
  *
- * Gets the raw protobuf struct for the current layer.
+ * Gets the decoded struct for the current layer.
  *
- * Returns: (transfer none): a [struct@VectorTile__Tile__Layer]
+ * Returns: (transfer none): a #ShumateVectorMvtLayer
  */
-VectorTile__Tile__Layer *
+ShumateVectorMvtLayer *
 shumate_vector_reader_iter_get_layer_struct (ShumateVectorReaderIter *self)
 {
   g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), NULL);
@@ -780,13 +818,41 @@ shumate_vector_reader_iter_get_layer_struct (ShumateVectorReaderIter *self)
 /*< private >
  * shumate_vector_reader_iter_get_feature_struct:
  *
- * Gets the raw protobuf struct for the current feature.
+ * Gets the decoded struct for the current feature. It is only valid until
+ * the iterator moves to another feature.
  *
- * Returns: (transfer none): a [struct@VectorTile__Tile__Feature]
+ * Returns: (transfer none): a #ShumateVectorMvtFeature
  */
-VectorTile__Tile__Feature *
+ShumateVectorMvtFeature *
 shumate_vector_reader_iter_get_feature_struct (ShumateVectorReaderIter *self)
 {
   g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), NULL);
   return self->feature;
 }
+
+/*< private >
+ * shumate_vector_reader_iter_get_feature_geometry:
+ * @self: A [class@VectorReaderIter]
+ * @n_geometry: (out): the number of geometry commands and parameters
+ *
+ * Gets the geometry commands of the current feature, decoding them if
+ * needed. They are only valid until the iterator moves to another feature.
+ *
+ * Returns: (transfer none) (array length=n_geometry): the geometry
+ */
+const guint32 *
+shumate_vector_reader_iter_get_feature_geometry (ShumateVectorReaderIter *self,
+                                                 guint                   *n_geometry)
+{
+  g_return_val_if_fail (SHUMATE_IS_VECTOR_READER_ITER (self), NULL);
+  g_return_val_if_fail (self->feature != NULL, NULL);
+
+  if (!self->geometry_decoded)
+    {
+      shumate_vector_mvt_feature_decode_geometry (self->feature, self->geometry);
+      self->geometry_decoded = TRUE;
+    }
+
+  *n_geometry = self->geometry->len;
+  return (const guint32 *)self->geometry->data;
+}
@@ -18,7 +18,7 @@
 #pragma once
 
 #include "shumate-vector-reader.h"
-#include "vector/vector_tile.pb-c.h"
+#include "vector/shumate-vector-mvt-private.h"
 
 G_BEGIN_DECLS
 
@@ -26,7 +26,7 @@ struct _ShumateVectorReader
 {
   GObject parent_instance;
 
-  VectorTile__Tile *tile;
+  ShumateVectorMvt *tile;
 };
 
 ShumateVectorReaderIter *shumate_vector_reader_iter_new (ShumateVectorReader *reader);
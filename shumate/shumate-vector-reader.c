@@ -16,7 +16,6 @@
  */
 
 #include "shumate-vector-reader-private.h"
-#include "vector/vector_tile.pb-c.h"
 
 /**
  * ShumateVectorReader:
@@ -39,8 +38,7 @@ shumate_vector_reader_finalize (GObject *object)
 {
   ShumateVectorReader *self = SHUMATE_VECTOR_READER (object);
 
-  vector_tile__tile__free_unpacked (self->tile, NULL);
-  self->tile = NULL;
+  g_clear_pointer (&self->tile, shumate_vector_mvt_free);
 
   G_OBJECT_CLASS (shumate_vector_reader_parent_class)->finalize (object);
 }
@@ -72,11 +70,9 @@ ShumateVectorReader *
 shumate_vector_reader_new (GBytes *bytes)
 {
   g_autoptr(ShumateVectorReader) self = g_object_new(SHUMATE_TYPE_VECTOR_READER, NULL);
-  gconstpointer data;
-  gsize len;
 
-  data = g_bytes_get_data (bytes, &len);
-  self->tile = vector_tile__tile__unpack (NULL, len, data);
+  /* Layers and features are decoded as they are read */
+  self->tile = shumate_vector_mvt_new (bytes);
 
   if (self->tile == NULL)
     return NULL;
@@ -27,3 +27,11 @@ void shumate_vector_renderer_render (ShumateVectorRenderer  *self,
                                      ShumateGridPosition    *source_position,
                                      GdkPaintable          **paintable,
                                      GPtrArray             **symbols);
+
+void shumate_vector_renderer_set_priority_center (ShumateVectorRenderer *self,
+                                                  double                 x,
+                                                  double                 y,
+                                                  int                    zoom_level);
+
+void shumate_vector_renderer_set_batching (ShumateVectorRenderer *self,
+                                           gboolean               batching);
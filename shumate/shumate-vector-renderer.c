@@ -16,6 +16,7 @@
  */
 
 #include "shumate-vector-renderer-private.h"
+#include "shumate-memory-cache-private.h"
 #include "shumate-tile-downloader.h"
 #include "shumate-tile-private.h"
 #include "shumate-profiling-private.h"
@@ -31,12 +32,15 @@
 
 #include <json-glib/json-glib.h>
 #include <cairo/cairo.h>
+#include <math.h>
 
 #include "vector/shumate-vector-render-scope-private.h"
 #include "vector/shumate-vector-symbol-info-private.h"
 #include "vector/shumate-vector-utils-private.h"
 #include "vector/shumate-vector-layer-private.h"
 #include "vector/shumate-vector-index-private.h"
+#include "vector/shumate-vector-decoded-tile-private.h"
+#include "vector/shumate-vector-shaped-text-private.h"
 
 struct _ShumateVectorRenderer
 {
@@ -50,17 +54,59 @@ struct _ShumateVectorRenderer
 
   GHashTable *global_state;
   GHashTable *default_global_state;
+  /* Recently rendered global states, compared in full, to a unique ID for
+   * the render cache. global_state_lru holds the same states, most recently
+   * used first. See copy_global_state(). */
+  GHashTable *global_state_ids;
+  GQueue global_state_lru;
+  guint next_global_state_id;
   GMutex global_state_mutex;
 
   GThreadPool *thread_pool;
+  guint render_threads;
+
+  /* The tile position that queued render jobs are prioritized around. Only
+   * touched on the main thread, which is also the only thread that pushes to
+   * or sorts the thread pool queue. */
+  double priority_x, priority_y;
+  int priority_zoom;
+
+  /* See shumate_vector_renderer_set_batching() */
+  gboolean batching_disabled;
 
   char *style_json;
 
   GPtrArray *layers;
 
   ShumateVectorIndexDescription *index_description;
+
+  /* Rendered tiles, keyed by everything that affects the output. See
+   * get_render_cache_id(). */
+  ShumateMemoryCache *render_cache;
+  GMutex render_cache_mutex;
+
+  /* Decoded source tiles, shared by the tiles rendered from them when
+   * overzooming */
+  ShumateVectorDecodedTileCache *decoded_tiles;
 };
 
+/* Rendered tiles kept by the renderer itself, in addition to the per-layer
+ * memory cache. The memory limit is in megabytes. */
+#define RENDER_CACHE_SIZE 256
+#define RENDER_CACHE_MEMORY_LIMIT 128
+
+/* Enough for the tiles covering a large viewport, so that re-rendering them
+ * doesn't decode them again, plus a few that are still in use by render
+ * threads after a pan. */
+#define DECODED_TILE_CACHE_SIZE 64
+
+/* Global states that keep their render cache ID. Apps that toggle between a
+ * few states reuse their cached renders; ones that keep setting new values
+ * (an animated filter, say) don't grow the table forever. A state that is
+ * forgotten gets a new ID if it comes back, and its old renders age out of
+ * the render cache. */
+#define GLOBAL_STATE_IDS_SIZE 32
+
 
 static gboolean begin_render (ShumateVectorRenderer  *self,
                               GTask                  *task,
@@ -76,6 +122,7 @@ enum {
   PROP_0,
   PROP_STYLE_JSON,
   PROP_SPRITE_SHEET,
+  PROP_RENDER_THREADS,
   N_PROPS
 };
 
@@ -141,6 +188,9 @@ shumate_vector_renderer_finalize (GObject *object)
   g_clear_object (&self->data_source);
   g_clear_object (&self->sprites);
   g_clear_pointer (&self->index_description, shumate_vector_index_description_free);
+  g_clear_object (&self->render_cache);
+  g_mutex_clear (&self->render_cache_mutex);
+  g_clear_pointer (&self->decoded_tiles, shumate_vector_decoded_tile_cache_free);
 
   if (self->thread_pool)
     g_thread_pool_free (self->thread_pool, FALSE, FALSE);
@@ -149,6 +199,8 @@ shumate_vector_renderer_finalize (GObject *object)
 
   g_clear_pointer (&self->global_state, g_hash_table_unref);
   g_clear_pointer (&self->default_global_state, g_hash_table_unref);
+  /* This frees the links in global_state_lru too */
+  g_clear_pointer (&self->global_state_ids, g_hash_table_unref);
   g_mutex_clear (&self->global_state_mutex);
 
   G_OBJECT_CLASS (shumate_vector_renderer_parent_class)->finalize (object);
@@ -170,6 +222,9 @@ shumate_vector_renderer_get_property (GObject    *object,
     case PROP_SPRITE_SHEET:
       g_value_set_object (value, shumate_vector_renderer_get_sprite_sheet (self));
       break;
+    case PROP_RENDER_THREADS:
+      g_value_set_uint (value, self->render_threads);
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -193,6 +248,9 @@ shumate_vector_renderer_set_property (GObject      *object,
     case PROP_SPRITE_SHEET:
       shumate_vector_renderer_set_sprite_sheet (self, g_value_get_object (value));
       break;
+    case PROP_RENDER_THREADS:
+      shumate_vector_renderer_set_render_threads (self, g_value_get_uint (value));
+      break;
     default:
       G_OBJECT_WARN_INVALID_PROPERTY_ID (object, prop_id, pspec);
     }
@@ -250,6 +308,21 @@ shumate_vector_renderer_class_init (ShumateVectorRendererClass *klass)
                          SHUMATE_TYPE_VECTOR_SPRITE_SHEET,
                          G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
 
+  /**
+   * ShumateVectorRenderer:render-threads:
+   *
+   * The number of threads used to render tiles. If 0, one thread is used for
+   * each processor except the one running the main loop.
+   *
+   * Since: 1.7
+   */
+  properties[PROP_RENDER_THREADS] =
+    g_param_spec_uint ("render-threads",
+                       "render-threads",
+                       "render-threads",
+                       0, G_MAXINT, 0,
+                       G_PARAM_READWRITE | G_PARAM_EXPLICIT_NOTIFY | G_PARAM_STATIC_STRINGS);
+
   g_object_class_install_properties (object_class, N_PROPS, properties);
 }
 
@@ -527,7 +600,11 @@ shumate_vector_renderer_init (ShumateVectorRenderer *self)
 {
   g_mutex_init (&self->sprites_mutex);
   g_mutex_init (&self->global_state_mutex);
+  g_mutex_init (&self->render_cache_mutex);
   self->index_description = shumate_vector_index_description_new ();
+  self->render_cache = shumate_memory_cache_new_full (RENDER_CACHE_SIZE);
+  shumate_memory_cache_set_memory_limit (self->render_cache, RENDER_CACHE_MEMORY_LIMIT);
+  self->decoded_tiles = shumate_vector_decoded_tile_cache_new (DECODED_TILE_CACHE_SIZE);
 }
 
 
@@ -635,7 +712,79 @@ shumate_vector_renderer_set_sprite_sheet (ShumateVectorRenderer    *self,
   locker = g_mutex_locker_new (&self->sprites_mutex);
 
   if (g_set_object (&self->sprites, sprites))
-    g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_SPRITE_SHEET]);
+    {
+      /* Previously rendered tiles may use icons from the old sprite sheet */
+      g_mutex_lock (&self->render_cache_mutex);
+      shumate_memory_cache_clean (self->render_cache);
+      g_mutex_unlock (&self->render_cache_mutex);
+
+      g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_SPRITE_SHEET]);
+    }
+}
+
+
+static int
+get_n_render_threads (ShumateVectorRenderer *self)
+{
+  if (self->render_threads > 0)
+    return self->render_threads;
+
+  /* Leave a processor for the main thread */
+  return MAX (1, (int)g_get_num_processors () - 1);
+}
+
+
+/**
+ * shumate_vector_renderer_get_render_threads:
+ * @self: a [class@VectorRenderer]
+ *
+ * Gets the number of threads used to render tiles, as set by
+ * [method@VectorRenderer.set_render_threads].
+ *
+ * Returns: the number of render threads, or 0 for the default
+ *
+ * Since: 1.7
+ */
+guint
+shumate_vector_renderer_get_render_threads (ShumateVectorRenderer *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_VECTOR_RENDERER (self), 0);
+
+  return self->render_threads;
+}
+
+
+/**
+ * shumate_vector_renderer_set_render_threads:
+ * @self: a [class@VectorRenderer]
+ * @render_threads: the number of threads, or 0 for the default
+ *
+ * Sets the number of threads used to render tiles. The default, 0, uses one
+ * thread for each processor except the one running the main loop.
+ *
+ * Since: 1.7
+ */
+void
+shumate_vector_renderer_set_render_threads (ShumateVectorRenderer *self,
+                                            guint                  render_threads)
+{
+  g_return_if_fail (SHUMATE_IS_VECTOR_RENDERER (self));
+  g_return_if_fail (render_threads <= G_MAXINT);
+
+  if (self->render_threads == render_threads)
+    return;
+
+  self->render_threads = render_threads;
+
+  if (self->thread_pool != NULL)
+    {
+      g_autoptr(GError) error = NULL;
+
+      if (!g_thread_pool_set_max_threads (self->thread_pool, get_n_render_threads (self), &error))
+        g_critical ("Failed to resize thread pool: %s", error->message);
+    }
+
+  g_object_notify_by_pspec (G_OBJECT (self), properties[PROP_RENDER_THREADS]);
 }
 
 
@@ -973,24 +1122,141 @@ shumate_vector_renderer_fill_tile_finish (ShumateMapSource  *map_source,
   return g_task_propagate_boolean (G_TASK (result), error);
 }
 
-void
-shumate_vector_renderer_render (ShumateVectorRenderer  *self,
-                                ShumateTile            *tile,
-                                GBytes                 *tile_data,
-                                ShumateGridPosition    *source_position,
-                                GdkPaintable          **paintable,
-                                GPtrArray             **symbols)
+static guint
+global_state_hash (gconstpointer data)
+{
+  GHashTable *global_state = (GHashTable *)data;
+  GHashTableIter iter;
+  const char *key;
+  ShumateVectorValue *value;
+  guint hash = 0;
+
+  g_hash_table_iter_init (&iter, global_state);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&value))
+    {
+      /* Combine in an order-independent way, since hash table iteration order
+       * is arbitrary */
+      hash += g_str_hash (key) * 31 + shumate_vector_value_hash (value);
+    }
+
+  return hash;
+}
+
+static gboolean
+global_state_equal (gconstpointer a,
+                    gconstpointer b)
+{
+  GHashTable *global_state_a = (GHashTable *)a;
+  GHashTable *global_state_b = (GHashTable *)b;
+  GHashTableIter iter;
+  const char *key;
+  ShumateVectorValue *value;
+
+  if (g_hash_table_size (global_state_a) != g_hash_table_size (global_state_b))
+    return FALSE;
+
+  g_hash_table_iter_init (&iter, global_state_a);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&value))
+    {
+      ShumateVectorValue *other = g_hash_table_lookup (global_state_b, key);
+
+      if (other == NULL || !shumate_vector_value_equal (value, other))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+typedef struct {
+  guint id;
+  /* Link in global_state_lru, whose data is the state */
+  GList link;
+} GlobalStateId;
+
+/* Copies the global state, so that a render isn't affected by changes made
+ * while it runs. If @id is not NULL, it is set to an ID that is the same for
+ * every copy of an equal state and different for any other state, for use
+ * in render cache keys. 0 means there is no global state. */
+static GHashTable *
+copy_global_state (ShumateVectorRenderer *self,
+                   guint                 *id)
+{
+  g_autoptr(GMutexLocker) locker = NULL;
+  GHashTable *global_state;
+  GHashTableIter iter;
+  const char *key;
+  ShumateVectorValue *value;
+  GlobalStateId *state_id;
+
+  if (id != NULL)
+    *id = 0;
+
+  locker = g_mutex_locker_new (&self->global_state_mutex);
+
+  if (self->global_state == NULL)
+    return NULL;
+
+  global_state = g_hash_table_new_similar (self->global_state);
+
+  g_hash_table_iter_init (&iter, self->global_state);
+  while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&value))
+    g_hash_table_insert (global_state, g_strdup (key), shumate_vector_value_dup (value));
+
+  if (id == NULL)
+    return global_state;
+
+  /* States are compared in full rather than by hash, so that two different
+   * states can never share cached renders. IDs are never reused, so an
+   * evicted state can't be confused with a newer one either. */
+  if (self->global_state_ids == NULL)
+    self->global_state_ids = g_hash_table_new_full (global_state_hash, global_state_equal,
+                                                    (GDestroyNotify)g_hash_table_unref, g_free);
+
+  if (g_hash_table_lookup_extended (self->global_state_ids, global_state, NULL, (gpointer *)&state_id))
+    {
+      g_queue_unlink (&self->global_state_lru, &state_id->link);
+      g_queue_push_head_link (&self->global_state_lru, &state_id->link);
+    }
+  else
+    {
+      state_id = g_new0 (GlobalStateId, 1);
+      state_id->id = ++self->next_global_state_id;
+      state_id->link.data = g_hash_table_ref (global_state);
+      g_hash_table_insert (self->global_state_ids, state_id->link.data, state_id);
+      g_queue_push_head_link (&self->global_state_lru, &state_id->link);
+
+      if (self->global_state_lru.length > GLOBAL_STATE_IDS_SIZE)
+        {
+          GList *oldest = g_queue_pop_tail_link (&self->global_state_lru);
+          g_hash_table_remove (self->global_state_ids, oldest->data);
+        }
+    }
+
+  *id = state_id->id;
+
+  return global_state;
+}
+
+
+static void
+render_tile (ShumateVectorRenderer  *self,
+             ShumateTile            *tile,
+             GBytes                 *tile_data,
+             ShumateGridPosition    *source_position,
+             GHashTable             *global_state,
+             GdkPaintable          **paintable,
+             GPtrArray             **symbols)
 {
   SHUMATE_PROFILE_START ();
 
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
   cairo_surface_t *surface;
   g_autoptr(GPtrArray) symbol_list = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_symbol_info_unref);
   int texture_size;
   g_autofree char *profile_desc = NULL;
   g_autoptr(ShumateVectorSpriteSheet) sprites = NULL;
   g_autoptr(ShumateVectorReader) reader = NULL;
-  g_autoptr(GHashTable) global_state = NULL;
+  g_autoptr(ShumateVectorDecodedTile) decoded = NULL;
 
   g_assert (SHUMATE_IS_VECTOR_RENDERER (self));
   g_assert (SHUMATE_IS_TILE (tile));
@@ -1001,23 +1267,9 @@ shumate_vector_renderer_render (ShumateVectorRenderer  *self,
   sprites = g_object_ref (self->sprites);
   g_mutex_unlock (&self->sprites_mutex);
 
-  g_mutex_lock (&self->global_state_mutex);
-  if (self->global_state != NULL)
-    {
-      GHashTableIter iter;
-      const char *key;
-      ShumateVectorValue *value;
-
-      global_state = g_hash_table_new_similar (self->global_state);
-
-      g_hash_table_iter_init (&iter, self->global_state);
-      while (g_hash_table_iter_next (&iter, (gpointer *)&key, (gpointer *)&value))
-        g_hash_table_insert (global_state, g_strdup (key), shumate_vector_value_dup (value));
-    }
-  g_mutex_unlock (&self->global_state_mutex);
-
   texture_size = shumate_tile_get_size (tile);
   scope.scale_factor = shumate_tile_get_scale_factor (tile);
+  scope.font_options = shumate_tile_get_font_options (tile);
   scope.target_size = texture_size;
   scope.tile_x = shumate_tile_get_x (tile);
   scope.tile_y = shumate_tile_get_y (tile);
@@ -1027,6 +1279,9 @@ shumate_vector_renderer_render (ShumateVectorRenderer  *self,
   scope.index = NULL;
   scope.index_description = self->index_description;
   scope.global_state = global_state;
+  scope.zoom_values = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify)shumate_vector_value_free);
+  scope.batch_pending = FALSE;
+  scope.batch_disabled = self->batching_disabled;
 
   if (scope.zoom_level > source_position->zoom)
     {
@@ -1050,8 +1305,19 @@ shumate_vector_renderer_render (ShumateVectorRenderer  *self,
   scope.cr = cairo_create (surface);
   cairo_scale (scope.cr, scope.scale_factor, scope.scale_factor);
 
-  reader = shumate_vector_reader_new (tile_data);
-  scope.reader = shumate_vector_reader_iterate (reader);
+  /* The decoded tile outlives this render, so the other pieces of an
+   * overzoomed source tile and later renders of the same data (after a
+   * refresh, a global state change or a scale factor change) don't decode
+   * and index it again */
+  decoded = shumate_vector_decoded_tile_cache_lookup (self->decoded_tiles,
+                                                      source_position,
+                                                      tile_data,
+                                                      self->index_description);
+  g_set_object (&reader, shumate_vector_decoded_tile_get_reader (decoded));
+  scope.index = shumate_vector_decoded_tile_get_index (decoded);
+
+  if (reader != NULL)
+    scope.reader = shumate_vector_reader_iterate (reader);
 
   if (scope.reader != NULL)
     for (scope.layer_idx = 0; scope.layer_idx < self->layers->len; scope.layer_idx ++)
@@ -1063,13 +1329,47 @@ shumate_vector_renderer_render (ShumateVectorRenderer  *self,
   cairo_destroy (scope.cr);
   cairo_surface_destroy (surface);
   g_clear_object (&scope.reader);
-
-  g_clear_pointer (&scope.index, shumate_vector_index_free);
+  g_clear_pointer (&scope.zoom_values, g_hash_table_unref);
 
   profile_desc = g_strdup_printf ("(%d, %d) @ %f", scope.tile_x, scope.tile_y, scope.zoom_level);
   SHUMATE_PROFILE_END (profile_desc);
 }
 
+void
+shumate_vector_renderer_render (ShumateVectorRenderer  *self,
+                                ShumateTile            *tile,
+                                GBytes                 *tile_data,
+                                ShumateGridPosition    *source_position,
+                                GdkPaintable          **paintable,
+                                GPtrArray             **symbols)
+{
+  g_autoptr(GHashTable) global_state = copy_global_state (self, NULL);
+
+  render_tile (self, tile, tile_data, source_position, global_state, paintable, symbols);
+}
+
+static char *
+get_render_cache_id (ShumateVectorRenderer *self,
+                     ShumateTile           *tile,
+                     GBytes                *tile_data,
+                     ShumateGridPosition   *source_position,
+                     guint                  global_state_id)
+{
+  g_autofree char *data_checksum = g_compute_checksum_for_bytes (G_CHECKSUM_SHA256, tile_data);
+
+  /* The tile position is already part of the memory cache key, and the cache
+   * belongs to this renderer, so the style is the same for every entry.
+   * Everything else that affects the rendered output goes here. Tile data is
+   * identified by its SHA-256 digest, so that a refreshed tile isn't served
+   * from a stale render without keeping a copy of the data. */
+  return g_strdup_printf ("%u/%s/%d/%g/%u",
+                          global_state_id,
+                          data_checksum,
+                          source_position->zoom,
+                          shumate_tile_get_scale_factor (tile),
+                          shumate_vector_shaped_text_get_font_options_id (shumate_tile_get_font_options (tile)));
+}
+
 static gboolean
 render_job_finish (RenderJob *job)
 {
@@ -1103,14 +1403,39 @@ thread_func (RenderJob *job)
 
   if (!g_cancellable_is_cancelled (job->cancellable))
     {
-      shumate_vector_renderer_render (
-        self,
-        data->tile,
-        job->data,
-        &job->source_position,
-        &job->paintable,
-        &job->symbols
-      );
+      g_autoptr(GHashTable) global_state = NULL;
+      g_autofree char *cache_id = NULL;
+      guint global_state_id;
+      gboolean cached;
+      int x = shumate_tile_get_x (data->tile);
+      int y = shumate_tile_get_y (data->tile);
+      int zoom_level = shumate_tile_get_zoom_level (data->tile);
+
+      global_state = copy_global_state (self, &global_state_id);
+      cache_id = get_render_cache_id (self, data->tile, job->data, &job->source_position, global_state_id);
+
+      g_mutex_lock (&self->render_cache_mutex);
+      cached = shumate_memory_cache_lookup (self->render_cache, x, y, zoom_level, cache_id,
+                                            &job->paintable, &job->symbols);
+      g_mutex_unlock (&self->render_cache_mutex);
+
+      if (!cached)
+        {
+          render_tile (
+            self,
+            data->tile,
+            job->data,
+            &job->source_position,
+            global_state,
+            &job->paintable,
+            &job->symbols
+          );
+
+          g_mutex_lock (&self->render_cache_mutex);
+          shumate_memory_cache_store (self->render_cache, x, y, zoom_level, cache_id,
+                                      job->paintable, job->symbols);
+          g_mutex_unlock (&self->render_cache_mutex);
+        }
     }
 
   g_idle_add ((GSourceFunc)render_job_finish, job);
@@ -1118,9 +1443,109 @@ thread_func (RenderJob *job)
 
 static void
 chain_cancel (GCancellable *source,
-              GCancellable *dest)
+              RenderJob    *job)
+{
+  g_cancellable_cancel (job->cancellable);
+}
+
+static void
+get_job_priority (ShumateVectorRenderer *self,
+                  RenderJob             *job,
+                  int                   *zoom_distance,
+                  double                *distance)
+{
+  TaskData *data = g_task_get_task_data (job->task);
+  int zoom_level = shumate_tile_get_zoom_level (data->tile);
+
+  /* Same measure as ShumateTileScheduler: the zoom level distance first, then
+   * the distance from the center to the middle of the tile */
+  double scale = ldexp (1.0, zoom_level - self->priority_zoom);
+  double dx = shumate_tile_get_x (data->tile) + 0.5 - self->priority_x * scale;
+  double dy = shumate_tile_get_y (data->tile) + 0.5 - self->priority_y * scale;
+
+  *zoom_distance = ABS (zoom_level - self->priority_zoom);
+  *distance = dx * dx + dy * dy;
+}
+
+static int
+compare_render_jobs (gconstpointer a,
+                     gconstpointer b,
+                     gpointer      user_data)
+{
+  ShumateVectorRenderer *self = user_data;
+  RenderJob *job_a = (RenderJob *)a;
+  RenderJob *job_b = (RenderJob *)b;
+  gboolean cancelled_a, cancelled_b;
+  int zoom_distance_a, zoom_distance_b;
+  double distance_a, distance_b;
+
+  /* Cancelled jobs go first. They don't render anything, so this just gets
+   * them out of the queue rather than leaving them to wait behind tiles that
+   * are still visible. */
+  cancelled_a = g_cancellable_is_cancelled (job_a->cancellable);
+  cancelled_b = g_cancellable_is_cancelled (job_b->cancellable);
+  if (cancelled_a != cancelled_b)
+    return cancelled_a ? -1 : 1;
+
+  get_job_priority (self, job_a, &zoom_distance_a, &distance_a);
+  get_job_priority (self, job_b, &zoom_distance_b, &distance_b);
+
+  if (zoom_distance_a != zoom_distance_b)
+    return zoom_distance_a < zoom_distance_b ? -1 : 1;
+
+  if (distance_a != distance_b)
+    return distance_a < distance_b ? -1 : 1;
+
+  return 0;
+}
+
+/*
+ * shumate_vector_renderer_set_priority_center:
+ * @self: a [class@VectorRenderer]
+ * @x: the X coordinate of the center of the viewport, in tiles
+ * @y: the Y coordinate of the center of the viewport, in tiles
+ * @zoom_level: the zoom level @x and @y are measured at
+ *
+ * Sets the point that queued render jobs are prioritized around, and reorders
+ * the jobs that haven't started yet so the tiles closest to it render first.
+ */
+void
+shumate_vector_renderer_set_priority_center (ShumateVectorRenderer *self,
+                                             double                 x,
+                                             double                 y,
+                                             int                    zoom_level)
 {
-  g_cancellable_cancel (dest);
+  g_return_if_fail (SHUMATE_IS_VECTOR_RENDERER (self));
+
+  if (self->priority_x == x && self->priority_y == y && self->priority_zoom == zoom_level)
+    return;
+
+  self->priority_x = x;
+  self->priority_y = y;
+  self->priority_zoom = zoom_level;
+
+  /* Setting the sort function again re-sorts the queue */
+  if (self->thread_pool != NULL)
+    g_thread_pool_set_sort_function (self->thread_pool, compare_render_jobs, self);
+}
+
+/*
+ * shumate_vector_renderer_set_batching:
+ * @self: a [class@VectorRenderer]
+ * @batching: whether to draw consecutive features with the same paint as one
+ *   path
+ *
+ * Batching is on by default. Turning it off draws every feature by itself,
+ * like before batching existed, so that vector-render-benchmark can compare
+ * both in one run. Must be called before any tiles are rendered.
+ */
+void
+shumate_vector_renderer_set_batching (ShumateVectorRenderer *self,
+                                      gboolean               batching)
+{
+  g_return_if_fail (SHUMATE_IS_VECTOR_RENDERER (self));
+
+  self->batching_disabled = !batching;
 }
 
 static gboolean
@@ -1159,7 +1584,7 @@ begin_render (ShumateVectorRenderer  *self,
         (GFunc)thread_func,
         NULL,
         (GDestroyNotify)render_job_unref,
-        g_get_num_processors () - 1,
+        get_n_render_threads (self),
         FALSE,
         &error
       );
@@ -1168,6 +1593,8 @@ begin_render (ShumateVectorRenderer  *self,
           g_critical ("Failed to create thread pool: %s", error->message);
           return FALSE;
         }
+
+      g_thread_pool_set_sort_function (self->thread_pool, compare_render_jobs, self);
     }
 
   if (!g_thread_pool_push (self->thread_pool, job, &error))
@@ -46,6 +46,10 @@ ShumateVectorSpriteSheet *shumate_vector_renderer_get_sprite_sheet (ShumateVecto
 void shumate_vector_renderer_set_sprite_sheet (ShumateVectorRenderer    *self,
                                                ShumateVectorSpriteSheet *sprites);
 
+guint shumate_vector_renderer_get_render_threads (ShumateVectorRenderer *self);
+void shumate_vector_renderer_set_render_threads (ShumateVectorRenderer *self,
+                                                 guint                  render_threads);
+
 void shumate_vector_renderer_set_data_source (ShumateVectorRenderer *self,
                                               const char            *name,
                                               ShumateDataSource     *data_source);
@@ -73,6 +73,8 @@ G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (ShumateVectorValue, shumate_vector_value_unset
 
 GPtrArray *shumate_vector_value_get_array (ShumateVectorValue *self);
 
+void shumate_vector_value_set_string_len (ShumateVectorValue *self, const char *string, gsize len);
+
 void shumate_vector_value_set_image (ShumateVectorValue *self, ShumateVectorSprite *image, const char *image_name);
 gboolean shumate_vector_value_get_image (ShumateVectorValue *self, ShumateVectorSprite **image);
 
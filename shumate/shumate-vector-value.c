@@ -468,6 +468,19 @@ shumate_vector_value_set_string (ShumateVectorValue *self, const char *string)
   self->color_state = COLOR_UNSET;
 }
 
+/* Like shumate_vector_value_set_string(), for strings that are not
+ * NUL-terminated */
+void
+shumate_vector_value_set_string_len (ShumateVectorValue *self,
+                                     const char         *string,
+                                     gsize               len)
+{
+  shumate_vector_value_unset (self);
+  self->type = SHUMATE_VECTOR_VALUE_TYPE_STRING;
+  self->string = g_strndup (string, len);
+  self->color_state = COLOR_UNSET;
+}
+
 
 /**
  * shumate_vector_value_get_string:
@@ -55,7 +55,12 @@ gboolean shumate_vector_collision_query_point (ShumateVectorCollision *self,
                                                double                  x,
                                                double                  y,
                                                gpointer                tag);
+gpointer shumate_vector_collision_find_point (ShumateVectorCollision *self,
+                                              double                  x,
+                                              double                  y);
 
+void shumate_vector_collision_remove_tags (ShumateVectorCollision *self,
+                                           GHashTable             *tags);
 void shumate_vector_collision_clear (ShumateVectorCollision *self);
 
 void shumate_vector_collision_visualize (ShumateVectorCollision *self,
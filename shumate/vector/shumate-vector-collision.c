@@ -501,11 +501,12 @@ point_intersects_rect (Box    *box,
 }
 
 
-gboolean
-shumate_vector_collision_query_point (ShumateVectorCollision *self,
-                                      double                 x,
-                                      double                 y,
-                                      gpointer              tag)
+/* Finds a box containing the point, with the given tag if it isn't NULL */
+static Box *
+find_box (ShumateVectorCollision *self,
+          double                  x,
+          double                  y,
+          gpointer                tag)
 {
   for (int i = 0; i < self->bucket_rows_array->len; i ++)
     {
@@ -543,14 +544,80 @@ shumate_vector_collision_query_point (ShumateVectorCollision *self,
                       Box *b = &((Box*)col->boxes->data)[i];
 
                       if (point_intersects_rect (b, x, y) && (tag == NULL || tag == b->tag))
-                        return TRUE;
+                        return b;
                     }
                 }
             }
         }
     }
 
-  return FALSE;
+  return NULL;
+}
+
+
+gboolean
+shumate_vector_collision_query_point (ShumateVectorCollision *self,
+                                      double                 x,
+                                      double                 y,
+                                      gpointer              tag)
+{
+  return find_box (self, x, y, tag) != NULL;
+}
+
+
+/* Returns the tag of a box containing the point, or NULL if there is none */
+gpointer
+shumate_vector_collision_find_point (ShumateVectorCollision *self,
+                                     double                  x,
+                                     double                  y)
+{
+  Box *box = find_box (self, x, y, NULL);
+
+  return box != NULL ? box->tag : NULL;
+}
+
+
+/* Removes the committed boxes whose tag is in @tags. The bounding boxes of
+ * the tree nodes aren't shrunk, which only makes lookups a bit slower until
+ * the index is cleared. */
+void
+shumate_vector_collision_remove_tags (ShumateVectorCollision *self,
+                                      GHashTable             *tags)
+{
+  for (int i = 0; i < self->bucket_rows_array->len; i ++)
+    {
+      RTreeBucketRow *bucket_row = g_ptr_array_index (self->bucket_rows_array, i);
+
+      for (int j = 0; j < bucket_row->bucket_cols_array->len; j ++)
+        {
+          RTreeBucketCol *bucket_col = g_ptr_array_index (bucket_row->bucket_cols_array, j);
+
+          if (bucket_col->n_boxes == 0)
+            continue;
+
+          for (int r = 0; r < NODES; r ++)
+            {
+              for (int c = 0; c < NODES; c ++)
+                {
+                  RTreeCol *col = &bucket_col->rows[r].cols[c];
+
+                  if (col->boxes == NULL)
+                    continue;
+
+                  for (int k = col->boxes->len - 1; k >= 0; k --)
+                    {
+                      Box *b = &((Box*)col->boxes->data)[k];
+
+                      if (g_hash_table_contains (tags, b->tag))
+                        {
+                          g_array_remove_index_fast (col->boxes, k);
+                          bucket_col->n_boxes --;
+                        }
+                    }
+                }
+            }
+        }
+    }
 }
 
 
@@ -0,0 +1,46 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+#include "../shumate-utils-private.h"
+#include "../shumate-vector-reader.h"
+#include "shumate-vector-index-private.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ShumateVectorDecodedTile ShumateVectorDecodedTile;
+typedef struct _ShumateVectorDecodedTileCache ShumateVectorDecodedTileCache;
+
+ShumateVectorDecodedTile *shumate_vector_decoded_tile_ref (ShumateVectorDecodedTile *self);
+void shumate_vector_decoded_tile_unref (ShumateVectorDecodedTile *self);
+
+ShumateVectorReader *shumate_vector_decoded_tile_get_reader (ShumateVectorDecodedTile *self);
+ShumateVectorIndex *shumate_vector_decoded_tile_get_index (ShumateVectorDecodedTile *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ShumateVectorDecodedTile, shumate_vector_decoded_tile_unref)
+
+ShumateVectorDecodedTileCache *shumate_vector_decoded_tile_cache_new (guint size);
+void shumate_vector_decoded_tile_cache_free (ShumateVectorDecodedTileCache *self);
+
+ShumateVectorDecodedTile *shumate_vector_decoded_tile_cache_lookup (ShumateVectorDecodedTileCache *self,
+                                                                    const ShumateGridPosition     *pos,
+                                                                    GBytes                        *data,
+                                                                    ShumateVectorIndexDescription *index_description);
+
+G_END_DECLS
@@ -0,0 +1,283 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * When the map is zoomed in past the data source's maximum zoom level, every
+ * rendered tile is a piece of a larger source tile: 4 of them one level past
+ * the maximum, 16 two levels past, and so on. Decoding the source tile and
+ * building its indexes is a large part of rendering, and would otherwise be
+ * repeated for every one of those pieces.
+ *
+ * The same work would also be repeated whenever a tile is rendered again
+ * from the same data: after a refresh that didn't change it, a global state
+ * change, or a change of scale factor.
+ *
+ * ShumateVectorDecodedTileCache keeps the most recently used decoded tiles,
+ * keyed by source position and data, so all of those renders can share
+ * them. Decoded tiles are refcounted, so one can be evicted while a render
+ * thread is still using it.
+ *
+ * A decoded tile is shared between render threads, so it must not change
+ * once it has been decoded. The index is built for every layer up front,
+ * rather than lazily as the style layers ask for it, for that reason.
+ */
+
+#include "shumate-vector-decoded-tile-private.h"
+#include "shumate-vector-render-scope-private.h"
+
+struct _ShumateVectorDecodedTile
+{
+  guint ref_count;
+
+  ShumateGridPosition pos;
+  GBytes *data;
+
+  /* Held while decoding, so that other threads that want the same tile wait
+   * for it rather than decoding it again */
+  GMutex mutex;
+  gboolean decoded;
+
+  ShumateVectorReader *reader;
+  ShumateVectorIndex *index;
+};
+
+struct _ShumateVectorDecodedTileCache
+{
+  GMutex mutex;
+  guint size;
+
+  /* Most recently used first */
+  GQueue tiles;
+};
+
+
+static ShumateVectorDecodedTile *
+shumate_vector_decoded_tile_new (const ShumateGridPosition *pos,
+                                 GBytes                    *data)
+{
+  ShumateVectorDecodedTile *self = g_new0 (ShumateVectorDecodedTile, 1);
+
+  self->ref_count = 1;
+  self->pos = *pos;
+  self->data = g_bytes_ref (data);
+  g_mutex_init (&self->mutex);
+
+  return self;
+}
+
+ShumateVectorDecodedTile *
+shumate_vector_decoded_tile_ref (ShumateVectorDecodedTile *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (self->ref_count, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+  return self;
+}
+
+void
+shumate_vector_decoded_tile_unref (ShumateVectorDecodedTile *self)
+{
+  g_return_if_fail (self != NULL);
+  g_return_if_fail (self->ref_count);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      g_clear_pointer (&self->data, g_bytes_unref);
+      g_clear_object (&self->reader);
+      g_clear_pointer (&self->index, shumate_vector_index_free);
+      g_mutex_clear (&self->mutex);
+      g_free (self);
+    }
+}
+
+/*
+ * shumate_vector_decoded_tile_get_reader:
+ * @self: a #ShumateVectorDecodedTile
+ *
+ * Gets the reader for the tile's data.
+ *
+ * Returns: (transfer none) (nullable): the reader, or %NULL if the data could
+ * not be parsed
+ */
+ShumateVectorReader *
+shumate_vector_decoded_tile_get_reader (ShumateVectorDecodedTile *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return self->reader;
+}
+
+/*
+ * shumate_vector_decoded_tile_get_index:
+ * @self: a #ShumateVectorDecodedTile
+ *
+ * Gets the tile's index. It covers every layer in the tile and must not be
+ * modified.
+ *
+ * Returns: (transfer none) (nullable): the index, or %NULL if the data could
+ * not be parsed
+ */
+ShumateVectorIndex *
+shumate_vector_decoded_tile_get_index (ShumateVectorDecodedTile *self)
+{
+  g_return_val_if_fail (self != NULL, NULL);
+
+  return self->index;
+}
+
+static void
+decode (ShumateVectorDecodedTile      *self,
+        ShumateVectorIndexDescription *index_description)
+{
+  g_autoptr(ShumateVectorReaderIter) iter = NULL;
+  ShumateVectorRenderScope scope = { 0 };
+  g_autofree const char **layer_names = NULL;
+  guint n_names;
+  int n_layers;
+
+  self->reader = shumate_vector_reader_new (self->data);
+  if (self->reader == NULL)
+    return;
+
+  self->index = shumate_vector_index_new ();
+
+  iter = shumate_vector_reader_iterate (self->reader);
+  n_layers = shumate_vector_reader_iter_get_layer_count (iter);
+
+  scope.reader = iter;
+  scope.index = self->index;
+  scope.index_description = index_description;
+
+  /* Only read the layers the style has indexes for. Looking them up by name
+   * uses the tile's name table, so the other layers are never decoded. */
+  layer_names = shumate_vector_index_description_get_layers (index_description, &n_names);
+  for (guint i = 0; i < n_names; i ++)
+    {
+      if (!shumate_vector_reader_iter_read_layer_by_name (iter, layer_names[i]))
+        continue;
+
+      scope.source_layer_idx = shumate_vector_reader_iter_get_layer_index (iter);
+
+      if (shumate_vector_reader_iter_get_layer_feature_count (iter) > 0)
+        shumate_vector_render_scope_index_layer (&scope);
+    }
+
+  /* Make sure rendering never tries to index a layer again, since that would
+   * modify the index while other threads are reading it */
+  for (int i = 0; i < n_layers; i ++)
+    shumate_vector_index_add_layer (self->index, i);
+}
+
+ShumateVectorDecodedTileCache *
+shumate_vector_decoded_tile_cache_new (guint size)
+{
+  ShumateVectorDecodedTileCache *self;
+
+  g_return_val_if_fail (size > 0, NULL);
+
+  self = g_new0 (ShumateVectorDecodedTileCache, 1);
+  g_mutex_init (&self->mutex);
+  self->size = size;
+  g_queue_init (&self->tiles);
+
+  return self;
+}
+
+void
+shumate_vector_decoded_tile_cache_free (ShumateVectorDecodedTileCache *self)
+{
+  g_queue_clear_full (&self->tiles, (GDestroyNotify)shumate_vector_decoded_tile_unref);
+  g_mutex_clear (&self->mutex);
+  g_free (self);
+}
+
+static gboolean
+tile_matches (ShumateVectorDecodedTile  *tile,
+              const ShumateGridPosition *pos,
+              GBytes                    *data)
+{
+  if (tile->pos.x != pos->x || tile->pos.y != pos->y || tile->pos.zoom != pos->zoom)
+    return FALSE;
+
+  /* The data is usually the very same GBytes, since all the pieces are
+   * rendered from one data source request. A refreshed tile has new data. */
+  return tile->data == data || g_bytes_equal (tile->data, data);
+}
+
+/*
+ * shumate_vector_decoded_tile_cache_lookup:
+ * @self: a #ShumateVectorDecodedTileCache
+ * @pos: the position of the source tile
+ * @data: the source tile's data
+ * @index_description: the indexes to build
+ *
+ * Gets the decoded tile for @data, decoding it if it isn't in the cache. If
+ * another thread is already decoding it, waits for that thread to finish.
+ *
+ * All lookups on the same cache must use the same @index_description.
+ *
+ * Returns: (transfer full): the decoded tile
+ */
+ShumateVectorDecodedTile *
+shumate_vector_decoded_tile_cache_lookup (ShumateVectorDecodedTileCache *self,
+                                          const ShumateGridPosition     *pos,
+                                          GBytes                        *data,
+                                          ShumateVectorIndexDescription *index_description)
+{
+  ShumateVectorDecodedTile *tile = NULL;
+
+  g_return_val_if_fail (self != NULL, NULL);
+  g_return_val_if_fail (pos != NULL, NULL);
+  g_return_val_if_fail (data != NULL, NULL);
+
+  g_mutex_lock (&self->mutex);
+
+  for (GList *link = self->tiles.head; link != NULL; link = link->next)
+    {
+      if (tile_matches (link->data, pos, data))
+        {
+          tile = link->data;
+          g_queue_unlink (&self->tiles, link);
+          g_queue_push_head_link (&self->tiles, link);
+          break;
+        }
+    }
+
+  if (tile == NULL)
+    {
+      tile = shumate_vector_decoded_tile_new (pos, data);
+      g_queue_push_head (&self->tiles, tile);
+
+      while (self->tiles.length > self->size)
+        shumate_vector_decoded_tile_unref (g_queue_pop_tail (&self->tiles));
+    }
+
+  shumate_vector_decoded_tile_ref (tile);
+
+  g_mutex_unlock (&self->mutex);
+
+  g_mutex_lock (&tile->mutex);
+  if (!tile->decoded)
+    {
+      decode (tile, index_description);
+      tile->decoded = TRUE;
+    }
+  g_mutex_unlock (&tile->mutex);
+
+  return tile;
+}
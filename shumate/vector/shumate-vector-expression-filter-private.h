@@ -33,4 +33,6 @@ ShumateVectorExpression *shumate_vector_expression_filter_from_array_or_literal
                                                                                  GError                         **error);
 ShumateVectorExpression *shumate_vector_expression_filter_from_literal (ShumateVectorValue *value);
 
+ShumateVectorValue *shumate_vector_expression_filter_get_literal (ShumateVectorExpression *expr);
+
 G_END_DECLS
@@ -19,6 +19,7 @@
 #include "shumate-vector-renderer.h"
 #include "shumate-vector-expression-filter-private.h"
 #include "shumate-vector-expression-interpolate-private.h"
+#include "shumate-vector-expression-program-private.h"
 #include "shumate-vector-expression-type-private.h"
 #include "../shumate-vector-reader-iter.h"
 
@@ -36,6 +37,9 @@ struct _ShumateVectorExpressionFilter
 
   GPtrArray *expressions;
 
+  /* The atom for fast_get_key, fast_in.key or fast_eq.key */
+  GQuark fast_key_atom;
+
   union {
     ShumateVectorValue value;
     GPtrArray *format_parts;
@@ -92,6 +96,24 @@ shumate_vector_expression_filter_from_literal (ShumateVectorValue *value)
 }
 
 
+/* Returns the value of a literal expression, or NULL if the expression isn't
+ * a literal */
+ShumateVectorValue *
+shumate_vector_expression_filter_get_literal (ShumateVectorExpression *expr)
+{
+  ShumateVectorExpressionFilter *self;
+
+  if (!SHUMATE_IS_VECTOR_EXPRESSION_FILTER (expr))
+    return NULL;
+
+  self = (ShumateVectorExpressionFilter *)expr;
+  if (self->type != EXPR_LITERAL)
+    return NULL;
+
+  return &self->value;
+}
+
+
 ShumateVectorExpression *
 shumate_vector_expression_filter_from_array_or_literal (JsonNode                        *node,
                                                         ShumateVectorExpressionContext  *ctx,
@@ -535,6 +557,7 @@ shumate_vector_expression_filter_from_json_array (JsonArray
               expr = g_object_new (SHUMATE_TYPE_VECTOR_EXPRESSION_FILTER, NULL);
               ((ShumateVectorExpressionFilter *)expr)->type = EXPR_FAST_GET;
               ((ShumateVectorExpressionFilter *)expr)->fast_get_key = g_strdup (string);
+              ((ShumateVectorExpressionFilter *)expr)->fast_key_atom = shumate_vector_mvt_intern_key (string);
             }
         }
       else if (!(expr = shumate_vector_expression_filter_from_array_or_literal (arg, ctx, error)))
@@ -609,6 +632,7 @@ shumate_vector_expression_filter_from_format (const char *format, GError **error
       get_expr = g_object_new (SHUMATE_TYPE_VECTOR_EXPRESSION_FILTER, NULL);
       get_expr->type = EXPR_FAST_GET;
       get_expr->fast_get_key = g_strdup (parts[i]);
+      get_expr->fast_key_atom = shumate_vector_mvt_intern_key (parts[i]);
       g_ptr_array_add (self->expressions, g_steal_pointer (&get_expr));
       i ++;
     }
@@ -665,6 +689,7 @@ optimize (ShumateVectorExpressionFilter *self)
           case EXPR_FAST_GET:
             self->type = self->type == EXPR_EQ ? EXPR_FAST_EQ : EXPR_FAST_NE;
             self->fast_eq.key = g_strdup (key_expr->fast_get_key);
+            self->fast_key_atom = key_expr->fast_key_atom;
             shumate_vector_value_copy (&value_expr->value, &self->fast_eq.value);
             g_clear_pointer (&self->expressions, g_ptr_array_unref);
             break;
@@ -706,6 +731,7 @@ optimize (ShumateVectorExpressionFilter *self)
           {
             self->type = (self->type == EXPR_GET) ? EXPR_FAST_GET : (self->type == EXPR_HAS) ? EXPR_FAST_HAS : EXPR_FAST_NOT_HAS;
             self->fast_get_key = g_strdup (key);
+            self->fast_key_atom = shumate_vector_mvt_intern_key (key);
             g_clear_pointer (&self->expressions, g_ptr_array_unref);
           }
         break;
@@ -766,6 +792,7 @@ optimize (ShumateVectorExpressionFilter *self)
 
             self->type = self->type == EXPR_IN ? EXPR_FAST_IN : EXPR_FAST_NOT_IN;
             self->fast_in.key = g_strdup (key_expr->fast_get_key);
+            self->fast_key_atom = key_expr->fast_key_atom;
 
             self->fast_in.haystack = g_hash_table_new_full (
               (GHashFunc)shumate_vector_value_hash, (GEqualFunc)shumate_vector_value_equal, (GDestroyNotify)shumate_vector_value_free, NULL
@@ -805,6 +832,20 @@ optimize (ShumateVectorExpressionFilter *self)
       break;
     }
 
+  /* Fold operators whose arguments are all constant, unless they fail */
+  if (self->type != EXPR_LITERAL
+      && shumate_vector_expression_get_dependency ((ShumateVectorExpression *)self) == SHUMATE_VECTOR_DEPENDENCY_CONSTANT)
+    {
+      ShumateVectorRenderScope scope = { 0 };
+      g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
+
+      if (shumate_vector_expression_eval ((ShumateVectorExpression *)self, &scope, &value))
+        {
+          g_object_unref (self);
+          return shumate_vector_expression_filter_from_literal (&value);
+        }
+    }
+
   return (ShumateVectorExpression *)self;
 }
 
@@ -1652,7 +1693,7 @@ shumate_vector_expression_filter_eval (ShumateVectorExpression  *expr,
 
     case EXPR_GEOMETRY_TYPE:
       {
-        VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
+        ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
         ShumateGeometryType geometry_type;
 
         if (feature == NULL)
@@ -1685,7 +1726,7 @@ shumate_vector_expression_filter_eval (ShumateVectorExpression  *expr,
 
     case EXPR_ID:
       {
-        VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
+        ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
 
         if (!feature || !feature->has_id)
           shumate_vector_value_unset (out);
@@ -1940,19 +1981,19 @@ shumate_vector_expression_filter_eval (ShumateVectorExpression  *expr,
       inverted = TRUE;
       G_GNUC_FALLTHROUGH;
     case EXPR_FAST_HAS:
-      shumate_vector_render_scope_get_variable (scope, self->fast_get_key, &value);
+      shumate_vector_render_scope_get_variable_atom (scope, self->fast_key_atom, self->fast_get_key, &value);
       shumate_vector_value_set_boolean (out, !shumate_vector_value_is_null (&value) ^ inverted);
       return TRUE;
 
     case EXPR_FAST_GET:
-      shumate_vector_render_scope_get_variable (scope, self->fast_get_key, out);
+      shumate_vector_render_scope_get_variable_atom (scope, self->fast_key_atom, self->fast_get_key, out);
       return TRUE;
 
     case EXPR_FAST_NOT_IN:
       inverted = TRUE;
       G_GNUC_FALLTHROUGH;
     case EXPR_FAST_IN:
-      shumate_vector_render_scope_get_variable (scope, self->fast_in.key, &value);
+      shumate_vector_render_scope_get_variable_atom (scope, self->fast_key_atom, self->fast_in.key, &value);
       shumate_vector_value_set_boolean (out, g_hash_table_contains (self->fast_in.haystack, &value) ^ inverted);
       return TRUE;
 
@@ -1960,7 +2001,7 @@ shumate_vector_expression_filter_eval (ShumateVectorExpression  *expr,
       inverted = TRUE;
       G_GNUC_FALLTHROUGH;
     case EXPR_FAST_EQ:
-      shumate_vector_render_scope_get_variable (scope, self->fast_eq.key, &value);
+      shumate_vector_render_scope_get_variable_atom (scope, self->fast_key_atom, self->fast_eq.key, &value);
       shumate_vector_value_set_boolean (out, shumate_vector_value_equal (&value, &self->fast_eq.value) ^ inverted);
       return TRUE;
 
@@ -1969,7 +2010,7 @@ shumate_vector_expression_filter_eval (ShumateVectorExpression  *expr,
       G_GNUC_FALLTHROUGH;
     case EXPR_FAST_GEOMETRY_TYPE:
       {
-        VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
+        ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
         gboolean result = FALSE;
 
         if (feature == NULL)
@@ -2009,7 +2050,7 @@ shumate_vector_expression_filter_eval_bitset (ShumateVectorExpression  *expr,
                                               ShumateVectorIndexBitset *mask)
 {
   ShumateVectorExpressionFilter *self = (ShumateVectorExpressionFilter *)expr;
-  VectorTile__Tile__Layer *layer = shumate_vector_reader_iter_get_layer_struct (scope->reader);
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (scope->reader);
   ShumateVectorIndexBitset *bitset = NULL;
 
   switch (self->type)
@@ -2199,6 +2240,475 @@ shumate_vector_expression_filter_collect_indexes (ShumateVectorExpression
     }
 }
 
+static ShumateVectorDependency
+shumate_vector_expression_filter_get_dependency (ShumateVectorExpression *expr)
+{
+  ShumateVectorExpressionFilter *self = (ShumateVectorExpressionFilter *)expr;
+  ShumateVectorDependency dependency = SHUMATE_VECTOR_DEPENDENCY_CONSTANT;
+
+  switch (self->type)
+    {
+    case EXPR_LITERAL:
+      return SHUMATE_VECTOR_DEPENDENCY_CONSTANT;
+
+    case EXPR_ZOOM:
+      return SHUMATE_VECTOR_DEPENDENCY_ZOOM;
+
+    /* Operators that only depend on their arguments */
+    case EXPR_NOT:
+    case EXPR_NE:
+    case EXPR_EQ:
+    case EXPR_LT:
+    case EXPR_GT:
+    case EXPR_LE:
+    case EXPR_GE:
+    case EXPR_ALL:
+    case EXPR_ANY:
+    case EXPR_NONE:
+    case EXPR_CASE:
+    case EXPR_COALESCE:
+    case EXPR_MATCH:
+    case EXPR_CONCAT:
+    case EXPR_DOWNCASE:
+    case EXPR_UPCASE:
+    case EXPR_TO_BOOLEAN:
+    case EXPR_TO_COLOR:
+    case EXPR_TO_NUMBER:
+    case EXPR_TO_STRING:
+    case EXPR_TYPEOF:
+    case EXPR_AT:
+    case EXPR_INDEX_OF:
+    case EXPR_LENGTH:
+    case EXPR_SLICE:
+    case EXPR_SUB:
+    case EXPR_MUL:
+    case EXPR_DIV:
+    case EXPR_REM:
+    case EXPR_POW:
+    case EXPR_ADD:
+    case EXPR_ABS:
+    case EXPR_ACOS:
+    case EXPR_ASIN:
+    case EXPR_ATAN:
+    case EXPR_CEIL:
+    case EXPR_COS:
+    case EXPR_FLOOR:
+    case EXPR_LN:
+    case EXPR_LOG10:
+    case EXPR_LOG2:
+    case EXPR_MAX:
+    case EXPR_MIN:
+    case EXPR_ROUND:
+    case EXPR_SIN:
+    case EXPR_SQRT:
+    case EXPR_TAN:
+      if (self->expressions != NULL)
+        {
+          for (guint i = 0; i < self->expressions->len; i ++)
+            dependency = MAX (dependency, shumate_vector_expression_get_dependency (self->expressions->pdata[i]));
+        }
+
+      if (self->type == EXPR_MATCH)
+        {
+          GHashTableIter iter;
+          ShumateVectorExpression *output;
+
+          g_hash_table_iter_init (&iter, self->match_expressions);
+          while (g_hash_table_iter_next (&iter, NULL, (gpointer *)&output))
+            dependency = MAX (dependency, shumate_vector_expression_get_dependency (output));
+        }
+
+      return dependency;
+
+    /* Everything else reads the feature, or other state of the scope such as
+     * global state, sprites or the locale */
+    default:
+      return SHUMATE_VECTOR_DEPENDENCY_FEATURE;
+    }
+}
+
+static ShumateVectorOpcode
+get_opcode (ExpressionType type)
+{
+  switch (type)
+    {
+    case EXPR_ADD:
+      return OP_ADD;
+    case EXPR_SUB:
+      return OP_SUB;
+    case EXPR_MUL:
+      return OP_MUL;
+    case EXPR_DIV:
+      return OP_DIV;
+    case EXPR_REM:
+      return OP_REM;
+    case EXPR_POW:
+      return OP_POW;
+    case EXPR_MIN:
+      return OP_MIN;
+    case EXPR_MAX:
+      return OP_MAX;
+    case EXPR_ABS:
+      return OP_ABS;
+    case EXPR_ACOS:
+      return OP_ACOS;
+    case EXPR_ASIN:
+      return OP_ASIN;
+    case EXPR_ATAN:
+      return OP_ATAN;
+    case EXPR_CEIL:
+      return OP_CEIL;
+    case EXPR_COS:
+      return OP_COS;
+    case EXPR_FLOOR:
+      return OP_FLOOR;
+    case EXPR_LN:
+      return OP_LN;
+    case EXPR_LOG10:
+      return OP_LOG10;
+    case EXPR_LOG2:
+      return OP_LOG2;
+    case EXPR_ROUND:
+      return OP_ROUND;
+    case EXPR_SIN:
+      return OP_SIN;
+    case EXPR_SQRT:
+      return OP_SQRT;
+    case EXPR_TAN:
+      return OP_TAN;
+    case EXPR_LT:
+      return OP_LT;
+    case EXPR_GT:
+      return OP_GT;
+    case EXPR_LE:
+      return OP_LE;
+    case EXPR_GE:
+      return OP_GE;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+/* Compiles the operators that paint properties and filters are mostly made
+   of. Everything else, including the FAST_ variants, is left to the tree
+   evaluator, since those spend their time on strings and feature lookups
+   rather than on boxing values. */
+static gboolean
+shumate_vector_expression_filter_compile (ShumateVectorExpression         *expr,
+                                          ShumateVectorExpressionCompiler *compiler,
+                                          ShumateVectorRegister           *result)
+{
+  ShumateVectorExpressionFilter *self = (ShumateVectorExpressionFilter *)expr;
+  ShumateVectorExpression **expressions = NULL;
+  guint n_expressions = 0;
+  ShumateVectorCompilerMark mark;
+  ShumateVectorRegister a, b;
+
+  if (self->expressions)
+    {
+      expressions = (ShumateVectorExpression **)self->expressions->pdata;
+      n_expressions = self->expressions->len;
+    }
+
+  switch (self->type)
+    {
+    case EXPR_LITERAL:
+      *result = shumate_vector_expression_compiler_load (compiler, &self->value);
+      return TRUE;
+
+    case EXPR_ZOOM:
+      *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_NUMBER);
+      shumate_vector_expression_compiler_emit (compiler, OP_ZOOM, *result, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, 0);
+      return TRUE;
+
+    case EXPR_NOT:
+      mark = shumate_vector_expression_compiler_mark (compiler);
+      a = shumate_vector_expression_compiler_compile_as (compiler, expressions[0], SHUMATE_VECTOR_REGISTER_BOOLEAN);
+      shumate_vector_expression_compiler_reset (compiler, mark);
+
+      *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_BOOLEAN);
+      shumate_vector_expression_compiler_emit (compiler, OP_NOT, *result, a, SHUMATE_VECTOR_NO_REGISTER, 0);
+      return TRUE;
+
+    case EXPR_ANY:
+    case EXPR_ALL:
+    case EXPR_NONE:
+      {
+        /* Jump out at the first child that decides the result */
+        gboolean is_all = self->type == EXPR_ALL;
+        gboolean decided = self->type == EXPR_ANY;
+        g_autoptr(GArray) exits = g_array_new (FALSE, FALSE, sizeof (guint));
+        guint pc;
+
+        *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_BOOLEAN);
+        mark = shumate_vector_expression_compiler_mark (compiler);
+
+        for (guint i = 0; i < n_expressions; i ++)
+          {
+            a = shumate_vector_expression_compiler_compile_as (compiler, expressions[i], SHUMATE_VECTOR_REGISTER_BOOLEAN);
+            pc = shumate_vector_expression_compiler_emit (compiler, is_all ? OP_JUMP_IF_FALSE : OP_JUMP_IF_TRUE,
+                                                          SHUMATE_VECTOR_NO_REGISTER, a, SHUMATE_VECTOR_NO_REGISTER, 0);
+            g_array_append_val (exits, pc);
+            shumate_vector_expression_compiler_reset (compiler, mark);
+          }
+
+        shumate_vector_expression_compiler_emit (compiler, OP_LOAD_BOOLEAN, *result, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, !decided);
+        pc = shumate_vector_expression_compiler_emit (compiler, OP_JUMP, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, 0);
+
+        for (guint i = 0; i < exits->len; i ++)
+          shumate_vector_expression_compiler_set_target (compiler, g_array_index (exits, guint, i), shumate_vector_expression_compiler_get_pc (compiler));
+        shumate_vector_expression_compiler_emit (compiler, OP_LOAD_BOOLEAN, *result, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, decided);
+
+        shumate_vector_expression_compiler_set_target (compiler, pc, shumate_vector_expression_compiler_get_pc (compiler));
+        return TRUE;
+      }
+
+    case EXPR_EQ:
+    case EXPR_NE:
+      {
+        ShumateVectorOpcode op;
+
+        /* Comparisons with a collator are left to the tree evaluator */
+        if (n_expressions != 2)
+          return FALSE;
+
+        mark = shumate_vector_expression_compiler_mark (compiler);
+        a = shumate_vector_expression_compiler_compile (compiler, expressions[0]);
+        b = shumate_vector_expression_compiler_compile (compiler, expressions[1]);
+
+        if (a.kind != b.kind)
+          {
+            a = shumate_vector_expression_compiler_convert (compiler, a, SHUMATE_VECTOR_REGISTER_VALUE);
+            b = shumate_vector_expression_compiler_convert (compiler, b, SHUMATE_VECTOR_REGISTER_VALUE);
+          }
+
+        switch (a.kind)
+          {
+          case SHUMATE_VECTOR_REGISTER_NUMBER:
+            op = OP_EQ_NUMBER;
+            break;
+          case SHUMATE_VECTOR_REGISTER_BOOLEAN:
+            op = OP_EQ_BOOLEAN;
+            break;
+          case SHUMATE_VECTOR_REGISTER_COLOR:
+            op = OP_EQ_COLOR;
+            break;
+          case SHUMATE_VECTOR_REGISTER_VALUE:
+            op = OP_EQ_VALUE;
+            break;
+          default:
+            g_assert_not_reached ();
+          }
+
+        shumate_vector_expression_compiler_reset (compiler, mark);
+        *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_BOOLEAN);
+        shumate_vector_expression_compiler_emit (compiler, op, *result, a, b, 0);
+
+        if (self->type == EXPR_NE)
+          shumate_vector_expression_compiler_emit (compiler, OP_NOT, *result, *result, SHUMATE_VECTOR_NO_REGISTER, 0);
+
+        return TRUE;
+      }
+
+    case EXPR_LT:
+    case EXPR_GT:
+    case EXPR_LE:
+    case EXPR_GE:
+      if (n_expressions != 2)
+        return FALSE;
+
+      mark = shumate_vector_expression_compiler_mark (compiler);
+      a = shumate_vector_expression_compiler_compile (compiler, expressions[0]);
+      b = shumate_vector_expression_compiler_compile (compiler, expressions[1]);
+
+      if (a.kind == SHUMATE_VECTOR_REGISTER_NUMBER && b.kind == SHUMATE_VECTOR_REGISTER_NUMBER)
+        {
+          shumate_vector_expression_compiler_reset (compiler, mark);
+          *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_BOOLEAN);
+          shumate_vector_expression_compiler_emit (compiler, get_opcode (self->type), *result, a, b, 0);
+        }
+      else
+        {
+          /* Could be numbers or strings, so compare them at runtime */
+          a = shumate_vector_expression_compiler_convert (compiler, a, SHUMATE_VECTOR_REGISTER_VALUE);
+          b = shumate_vector_expression_compiler_convert (compiler, b, SHUMATE_VECTOR_REGISTER_VALUE);
+          shumate_vector_expression_compiler_reset (compiler, mark);
+          *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_BOOLEAN);
+          shumate_vector_expression_compiler_emit (compiler, OP_COMPARE_VALUE, *result, a, b, get_opcode (self->type));
+        }
+
+      return TRUE;
+
+    case EXPR_CASE:
+      {
+        ShumateVectorCompilerChoice choice;
+
+        shumate_vector_expression_compiler_begin_choice (compiler, &choice);
+        mark = shumate_vector_expression_compiler_mark (compiler);
+
+        for (guint i = 0; i + 1 < n_expressions; i += 2)
+          {
+            guint next;
+
+            a = shumate_vector_expression_compiler_compile_as (compiler, expressions[i], SHUMATE_VECTOR_REGISTER_BOOLEAN);
+            next = shumate_vector_expression_compiler_emit (compiler, OP_JUMP_IF_FALSE, SHUMATE_VECTOR_NO_REGISTER, a, SHUMATE_VECTOR_NO_REGISTER, 0);
+            shumate_vector_expression_compiler_reset (compiler, mark);
+
+            a = shumate_vector_expression_compiler_compile (compiler, expressions[i + 1]);
+            shumate_vector_expression_compiler_add_choice (compiler, &choice, a);
+            shumate_vector_expression_compiler_reset (compiler, mark);
+
+            shumate_vector_expression_compiler_set_target (compiler, next, shumate_vector_expression_compiler_get_pc (compiler));
+          }
+
+        if (n_expressions % 2 == 1)
+          {
+            a = shumate_vector_expression_compiler_compile (compiler, expressions[n_expressions - 1]);
+            shumate_vector_expression_compiler_add_choice (compiler, &choice, a);
+            shumate_vector_expression_compiler_reset (compiler, mark);
+          }
+        else
+          /* no case matched and there was no fallback */
+          shumate_vector_expression_compiler_emit (compiler, OP_FAIL, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, 0);
+
+        *result = shumate_vector_expression_compiler_end_choice (compiler, &choice);
+        return TRUE;
+      }
+
+    case EXPR_MATCH:
+      {
+        ShumateVectorCompilerChoice choice;
+        ShumateVectorMatchTable *table;
+        g_autoptr(GHashTable) branches = g_hash_table_new (NULL, NULL);
+        g_autoptr(GPtrArray) outputs = g_ptr_array_new ();
+        GHashTableIter iter;
+        ShumateVectorValue *label;
+        ShumateVectorExpression *output;
+
+        shumate_vector_expression_compiler_begin_choice (compiler, &choice);
+        mark = shumate_vector_expression_compiler_mark (compiler);
+
+        a = shumate_vector_expression_compiler_compile_as (compiler, expressions[0], SHUMATE_VECTOR_REGISTER_VALUE);
+
+        /* Several labels may share an output, which is compiled once */
+        table = g_new0 (ShumateVectorMatchTable, 1);
+        table->labels = g_hash_table_new_full ((GHashFunc)shumate_vector_value_hash,
+                                               (GEqualFunc)shumate_vector_value_equal,
+                                               (GDestroyNotify)shumate_vector_value_free,
+                                               NULL);
+        table->targets = g_array_new (FALSE, FALSE, sizeof (guint));
+
+        g_hash_table_iter_init (&iter, self->match_expressions);
+        while (g_hash_table_iter_next (&iter, (gpointer *)&label, (gpointer *)&output))
+          {
+            guint branch = GPOINTER_TO_UINT (g_hash_table_lookup (branches, output));
+
+            if (branch == 0)
+              {
+                g_ptr_array_add (outputs, output);
+                branch = outputs->len;
+                g_hash_table_insert (branches, output, GUINT_TO_POINTER (branch));
+              }
+
+            g_hash_table_insert (table->labels, shumate_vector_value_dup (label), GUINT_TO_POINTER (branch));
+          }
+
+        shumate_vector_expression_compiler_emit (compiler, OP_MATCH, SHUMATE_VECTOR_NO_REGISTER, a, SHUMATE_VECTOR_NO_REGISTER,
+                                                 shumate_vector_expression_compiler_add_match (compiler, table));
+        shumate_vector_expression_compiler_reset (compiler, mark);
+
+        for (guint i = 0; i < outputs->len; i ++)
+          {
+            guint target = shumate_vector_expression_compiler_get_pc (compiler);
+
+            g_array_append_val (table->targets, target);
+            a = shumate_vector_expression_compiler_compile (compiler, g_ptr_array_index (outputs, i));
+            shumate_vector_expression_compiler_add_choice (compiler, &choice, a);
+            shumate_vector_expression_compiler_reset (compiler, mark);
+          }
+
+        table->fallback = shumate_vector_expression_compiler_get_pc (compiler);
+        if (n_expressions == 2)
+          {
+            a = shumate_vector_expression_compiler_compile (compiler, expressions[1]);
+            shumate_vector_expression_compiler_add_choice (compiler, &choice, a);
+            shumate_vector_expression_compiler_reset (compiler, mark);
+          }
+        else
+          shumate_vector_expression_compiler_emit (compiler, OP_FAIL, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, 0);
+
+        *result = shumate_vector_expression_compiler_end_choice (compiler, &choice);
+        return TRUE;
+      }
+
+    case EXPR_ADD:
+    case EXPR_MUL:
+    case EXPR_MIN:
+    case EXPR_MAX:
+    case EXPR_SUB:
+    case EXPR_DIV:
+    case EXPR_REM:
+    case EXPR_POW:
+      mark = shumate_vector_expression_compiler_mark (compiler);
+      a = shumate_vector_expression_compiler_compile_as (compiler, expressions[0], SHUMATE_VECTOR_REGISTER_NUMBER);
+
+      if (n_expressions == 1)
+        {
+          if (self->type != EXPR_SUB)
+            {
+              *result = a;
+              return TRUE;
+            }
+
+          shumate_vector_expression_compiler_reset (compiler, mark);
+          *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_NUMBER);
+          shumate_vector_expression_compiler_emit (compiler, OP_NEGATE, *result, a, SHUMATE_VECTOR_NO_REGISTER, 0);
+          return TRUE;
+        }
+
+      b = shumate_vector_expression_compiler_compile_as (compiler, expressions[1], SHUMATE_VECTOR_REGISTER_NUMBER);
+      shumate_vector_expression_compiler_reset (compiler, mark);
+      *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_NUMBER);
+      shumate_vector_expression_compiler_emit (compiler, get_opcode (self->type), *result, a, b, 0);
+
+      /* Only +, *, min and max take more than two arguments */
+      for (guint i = 2; i < n_expressions; i ++)
+        {
+          mark = shumate_vector_expression_compiler_mark (compiler);
+          b = shumate_vector_expression_compiler_compile_as (compiler, expressions[i], SHUMATE_VECTOR_REGISTER_NUMBER);
+          shumate_vector_expression_compiler_emit (compiler, get_opcode (self->type), *result, *result, b, 0);
+          shumate_vector_expression_compiler_reset (compiler, mark);
+        }
+
+      return TRUE;
+
+    case EXPR_ABS:
+    case EXPR_ACOS:
+    case EXPR_ASIN:
+    case EXPR_ATAN:
+    case EXPR_CEIL:
+    case EXPR_COS:
+    case EXPR_FLOOR:
+    case EXPR_LN:
+    case EXPR_LOG10:
+    case EXPR_LOG2:
+    case EXPR_ROUND:
+    case EXPR_SIN:
+    case EXPR_SQRT:
+    case EXPR_TAN:
+      mark = shumate_vector_expression_compiler_mark (compiler);
+      a = shumate_vector_expression_compiler_compile_as (compiler, expressions[0], SHUMATE_VECTOR_REGISTER_NUMBER);
+      shumate_vector_expression_compiler_reset (compiler, mark);
+
+      *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_NUMBER);
+      shumate_vector_expression_compiler_emit (compiler, get_opcode (self->type), *result, a, SHUMATE_VECTOR_NO_REGISTER, 0);
+      return TRUE;
+
+    default:
+      return FALSE;
+    }
+}
+
 static void
 shumate_vector_expression_filter_class_init (ShumateVectorExpressionFilterClass *klass)
 {
@@ -2209,6 +2719,8 @@ shumate_vector_expression_filter_class_init (ShumateVectorExpressionFilterClass
   expr_class->eval = shumate_vector_expression_filter_eval;
   expr_class->eval_bitset = shumate_vector_expression_filter_eval_bitset;
   expr_class->collect_indexes = shumate_vector_expression_filter_collect_indexes;
+  expr_class->compile = shumate_vector_expression_filter_compile;
+  expr_class->get_dependency = shumate_vector_expression_filter_get_dependency;
 }
 
 
@@ -18,6 +18,7 @@
 #include "shumate-vector-renderer.h"
 #include "shumate-vector-expression-interpolate-private.h"
 #include "shumate-vector-expression-filter-private.h"
+#include "shumate-vector-expression-program-private.h"
 #include "shumate-vector-utils-private.h"
 
 typedef struct {
@@ -480,6 +481,112 @@ shumate_vector_expression_interpolate_eval (ShumateVectorExpression  *expr,
 }
 
 
+/* Only interpolations whose stops are all numbers or all colors are compiled,
+ * which covers nearly every zoom-dependent paint property. */
+static gboolean
+shumate_vector_expression_interpolate_compile (ShumateVectorExpression         *expr,
+                                               ShumateVectorExpressionCompiler *compiler,
+                                               ShumateVectorRegister           *result)
+{
+  ShumateVectorExpressionInterpolate *self = (ShumateVectorExpressionInterpolate *)expr;
+  Stop **stops = (Stop **)self->stops->pdata;
+  guint n_stops = self->stops->len;
+  g_autofree double *points = NULL;
+  g_autofree double *numbers = NULL;
+  g_autofree GdkRGBA *colors = NULL;
+  ShumateVectorInterpolation *interpolation;
+  ShumateVectorCompilerMark mark;
+  ShumateVectorRegister input;
+
+  if (n_stops == 0)
+    return FALSE;
+
+  points = g_new (double, n_stops);
+  numbers = g_new (double, n_stops);
+  colors = g_new (GdkRGBA, n_stops);
+
+  for (guint i = 0; i < n_stops; i ++)
+    {
+      ShumateVectorValue *literal = shumate_vector_expression_filter_get_literal (stops[i]->expr);
+      g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
+
+      if (literal == NULL)
+        return FALSE;
+
+      points[i] = stops[i]->point;
+
+      /* get_color() caches the parsed color in the value, so use a copy */
+      shumate_vector_value_copy (literal, &value);
+
+      if (numbers != NULL && !shumate_vector_value_get_number (&value, &numbers[i]))
+        g_clear_pointer (&numbers, g_free);
+
+      if (colors != NULL
+          && (value.type == SHUMATE_VECTOR_VALUE_TYPE_NUMBER
+              || !shumate_vector_value_get_color (&value, &colors[i])))
+        g_clear_pointer (&colors, g_free);
+
+      if (numbers == NULL && colors == NULL)
+        return FALSE;
+    }
+
+  interpolation = g_new0 (ShumateVectorInterpolation, 1);
+  interpolation->step = self->interpolation == STEP;
+  interpolation->base = self->interpolation == EXPONENTIAL ? self->base : 1.0;
+  interpolation->n_stops = n_stops;
+  interpolation->points = g_steal_pointer (&points);
+  interpolation->numbers = g_steal_pointer (&numbers);
+  interpolation->colors = g_steal_pointer (&colors);
+
+  mark = shumate_vector_expression_compiler_mark (compiler);
+  if (self->input != NULL)
+    input = shumate_vector_expression_compiler_compile_as (compiler, self->input, SHUMATE_VECTOR_REGISTER_NUMBER);
+  else
+    {
+      input = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_NUMBER);
+      shumate_vector_expression_compiler_emit (compiler, OP_ZOOM, input, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, 0);
+    }
+  shumate_vector_expression_compiler_reset (compiler, mark);
+
+  if (interpolation->numbers != NULL)
+    {
+      *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_NUMBER);
+      shumate_vector_expression_compiler_emit (compiler, OP_INTERPOLATE_NUMBER, *result, input, SHUMATE_VECTOR_NO_REGISTER,
+                                               shumate_vector_expression_compiler_add_interpolation (compiler, interpolation));
+    }
+  else
+    {
+      *result = shumate_vector_expression_compiler_alloc (compiler, SHUMATE_VECTOR_REGISTER_COLOR);
+      shumate_vector_expression_compiler_emit (compiler, OP_INTERPOLATE_COLOR, *result, input, SHUMATE_VECTOR_NO_REGISTER,
+                                               shumate_vector_expression_compiler_add_interpolation (compiler, interpolation));
+    }
+
+  return TRUE;
+}
+
+
+static ShumateVectorDependency
+shumate_vector_expression_interpolate_get_dependency (ShumateVectorExpression *expr)
+{
+  ShumateVectorExpressionInterpolate *self = (ShumateVectorExpressionInterpolate *)expr;
+  ShumateVectorDependency dependency;
+
+  /* Without an input, the stops are zoom levels */
+  if (self->input != NULL)
+    dependency = shumate_vector_expression_get_dependency (self->input);
+  else
+    dependency = SHUMATE_VECTOR_DEPENDENCY_ZOOM;
+
+  for (guint i = 0; i < self->stops->len; i ++)
+    {
+      Stop *stop = g_ptr_array_index (self->stops, i);
+      dependency = MAX (dependency, shumate_vector_expression_get_dependency (stop->expr));
+    }
+
+  return dependency;
+}
+
+
 static void
 shumate_vector_expression_interpolate_class_init (ShumateVectorExpressionInterpolateClass *klass)
 {
@@ -488,6 +595,8 @@ shumate_vector_expression_interpolate_class_init (ShumateVectorExpressionInterpo
 
   object_class->finalize = shumate_vector_expression_interpolate_finalize;
   expr_class->eval = shumate_vector_expression_interpolate_eval;
+  expr_class->compile = shumate_vector_expression_interpolate_compile;
+  expr_class->get_dependency = shumate_vector_expression_interpolate_get_dependency;
 }
 
 static void
@@ -35,6 +35,18 @@ void shumate_vector_expression_context_clear (ShumateVectorExpressionContext *ct
 
 G_DEFINE_AUTO_CLEANUP_CLEAR_FUNC (ShumateVectorExpressionContext, shumate_vector_expression_context_clear)
 
+typedef struct _ShumateVectorExpressionProgram ShumateVectorExpressionProgram;
+typedef struct _ShumateVectorExpressionCompiler ShumateVectorExpressionCompiler;
+typedef struct _ShumateVectorRegister ShumateVectorRegister;
+
+/* What an expression's value depends on, from least to most */
+typedef enum {
+  SHUMATE_VECTOR_DEPENDENCY_CONSTANT,
+  SHUMATE_VECTOR_DEPENDENCY_ZOOM,
+  /* The feature, or anything else in the render scope */
+  SHUMATE_VECTOR_DEPENDENCY_FEATURE,
+} ShumateVectorDependency;
+
 #define SHUMATE_TYPE_VECTOR_EXPRESSION (shumate_vector_expression_get_type())
 G_DECLARE_DERIVABLE_TYPE (ShumateVectorExpression, shumate_vector_expression, SHUMATE, VECTOR_EXPRESSION, GObject)
 
@@ -53,6 +65,12 @@ struct _ShumateVectorExpressionClass
   void (*collect_indexes) (ShumateVectorExpression       *self,
                            const char                    *layer_name,
                            ShumateVectorIndexDescription *index_description);
+
+  gboolean (*compile) (ShumateVectorExpression         *self,
+                       ShumateVectorExpressionCompiler *compiler,
+                       ShumateVectorRegister           *result);
+
+  ShumateVectorDependency (*get_dependency) (ShumateVectorExpression *self);
 };
 
 ShumateVectorExpression *shumate_vector_expression_from_json (JsonNode  *json,
@@ -60,6 +78,10 @@ ShumateVectorExpression *shumate_vector_expression_from_json (JsonNode  *json,
 ShumateVectorExpression *shumate_vector_expression_filter_from_format (const char *format,
                                                                        GError **error);
 
+ShumateVectorExpressionProgram *shumate_vector_expression_get_program (ShumateVectorExpression *self);
+
+ShumateVectorDependency shumate_vector_expression_get_dependency (ShumateVectorExpression *self);
+
 gboolean shumate_vector_expression_eval (ShumateVectorExpression  *self,
                                          ShumateVectorRenderScope *scope,
                                          ShumateVectorValue       *out);
@@ -0,0 +1,206 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include "shumate-vector-expression-private.h"
+
+G_BEGIN_DECLS
+
+typedef enum {
+  /* dest = constant */
+  OP_LOAD_NUMBER,
+  OP_LOAD_BOOLEAN,
+  OP_LOAD_COLOR,
+  OP_LOAD_VALUE,
+  OP_ZOOM,
+
+  /* dest = the tree evaluator's result for a subexpression */
+  OP_EVAL_TREE,
+
+  /* Conversions. The TO_ ones fail if the value has the wrong type. */
+  OP_TO_NUMBER,
+  OP_TO_BOOLEAN,
+  OP_TO_COLOR,
+  OP_BOX_NUMBER,
+  OP_BOX_BOOLEAN,
+  OP_BOX_COLOR,
+  OP_MOVE,
+  OP_MOVE_VALUE,
+
+  /* dest = a op b, on numbers */
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_REM,
+  OP_POW,
+  OP_MIN,
+  OP_MAX,
+
+  /* dest = op a, on numbers */
+  OP_NEGATE,
+  OP_ABS,
+  OP_ACOS,
+  OP_ASIN,
+  OP_ATAN,
+  OP_CEIL,
+  OP_COS,
+  OP_FLOOR,
+  OP_LN,
+  OP_LOG10,
+  OP_LOG2,
+  OP_ROUND,
+  OP_SIN,
+  OP_SQRT,
+  OP_TAN,
+
+  /* dest = a op b, as a boolean. OP_COMPARE_VALUE takes one of OP_LT, OP_GT,
+   * OP_LE or OP_GE in arg and compares values like the tree evaluator. */
+  OP_LT,
+  OP_GT,
+  OP_LE,
+  OP_GE,
+  OP_COMPARE_VALUE,
+  OP_EQ_NUMBER,
+  OP_EQ_BOOLEAN,
+  OP_EQ_COLOR,
+  OP_EQ_VALUE,
+  OP_NOT,
+
+  /* dest = interpolation arg evaluated at a */
+  OP_INTERPOLATE_NUMBER,
+  OP_INTERPOLATE_COLOR,
+
+  /* Control flow. Jump targets are in arg. */
+  OP_JUMP,
+  OP_JUMP_IF_TRUE,
+  OP_JUMP_IF_FALSE,
+  OP_MATCH,
+  OP_FAIL,
+} ShumateVectorOpcode;
+
+typedef enum {
+  SHUMATE_VECTOR_REGISTER_NUMBER,
+  SHUMATE_VECTOR_REGISTER_BOOLEAN,
+  SHUMATE_VECTOR_REGISTER_COLOR,
+  SHUMATE_VECTOR_REGISTER_VALUE,
+} ShumateVectorRegisterKind;
+
+/* Numbers, booleans and colors share one register file. Boxed values have
+ * their own, since they need to be initialized and freed. */
+struct _ShumateVectorRegister {
+  ShumateVectorRegisterKind kind;
+  guint index;
+};
+
+#define SHUMATE_VECTOR_NO_REGISTER ((ShumateVectorRegister) { SHUMATE_VECTOR_REGISTER_NUMBER, 0 })
+
+typedef struct {
+  guint n_registers;
+  guint n_values;
+} ShumateVectorCompilerMark;
+
+typedef struct {
+  gboolean step;
+  /* 1.0 for linear interpolation */
+  double base;
+  guint n_stops;
+  double *points;
+  double *numbers;
+  GdkRGBA *colors;
+} ShumateVectorInterpolation;
+
+typedef struct {
+  /* Label (ShumateVectorValue) -> index into targets + 1 */
+  GHashTable *labels;
+  GArray *targets;
+  guint fallback;
+} ShumateVectorMatchTable;
+
+/* Collects the result registers of the branches of a case or match
+ * expression into one register */
+typedef struct {
+  ShumateVectorRegister unboxed;
+  ShumateVectorRegister value;
+  GArray *branches;
+} ShumateVectorCompilerChoice;
+
+
+ShumateVectorExpressionProgram *shumate_vector_expression_program_compile (ShumateVectorExpression *expression);
+void shumate_vector_expression_program_free (ShumateVectorExpressionProgram *self);
+
+ShumateVectorRegisterKind shumate_vector_expression_program_get_result_kind (ShumateVectorExpressionProgram *self);
+
+gboolean shumate_vector_expression_program_eval (ShumateVectorExpressionProgram *self,
+                                                 ShumateVectorRenderScope       *scope,
+                                                 ShumateVectorValue             *out);
+gboolean shumate_vector_expression_program_eval_number (ShumateVectorExpressionProgram *self,
+                                                        ShumateVectorRenderScope       *scope,
+                                                        double                         *out);
+gboolean shumate_vector_expression_program_eval_boolean (ShumateVectorExpressionProgram *self,
+                                                         ShumateVectorRenderScope       *scope,
+                                                         gboolean                       *out);
+gboolean shumate_vector_expression_program_eval_color (ShumateVectorExpressionProgram *self,
+                                                       ShumateVectorRenderScope       *scope,
+                                                       GdkRGBA                        *out);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ShumateVectorExpressionProgram, shumate_vector_expression_program_free)
+
+
+ShumateVectorRegister shumate_vector_expression_compiler_compile (ShumateVectorExpressionCompiler *self,
+                                                                  ShumateVectorExpression         *expression);
+ShumateVectorRegister shumate_vector_expression_compiler_compile_as (ShumateVectorExpressionCompiler *self,
+                                                                     ShumateVectorExpression         *expression,
+                                                                     ShumateVectorRegisterKind        kind);
+ShumateVectorRegister shumate_vector_expression_compiler_convert (ShumateVectorExpressionCompiler *self,
+                                                                  ShumateVectorRegister            reg,
+                                                                  ShumateVectorRegisterKind        kind);
+ShumateVectorRegister shumate_vector_expression_compiler_load (ShumateVectorExpressionCompiler *self,
+                                                               ShumateVectorValue              *value);
+
+ShumateVectorRegister shumate_vector_expression_compiler_alloc (ShumateVectorExpressionCompiler *self,
+                                                                ShumateVectorRegisterKind        kind);
+ShumateVectorCompilerMark shumate_vector_expression_compiler_mark (ShumateVectorExpressionCompiler *self);
+void shumate_vector_expression_compiler_reset (ShumateVectorExpressionCompiler *self,
+                                               ShumateVectorCompilerMark        mark);
+
+guint shumate_vector_expression_compiler_emit (ShumateVectorExpressionCompiler *self,
+                                               ShumateVectorOpcode              op,
+                                               ShumateVectorRegister            dest,
+                                               ShumateVectorRegister            a,
+                                               ShumateVectorRegister            b,
+                                               guint                            arg);
+guint shumate_vector_expression_compiler_get_pc (ShumateVectorExpressionCompiler *self);
+void shumate_vector_expression_compiler_set_target (ShumateVectorExpressionCompiler *self,
+                                                    guint                            pc,
+                                                    guint                            target);
+
+guint shumate_vector_expression_compiler_add_interpolation (ShumateVectorExpressionCompiler *self,
+                                                            ShumateVectorInterpolation      *interpolation);
+guint shumate_vector_expression_compiler_add_match (ShumateVectorExpressionCompiler *self,
+                                                    ShumateVectorMatchTable         *table);
+
+void shumate_vector_expression_compiler_begin_choice (ShumateVectorExpressionCompiler *self,
+                                                      ShumateVectorCompilerChoice     *choice);
+void shumate_vector_expression_compiler_add_choice (ShumateVectorExpressionCompiler *self,
+                                                    ShumateVectorCompilerChoice     *choice,
+                                                    ShumateVectorRegister            reg);
+ShumateVectorRegister shumate_vector_expression_compiler_end_choice (ShumateVectorExpressionCompiler *self,
+                                                                     ShumateVectorCompilerChoice     *choice);
+
+G_END_DECLS
@@ -0,0 +1,1020 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+
+/*
+ * A compiled form of a style expression.
+ *
+ * Evaluating a ShumateVectorExpression tree calls a virtual method for every
+ * node and passes every intermediate result through a ShumateVectorValue.
+ * Paint properties are evaluated for every feature, and most of them are
+ * arithmetic, comparisons and interpolations over numbers and colors, so a
+ * lot of that work is overhead.
+ *
+ * A program is a flat array of instructions for a small register machine.
+ * Numbers, booleans and colors are kept unboxed in registers, and boxed
+ * values have a separate register file. Each expression class compiles
+ * itself through its compile() vfunc. Anything a class doesn't compile, such
+ * as string operations, is evaluated with the tree evaluator by an
+ * OP_EVAL_TREE instruction, so every expression can be compiled.
+ *
+ * The tree evaluator remains the reference: a program must produce the same
+ * result, and fail in the same cases, as shumate_vector_expression_eval().
+ * The one difference is that interpolated colors are always color values,
+ * where the tree evaluator returns the stop's literal (often a string) when
+ * the input is outside the stops.
+ *
+ * Registers are allocated like a stack. Once an instruction has consumed its
+ * operands, the caller resets the stack to where it was before compiling
+ * them, so the number of registers a program needs grows with the depth of
+ * the expression rather than its size.
+ */
+
+#include <math.h>
+#include "shumate-vector-expression-program-private.h"
+
+/* Registers live on the stack during evaluation. Expressions that need more
+ * are left to the tree evaluator. */
+#define MAX_REGISTERS 64
+#define MAX_VALUES 16
+
+typedef struct {
+  guint8 op;
+  guint8 dest;
+  guint8 a;
+  guint8 b;
+  guint32 arg;
+} Instruction;
+
+typedef union {
+  double number;
+  gboolean boolean;
+  GdkRGBA color;
+} Register;
+
+struct _ShumateVectorExpressionProgram
+{
+  GArray *code;
+
+  GArray *numbers;
+  GArray *colors;
+  GPtrArray *values;
+  GPtrArray *expressions;
+  GPtrArray *interpolations;
+  GPtrArray *matches;
+
+  guint n_registers;
+  guint n_values;
+  ShumateVectorRegister result;
+};
+
+struct _ShumateVectorExpressionCompiler
+{
+  ShumateVectorExpressionProgram *program;
+
+  guint n_registers;
+  guint n_values;
+  gboolean overflow;
+};
+
+typedef struct {
+  ShumateVectorRegister reg;
+  guint move_pc;
+  guint jump_pc;
+} ChoiceBranch;
+
+
+static void
+interpolation_free (ShumateVectorInterpolation *interpolation)
+{
+  g_free (interpolation->points);
+  g_free (interpolation->numbers);
+  g_free (interpolation->colors);
+  g_free (interpolation);
+}
+
+static void
+match_table_free (ShumateVectorMatchTable *table)
+{
+  g_clear_pointer (&table->labels, g_hash_table_unref);
+  g_clear_pointer (&table->targets, g_array_unref);
+  g_free (table);
+}
+
+static ShumateVectorExpressionProgram *
+program_new (void)
+{
+  ShumateVectorExpressionProgram *self = g_new0 (ShumateVectorExpressionProgram, 1);
+
+  self->code = g_array_new (FALSE, FALSE, sizeof (Instruction));
+  self->numbers = g_array_new (FALSE, FALSE, sizeof (double));
+  self->colors = g_array_new (FALSE, FALSE, sizeof (GdkRGBA));
+  self->values = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_value_free);
+  self->expressions = g_ptr_array_new_with_free_func (g_object_unref);
+  self->interpolations = g_ptr_array_new_with_free_func ((GDestroyNotify)interpolation_free);
+  self->matches = g_ptr_array_new_with_free_func ((GDestroyNotify)match_table_free);
+
+  return self;
+}
+
+void
+shumate_vector_expression_program_free (ShumateVectorExpressionProgram *self)
+{
+  g_clear_pointer (&self->code, g_array_unref);
+  g_clear_pointer (&self->numbers, g_array_unref);
+  g_clear_pointer (&self->colors, g_array_unref);
+  g_clear_pointer (&self->values, g_ptr_array_unref);
+  g_clear_pointer (&self->expressions, g_ptr_array_unref);
+  g_clear_pointer (&self->interpolations, g_ptr_array_unref);
+  g_clear_pointer (&self->matches, g_ptr_array_unref);
+  g_free (self);
+}
+
+
+/* Compiles an expression into a program. Returns NULL if the program
+ * wouldn't be any faster than the tree evaluator, because none of the
+ * expression could be compiled, or if it needs too many registers. */
+ShumateVectorExpressionProgram *
+shumate_vector_expression_program_compile (ShumateVectorExpression *expression)
+{
+  g_autoptr(ShumateVectorExpressionProgram) program = program_new ();
+  ShumateVectorExpressionCompiler compiler = { 0 };
+
+  g_assert (SHUMATE_IS_VECTOR_EXPRESSION (expression));
+
+  compiler.program = program;
+  program->result = shumate_vector_expression_compiler_compile (&compiler, expression);
+
+  if (compiler.overflow)
+    return NULL;
+
+  if (program->code->len == 1 && g_array_index (program->code, Instruction, 0).op == OP_EVAL_TREE)
+    return NULL;
+
+  return g_steal_pointer (&program);
+}
+
+
+ShumateVectorRegisterKind
+shumate_vector_expression_program_get_result_kind (ShumateVectorExpressionProgram *self)
+{
+  return self->result.kind;
+}
+
+
+ShumateVectorRegister
+shumate_vector_expression_compiler_alloc (ShumateVectorExpressionCompiler *self,
+                                          ShumateVectorRegisterKind        kind)
+{
+  ShumateVectorRegister reg = { kind, 0 };
+
+  if (kind == SHUMATE_VECTOR_REGISTER_VALUE)
+    {
+      reg.index = self->n_values ++;
+      self->program->n_values = MAX (self->program->n_values, self->n_values);
+    }
+  else
+    {
+      reg.index = self->n_registers ++;
+      self->program->n_registers = MAX (self->program->n_registers, self->n_registers);
+    }
+
+  if (self->program->n_registers > MAX_REGISTERS || self->program->n_values > MAX_VALUES)
+    {
+      /* Keep going so the caller doesn't have to check, but the program
+       * will be thrown away */
+      self->overflow = TRUE;
+      reg.index = 0;
+    }
+
+  return reg;
+}
+
+
+ShumateVectorCompilerMark
+shumate_vector_expression_compiler_mark (ShumateVectorExpressionCompiler *self)
+{
+  return (ShumateVectorCompilerMark) { self->n_registers, self->n_values };
+}
+
+
+/* Frees every register allocated since the mark was taken */
+void
+shumate_vector_expression_compiler_reset (ShumateVectorExpressionCompiler *self,
+                                          ShumateVectorCompilerMark        mark)
+{
+  self->n_registers = mark.n_registers;
+  self->n_values = mark.n_values;
+}
+
+
+guint
+shumate_vector_expression_compiler_emit (ShumateVectorExpressionCompiler *self,
+                                         ShumateVectorOpcode              op,
+                                         ShumateVectorRegister            dest,
+                                         ShumateVectorRegister            a,
+                                         ShumateVectorRegister            b,
+                                         guint                            arg)
+{
+  Instruction instruction = {
+    .op = op,
+    .dest = dest.index,
+    .a = a.index,
+    .b = b.index,
+    .arg = arg,
+  };
+
+  g_array_append_val (self->program->code, instruction);
+  return self->program->code->len - 1;
+}
+
+
+guint
+shumate_vector_expression_compiler_get_pc (ShumateVectorExpressionCompiler *self)
+{
+  return self->program->code->len;
+}
+
+
+void
+shumate_vector_expression_compiler_set_target (ShumateVectorExpressionCompiler *self,
+                                               guint                            pc,
+                                               guint                            target)
+{
+  g_assert (pc < self->program->code->len);
+  g_array_index (self->program->code, Instruction, pc).arg = target;
+}
+
+
+/* Takes ownership of the interpolation */
+guint
+shumate_vector_expression_compiler_add_interpolation (ShumateVectorExpressionCompiler *self,
+                                                      ShumateVectorInterpolation      *interpolation)
+{
+  g_ptr_array_add (self->program->interpolations, interpolation);
+  return self->program->interpolations->len - 1;
+}
+
+
+/* Takes ownership of the table. It stays valid, so the caller can fill in
+ * the targets as it compiles the branches. */
+guint
+shumate_vector_expression_compiler_add_match (ShumateVectorExpressionCompiler *self,
+                                              ShumateVectorMatchTable         *table)
+{
+  g_ptr_array_add (self->program->matches, table);
+  return self->program->matches->len - 1;
+}
+
+
+ShumateVectorRegister
+shumate_vector_expression_compiler_load (ShumateVectorExpressionCompiler *self,
+                                         ShumateVectorValue              *value)
+{
+  ShumateVectorRegister reg;
+
+  switch (value->type)
+    {
+    case SHUMATE_VECTOR_VALUE_TYPE_NUMBER:
+      reg = shumate_vector_expression_compiler_alloc (self, SHUMATE_VECTOR_REGISTER_NUMBER);
+      g_array_append_val (self->program->numbers, value->number);
+      shumate_vector_expression_compiler_emit (self, OP_LOAD_NUMBER, reg, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER,
+                                               self->program->numbers->len - 1);
+      return reg;
+
+    case SHUMATE_VECTOR_VALUE_TYPE_BOOLEAN:
+      reg = shumate_vector_expression_compiler_alloc (self, SHUMATE_VECTOR_REGISTER_BOOLEAN);
+      shumate_vector_expression_compiler_emit (self, OP_LOAD_BOOLEAN, reg, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER,
+                                               value->boolean);
+      return reg;
+
+    case SHUMATE_VECTOR_VALUE_TYPE_COLOR:
+      reg = shumate_vector_expression_compiler_alloc (self, SHUMATE_VECTOR_REGISTER_COLOR);
+      g_array_append_val (self->program->colors, value->color);
+      shumate_vector_expression_compiler_emit (self, OP_LOAD_COLOR, reg, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER,
+                                               self->program->colors->len - 1);
+      return reg;
+
+    default:
+      {
+        ShumateVectorValue *copy = shumate_vector_value_dup (value);
+        GdkRGBA color;
+
+        /* Strings remember whether they parse as a color, and copies keep
+         * that, so parse it once now rather than on every evaluation */
+        if (copy->type == SHUMATE_VECTOR_VALUE_TYPE_STRING)
+          shumate_vector_value_get_color (copy, &color);
+
+        reg = shumate_vector_expression_compiler_alloc (self, SHUMATE_VECTOR_REGISTER_VALUE);
+        g_ptr_array_add (self->program->values, copy);
+        shumate_vector_expression_compiler_emit (self, OP_LOAD_VALUE, reg, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER,
+                                                 self->program->values->len - 1);
+        return reg;
+      }
+    }
+}
+
+
+/* Compiles a subexpression, using the tree evaluator if its class can't be
+ * compiled. Compile vfuncs must not emit anything before deciding whether
+ * they can compile the expression. */
+ShumateVectorRegister
+shumate_vector_expression_compiler_compile (ShumateVectorExpressionCompiler *self,
+                                            ShumateVectorExpression         *expression)
+{
+  ShumateVectorExpressionClass *klass = SHUMATE_VECTOR_EXPRESSION_GET_CLASS (expression);
+  ShumateVectorRegister result;
+
+  if (klass->compile != NULL && klass->compile (expression, self, &result))
+    return result;
+
+  result = shumate_vector_expression_compiler_alloc (self, SHUMATE_VECTOR_REGISTER_VALUE);
+  g_ptr_array_add (self->program->expressions, g_object_ref (expression));
+  shumate_vector_expression_compiler_emit (self, OP_EVAL_TREE, result, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER,
+                                           self->program->expressions->len - 1);
+  return result;
+}
+
+
+/* Converts a register to another kind, failing at runtime where
+ * shumate_vector_value_get_number() and friends would */
+ShumateVectorRegister
+shumate_vector_expression_compiler_convert (ShumateVectorExpressionCompiler *self,
+                                            ShumateVectorRegister            reg,
+                                            ShumateVectorRegisterKind        kind)
+{
+  ShumateVectorRegister result;
+  ShumateVectorOpcode op;
+
+  if (reg.kind == kind)
+    return reg;
+
+  result = shumate_vector_expression_compiler_alloc (self, kind);
+
+  if (kind == SHUMATE_VECTOR_REGISTER_VALUE)
+    {
+      switch (reg.kind)
+        {
+        case SHUMATE_VECTOR_REGISTER_NUMBER:
+          op = OP_BOX_NUMBER;
+          break;
+        case SHUMATE_VECTOR_REGISTER_BOOLEAN:
+          op = OP_BOX_BOOLEAN;
+          break;
+        case SHUMATE_VECTOR_REGISTER_COLOR:
+          op = OP_BOX_COLOR;
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+    }
+  else if (reg.kind == SHUMATE_VECTOR_REGISTER_VALUE)
+    {
+      switch (kind)
+        {
+        case SHUMATE_VECTOR_REGISTER_NUMBER:
+          op = OP_TO_NUMBER;
+          break;
+        case SHUMATE_VECTOR_REGISTER_BOOLEAN:
+          op = OP_TO_BOOLEAN;
+          break;
+        case SHUMATE_VECTOR_REGISTER_COLOR:
+          op = OP_TO_COLOR;
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+    }
+  else
+    /* Numbers, booleans and colors never convert to each other */
+    op = OP_FAIL;
+
+  shumate_vector_expression_compiler_emit (self, op, result, reg, SHUMATE_VECTOR_NO_REGISTER, 0);
+  return result;
+}
+
+
+ShumateVectorRegister
+shumate_vector_expression_compiler_compile_as (ShumateVectorExpressionCompiler *self,
+                                               ShumateVectorExpression         *expression,
+                                               ShumateVectorRegisterKind        kind)
+{
+  ShumateVectorRegister reg = shumate_vector_expression_compiler_compile (self, expression);
+  return shumate_vector_expression_compiler_convert (self, reg, kind);
+}
+
+
+void
+shumate_vector_expression_compiler_begin_choice (ShumateVectorExpressionCompiler *self,
+                                                 ShumateVectorCompilerChoice     *choice)
+{
+  choice->unboxed = shumate_vector_expression_compiler_alloc (self, SHUMATE_VECTOR_REGISTER_NUMBER);
+  choice->value = shumate_vector_expression_compiler_alloc (self, SHUMATE_VECTOR_REGISTER_VALUE);
+  choice->branches = g_array_new (FALSE, FALSE, sizeof (ChoiceBranch));
+}
+
+
+/* Ends a branch whose result is in reg. The move is patched in
+ * shumate_vector_expression_compiler_end_choice(), once the kinds of all the
+ * branches are known. */
+void
+shumate_vector_expression_compiler_add_choice (ShumateVectorExpressionCompiler *self,
+                                               ShumateVectorCompilerChoice     *choice,
+                                               ShumateVectorRegister            reg)
+{
+  ChoiceBranch branch;
+
+  branch.reg = reg;
+  branch.move_pc = shumate_vector_expression_compiler_emit (self, OP_MOVE, SHUMATE_VECTOR_NO_REGISTER, reg, SHUMATE_VECTOR_NO_REGISTER, 0);
+  branch.jump_pc = shumate_vector_expression_compiler_emit (self, OP_JUMP, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, SHUMATE_VECTOR_NO_REGISTER, 0);
+  g_array_append_val (choice->branches, branch);
+}
+
+
+/* If every branch has the same kind, the result has that kind. Otherwise
+ * the branches are boxed. */
+ShumateVectorRegister
+shumate_vector_expression_compiler_end_choice (ShumateVectorExpressionCompiler *self,
+                                               ShumateVectorCompilerChoice     *choice)
+{
+  ShumateVectorRegisterKind kind = SHUMATE_VECTOR_REGISTER_VALUE;
+  gboolean uniform = TRUE;
+  ShumateVectorRegister result;
+  guint end = shumate_vector_expression_compiler_get_pc (self);
+
+  for (guint i = 0; i < choice->branches->len; i ++)
+    {
+      ChoiceBranch *branch = &g_array_index (choice->branches, ChoiceBranch, i);
+
+      if (i == 0)
+        kind = branch->reg.kind;
+      else if (branch->reg.kind != kind)
+        uniform = FALSE;
+    }
+
+  if (uniform && kind != SHUMATE_VECTOR_REGISTER_VALUE)
+    {
+      result = choice->unboxed;
+      result.kind = kind;
+    }
+  else
+    result = choice->value;
+
+  for (guint i = 0; i < choice->branches->len; i ++)
+    {
+      ChoiceBranch *branch = &g_array_index (choice->branches, ChoiceBranch, i);
+      Instruction *move = &g_array_index (self->program->code, Instruction, branch->move_pc);
+
+      move->dest = result.index;
+
+      switch (branch->reg.kind)
+        {
+        case SHUMATE_VECTOR_REGISTER_VALUE:
+          move->op = OP_MOVE_VALUE;
+          break;
+        case SHUMATE_VECTOR_REGISTER_NUMBER:
+          move->op = result.kind == SHUMATE_VECTOR_REGISTER_VALUE ? OP_BOX_NUMBER : OP_MOVE;
+          break;
+        case SHUMATE_VECTOR_REGISTER_BOOLEAN:
+          move->op = result.kind == SHUMATE_VECTOR_REGISTER_VALUE ? OP_BOX_BOOLEAN : OP_MOVE;
+          break;
+        case SHUMATE_VECTOR_REGISTER_COLOR:
+          move->op = result.kind == SHUMATE_VECTOR_REGISTER_VALUE ? OP_BOX_COLOR : OP_MOVE;
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+
+      shumate_vector_expression_compiler_set_target (self, branch->jump_pc, end);
+    }
+
+  g_clear_pointer (&choice->branches, g_array_unref);
+  return result;
+}
+
+
+static double
+lerp_double (double a, double b, double pos)
+{
+  return (b - a) * pos + a;
+}
+
+/* Finds the stops on either side of the input and how far between them it
+ * is, the same way the tree evaluator does. If the input is outside the
+ * stops, or this is a step function, *last == *next. */
+static void
+find_stops (ShumateVectorInterpolation *self,
+            double                      input,
+            guint                      *last,
+            guint                      *next,
+            double                     *pos)
+{
+  double *points = self->points;
+
+  *pos = 0;
+
+  if (input < points[0])
+    {
+      *last = *next = 0;
+      return;
+    }
+
+  for (guint i = 1; i < self->n_stops; i ++)
+    {
+      if (points[i - 1] <= input && input < points[i])
+        {
+          *last = i - 1;
+
+          if (self->step)
+            *next = i - 1;
+          else
+            {
+              *next = i;
+
+              if (self->base == 1.0)
+                *pos = (input - points[i - 1]) / (points[i] - points[i - 1]);
+              else
+                *pos = (pow (self->base, input - points[i - 1]) - 1.0) / (pow (self->base, points[i] - points[i - 1]) - 1.0);
+            }
+
+          return;
+        }
+    }
+
+  *last = *next = self->n_stops - 1;
+}
+
+static gboolean
+compare_values (ShumateVectorValue *a,
+                ShumateVectorValue *b,
+                int                *cmp)
+{
+  double number, number2;
+  const char *str, *str2;
+
+  if (shumate_vector_value_get_number (a, &number))
+    {
+      if (!shumate_vector_value_get_number (b, &number2))
+        return FALSE;
+
+      *cmp = number > number2 ? 1 : number < number2 ? -1 : 0;
+      return TRUE;
+    }
+  else if (shumate_vector_value_get_string (a, &str))
+    {
+      if (!shumate_vector_value_get_string (b, &str2))
+        return FALSE;
+
+      *cmp = g_utf8_collate (str, str2);
+      return TRUE;
+    }
+  else
+    return FALSE;
+}
+
+static gboolean
+test_comparison (ShumateVectorOpcode op,
+                 int                 cmp)
+{
+  switch (op)
+    {
+    case OP_LT:
+      return cmp < 0;
+    case OP_GT:
+      return cmp > 0;
+    case OP_LE:
+      return cmp <= 0;
+    case OP_GE:
+      return cmp >= 0;
+    default:
+      g_assert_not_reached ();
+    }
+}
+
+static gboolean
+run (ShumateVectorExpressionProgram *self,
+     ShumateVectorRenderScope       *scope,
+     Register                       *registers,
+     ShumateVectorValue             *values)
+{
+  const Instruction *code = (const Instruction *)self->code->data;
+  guint n_code = self->code->len;
+  guint pc = 0;
+
+  while (pc < n_code)
+    {
+      const Instruction *ins = &code[pc ++];
+      Register *dest = &registers[ins->dest];
+      Register *a = &registers[ins->a];
+      Register *b = &registers[ins->b];
+      double number;
+      int cmp;
+
+      switch ((ShumateVectorOpcode)ins->op)
+        {
+        case OP_LOAD_NUMBER:
+          dest->number = g_array_index (self->numbers, double, ins->arg);
+          break;
+        case OP_LOAD_BOOLEAN:
+          dest->boolean = ins->arg;
+          break;
+        case OP_LOAD_COLOR:
+          dest->color = g_array_index (self->colors, GdkRGBA, ins->arg);
+          break;
+        case OP_LOAD_VALUE:
+          shumate_vector_value_copy (g_ptr_array_index (self->values, ins->arg), &values[ins->dest]);
+          break;
+        case OP_ZOOM:
+          dest->number = scope->zoom_level;
+          break;
+
+        case OP_EVAL_TREE:
+          shumate_vector_value_unset (&values[ins->dest]);
+          if (!shumate_vector_expression_eval (g_ptr_array_index (self->expressions, ins->arg), scope, &values[ins->dest]))
+            return FALSE;
+          break;
+
+        case OP_TO_NUMBER:
+          if (!shumate_vector_value_get_number (&values[ins->a], &dest->number))
+            return FALSE;
+          break;
+        case OP_TO_BOOLEAN:
+          if (!shumate_vector_value_get_boolean (&values[ins->a], &dest->boolean))
+            return FALSE;
+          break;
+        case OP_TO_COLOR:
+          if (!shumate_vector_value_get_color (&values[ins->a], &dest->color))
+            return FALSE;
+          break;
+        case OP_BOX_NUMBER:
+          shumate_vector_value_set_number (&values[ins->dest], a->number);
+          break;
+        case OP_BOX_BOOLEAN:
+          shumate_vector_value_set_boolean (&values[ins->dest], a->boolean);
+          break;
+        case OP_BOX_COLOR:
+          shumate_vector_value_set_color (&values[ins->dest], &a->color);
+          break;
+        case OP_MOVE:
+          *dest = *a;
+          break;
+        case OP_MOVE_VALUE:
+          if (ins->dest != ins->a)
+            {
+              shumate_vector_value_unset (&values[ins->dest]);
+              shumate_vector_value_steal (&values[ins->a], &values[ins->dest]);
+            }
+          break;
+
+        case OP_ADD:
+          dest->number = a->number + b->number;
+          break;
+        case OP_SUB:
+          dest->number = a->number - b->number;
+          break;
+        case OP_MUL:
+          dest->number = a->number * b->number;
+          break;
+        case OP_DIV:
+          if (b->number == 0)
+            dest->number = a->number == 0 ? NAN : a->number > 0 ? INFINITY : -INFINITY;
+          else
+            dest->number = a->number / b->number;
+          break;
+        case OP_REM:
+          if (b->number == 0)
+            dest->number = NAN;
+          else
+            dest->number = fmod (a->number, b->number);
+          break;
+        case OP_POW:
+          number = pow (a->number, b->number);
+          if (isnan (number))
+            return FALSE;
+          dest->number = number;
+          break;
+        case OP_MIN:
+          dest->number = MIN (a->number, b->number);
+          break;
+        case OP_MAX:
+          dest->number = MAX (a->number, b->number);
+          break;
+
+        case OP_NEGATE:
+          dest->number = 0 - a->number;
+          break;
+        case OP_ABS:
+        case OP_ACOS:
+        case OP_ASIN:
+        case OP_ATAN:
+        case OP_CEIL:
+        case OP_COS:
+        case OP_FLOOR:
+        case OP_LN:
+        case OP_LOG10:
+        case OP_LOG2:
+        case OP_ROUND:
+        case OP_SIN:
+        case OP_SQRT:
+        case OP_TAN:
+          switch ((ShumateVectorOpcode)ins->op)
+            {
+            case OP_ABS:
+              number = fabs (a->number);
+              break;
+            case OP_ACOS:
+              number = acos (a->number);
+              break;
+            case OP_ASIN:
+              number = asin (a->number);
+              break;
+            case OP_ATAN:
+              number = atan (a->number);
+              break;
+            case OP_CEIL:
+              number = ceil (a->number);
+              break;
+            case OP_COS:
+              number = cos (a->number);
+              break;
+            case OP_FLOOR:
+              number = floor (a->number);
+              break;
+            case OP_LN:
+              number = log (a->number);
+              break;
+            case OP_LOG10:
+              number = log10 (a->number);
+              break;
+            case OP_LOG2:
+              number = log2 (a->number);
+              break;
+            case OP_ROUND:
+              number = round (a->number);
+              break;
+            case OP_SIN:
+              number = sin (a->number);
+              break;
+            case OP_SQRT:
+              number = sqrt (a->number);
+              break;
+            case OP_TAN:
+              number = tan (a->number);
+              break;
+            default:
+              g_assert_not_reached ();
+            }
+
+          if (isnan (number))
+            return FALSE;
+          dest->number = number;
+          break;
+
+        case OP_LT:
+        case OP_GT:
+        case OP_LE:
+        case OP_GE:
+          cmp = a->number > b->number ? 1 : a->number < b->number ? -1 : 0;
+          dest->boolean = test_comparison (ins->op, cmp);
+          break;
+        case OP_COMPARE_VALUE:
+          if (!compare_values (&values[ins->a], &values[ins->b], &cmp))
+            return FALSE;
+          dest->boolean = test_comparison (ins->arg, cmp);
+          break;
+        case OP_EQ_NUMBER:
+          dest->boolean = a->number == b->number;
+          break;
+        case OP_EQ_BOOLEAN:
+          dest->boolean = a->boolean == b->boolean;
+          break;
+        case OP_EQ_COLOR:
+          dest->boolean = gdk_rgba_equal (&a->color, &b->color);
+          break;
+        case OP_EQ_VALUE:
+          dest->boolean = shumate_vector_value_equal (&values[ins->a], &values[ins->b]);
+          break;
+        case OP_NOT:
+          dest->boolean = !a->boolean;
+          break;
+
+        case OP_INTERPOLATE_NUMBER:
+          {
+            ShumateVectorInterpolation *interpolation = g_ptr_array_index (self->interpolations, ins->arg);
+            guint last, next;
+            double pos;
+
+            find_stops (interpolation, a->number, &last, &next, &pos);
+
+            if (last == next)
+              dest->number = interpolation->numbers[last];
+            else
+              dest->number = lerp_double (interpolation->numbers[last], interpolation->numbers[next], pos);
+            break;
+          }
+        case OP_INTERPOLATE_COLOR:
+          {
+            ShumateVectorInterpolation *interpolation = g_ptr_array_index (self->interpolations, ins->arg);
+            GdkRGBA *colors = interpolation->colors;
+            guint last, next;
+            double pos;
+
+            find_stops (interpolation, a->number, &last, &next, &pos);
+
+            if (last == next)
+              dest->color = colors[last];
+            else
+              dest->color = (GdkRGBA) {
+                .red = lerp_double (colors[last].red, colors[next].red, pos),
+                .green = lerp_double (colors[last].green, colors[next].green, pos),
+                .blue = lerp_double (colors[last].blue, colors[next].blue, pos),
+                .alpha = lerp_double (colors[last].alpha, colors[next].alpha, pos),
+              };
+            break;
+          }
+
+        case OP_JUMP:
+          pc = ins->arg;
+          break;
+        case OP_JUMP_IF_TRUE:
+          if (a->boolean)
+            pc = ins->arg;
+          break;
+        case OP_JUMP_IF_FALSE:
+          if (!a->boolean)
+            pc = ins->arg;
+          break;
+        case OP_MATCH:
+          {
+            ShumateVectorMatchTable *table = g_ptr_array_index (self->matches, ins->arg);
+            guint branch = GPOINTER_TO_UINT (g_hash_table_lookup (table->labels, &values[ins->a]));
+
+            if (branch > 0)
+              pc = g_array_index (table->targets, guint, branch - 1);
+            else
+              pc = table->fallback;
+            break;
+          }
+        case OP_FAIL:
+          return FALSE;
+
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  return TRUE;
+}
+
+
+typedef struct {
+  Register registers[MAX_REGISTERS];
+  ShumateVectorValue values[MAX_VALUES];
+} Frame;
+
+static gboolean
+frame_run (Frame                          *frame,
+           ShumateVectorExpressionProgram *program,
+           ShumateVectorRenderScope       *scope)
+{
+  for (guint i = 0; i < program->n_values; i ++)
+    frame->values[i] = SHUMATE_VECTOR_VALUE_INIT;
+
+  return run (program, scope, frame->registers, frame->values);
+}
+
+static void
+frame_clear (Frame                          *frame,
+             ShumateVectorExpressionProgram *program)
+{
+  for (guint i = 0; i < program->n_values; i ++)
+    shumate_vector_value_unset (&frame->values[i]);
+}
+
+
+/* Evaluates the program into a boxed value. Returns FALSE if the expression
+ * failed, like shumate_vector_expression_eval(). */
+gboolean
+shumate_vector_expression_program_eval (ShumateVectorExpressionProgram *self,
+                                        ShumateVectorRenderScope       *scope,
+                                        ShumateVectorValue             *out)
+{
+  Frame frame;
+  gboolean success = frame_run (&frame, self, scope);
+  Register *result = &frame.registers[self->result.index];
+  ShumateVectorValue *result_value = &frame.values[self->result.index];
+
+  if (success)
+    {
+      switch (self->result.kind)
+        {
+        case SHUMATE_VECTOR_REGISTER_NUMBER:
+          shumate_vector_value_set_number (out, result->number);
+          break;
+        case SHUMATE_VECTOR_REGISTER_BOOLEAN:
+          shumate_vector_value_set_boolean (out, result->boolean);
+          break;
+        case SHUMATE_VECTOR_REGISTER_COLOR:
+          shumate_vector_value_set_color (out, &result->color);
+          break;
+        case SHUMATE_VECTOR_REGISTER_VALUE:
+          shumate_vector_value_unset (out);
+          shumate_vector_value_steal (result_value, out);
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+    }
+
+  frame_clear (&frame, self);
+  return success;
+}
+
+
+gboolean
+shumate_vector_expression_program_eval_number (ShumateVectorExpressionProgram *self,
+                                               ShumateVectorRenderScope       *scope,
+                                               double                         *out)
+{
+  Frame frame;
+  gboolean success = frame_run (&frame, self, scope);
+  Register *result = &frame.registers[self->result.index];
+  ShumateVectorValue *result_value = &frame.values[self->result.index];
+
+  if (success)
+    {
+      if (self->result.kind == SHUMATE_VECTOR_REGISTER_NUMBER)
+        *out = result->number;
+      else if (self->result.kind == SHUMATE_VECTOR_REGISTER_VALUE)
+        success = shumate_vector_value_get_number (result_value, out);
+      else
+        success = FALSE;
+    }
+
+  frame_clear (&frame, self);
+  return success;
+}
+
+
+gboolean
+shumate_vector_expression_program_eval_boolean (ShumateVectorExpressionProgram *self,
+                                                ShumateVectorRenderScope       *scope,
+                                                gboolean                       *out)
+{
+  Frame frame;
+  gboolean success = frame_run (&frame, self, scope);
+  Register *result = &frame.registers[self->result.index];
+  ShumateVectorValue *result_value = &frame.values[self->result.index];
+
+  if (success)
+    {
+      if (self->result.kind == SHUMATE_VECTOR_REGISTER_BOOLEAN)
+        *out = result->boolean;
+      else if (self->result.kind == SHUMATE_VECTOR_REGISTER_VALUE)
+        success = shumate_vector_value_get_boolean (result_value, out);
+      else
+        success = FALSE;
+    }
+
+  frame_clear (&frame, self);
+  return success;
+}
+
+
+gboolean
+shumate_vector_expression_program_eval_color (ShumateVectorExpressionProgram *self,
+                                              ShumateVectorRenderScope       *scope,
+                                              GdkRGBA                        *out)
+{
+  Frame frame;
+  gboolean success = frame_run (&frame, self, scope);
+  Register *result = &frame.registers[self->result.index];
+  ShumateVectorValue *result_value = &frame.values[self->result.index];
+
+  if (success)
+    {
+      if (self->result.kind == SHUMATE_VECTOR_REGISTER_COLOR)
+        *out = result->color;
+      else if (self->result.kind == SHUMATE_VECTOR_REGISTER_VALUE)
+        success = shumate_vector_value_get_color (result_value, out);
+      else
+        success = FALSE;
+    }
+
+  frame_clear (&frame, self);
+  return success;
+}
@@ -20,15 +20,23 @@
 #include "shumate-vector-expression-private.h"
 #include "shumate-vector-expression-filter-private.h"
 #include "shumate-vector-expression-interpolate-private.h"
+#include "shumate-vector-expression-program-private.h"
 #include "shumate-vector-value-private.h"
 
 
-G_DEFINE_TYPE (ShumateVectorExpression, shumate_vector_expression, G_TYPE_OBJECT)
+typedef struct
+{
+  /* Only set on top-level expressions, see shumate_vector_expression_from_json() */
+  ShumateVectorExpressionProgram *program;
+  ShumateVectorDependency dependency;
+} ShumateVectorExpressionPrivate;
 
+G_DEFINE_TYPE_WITH_PRIVATE (ShumateVectorExpression, shumate_vector_expression, G_TYPE_OBJECT)
 
-ShumateVectorExpression *
-shumate_vector_expression_from_json (JsonNode  *json,
-                                     GError   **error)
+
+static ShumateVectorExpression *
+parse_json (JsonNode  *json,
+            GError   **error)
 {
   if (json == NULL || JSON_NODE_HOLDS_NULL (json))
     return shumate_vector_expression_filter_from_literal (&SHUMATE_VECTOR_VALUE_INIT);
@@ -85,6 +93,59 @@ shumate_vector_expression_from_json (JsonNode  *json,
 }
 
 
+/* Parses a top-level expression, such as a style property or filter, and
+ * compiles and analyzes it. Subexpressions are parsed by the expression classes and are
+ * only evaluated as part of their parent, so they aren't compiled. */
+ShumateVectorExpression *
+shumate_vector_expression_from_json (JsonNode  *json,
+                                     GError   **error)
+{
+  ShumateVectorExpression *expression = parse_json (json, error);
+  ShumateVectorExpressionPrivate *priv;
+
+  if (expression == NULL)
+    return NULL;
+
+  priv = shumate_vector_expression_get_instance_private (expression);
+  priv->program = shumate_vector_expression_program_compile (expression);
+  priv->dependency = shumate_vector_expression_get_dependency (expression);
+
+  return expression;
+}
+
+
+/* Returns the compiled form of the expression, or NULL if it isn't compiled */
+ShumateVectorExpressionProgram *
+shumate_vector_expression_get_program (ShumateVectorExpression *self)
+{
+  ShumateVectorExpressionPrivate *priv;
+
+  if (self == NULL)
+    return NULL;
+
+  priv = shumate_vector_expression_get_instance_private (self);
+  return priv->program;
+}
+
+
+/* Classifies the expression by what its value depends on. Constant
+ * subexpressions are folded as they're parsed, and the values of
+ * zoom-dependent top-level expressions are cached for each tile. */
+ShumateVectorDependency
+shumate_vector_expression_get_dependency (ShumateVectorExpression *self)
+{
+  g_assert (SHUMATE_IS_VECTOR_EXPRESSION (self));
+  return SHUMATE_VECTOR_EXPRESSION_GET_CLASS (self)->get_dependency (self);
+}
+
+
+static ShumateVectorDependency
+shumate_vector_expression_real_get_dependency (ShumateVectorExpression *self)
+{
+  return SHUMATE_VECTOR_DEPENDENCY_FEATURE;
+}
+
+
 static gboolean
 shumate_vector_expression_real_eval (ShumateVectorExpression  *self,
                                      ShumateVectorRenderScope *scope,
@@ -101,7 +162,7 @@ shumate_vector_expression_real_eval_bitset (ShumateVectorExpression  *self,
                                             ShumateVectorRenderScope *scope,
                                             ShumateVectorIndexBitset *mask)
 {
-  VectorTile__Tile__Layer *layer = shumate_vector_reader_iter_get_layer_struct (scope->reader);
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (scope->reader);
   ShumateVectorIndexBitset *result = shumate_vector_index_bitset_new (layer->n_features);
   int feature_idx = 0;
 
@@ -134,21 +195,44 @@ shumate_vector_expression_real_eval_bitset (ShumateVectorExpression  *self,
 }
 
 
+static void
+shumate_vector_expression_finalize (GObject *object)
+{
+  ShumateVectorExpression *self = (ShumateVectorExpression *)object;
+  ShumateVectorExpressionPrivate *priv = shumate_vector_expression_get_instance_private (self);
+
+  g_clear_pointer (&priv->program, shumate_vector_expression_program_free);
+
+  G_OBJECT_CLASS (shumate_vector_expression_parent_class)->finalize (object);
+}
+
+
 static void
 shumate_vector_expression_class_init (ShumateVectorExpressionClass *klass)
 {
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+
+  object_class->finalize = shumate_vector_expression_finalize;
+
   klass->eval = shumate_vector_expression_real_eval;
   klass->eval_bitset = shumate_vector_expression_real_eval_bitset;
   klass->collect_indexes = NULL;
+  klass->compile = NULL;
+  klass->get_dependency = shumate_vector_expression_real_get_dependency;
 }
 
 
 static void
 shumate_vector_expression_init (ShumateVectorExpression *self)
 {
+  ShumateVectorExpressionPrivate *priv = shumate_vector_expression_get_instance_private (self);
+
+  priv->dependency = SHUMATE_VECTOR_DEPENDENCY_FEATURE;
 }
 
 
+/* Evaluates the expression by walking the tree. This is the reference
+   evaluator; compiled programs must produce the same results. */
 gboolean
 shumate_vector_expression_eval (ShumateVectorExpression  *self,
                                 ShumateVectorRenderScope *scope,
@@ -189,6 +273,41 @@ shumate_vector_expression_collect_indexes (ShumateVectorExpression       *self,
 }
 
 
+/* Expressions that only depend on the zoom level have the same value for
+ * every feature in a tile, so their values are kept in the scope. Returns
+ * NULL if the expression's value isn't cached, or if the scope has no
+ * cache. */
+static ShumateVectorValue *
+get_zoom_value (ShumateVectorExpression  *self,
+                ShumateVectorRenderScope *scope)
+{
+  ShumateVectorExpressionPrivate *priv;
+  ShumateVectorValue *value;
+
+  if (self == NULL || scope->zoom_values == NULL)
+    return NULL;
+
+  priv = shumate_vector_expression_get_instance_private (self);
+  if (priv->dependency != SHUMATE_VECTOR_DEPENDENCY_ZOOM)
+    return NULL;
+
+  value = g_hash_table_lookup (scope->zoom_values, self);
+  if (value == NULL)
+    {
+      value = g_new0 (ShumateVectorValue, 1);
+
+      if (priv->program != NULL)
+        shumate_vector_expression_program_eval (priv->program, scope, value);
+      else
+        shumate_vector_expression_eval (self, scope, value);
+
+      g_hash_table_insert (scope->zoom_values, self, value);
+    }
+
+  return value;
+}
+
+
 double
 shumate_vector_expression_eval_number (ShumateVectorExpression  *self,
                                        ShumateVectorRenderScope *scope,
@@ -196,6 +315,24 @@ shumate_vector_expression_eval_number (ShumateVectorExpression  *self,
 {
   double result;
   g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
+  ShumateVectorExpressionProgram *program = shumate_vector_expression_get_program (self);
+  ShumateVectorValue *zoom_value = get_zoom_value (self, scope);
+
+  if (zoom_value != NULL)
+    {
+      if (shumate_vector_value_get_number (zoom_value, &result))
+        return result;
+      else
+        return default_val;
+    }
+
+  if (program != NULL)
+    {
+      if (shumate_vector_expression_program_eval_number (program, scope, &result))
+        return result;
+      else
+        return default_val;
+    }
 
   shumate_vector_expression_eval (self, scope, &value);
 
@@ -213,6 +350,24 @@ shumate_vector_expression_eval_boolean (ShumateVectorExpression  *self,
 {
   gboolean result;
   g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
+  ShumateVectorExpressionProgram *program = shumate_vector_expression_get_program (self);
+  ShumateVectorValue *zoom_value = get_zoom_value (self, scope);
+
+  if (zoom_value != NULL)
+    {
+      if (shumate_vector_value_get_boolean (zoom_value, &result))
+        return result;
+      else
+        return default_val;
+    }
+
+  if (program != NULL)
+    {
+      if (shumate_vector_expression_program_eval_boolean (program, scope, &result))
+        return result;
+      else
+        return default_val;
+    }
 
   shumate_vector_expression_eval (self, scope, &value);
 
@@ -230,6 +385,15 @@ shumate_vector_expression_eval_string (ShumateVectorExpression  *self,
 {
   const char *result;
   g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
+  ShumateVectorValue *zoom_value = get_zoom_value (self, scope);
+
+  if (zoom_value != NULL)
+    {
+      if (shumate_vector_value_get_string (zoom_value, &result))
+        return g_strdup (result);
+      else
+        return g_strdup (default_val);
+    }
 
   shumate_vector_expression_eval (self, scope, &value);
 
@@ -246,6 +410,22 @@ shumate_vector_expression_eval_color (ShumateVectorExpression  *self,
                                       GdkRGBA                  *color)
 {
   g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
+  ShumateVectorExpressionProgram *program = shumate_vector_expression_get_program (self);
+  ShumateVectorValue *zoom_value = get_zoom_value (self, scope);
+
+  if (zoom_value != NULL)
+    {
+      /* This also caches the parsed color in the value */
+      shumate_vector_value_get_color (zoom_value, color);
+      return;
+    }
+
+  if (program != NULL)
+    {
+      shumate_vector_expression_program_eval_color (program, scope, color);
+      return;
+    }
+
   shumate_vector_expression_eval (self, scope, &value);
   shumate_vector_value_get_color (&value, color);
 }
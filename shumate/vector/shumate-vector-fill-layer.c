@@ -102,12 +102,13 @@ shumate_vector_fill_layer_render (ShumateVectorLayer *layer, ShumateVectorRender
   opacity = shumate_vector_expression_eval_number (self->opacity, scope, 1.0);
   pattern_sprite = shumate_vector_expression_eval_image (self->pattern, scope);
 
-  shumate_vector_render_scope_exec_geometry (scope);
-
   if (pattern_sprite != NULL)
     {
       cairo_pattern_t *pattern = create_pattern (pattern_sprite, scope);
 
+      shumate_vector_render_scope_flush_batch (scope);
+      shumate_vector_render_scope_exec_geometry (scope);
+
       cairo_set_source (scope->cr, pattern);
 
       /* Use cairo_paint_with_alpha so that we can set fill-opacity correctly. */
@@ -120,8 +121,10 @@ shumate_vector_fill_layer_render (ShumateVectorLayer *layer, ShumateVectorRender
     }
   else
     {
-      cairo_set_source_rgba (scope->cr, color.red, color.green, color.blue, color.alpha * opacity);
-      cairo_fill (scope->cr);
+      ShumateVectorPaint paint = { .color = color };
+
+      paint.color.alpha *= opacity;
+      shumate_vector_render_scope_batch_feature (scope, &paint);
     }
 }
 
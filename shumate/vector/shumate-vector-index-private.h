@@ -47,6 +47,7 @@ G_DEFINE_AUTOPTR_CLEANUP_FUNC (ShumateVectorIndexBitset, shumate_vector_index_bi
 ShumateVectorIndex *shumate_vector_index_new (void);
 void shumate_vector_index_free (ShumateVectorIndex *index);
 gboolean shumate_vector_index_has_layer (ShumateVectorIndex *self, int layer_idx);
+void shumate_vector_index_add_layer (ShumateVectorIndex *self, int layer_idx);
 void shumate_vector_index_add_bitset (ShumateVectorIndex       *self,
                                       int                       layer_idx,
                                       const char               *field_name,
@@ -82,6 +83,8 @@ ShumateVectorIndexDescription *shumate_vector_index_description_new (void);
 void shumate_vector_index_description_free (ShumateVectorIndexDescription *description);
 gboolean shumate_vector_index_description_has_layer (ShumateVectorIndexDescription *description,
                                                      const char                    *layer_name);
+const char **shumate_vector_index_description_get_layers (ShumateVectorIndexDescription *description,
+                                                         guint                         *n_layers);
 gboolean shumate_vector_index_description_has_field (ShumateVectorIndexDescription *description,
                                                      const char                    *layer_name,
                                                      const char                    *field_name);
@@ -272,6 +272,15 @@ get_or_create_layer (ShumateVectorIndex *self,
   return layer;
 }
 
+/* Marks a layer as indexed, even if none of its fields needed an index, so
+ * that shumate_vector_index_has_layer() returns TRUE for it. */
+void
+shumate_vector_index_add_layer (ShumateVectorIndex *self,
+                                int                 layer_idx)
+{
+  get_or_create_layer (self, layer_idx);
+}
+
 static ShumateVectorIndexField *
 get_or_create_field (ShumateVectorIndex *self,
                      int                 layer_idx,
@@ -530,6 +539,15 @@ shumate_vector_index_description_has_layer (ShumateVectorIndexDescription *descr
   return g_hash_table_contains (description->layers, layer_name);
 }
 
+/* Returns the names of the layers the index description has indexes for. Free
+ * the array, but not the strings, with g_free(). */
+const char **
+shumate_vector_index_description_get_layers (ShumateVectorIndexDescription *description,
+                                            guint                         *n_layers)
+{
+  return (const char **)g_hash_table_get_keys_as_array (description->layers, n_layers);
+}
+
 /* Returns whether the index description has any indexes for the given field. */
 gboolean
 shumate_vector_index_description_has_field (ShumateVectorIndexDescription *description,
@@ -144,7 +144,7 @@ shumate_vector_layer_render (ShumateVectorLayer *self, ShumateVectorRenderScope
       /* Style layers with a source layer are rendered once for each feature
        * in that layer, if it exists */
 
-      VectorTile__Tile__Layer *layer = shumate_vector_reader_iter_get_layer_struct (scope->reader);
+      ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (scope->reader);
 
       if (layer->n_features == 0)
         return;
@@ -179,6 +179,8 @@ shumate_vector_layer_render (ShumateVectorLayer *self, ShumateVectorRenderScope
             SHUMATE_VECTOR_LAYER_GET_CLASS (self)->render (self, scope);
         }
 
+      /* The batched path is in the layer's coordinate space */
+      shumate_vector_render_scope_flush_batch (scope);
       cairo_restore (scope->cr);
     }
 }
@@ -121,6 +121,7 @@ shumate_vector_line_layer_render (ShumateVectorLayer *layer, ShumateVectorRender
   double width;
   g_autofree char *cap = NULL;
   g_autofree char *join = NULL;
+  ShumateVectorPaint paint;
 
   shumate_vector_expression_eval_color (self->color, scope, &color);
   opacity = shumate_vector_expression_eval_number (self->opacity, scope, 1.0);
@@ -128,55 +129,29 @@ shumate_vector_line_layer_render (ShumateVectorLayer *layer, ShumateVectorRender
   cap = shumate_vector_expression_eval_string (self->cap, scope, NULL);
   join = shumate_vector_expression_eval_string (self->join, scope, NULL);
 
-  shumate_vector_render_scope_exec_geometry (scope);
-
-  cairo_set_source_rgba (scope->cr, color.red, color.green, color.blue, color.alpha * opacity);
-  cairo_set_line_width (scope->cr, width * scope->scale);
+  paint.color = color;
+  paint.color.alpha *= opacity;
+  paint.stroke = TRUE;
+  paint.line_width = width;
 
   if (g_strcmp0 (cap, "round") == 0)
-    cairo_set_line_cap (scope->cr, CAIRO_LINE_CAP_ROUND);
+    paint.line_cap = CAIRO_LINE_CAP_ROUND;
   else if (g_strcmp0 (cap, "square") == 0)
-    cairo_set_line_cap (scope->cr, CAIRO_LINE_CAP_SQUARE);
+    paint.line_cap = CAIRO_LINE_CAP_SQUARE;
   else
-    cairo_set_line_cap (scope->cr, CAIRO_LINE_CAP_BUTT);
+    paint.line_cap = CAIRO_LINE_CAP_BUTT;
 
   if (g_strcmp0 (join, "bevel") == 0)
-    cairo_set_line_join (scope->cr, CAIRO_LINE_JOIN_BEVEL);
+    paint.line_join = CAIRO_LINE_JOIN_BEVEL;
   else if (g_strcmp0 (join, "round") == 0)
-    cairo_set_line_join (scope->cr, CAIRO_LINE_JOIN_ROUND);
+    paint.line_join = CAIRO_LINE_JOIN_ROUND;
   else
-    cairo_set_line_join (scope->cr, CAIRO_LINE_JOIN_MITER);
+    paint.line_join = CAIRO_LINE_JOIN_MITER;
 
-  if (self->dashes == NULL)
-    cairo_set_dash (scope->cr, NULL, 0, 0);
-  else
-    {
-      int i;
-      g_autofree double *dasharray = g_new (double, self->num_dashes);
-      gboolean any_nonzero = FALSE;
-      gboolean all_positive = TRUE;
-
-      for (i = 0; i < self->num_dashes; i ++)
-        {
-          dasharray[i] = self->dashes[i] * width * scope->scale;
-
-          if (dasharray[i] < 0)
-            {
-              all_positive = FALSE;
-              break;
-            }
-          else if (dasharray[i] != 0)
-            any_nonzero = TRUE;
-        }
-
-      /* make sure the dasharray is valid */
-      if (any_nonzero && all_positive)
-        cairo_set_dash (scope->cr, dasharray, self->num_dashes, 0);
-      else
-        cairo_set_dash (scope->cr, NULL, 0, 0);
-    }
+  paint.dashes = self->dashes;
+  paint.num_dashes = self->num_dashes;
 
-  cairo_stroke (scope->cr);
+  shumate_vector_render_scope_batch_feature (scope, &paint);
 }
 
 
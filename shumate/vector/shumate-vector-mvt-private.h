@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <glib.h>
+
+/* Only for the VECTOR_TILE__TILE__GEOM_TYPE__* values. Tiles are decoded by
+ * shumate-vector-mvt.c, not protobuf-c. */
+#include "vector_tile.pb-c.h"
+
+G_BEGIN_DECLS
+
+typedef struct _ShumateVectorMvt ShumateVectorMvt;
+
+/* A range of bytes within the tile data */
+typedef struct {
+  const guint8 *data;
+  gsize len;
+} ShumateVectorMvtSlice;
+
+typedef struct {
+  /* The name and keys are copied out of the tile data, once per layer, since
+   * they are handed out as NUL-terminated strings */
+  char *name;
+  char **keys;
+  guint n_keys;
+
+  /* The keys as quarks, or 0 for keys no style looks up. See
+   * shumate_vector_mvt_intern_key(). key_atoms_mutex serializes updates to
+   * both; see shumate_vector_mvt_layer_update_key_atoms(). */
+  GQuark *key_atoms;
+  int key_atoms_generation;
+  GMutex key_atoms_mutex;
+
+  guint32 version;
+  guint32 extent;
+
+  /* Undecoded Value and Feature messages */
+  ShumateVectorMvtSlice *values;
+  guint n_values;
+  ShumateVectorMvtSlice *features;
+  guint n_features;
+} ShumateVectorMvtLayer;
+
+/* The same fields as VectorTile__Tile__Value, except that string_value points
+ * into the tile data and is not NUL-terminated */
+typedef struct {
+  const char *string_value;
+  gsize string_len;
+  float float_value;
+  double double_value;
+  gint64 int_value;
+  guint64 uint_value;
+  gint64 sint_value;
+  gboolean bool_value;
+
+  guint8 has_string_value : 1;
+  guint8 has_float_value : 1;
+  guint8 has_double_value : 1;
+  guint8 has_int_value : 1;
+  guint8 has_uint_value : 1;
+  guint8 has_sint_value : 1;
+  guint8 has_bool_value : 1;
+} ShumateVectorMvtValue;
+
+typedef struct {
+  guint64 id;
+  gboolean has_id;
+  int type;
+
+  /* Decoded into a buffer owned by the caller of
+   * shumate_vector_mvt_layer_read_feature() */
+  const guint32 *tags;
+  guint n_tags;
+
+  /* The whole Feature message. The geometry is only decoded on request,
+   * since many passes over a layer only look at the tags. */
+  ShumateVectorMvtSlice data;
+} ShumateVectorMvtFeature;
+
+ShumateVectorMvt *shumate_vector_mvt_new (GBytes *bytes);
+void shumate_vector_mvt_free (ShumateVectorMvt *self);
+
+guint shumate_vector_mvt_get_n_layers (ShumateVectorMvt *self);
+ShumateVectorMvtLayer *shumate_vector_mvt_get_layer (ShumateVectorMvt *self,
+                                                     guint             index);
+int shumate_vector_mvt_find_layer (ShumateVectorMvt *self,
+                                   const char       *name);
+
+GQuark shumate_vector_mvt_intern_key (const char *key);
+void shumate_vector_mvt_layer_update_key_atoms (ShumateVectorMvtLayer *layer);
+
+gboolean shumate_vector_mvt_layer_get_value (ShumateVectorMvtLayer *layer,
+                                             guint                  index,
+                                             ShumateVectorMvtValue *value);
+gboolean shumate_vector_mvt_layer_read_feature (ShumateVectorMvtLayer   *layer,
+                                                guint                    index,
+                                                ShumateVectorMvtFeature *feature,
+                                                GArray                  *tags);
+
+gboolean shumate_vector_mvt_feature_decode_geometry (ShumateVectorMvtFeature *feature,
+                                                     GArray                  *geometry);
+
+G_END_DECLS
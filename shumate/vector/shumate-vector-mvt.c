@@ -0,0 +1,854 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * A lazy decoder for Mapbox Vector Tiles.
+ *
+ * protobuf-c's vector_tile__tile__unpack() allocates every layer, feature,
+ * key, value, tag array and geometry array in the tile up front. Rendering
+ * usually needs much less than that: most style layers only look at a few
+ * source layers, and most passes over a layer only look at the tags.
+ *
+ * Instead, this reads the protobuf wire format directly from the tile data.
+ * Creating a ShumateVectorMvt only finds where each layer is. A layer is
+ * decoded the first time it is requested, which finds where each of its
+ * features and values are, but doesn't decode them. Features are decoded
+ * into buffers supplied by the caller (ShumateVectorReaderIter), and values
+ * are decoded each time they are read. Strings in values point into the tile
+ * data.
+ *
+ * A ShumateVectorMvt may be shared between threads. Layers are decoded
+ * under g_once_init_enter(), and nothing changes after that.
+ *
+ * See https://github.com/mapbox/vector-tile-spec/blob/master/2.1/vector_tile.proto
+ * for the message definitions, and
+ * https://protobuf.dev/programming-guides/encoding/ for the wire format.
+ */
+
+#include <string.h>
+
+#include "shumate-vector-mvt-private.h"
+
+struct _ShumateVectorMvt
+{
+  GBytes *bytes;
+
+  /* The undecoded Layer messages, and the decoded layers, which are NULL
+   * until they are requested */
+  ShumateVectorMvtSlice *layer_data;
+  ShumateVectorMvtLayer **layers;
+  guint n_layers;
+
+  /* Layer name to index + 1, built the first time a layer is looked up by
+   * name */
+  GHashTable *layer_names;
+};
+
+/* Incremented whenever shumate_vector_mvt_intern_key() sees a new key */
+static int key_generation;
+
+/* The atoms shumate_vector_mvt_intern_key() has returned, protected by
+ * interned_keys_mutex */
+static GMutex interned_keys_mutex;
+static GHashTable *interned_keys;
+
+enum {
+  WIRE_TYPE_VARINT = 0,
+  WIRE_TYPE_I64 = 1,
+  WIRE_TYPE_LEN = 2,
+  WIRE_TYPE_I32 = 5,
+};
+
+/* Field numbers */
+enum {
+  TILE_LAYERS = 3,
+};
+
+enum {
+  LAYER_NAME = 1,
+  LAYER_FEATURES = 2,
+  LAYER_KEYS = 3,
+  LAYER_VALUES = 4,
+  LAYER_EXTENT = 5,
+  LAYER_VERSION = 15,
+};
+
+enum {
+  FEATURE_ID = 1,
+  FEATURE_TAGS = 2,
+  FEATURE_TYPE = 3,
+  FEATURE_GEOMETRY = 4,
+};
+
+enum {
+  VALUE_STRING = 1,
+  VALUE_FLOAT = 2,
+  VALUE_DOUBLE = 3,
+  VALUE_INT = 4,
+  VALUE_UINT = 5,
+  VALUE_SINT = 6,
+  VALUE_BOOL = 7,
+};
+
+
+typedef struct {
+  const guint8 *pos;
+  const guint8 *end;
+} PbReader;
+
+static inline void
+pb_reader_init (PbReader                    *reader,
+                const ShumateVectorMvtSlice *slice)
+{
+  reader->pos = slice->data;
+  reader->end = slice->data + slice->len;
+}
+
+static inline gboolean
+pb_reader_at_end (PbReader *reader)
+{
+  return reader->pos >= reader->end;
+}
+
+static inline gboolean
+read_varint (PbReader *reader,
+             guint64  *out)
+{
+  guint64 result = 0;
+
+  for (int shift = 0; shift < 64; shift += 7)
+    {
+      guint8 byte;
+
+      if (reader->pos >= reader->end)
+        return FALSE;
+
+      byte = *reader->pos++;
+      result |= (guint64)(byte & 0x7f) << shift;
+
+      if ((byte & 0x80) == 0)
+        {
+          *out = result;
+          return TRUE;
+        }
+    }
+
+  return FALSE;
+}
+
+static inline gboolean
+read_key (PbReader *reader,
+          guint    *field,
+          guint    *wire_type)
+{
+  guint64 key;
+
+  if (!read_varint (reader, &key))
+    return FALSE;
+
+  *field = key >> 3;
+  *wire_type = key & 0x7;
+  return TRUE;
+}
+
+static inline gboolean
+read_fixed (PbReader *reader,
+            gsize     size,
+            guint8   *out)
+{
+  if ((gsize)(reader->end - reader->pos) < size)
+    return FALSE;
+
+  memcpy (out, reader->pos, size);
+  reader->pos += size;
+  return TRUE;
+}
+
+static inline gboolean
+read_len (PbReader              *reader,
+          ShumateVectorMvtSlice *out)
+{
+  guint64 len;
+
+  if (!read_varint (reader, &len))
+    return FALSE;
+
+  if (len > (guint64)(reader->end - reader->pos))
+    return FALSE;
+
+  out->data = reader->pos;
+  out->len = len;
+  reader->pos += len;
+  return TRUE;
+}
+
+static gboolean
+skip_field (PbReader *reader,
+            guint     wire_type)
+{
+  guint64 varint;
+  guint8 fixed[8];
+  ShumateVectorMvtSlice slice;
+
+  switch (wire_type)
+    {
+    case WIRE_TYPE_VARINT:
+      return read_varint (reader, &varint);
+    case WIRE_TYPE_I64:
+      return read_fixed (reader, 8, fixed);
+    case WIRE_TYPE_LEN:
+      return read_len (reader, &slice);
+    case WIRE_TYPE_I32:
+      return read_fixed (reader, 4, fixed);
+    default:
+      /* Groups are deprecated and never used in vector tiles */
+      return FALSE;
+    }
+}
+
+/* Reads a repeated uint32 field, which may be packed or not */
+static gboolean
+read_repeated_uint32 (PbReader *reader,
+                      guint     wire_type,
+                      GArray   *out)
+{
+  guint64 value;
+
+  if (wire_type == WIRE_TYPE_VARINT)
+    {
+      guint32 value32;
+
+      if (!read_varint (reader, &value))
+        return FALSE;
+
+      value32 = value;
+      g_array_append_val (out, value32);
+      return TRUE;
+    }
+  else if (wire_type == WIRE_TYPE_LEN)
+    {
+      ShumateVectorMvtSlice slice;
+      PbReader packed;
+
+      if (!read_len (reader, &slice))
+        return FALSE;
+
+      pb_reader_init (&packed, &slice);
+      while (!pb_reader_at_end (&packed))
+        {
+          guint32 value32;
+
+          if (!read_varint (&packed, &value))
+            return FALSE;
+
+          value32 = value;
+          g_array_append_val (out, value32);
+        }
+
+      return TRUE;
+    }
+  else
+    return FALSE;
+}
+
+
+/*
+ * shumate_vector_mvt_new:
+ * @bytes: a vector tile
+ *
+ * Finds the layers in @bytes, without decoding them.
+ *
+ * Returns: (transfer full) (nullable): a new #ShumateVectorMvt, or %NULL if
+ * @bytes is not a valid vector tile
+ */
+ShumateVectorMvt *
+shumate_vector_mvt_new (GBytes *bytes)
+{
+  g_autoptr(GArray) layer_data = g_array_new (FALSE, FALSE, sizeof (ShumateVectorMvtSlice));
+  ShumateVectorMvtSlice tile;
+  ShumateVectorMvt *self;
+  PbReader reader;
+
+  g_return_val_if_fail (bytes != NULL, NULL);
+
+  tile.data = g_bytes_get_data (bytes, &tile.len);
+  pb_reader_init (&reader, &tile);
+
+  while (!pb_reader_at_end (&reader))
+    {
+      guint field, wire_type;
+
+      if (!read_key (&reader, &field, &wire_type))
+        return NULL;
+
+      if (field == TILE_LAYERS && wire_type == WIRE_TYPE_LEN)
+        {
+          ShumateVectorMvtSlice layer;
+
+          if (!read_len (&reader, &layer))
+            return NULL;
+
+          g_array_append_val (layer_data, layer);
+        }
+      else if (!skip_field (&reader, wire_type))
+        return NULL;
+    }
+
+  self = g_new0 (ShumateVectorMvt, 1);
+  self->bytes = g_bytes_ref (bytes);
+  self->n_layers = layer_data->len;
+  self->layer_data = (ShumateVectorMvtSlice *)g_array_free (g_steal_pointer (&layer_data), FALSE);
+  self->layers = g_new0 (ShumateVectorMvtLayer *, self->n_layers);
+
+  return self;
+}
+
+static void
+layer_free (ShumateVectorMvtLayer *layer)
+{
+  /* The keys point into the same block as the name */
+  g_free (layer->name);
+  g_free (layer->keys);
+  g_free (layer->key_atoms);
+  g_mutex_clear (&layer->key_atoms_mutex);
+  g_free (layer->values);
+  g_free (layer->features);
+  g_free (layer);
+}
+
+void
+shumate_vector_mvt_free (ShumateVectorMvt *self)
+{
+  for (guint i = 0; i < self->n_layers; i ++)
+    g_clear_pointer (&self->layers[i], layer_free);
+
+  g_clear_pointer (&self->layer_names, g_hash_table_unref);
+  g_free (self->layers);
+  g_free (self->layer_data);
+  g_bytes_unref (self->bytes);
+  g_free (self);
+}
+
+guint
+shumate_vector_mvt_get_n_layers (ShumateVectorMvt *self)
+{
+  return self->n_layers;
+}
+
+static ShumateVectorMvtLayer *
+decode_layer (const ShumateVectorMvtSlice *data)
+{
+  ShumateVectorMvtLayer *layer = g_new0 (ShumateVectorMvtLayer, 1);
+
+  g_mutex_init (&layer->key_atoms_mutex);
+  g_autoptr(GArray) features = g_array_new (FALSE, FALSE, sizeof (ShumateVectorMvtSlice));
+  g_autoptr(GArray) values = g_array_new (FALSE, FALSE, sizeof (ShumateVectorMvtSlice));
+  g_autoptr(GArray) keys = g_array_new (FALSE, FALSE, sizeof (ShumateVectorMvtSlice));
+  ShumateVectorMvtSlice name = { NULL, 0 };
+  gboolean valid = TRUE;
+  gsize strings_size;
+  char *strings;
+  PbReader reader;
+
+  /* Defaults from the .proto file */
+  layer->version = 1;
+  layer->extent = 4096;
+
+  pb_reader_init (&reader, data);
+
+  while (valid && !pb_reader_at_end (&reader))
+    {
+      guint field, wire_type;
+      ShumateVectorMvtSlice slice;
+      guint64 varint;
+
+      if (!read_key (&reader, &field, &wire_type))
+        {
+          valid = FALSE;
+          break;
+        }
+
+      if (wire_type == WIRE_TYPE_LEN
+          && (field == LAYER_NAME || field == LAYER_FEATURES || field == LAYER_KEYS || field == LAYER_VALUES))
+        {
+          if (!read_len (&reader, &slice))
+            {
+              valid = FALSE;
+              break;
+            }
+
+          switch (field)
+            {
+            case LAYER_NAME:
+              name = slice;
+              break;
+            case LAYER_FEATURES:
+              g_array_append_val (features, slice);
+              break;
+            case LAYER_KEYS:
+              g_array_append_val (keys, slice);
+              break;
+            case LAYER_VALUES:
+              g_array_append_val (values, slice);
+              break;
+            default:
+              g_assert_not_reached ();
+            }
+        }
+      else if (wire_type == WIRE_TYPE_VARINT && (field == LAYER_EXTENT || field == LAYER_VERSION))
+        {
+          if (!read_varint (&reader, &varint))
+            {
+              valid = FALSE;
+              break;
+            }
+
+          if (field == LAYER_EXTENT)
+            layer->extent = varint;
+          else
+            layer->version = varint;
+        }
+      else
+        valid = skip_field (&reader, wire_type);
+    }
+
+  /* A layer that can't be read is treated as empty, rather than failing the
+   * whole tile */
+  if (!valid)
+    {
+      g_array_set_size (features, 0);
+      g_array_set_size (values, 0);
+      g_array_set_size (keys, 0);
+    }
+
+  /* Copy the name and keys into one block */
+  strings_size = name.len + 1;
+  for (guint i = 0; i < keys->len; i ++)
+    strings_size += g_array_index (keys, ShumateVectorMvtSlice, i).len + 1;
+
+  strings = g_malloc (strings_size);
+  layer->name = strings;
+  if (name.len > 0)
+    memcpy (strings, name.data, name.len);
+  strings[name.len] = '\0';
+  strings += name.len + 1;
+
+  layer->n_keys = keys->len;
+  layer->keys = g_new (char *, keys->len);
+  for (guint i = 0; i < keys->len; i ++)
+    {
+      ShumateVectorMvtSlice *key = &g_array_index (keys, ShumateVectorMvtSlice, i);
+
+      layer->keys[i] = strings;
+      if (key->len > 0)
+        memcpy (strings, key->data, key->len);
+      strings[key->len] = '\0';
+      strings += key->len + 1;
+    }
+
+  /* Read the generation first, so that if a key is interned while the atoms
+   * are being looked up, the layer will see a different generation */
+  layer->key_atoms_generation = g_atomic_int_get (&key_generation);
+  layer->key_atoms = g_new (GQuark, keys->len);
+  for (guint i = 0; i < keys->len; i ++)
+    layer->key_atoms[i] = g_quark_try_string (layer->keys[i]);
+
+  layer->n_values = values->len;
+  layer->values = (ShumateVectorMvtSlice *)g_array_free (g_steal_pointer (&values), FALSE);
+  layer->n_features = features->len;
+  layer->features = (ShumateVectorMvtSlice *)g_array_free (g_steal_pointer (&features), FALSE);
+
+  return layer;
+}
+
+/*
+ * shumate_vector_mvt_get_layer:
+ * @self: a #ShumateVectorMvt
+ * @index: the index of the layer
+ *
+ * Gets a layer, decoding it if this is the first time it is requested. This
+ * is safe to call from multiple threads at once.
+ *
+ * Returns: (transfer none): the layer
+ */
+ShumateVectorMvtLayer *
+shumate_vector_mvt_get_layer (ShumateVectorMvt *self,
+                              guint             index)
+{
+  g_return_val_if_fail (index < self->n_layers, NULL);
+
+  if (g_once_init_enter (&self->layers[index]))
+    g_once_init_leave (&self->layers[index], decode_layer (&self->layer_data[index]));
+
+  return self->layers[index];
+}
+
+/* Finds a layer's name without decoding the rest of the layer */
+static gboolean
+read_layer_name (const ShumateVectorMvtSlice *data,
+                 ShumateVectorMvtSlice       *name)
+{
+  PbReader reader;
+
+  pb_reader_init (&reader, data);
+
+  while (!pb_reader_at_end (&reader))
+    {
+      guint field, wire_type;
+
+      if (!read_key (&reader, &field, &wire_type))
+        return FALSE;
+
+      if (field == LAYER_NAME && wire_type == WIRE_TYPE_LEN)
+        return read_len (&reader, name);
+      else if (!skip_field (&reader, wire_type))
+        return FALSE;
+    }
+
+  return FALSE;
+}
+
+static GHashTable *
+build_layer_names (ShumateVectorMvt *self)
+{
+  GHashTable *layer_names = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+
+  for (guint i = 0; i < self->n_layers; i ++)
+    {
+      ShumateVectorMvtSlice name;
+      char *key;
+
+      if (!read_layer_name (&self->layer_data[i], &name))
+        continue;
+
+      key = g_strndup ((const char *)name.data, name.len);
+
+      /* If a name is repeated, the first layer with it wins */
+      if (g_hash_table_contains (layer_names, key))
+        g_free (key);
+      else
+        g_hash_table_insert (layer_names, key, GUINT_TO_POINTER (i + 1));
+    }
+
+  return layer_names;
+}
+
+/*
+ * shumate_vector_mvt_find_layer:
+ * @self: a #ShumateVectorMvt
+ * @name: a layer name
+ *
+ * Finds a layer by name. The first call builds a table of all the layer
+ * names in the tile, so each lookup after that is a hash table lookup
+ * rather than a scan over the layers. This is safe to call from multiple
+ * threads at once.
+ *
+ * Returns: the index of the layer, or -1 if there is no such layer
+ */
+int
+shumate_vector_mvt_find_layer (ShumateVectorMvt *self,
+                               const char       *name)
+{
+  if (g_once_init_enter (&self->layer_names))
+    g_once_init_leave (&self->layer_names, build_layer_names (self));
+
+  return (int) GPOINTER_TO_UINT (g_hash_table_lookup (self->layer_names, name)) - 1;
+}
+
+/*
+ * shumate_vector_mvt_intern_key:
+ * @key: a property key
+ *
+ * Interns a property key that a style looks up, so that it can be compared
+ * against the layer's key_atoms instead of its keys.
+ *
+ * Layers only map keys that are already interned when they are decoded,
+ * since interning every key of every tile would grow the quark table
+ * without bound. If a new key is interned after that, key_atoms may be
+ * missing it until shumate_vector_mvt_layer_update_key_atoms() is called.
+ *
+ * Returns: the atom for @key
+ */
+GQuark
+shumate_vector_mvt_intern_key (const char *key)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&interned_keys_mutex);
+  GQuark atom = g_quark_from_string (key);
+
+  if (interned_keys == NULL)
+    interned_keys = g_hash_table_new (NULL, NULL);
+
+  /* The quark may already exist even though this is the first time the key
+   * is looked up, for example if GLib or another library interned the same
+   * string. Layers decoded before it existed may not have it in key_atoms,
+   * so the generation has to change either way. */
+  if (g_hash_table_add (interned_keys, GUINT_TO_POINTER (atom)))
+    g_atomic_int_inc (&key_generation);
+
+  return atom;
+}
+
+/*
+ * shumate_vector_mvt_layer_update_key_atoms:
+ * @layer: a #ShumateVectorMvtLayer
+ *
+ * Makes sure the layer's key_atoms include every key that has been interned
+ * with shumate_vector_mvt_intern_key(), looking up the atoms of the layer's
+ * unmapped keys again if any key was interned since the last time. A new key
+ * only costs each layer one pass over its own keys, rather than sending it
+ * back to comparing strings for good. This is safe to call from multiple
+ * threads at once.
+ */
+void
+shumate_vector_mvt_layer_update_key_atoms (ShumateVectorMvtLayer *layer)
+{
+  g_autoptr(GMutexLocker) locker = NULL;
+  int generation;
+
+  if (g_atomic_int_get (&layer->key_atoms_generation) == g_atomic_int_get (&key_generation))
+    return;
+
+  locker = g_mutex_locker_new (&layer->key_atoms_mutex);
+
+  /* Read the generation first, like decode_layer() does */
+  generation = g_atomic_int_get (&key_generation);
+  if (layer->key_atoms_generation == generation)
+    return;
+
+  /* Atoms only ever go from 0 to the key's quark, so threads that are still
+   * reading the array see either one, and nothing reads the new atoms until
+   * the generation below is published */
+  for (guint i = 0; i < layer->n_keys; i ++)
+    if (layer->key_atoms[i] == 0)
+      g_atomic_int_set (&layer->key_atoms[i], g_quark_try_string (layer->keys[i]));
+
+  g_atomic_int_set (&layer->key_atoms_generation, generation);
+}
+
+/*
+ * shumate_vector_mvt_layer_get_value:
+ * @layer: a #ShumateVectorMvtLayer
+ * @index: the index of the value
+ * @value: (out caller-allocates): the decoded value
+ *
+ * Decodes one of the layer's values.
+ *
+ * Returns: %TRUE if the value was decoded, %FALSE if @index is out of range
+ * or the value is malformed
+ */
+gboolean
+shumate_vector_mvt_layer_get_value (ShumateVectorMvtLayer *layer,
+                                    guint                  index,
+                                    ShumateVectorMvtValue *value)
+{
+  PbReader reader;
+
+  memset (value, 0, sizeof (ShumateVectorMvtValue));
+
+  if (index >= layer->n_values)
+    return FALSE;
+
+  pb_reader_init (&reader, &layer->values[index]);
+
+  while (!pb_reader_at_end (&reader))
+    {
+      guint field, wire_type;
+      guint64 varint;
+
+      if (!read_key (&reader, &field, &wire_type))
+        return FALSE;
+
+      if (field == VALUE_STRING && wire_type == WIRE_TYPE_LEN)
+        {
+          ShumateVectorMvtSlice slice;
+
+          if (!read_len (&reader, &slice))
+            return FALSE;
+
+          value->string_value = (const char *)slice.data;
+          value->string_len = slice.len;
+          value->has_string_value = TRUE;
+        }
+      else if (field == VALUE_FLOAT && wire_type == WIRE_TYPE_I32)
+        {
+          guint32 bits;
+
+          if (!read_fixed (&reader, 4, (guint8 *)&bits))
+            return FALSE;
+
+          bits = GUINT32_FROM_LE (bits);
+          memcpy (&value->float_value, &bits, 4);
+          value->has_float_value = TRUE;
+        }
+      else if (field == VALUE_DOUBLE && wire_type == WIRE_TYPE_I64)
+        {
+          guint64 bits;
+
+          if (!read_fixed (&reader, 8, (guint8 *)&bits))
+            return FALSE;
+
+          bits = GUINT64_FROM_LE (bits);
+          memcpy (&value->double_value, &bits, 8);
+          value->has_double_value = TRUE;
+        }
+      else if (wire_type == WIRE_TYPE_VARINT
+               && (field == VALUE_INT || field == VALUE_UINT || field == VALUE_SINT || field == VALUE_BOOL))
+        {
+          if (!read_varint (&reader, &varint))
+            return FALSE;
+
+          switch (field)
+            {
+            case VALUE_INT:
+              value->int_value = (gint64)varint;
+              value->has_int_value = TRUE;
+              break;
+            case VALUE_UINT:
+              value->uint_value = varint;
+              value->has_uint_value = TRUE;
+              break;
+            case VALUE_SINT:
+              value->sint_value = (gint64)(varint >> 1) ^ -(gint64)(varint & 1);
+              value->has_sint_value = TRUE;
+              break;
+            case VALUE_BOOL:
+              value->bool_value = varint != 0;
+              value->has_bool_value = TRUE;
+              break;
+            default:
+              g_assert_not_reached ();
+            }
+        }
+      else if (!skip_field (&reader, wire_type))
+        return FALSE;
+    }
+
+  return TRUE;
+}
+
+/*
+ * shumate_vector_mvt_layer_read_feature:
+ * @layer: a #ShumateVectorMvtLayer
+ * @index: the index of the feature
+ * @feature: (out caller-allocates): the decoded feature
+ * @tags: a #GArray of guint32 to decode the tags into
+ *
+ * Decodes a feature's ID, type and tags. @feature->tags points into @tags.
+ *
+ * If the feature is malformed, @feature is left empty, with no tags and no
+ * geometry.
+ *
+ * Returns: %TRUE if the feature was decoded
+ */
+gboolean
+shumate_vector_mvt_layer_read_feature (ShumateVectorMvtLayer   *layer,
+                                       guint                    index,
+                                       ShumateVectorMvtFeature *feature,
+                                       GArray                  *tags)
+{
+  PbReader reader;
+  gboolean valid = TRUE;
+
+  g_return_val_if_fail (index < layer->n_features, FALSE);
+
+  memset (feature, 0, sizeof (ShumateVectorMvtFeature));
+  g_array_set_size (tags, 0);
+
+  pb_reader_init (&reader, &layer->features[index]);
+
+  while (valid && !pb_reader_at_end (&reader))
+    {
+      guint field, wire_type;
+      guint64 varint;
+
+      if (!read_key (&reader, &field, &wire_type))
+        valid = FALSE;
+      else if (field == FEATURE_TAGS)
+        valid = read_repeated_uint32 (&reader, wire_type, tags);
+      else if ((field == FEATURE_ID || field == FEATURE_TYPE) && wire_type == WIRE_TYPE_VARINT)
+        {
+          valid = read_varint (&reader, &varint);
+
+          if (field == FEATURE_ID)
+            {
+              feature->id = varint;
+              feature->has_id = TRUE;
+            }
+          else
+            feature->type = varint;
+        }
+      else
+        valid = skip_field (&reader, wire_type);
+    }
+
+  if (!valid)
+    {
+      memset (feature, 0, sizeof (ShumateVectorMvtFeature));
+      g_array_set_size (tags, 0);
+      return FALSE;
+    }
+
+  feature->data = layer->features[index];
+  feature->tags = (const guint32 *)tags->data;
+  feature->n_tags = tags->len;
+  return TRUE;
+}
+
+/*
+ * shumate_vector_mvt_feature_decode_geometry:
+ * @feature: a #ShumateVectorMvtFeature
+ * @geometry: a #GArray of guint32 to decode the geometry into
+ *
+ * Decodes a feature's geometry commands. If the feature is malformed,
+ * @geometry is left empty.
+ *
+ * Returns: %TRUE if the geometry was decoded
+ */
+gboolean
+shumate_vector_mvt_feature_decode_geometry (ShumateVectorMvtFeature *feature,
+                                            GArray                  *geometry)
+{
+  PbReader reader;
+
+  g_array_set_size (geometry, 0);
+
+  if (feature->data.data == NULL)
+    return FALSE;
+
+  pb_reader_init (&reader, &feature->data);
+
+  while (!pb_reader_at_end (&reader))
+    {
+      guint field, wire_type;
+      gboolean valid;
+
+      if (!read_key (&reader, &field, &wire_type))
+        valid = FALSE;
+      else if (field == FEATURE_GEOMETRY)
+        valid = read_repeated_uint32 (&reader, wire_type, geometry);
+      else
+        valid = skip_field (&reader, wire_type);
+
+      if (!valid)
+        {
+          g_array_set_size (geometry, 0);
+          return FALSE;
+        }
+    }
+
+  return TRUE;
+}
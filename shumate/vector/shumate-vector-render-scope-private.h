@@ -32,11 +32,26 @@ typedef enum {
   SHUMATE_VECTOR_GEOMETRY_POLYGON = VECTOR_TILE__TILE__GEOM_TYPE__POLYGON,
 } ShumateVectorGeometryType;
 
+/* The evaluated paint properties of a line or fill feature. Consecutive
+ * features with equal paints are drawn as one path. */
+typedef struct {
+  GdkRGBA color;
+  gboolean stroke;
+  double line_width;
+  cairo_line_cap_t line_cap;
+  cairo_line_join_t line_join;
+  /* Unscaled dash lengths, owned by the layer */
+  const double *dashes;
+  int num_dashes;
+} ShumateVectorPaint;
+
 typedef struct {
   cairo_t *cr;
   int target_size;
   double scale;
   double scale_factor;
+  /* The font options labels are shaped with. May be NULL. */
+  const cairo_font_options_t *font_options;
   double zoom_level;
   int tile_x;
   int tile_y;
@@ -53,10 +68,23 @@ typedef struct {
   ShumateVectorReaderIter *reader;
   ShumateVectorIndex *index;
   ShumateVectorIndexDescription *index_description;
+
+  /* Values of zoom-dependent expressions, which are the same for the whole
+   * tile. Maps ShumateVectorExpression to ShumateVectorValue. May be NULL. */
+  GHashTable *zoom_values;
+
+  /* The paint of the path currently being built on cr, if any */
+  ShumateVectorPaint batch_paint;
+  gboolean batch_pending;
+  /* Draw every feature by itself, for comparison in benchmarks */
+  gboolean batch_disabled;
 } ShumateVectorRenderScope;
 
 
 void shumate_vector_render_scope_exec_geometry (ShumateVectorRenderScope *self);
+void shumate_vector_render_scope_batch_feature (ShumateVectorRenderScope *self,
+                                                const ShumateVectorPaint *paint);
+void shumate_vector_render_scope_flush_batch (ShumateVectorRenderScope *self);
 void shumate_vector_render_scope_get_geometry_center (ShumateVectorRenderScope *self, double *x, double *y);
 void shumate_vector_render_scope_get_bounds (ShumateVectorRenderScope *self,
                                              float                    *min_x,
@@ -68,6 +96,7 @@ ShumateVectorGeometryType shumate_vector_render_scope_get_geometry_type (Shumate
 GPtrArray *shumate_vector_render_scope_get_geometry (ShumateVectorRenderScope *self);
 
 void shumate_vector_render_scope_get_variable (ShumateVectorRenderScope *self, const char *variable, ShumateVectorValue *value);
+void shumate_vector_render_scope_get_variable_atom (ShumateVectorRenderScope *self, GQuark atom, const char *variable, ShumateVectorValue *value);
 
 GHashTable *shumate_vector_render_scope_create_tag_table (ShumateVectorRenderScope *self);
 
@@ -15,6 +15,7 @@
  * License along with this library; if not, see <https://www.gnu.org/licenses/>.
  */
 
+#include <math.h>
 #include "shumate-vector-render-scope-private.h"
 
 enum {
@@ -39,21 +40,384 @@ apply_transforms (ShumateVectorRenderScope *self,
   *y = ((*y / extent) - self->overzoom_y) * self->overzoom_scale;
 }
 
-/* Draws the current feature as a path onto the scope's cairo context. */
-void
-shumate_vector_render_scope_exec_geometry (ShumateVectorRenderScope *self)
+enum {
+  OUT_LEFT = 1 << 0,
+  OUT_RIGHT = 1 << 1,
+  OUT_TOP = 1 << 2,
+  OUT_BOTTOM = 1 << 3,
+};
+
+/* Turns decoded geometry commands into a cairo path, leaving out what can't
+ * be seen in the output.
+ *
+ * Vertices closer than tolerance to the previous one, which would land in
+ * the same output pixel, are dropped, except at the end of a line. When
+ * clip is set, geometry outside the box is removed as well: polygon rings
+ * are clipped against it, and line segments entirely on the far side of
+ * one of its edges are skipped, breaking the line in two. The box must
+ * include enough margin for stroke caps and joins. */
+typedef struct {
+  cairo_t *cr;
+  double tolerance;
+  gboolean clip;
+  gboolean polygon;
+  double min_x, min_y, max_x, max_y;
+
+  /* Lines: the last point seen and its outcode, the ring start for closing
+   * broken rings, and the last point given to cairo */
+  double x, y;
+  int outcode;
+  double start_x, start_y;
+  gboolean need_move, broken;
+  double last_x, last_y;
+  gboolean have_pending;
+
+  /* Polygons: the current ring, and scratch space for clipping it, as
+   * pairs of doubles */
+  GArray *ring;
+  GArray *scratch;
+  int ring_outcode;
+} GeometryWriter;
+
+static int
+get_outcode (GeometryWriter *w,
+             double          x,
+             double          y)
+{
+  int code = 0;
+
+  if (!w->clip)
+    return 0;
+
+  if (x < w->min_x)
+    code |= OUT_LEFT;
+  else if (x > w->max_x)
+    code |= OUT_RIGHT;
+  if (y < w->min_y)
+    code |= OUT_TOP;
+  else if (y > w->max_y)
+    code |= OUT_BOTTOM;
+
+  return code;
+}
+
+static gboolean
+is_near (GeometryWriter *w,
+         double          x1,
+         double          y1,
+         double          x2,
+         double          y2)
+{
+  return fabs (x1 - x2) < w->tolerance && fabs (y1 - y2) < w->tolerance;
+}
+
+static void
+line_finish_run (GeometryWriter *w)
+{
+  if (w->have_pending)
+    {
+      cairo_line_to (w->cr, w->x, w->y);
+      w->have_pending = FALSE;
+    }
+
+  w->need_move = TRUE;
+}
+
+static void
+line_move_to (GeometryWriter *w,
+              double          x,
+              double          y)
+{
+  line_finish_run (w);
+
+  w->x = w->start_x = x;
+  w->y = w->start_y = y;
+  w->outcode = get_outcode (w, x, y);
+  w->broken = FALSE;
+}
+
+static void
+line_line_to (GeometryWriter *w,
+              double          x,
+              double          y)
+{
+  int outcode = get_outcode (w, x, y);
+
+  if ((w->outcode & outcode) != 0)
+    {
+      /* The segment can't be seen */
+      line_finish_run (w);
+      w->broken = TRUE;
+    }
+  else
+    {
+      if (w->need_move)
+        {
+          cairo_move_to (w->cr, w->x, w->y);
+          w->last_x = w->x;
+          w->last_y = w->y;
+          w->need_move = FALSE;
+        }
+
+      if (is_near (w, x, y, w->last_x, w->last_y))
+        w->have_pending = TRUE;
+      else
+        {
+          cairo_line_to (w->cr, x, y);
+          w->last_x = x;
+          w->last_y = y;
+          w->have_pending = FALSE;
+        }
+    }
+
+  w->x = x;
+  w->y = y;
+  w->outcode = outcode;
+}
+
+static void
+line_close (GeometryWriter *w)
+{
+  double x = w->x, y = w->y;
+
+  if (w->broken || w->need_move)
+    {
+      /* Part of the ring was skipped, so cairo's subpath doesn't start at
+       * the ring's start. Draw the closing segment explicitly. */
+      line_line_to (w, w->start_x, w->start_y);
+      line_finish_run (w);
+    }
+  else
+    {
+      if (w->have_pending)
+        cairo_line_to (w->cr, w->x, w->y);
+      cairo_close_path (w->cr);
+      w->have_pending = FALSE;
+      w->need_move = TRUE;
+    }
+
+  /* After ClosePath, the cursor stays at the ring's last point */
+  w->x = x;
+  w->y = y;
+  w->outcode = get_outcode (w, x, y);
+}
+
+/* One pass of Sutherland-Hodgman clipping, against one edge of the box */
+static void
+clip_ring (GeometryWriter *w,
+           GArray         *in,
+           GArray         *out,
+           int             edge)
+{
+  guint n = in->len / 2;
+  double *points = (double *)in->data;
+
+  g_array_set_size (out, 0);
+
+  for (guint i = 0; i < n; i ++)
+    {
+      double x1 = points[((i + n - 1) % n) * 2], y1 = points[((i + n - 1) % n) * 2 + 1];
+      double x2 = points[i * 2], y2 = points[i * 2 + 1];
+      gboolean in1, in2;
+      double bound;
+
+      switch (edge)
+        {
+        case OUT_LEFT:
+          bound = w->min_x;
+          in1 = x1 >= bound;
+          in2 = x2 >= bound;
+          break;
+        case OUT_RIGHT:
+          bound = w->max_x;
+          in1 = x1 <= bound;
+          in2 = x2 <= bound;
+          break;
+        case OUT_TOP:
+          bound = w->min_y;
+          in1 = y1 >= bound;
+          in2 = y2 >= bound;
+          break;
+        case OUT_BOTTOM:
+          bound = w->max_y;
+          in1 = y1 <= bound;
+          in2 = y2 <= bound;
+          break;
+        default:
+          g_assert_not_reached ();
+        }
+
+      if (in1 != in2)
+        {
+          double point[2];
+
+          if (edge == OUT_LEFT || edge == OUT_RIGHT)
+            {
+              point[0] = bound;
+              point[1] = y1 + (y2 - y1) * (bound - x1) / (x2 - x1);
+            }
+          else
+            {
+              point[0] = x1 + (x2 - x1) * (bound - y1) / (y2 - y1);
+              point[1] = bound;
+            }
+
+          g_array_append_vals (out, point, 2);
+        }
+
+      if (in2)
+        g_array_append_vals (out, &points[i * 2], 2);
+    }
+}
+
+static void
+polygon_finish_ring (GeometryWriter *w)
+{
+  GArray *ring = w->ring;
+  double *points;
+
+  if (ring->len < 6)
+    {
+      g_array_set_size (ring, 0);
+      return;
+    }
+
+  if (w->ring_outcode != 0)
+    {
+      static const int edges[] = { OUT_LEFT, OUT_RIGHT, OUT_TOP, OUT_BOTTOM };
+
+      for (int i = 0; i < G_N_ELEMENTS (edges) && ring->len >= 6; i ++)
+        {
+          GArray *tmp;
+
+          if (!(w->ring_outcode & edges[i]))
+            continue;
+
+          clip_ring (w, ring, w->scratch, edges[i]);
+          tmp = ring;
+          ring = w->scratch;
+          w->scratch = tmp;
+        }
+
+      w->ring = ring;
+    }
+
+  if (ring->len >= 6)
+    {
+      points = (double *)ring->data;
+      cairo_move_to (w->cr, points[0], points[1]);
+      for (guint i = 2; i < ring->len; i += 2)
+        cairo_line_to (w->cr, points[i], points[i + 1]);
+      cairo_close_path (w->cr);
+    }
+
+  g_array_set_size (w->ring, 0);
+  w->ring_outcode = 0;
+}
+
+static void
+polygon_add_point (GeometryWriter *w,
+                   double          x,
+                   double          y)
 {
-  VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  double point[2] = { x, y };
+  double *points = (double *)w->ring->data;
+
+  if (w->ring->len > 0 && is_near (w, x, y, points[w->ring->len - 2], points[w->ring->len - 1]))
+    return;
+
+  w->ring_outcode |= get_outcode (w, x, y);
+  g_array_append_vals (w->ring, point, 2);
+}
+
+static void
+writer_move_to (GeometryWriter *w,
+                double          x,
+                double          y)
+{
+  if (w->polygon)
+    {
+      polygon_finish_ring (w);
+      polygon_add_point (w, x, y);
+    }
+  else
+    line_move_to (w, x, y);
+}
+
+static void
+writer_line_to (GeometryWriter *w,
+                double          x,
+                double          y)
+{
+  if (w->polygon)
+    polygon_add_point (w, x, y);
+  else
+    line_line_to (w, x, y);
+}
+
+static void
+writer_close (GeometryWriter *w)
+{
+  if (w->polygon)
+    polygon_finish_ring (w);
+  else
+    line_close (w);
+}
+
+static void
+writer_end (GeometryWriter *w)
+{
+  if (w->polygon)
+    {
+      polygon_finish_ring (w);
+      g_array_unref (w->ring);
+      g_array_unref (w->scratch);
+    }
+  else
+    line_finish_run (w);
+}
+
+/* Appends the current feature to the path on the scope's cairo context.
+ * Parts of the feature further than margin output pixels outside the tile
+ * are left out, unless margin is negative. */
+static void
+append_geometry (ShumateVectorRenderScope *self,
+                 gboolean                  stroke,
+                 double                    margin)
+{
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
+  GeometryWriter w = { 0 };
+  const guint32 *geometry;
+  guint n_geometry;
+  double x = 0, y = 0;
 
   g_return_if_fail (feature != NULL);
 
-  cairo_new_path (self->cr);
-  cairo_move_to (self->cr, 0, 0);
+  geometry = shumate_vector_reader_iter_get_feature_geometry (self->reader, &n_geometry);
+
+  /* self->scale is in tile units per logical pixel. The box is the visible
+   * part of the source tile, which is all of it unless overzooming. */
+  w.cr = self->cr;
+  w.tolerance = self->scale / self->scale_factor;
+  w.polygon = !stroke && feature->type == SHUMATE_VECTOR_GEOMETRY_POLYGON;
+  /* Skipping segments would change the shape of a filled line string */
+  w.clip = margin >= 0 && (stroke || w.polygon);
+  w.min_x = self->overzoom_x * layer->extent - margin * self->scale;
+  w.min_y = self->overzoom_y * layer->extent - margin * self->scale;
+  w.max_x = (self->overzoom_x + 1.0 / self->overzoom_scale) * layer->extent + margin * self->scale;
+  w.max_y = (self->overzoom_y + 1.0 / self->overzoom_scale) * layer->extent + margin * self->scale;
+  w.need_move = TRUE;
+
+  if (w.polygon)
+    {
+      w.ring = g_array_new (FALSE, FALSE, sizeof (double));
+      w.scratch = g_array_new (FALSE, FALSE, sizeof (double));
+    }
 
-  for (int i = 0; i < feature->n_geometry; i ++)
+  for (int i = 0; i < n_geometry; i ++)
     {
-      int cmd = feature->geometry[i];
-      double dx, dy;
+      int cmd = geometry[i];
 
       /* See https://github.com/mapbox/vector-tile-spec/tree/master/2.1#43-geometry-encoding */
       int op = cmd & 0x7;
@@ -63,45 +427,182 @@ shumate_vector_render_scope_exec_geometry (ShumateVectorRenderScope *self)
         {
           switch (op) {
           case MOVE_TO:
-            g_return_if_fail (i + 2 < feature->n_geometry);
-            dx = zigzag (feature->geometry[++i]);
-            dy = zigzag (feature->geometry[++i]);
-            cairo_rel_move_to (self->cr, dx, dy);
+            if (i + 2 >= n_geometry)
+              goto out;
+            x += zigzag (geometry[++i]);
+            y += zigzag (geometry[++i]);
+            writer_move_to (&w, x, y);
             break;
           case LINE_TO:
-            g_return_if_fail (i + 2 < feature->n_geometry);
-            dx = zigzag (feature->geometry[++i]);
-            dy = zigzag (feature->geometry[++i]);
-            cairo_rel_line_to (self->cr, dx, dy);
+            if (i + 2 >= n_geometry)
+              goto out;
+            x += zigzag (geometry[++i]);
+            y += zigzag (geometry[++i]);
+            writer_line_to (&w, x, y);
             break;
           case CLOSE_PATH:
-            cairo_get_current_point (self->cr, &dx, &dy);
-            cairo_close_path (self->cr);
-            cairo_move_to (self->cr, dx, dy);
+            writer_close (&w);
             break;
           default:
             g_assert_not_reached ();
           }
         }
     }
+
+out:
+  writer_end (&w);
+}
+
+
+/* Draws the current feature as a path onto the scope's cairo context. The
+ * path is used as a fill, so it gets the one pixel margin for antialiasing. */
+void
+shumate_vector_render_scope_exec_geometry (ShumateVectorRenderScope *self)
+{
+  cairo_new_path (self->cr);
+  append_geometry (self, FALSE, 1);
 }
 
 
+static gboolean
+paint_equal (const ShumateVectorPaint *a,
+             const ShumateVectorPaint *b)
+{
+  return gdk_rgba_equal (&a->color, &b->color)
+         && a->stroke == b->stroke
+         && (!a->stroke
+             || (a->line_width == b->line_width
+                 && a->line_cap == b->line_cap
+                 && a->line_join == b->line_join
+                 && a->dashes == b->dashes
+                 && a->num_dashes == b->num_dashes));
+}
+
+static void
+apply_paint (ShumateVectorRenderScope *self,
+             const ShumateVectorPaint *paint)
+{
+  cairo_set_source_rgba (self->cr, paint->color.red, paint->color.green, paint->color.blue, paint->color.alpha);
+
+  if (!paint->stroke)
+    return;
+
+  cairo_set_line_width (self->cr, paint->line_width * self->scale);
+  cairo_set_line_cap (self->cr, paint->line_cap);
+  cairo_set_line_join (self->cr, paint->line_join);
+
+  if (paint->dashes == NULL)
+    cairo_set_dash (self->cr, NULL, 0, 0);
+  else
+    {
+      int i;
+      g_autofree double *dasharray = g_new (double, paint->num_dashes);
+      gboolean any_nonzero = FALSE;
+      gboolean all_positive = TRUE;
+
+      for (i = 0; i < paint->num_dashes; i ++)
+        {
+          dasharray[i] = paint->dashes[i] * paint->line_width * self->scale;
+
+          if (dasharray[i] < 0)
+            {
+              all_positive = FALSE;
+              break;
+            }
+          else if (dasharray[i] != 0)
+            any_nonzero = TRUE;
+        }
+
+      /* make sure the dasharray is valid */
+      if (any_nonzero && all_positive)
+        cairo_set_dash (self->cr, dasharray, paint->num_dashes, 0);
+      else
+        cairo_set_dash (self->cr, NULL, 0, 0);
+    }
+}
+
+/* How far outside the tile, in output pixels, geometry drawn with the paint
+ * can still be seen. Fills need one pixel for antialiasing. Strokes need
+ * half their width plus the longest miter join at cairo's default miter
+ * limit of 10. Dashed lines are not clipped at all, since breaking a line
+ * would restart its dash pattern. */
+static double
+get_margin (const ShumateVectorPaint *paint)
+{
+  if (!paint->stroke)
+    return 1;
+
+  if (paint->dashes != NULL)
+    return -1;
+
+  return paint->line_width * 5 + 1;
+}
+
+/* Adds the current feature to the batch of features drawn with the same
+ * paint, starting a new batch if the paint differs from the pending one.
+ * Only consecutive features are merged, so the draw order is unchanged.
+ *
+ * Translucent features are drawn right away, since overlapping features in
+ * one path would only be blended once. Merging opaque fills is safe with
+ * the nonzero fill rule: the spec requires holes to wind the opposite way
+ * from their exterior ring, so they still cancel out. */
+void
+shumate_vector_render_scope_batch_feature (ShumateVectorRenderScope *self,
+                                           const ShumateVectorPaint *paint)
+{
+  g_return_if_fail (paint != NULL);
+
+  if (!self->batch_pending || !paint_equal (&self->batch_paint, paint))
+    {
+      shumate_vector_render_scope_flush_batch (self);
+
+      apply_paint (self, paint);
+      cairo_new_path (self->cr);
+      self->batch_paint = *paint;
+      self->batch_pending = TRUE;
+    }
+
+  append_geometry (self, paint->stroke, get_margin (paint));
+
+  if (paint->color.alpha < 1.0 || self->batch_disabled)
+    shumate_vector_render_scope_flush_batch (self);
+}
+
+/* Draws the pending batch, if any. Must be called before the transform of
+ * the cairo context changes and before drawing anything else on it. */
+void
+shumate_vector_render_scope_flush_batch (ShumateVectorRenderScope *self)
+{
+  if (!self->batch_pending)
+    return;
+
+  if (self->batch_paint.stroke)
+    cairo_stroke (self->cr);
+  else
+    cairo_fill (self->cr);
+
+  self->batch_pending = FALSE;
+}
+
 GPtrArray *
 shumate_vector_render_scope_get_geometry (ShumateVectorRenderScope *self)
 {
-  GPtrArray *lines = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_line_string_free);
+  GPtrArray *lines = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_line_string_unref);
   ShumateVectorLineString *current_line = NULL;
-  VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
-  VectorTile__Tile__Layer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
+  const guint32 *geometry;
+  guint n_geometry;
   float x = 0, y = 0;
   float x_tf, y_tf;
 
   g_return_val_if_fail (feature != NULL, NULL);
 
-  for (int i = 0; i < feature->n_geometry; i ++)
+  geometry = shumate_vector_reader_iter_get_feature_geometry (self->reader, &n_geometry);
+
+  for (int i = 0; i < n_geometry; i ++)
     {
-      int cmd = feature->geometry[i];
+      int cmd = geometry[i];
       double start_x = 0, start_y = 0;
 
       int op = cmd & 0x7;
@@ -114,17 +615,15 @@ shumate_vector_render_scope_get_geometry (ShumateVectorRenderScope *self)
         {
           switch (op) {
           case MOVE_TO:
-            g_return_val_if_fail (i + 2 < feature->n_geometry, NULL);
+            g_return_val_if_fail (i + 2 < n_geometry, NULL);
 
             if (current_line != NULL)
               g_ptr_array_add (lines, current_line);
 
-            current_line = g_new (ShumateVectorLineString, 1);
-            current_line->points = g_new (ShumateVectorPoint, 1);
-            current_line->n_points = 1;
+            current_line = shumate_vector_line_string_new (1);
 
-            x += zigzag (feature->geometry[++i]);
-            y += zigzag (feature->geometry[++i]);
+            x += zigzag (geometry[++i]);
+            y += zigzag (geometry[++i]);
 
             x_tf = x;
             y_tf = y;
@@ -139,11 +638,11 @@ shumate_vector_render_scope_get_geometry (ShumateVectorRenderScope *self)
             };
             break;
           case LINE_TO:
-            g_return_val_if_fail (i + 2 < feature->n_geometry, NULL);
+            g_return_val_if_fail (i + 2 < n_geometry, NULL);
             g_return_val_if_fail (current_line != NULL, NULL);
 
-            x += zigzag (feature->geometry[++i]);
-            y += zigzag (feature->geometry[++i]);
+            x += zigzag (geometry[++i]);
+            y += zigzag (geometry[++i]);
 
             x_tf = x;
             y_tf = y;
@@ -182,8 +681,10 @@ shumate_vector_render_scope_get_bounds (ShumateVectorRenderScope *self,
                                         float                    *max_x,
                                         float                    *max_y)
 {
-  VectorTile__Tile__Layer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
-  VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  const guint32 *geometry;
+  guint n_geometry;
   double x = 0, y = 0;
 
   *min_x = G_MAXFLOAT;
@@ -193,9 +694,11 @@ shumate_vector_render_scope_get_bounds (ShumateVectorRenderScope *self,
 
   g_return_if_fail (feature != NULL);
 
-  for (int i = 0; i < feature->n_geometry; i ++)
+  geometry = shumate_vector_reader_iter_get_feature_geometry (self->reader, &n_geometry);
+
+  for (int i = 0; i < n_geometry; i ++)
     {
-      int cmd = feature->geometry[i];
+      int cmd = geometry[i];
 
       /* See https://github.com/mapbox/vector-tile-spec/tree/master/2.1#43-geometry-encoding */
       int op = cmd & 0x7;
@@ -205,14 +708,14 @@ shumate_vector_render_scope_get_bounds (ShumateVectorRenderScope *self,
         {
           switch (op) {
           case 1:
-            g_return_if_fail (i + 2 < feature->n_geometry);
-            x += zigzag (feature->geometry[++i]);
-            y += zigzag (feature->geometry[++i]);
+            g_return_if_fail (i + 2 < n_geometry);
+            x += zigzag (geometry[++i]);
+            y += zigzag (geometry[++i]);
             break;
           case 2:
-            g_return_if_fail (i + 2 < feature->n_geometry);
-            x += zigzag (feature->geometry[++i]);
-            y += zigzag (feature->geometry[++i]);
+            g_return_if_fail (i + 2 < n_geometry);
+            x += zigzag (geometry[++i]);
+            y += zigzag (geometry[++i]);
             break;
           case 7:
             break;
@@ -235,7 +738,7 @@ shumate_vector_render_scope_get_bounds (ShumateVectorRenderScope *self,
 ShumateVectorGeometryType
 shumate_vector_render_scope_get_geometry_type (ShumateVectorRenderScope *self)
 {
-  VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
   g_return_val_if_fail (feature != NULL, 0);
   return (ShumateVectorGeometryType) feature->type;
 }
@@ -252,22 +755,26 @@ shumate_vector_render_scope_get_geometry_center (ShumateVectorRenderScope *self,
 }
 
 static void
-convert_vector_value (VectorTile__Tile__Value *v, ShumateVectorValue *value)
-{
-  if (v->has_int_value)
-    shumate_vector_value_set_number (value, v->int_value);
-  else if (v->has_uint_value)
-    shumate_vector_value_set_number (value, v->uint_value);
-  else if (v->has_sint_value)
-    shumate_vector_value_set_number (value, v->sint_value);
-  else if (v->has_float_value)
-    shumate_vector_value_set_number (value, v->float_value);
-  else if (v->has_double_value)
-    shumate_vector_value_set_number (value, v->double_value);
-  else if (v->has_bool_value)
-    shumate_vector_value_set_boolean (value, v->bool_value);
-  else if (v->string_value != NULL)
-    shumate_vector_value_set_string (value, v->string_value);
+convert_vector_value (ShumateVectorMvtLayer *layer, guint index, ShumateVectorValue *value)
+{
+  ShumateVectorMvtValue v;
+
+  if (!shumate_vector_mvt_layer_get_value (layer, index, &v))
+    shumate_vector_value_unset (value);
+  else if (v.has_int_value)
+    shumate_vector_value_set_number (value, v.int_value);
+  else if (v.has_uint_value)
+    shumate_vector_value_set_number (value, v.uint_value);
+  else if (v.has_sint_value)
+    shumate_vector_value_set_number (value, v.sint_value);
+  else if (v.has_float_value)
+    shumate_vector_value_set_number (value, v.float_value);
+  else if (v.has_double_value)
+    shumate_vector_value_set_number (value, v.double_value);
+  else if (v.has_bool_value)
+    shumate_vector_value_set_boolean (value, v.bool_value);
+  else if (v.has_string_value)
+    shumate_vector_value_set_string_len (value, v.string_value, v.string_len);
   else
     shumate_vector_value_unset (value);
 }
@@ -275,14 +782,48 @@ convert_vector_value (VectorTile__Tile__Value *v, ShumateVectorValue *value)
 void
 shumate_vector_render_scope_get_variable (ShumateVectorRenderScope *self, const char *variable, ShumateVectorValue *value)
 {
-  VectorTile__Tile__Layer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
-  VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
 
   for (int i = 0; i + 1 < feature->n_tags; i += 2)
     {
+      if (feature->tags[i] >= layer->n_keys)
+        continue;
+
       if (strcmp (layer->keys[feature->tags[i]], variable) == 0)
         {
-          convert_vector_value (layer->values[feature->tags[i + 1]], value);
+          convert_vector_value (layer, feature->tags[i + 1], value);
+          return;
+        }
+    }
+
+  shumate_vector_value_unset (value);
+}
+
+/* Like shumate_vector_render_scope_get_variable(), but compares keys by
+ * atom, from shumate_vector_mvt_intern_key(), rather than by string */
+void
+shumate_vector_render_scope_get_variable_atom (ShumateVectorRenderScope *self,
+                                               GQuark                    atom,
+                                               const char               *variable,
+                                               ShumateVectorValue       *value)
+{
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+
+  if (atom == 0)
+    {
+      shumate_vector_render_scope_get_variable (self, variable, value);
+      return;
+    }
+
+  shumate_vector_mvt_layer_update_key_atoms (layer);
+
+  for (int i = 0; i + 1 < feature->n_tags; i += 2)
+    {
+      if (feature->tags[i] < layer->n_keys && layer->key_atoms[feature->tags[i]] == atom)
+        {
+          convert_vector_value (layer, feature->tags[i + 1], value);
           return;
         }
     }
@@ -296,8 +837,8 @@ shumate_vector_render_scope_create_tag_table (ShumateVectorRenderScope *self)
 {
   g_autoptr(GHashTable) tags = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, g_free);
   g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
-  VectorTile__Tile__Layer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
-  VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+  ShumateVectorMvtLayer *layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
 
   for (int i = 1; i < feature->n_tags; i += 2)
     {
@@ -308,7 +849,7 @@ shumate_vector_render_scope_create_tag_table (ShumateVectorRenderScope *self)
       if (key >= layer->n_keys || val >= layer->n_values)
         continue;
 
-      convert_vector_value (layer->values[val], &value);
+      convert_vector_value (layer, val, &value);
       g_hash_table_insert (tags, g_strdup (layer->keys[key]), shumate_vector_value_as_string (&value));
     }
 
@@ -336,7 +877,7 @@ void
 shumate_vector_render_scope_index_layer (ShumateVectorRenderScope *self)
 {
   const char *layer_name = shumate_vector_reader_iter_get_layer_name (self->reader);
-  VectorTile__Tile__Layer *layer;
+  ShumateVectorMvtLayer *layer;
   FieldIndexingData *fields;
   int feature_idx = 0;
   ShumateVectorIndexBitset *broad_geometry_indexes[3] = { NULL, NULL, NULL };
@@ -350,6 +891,8 @@ shumate_vector_render_scope_index_layer (ShumateVectorRenderScope *self)
   if (!shumate_vector_index_description_has_layer (self->index_description, layer_name))
     return;
 
+  shumate_vector_index_add_layer (self->index, self->source_layer_idx);
+
   layer = shumate_vector_reader_iter_get_layer_struct (self->reader);
   fields = g_new0 (FieldIndexingData, layer->n_keys);
 
@@ -367,7 +910,7 @@ shumate_vector_render_scope_index_layer (ShumateVectorRenderScope *self)
   shumate_vector_reader_iter_read_feature (self->reader, 0);
   while (TRUE)
     {
-      VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
+      ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (self->reader);
 
       if (broad_geometry_indexes[0] != NULL)
         {
@@ -428,10 +971,9 @@ shumate_vector_render_scope_index_layer (ShumateVectorRenderScope *self)
           else
             {
               g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
-              VectorTile__Tile__Value *v = layer->values[val];
               const char *field_name = layer->keys[key];
 
-              convert_vector_value (v, &value);
+              convert_vector_value (layer, val, &value);
 
               if (shumate_vector_index_description_has_value (self->index_description, layer_name, field_name, &value))
                 bitset = shumate_vector_index_bitset_new (layer->n_features);
@@ -471,10 +1013,8 @@ shumate_vector_render_scope_index_layer (ShumateVectorRenderScope *self)
         {
           int val = GPOINTER_TO_INT(valp);
           g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
-          VectorTile__Tile__Value *v;
 
-          v = layer->values[val];
-          convert_vector_value (v, &value);
+          convert_vector_value (layer, val, &value);
 
           shumate_vector_index_add_bitset (self->index, self->source_layer_idx, field_name, &value, bitset);
         }
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <gtk/gtk.h>
+#include "../shumate-vector-sprite.h"
+
+G_BEGIN_DECLS
+
+/* One run of a shaped label: either a glyph string in a single font and
+ * color, or an inline image. All positions and sizes are in pixels,
+ * relative to the label's layout. */
+typedef struct {
+  /* For glyph runs. x and y are the origin of the run's baseline. */
+  PangoFont *font;
+  PangoGlyphString *glyphs;
+
+  /* For image runs. x, y, width and height are the image's ink extents and
+   * advance is its logical width, which includes letter spacing. */
+  ShumateVectorSprite *sprite;
+  double width, height, advance;
+
+  double x, y;
+  GdkRGBA color;
+} ShumateVectorShapedRun;
+
+typedef struct {
+  int layout_width, layout_height, layout_y;
+  double baseline;
+
+  /* Array of ShumateVectorShapedRun, in visual order */
+  GArray *runs;
+
+  /*< private >*/
+  guint ref_count;
+} ShumateVectorShapedText;
+
+
+ShumateVectorShapedText *shumate_vector_shaped_text_new (PangoContext  *context,
+                                                         GPtrArray     *formatted_text,
+                                                         const char    *font,
+                                                         double         size,
+                                                         double         letter_spacing,
+                                                         const GdkRGBA *color);
+
+guint shumate_vector_shaped_text_get_font_options_id (const cairo_font_options_t *options);
+
+ShumateVectorShapedText *shumate_vector_shaped_text_shape (GPtrArray                  *formatted_text,
+                                                           const char                 *font,
+                                                           double                      size,
+                                                           double                      letter_spacing,
+                                                           const GdkRGBA              *color,
+                                                           const cairo_font_options_t *font_options);
+ShumateVectorShapedText *shumate_vector_shaped_text_lookup (GPtrArray                  *formatted_text,
+                                                            const char                 *font,
+                                                            double                      size,
+                                                            double                      letter_spacing,
+                                                            const GdkRGBA              *color,
+                                                            const cairo_font_options_t *font_options);
+void shumate_vector_shaped_text_cache_set_max_size (gsize max_size);
+
+void shumate_vector_shaped_text_lock_fonts (void);
+void shumate_vector_shaped_text_unlock_fonts (void);
+
+ShumateVectorShapedText *shumate_vector_shaped_text_ref (ShumateVectorShapedText *self);
+void shumate_vector_shaped_text_unref (ShumateVectorShapedText *self);
+
+gsize shumate_vector_shaped_text_get_memory_size (ShumateVectorShapedText *self);
+
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ShumateVectorShapedText, shumate_vector_shaped_text_unref)
+
+G_END_DECLS
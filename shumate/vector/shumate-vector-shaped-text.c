@@ -0,0 +1,630 @@
+/*
+ * Copyright (C) 2026 libshumate contributors
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, see <https://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Laying out a label with Pango is the expensive part of creating a symbol.
+ * ShumateVectorShapedText is the result of that layout, made while the tile
+ * is rendered on a worker thread: the label's extents and its runs of
+ * glyphs, with the font, glyph ids and advances already resolved. The
+ * symbol only has to turn them into render nodes on the main thread.
+ *
+ * The runs are immutable once created, so a shaped text can be shared by
+ * all the symbols of a feature, and by every other label with the same text
+ * and style. The same street name shows up in neighbouring tiles and at
+ * every zoom level, so shumate_vector_shaped_text_lookup() keeps the most
+ * recently used shaped texts in a process-wide cache, bounded by their
+ * estimated size.
+ *
+ * Pango font maps and contexts are not thread safe, and neither are the
+ * fonts they create. Labels are shaped with a font map of their own,
+ * separate from the one GTK uses on the main thread, and everything that
+ * touches it or its fonts holds font_mutex: the render threads while
+ * shaping, and the main thread while it builds text nodes from the runs
+ * (see shumate_vector_shaped_text_lock_fonts()).
+ *
+ * Hinting changes glyph metrics, so labels are shaped with the cairo font
+ * options of the widget they are shown in. Maps in different windows may
+ * have different ones, so the font map has a context for each distinct set
+ * of options, and the options are part of the cache key.
+ */
+
+#include <pango/pangocairo.h>
+#include "shumate-vector-shaped-text-private.h"
+#include "../shumate-vector-value-private.h"
+
+#define DEFAULT_CACHE_SIZE (4 * 1024 * 1024)
+
+typedef struct {
+  char *key;
+  ShumateVectorShapedText *shaped_text;
+  gsize size;
+} CacheEntry;
+
+typedef struct {
+  /* NULL for the default options */
+  cairo_font_options_t *options;
+  PangoContext *context;
+} FontContext;
+
+/* Protects font_map, font_contexts and the fonts they create */
+static GMutex font_mutex;
+static PangoFontMap *font_map;
+/* FontContext for each set of font options seen so far, whose index is the
+ * options' ID. They are never freed, but there are only as many as there
+ * are distinct font options among the app's windows. */
+static GArray *font_contexts;
+
+/* All of these are protected by cache_mutex */
+static GMutex cache_mutex;
+/* Key -> GList link in cache_lru */
+static GHashTable *cache_entries;
+/* CacheEntry, most recently used first */
+static GQueue cache_lru = G_QUEUE_INIT;
+static gsize cache_size;
+static gsize cache_max_size = DEFAULT_CACHE_SIZE;
+
+
+static void
+shaped_run_clear (ShumateVectorShapedRun *run)
+{
+  g_clear_object (&run->font);
+  g_clear_pointer (&run->glyphs, pango_glyph_string_free);
+  g_clear_object (&run->sprite);
+}
+
+
+static PangoAttrShape *
+get_shape_from_glyph_item (PangoGlyphItem *item)
+{
+  for (GSList *list = item->item->analysis.extra_attrs; list != NULL; list = list->next)
+    if (((PangoAttribute*)list->data)->klass->type == PANGO_ATTR_SHAPE)
+      return (PangoAttrShape*)list->data;
+  return NULL;
+}
+
+static void
+get_color_from_glyph_item (PangoGlyphItem *item, GdkRGBA *color)
+{
+  *color = SHUMATE_VECTOR_COLOR_BLACK;
+
+  for (GSList *list = item->item->analysis.extra_attrs; list != NULL; list = list->next)
+    {
+      if (((PangoAttribute*)list->data)->klass->type == PANGO_ATTR_FOREGROUND)
+        {
+          PangoColor c = ((PangoAttrColor*)list->data)->color;
+          color->red = c.red / 65535.0;
+          color->green = c.green / 65535.0;
+          color->blue = c.blue / 65535.0;
+        }
+      else if (((PangoAttribute*)list->data)->klass->type == PANGO_ATTR_FOREGROUND_ALPHA)
+        color->alpha = ((PangoAttrInt*)list->data)->value / 65535.0;
+    }
+}
+
+
+/*
+ * shumate_vector_shaped_text_new:
+ * @context: the #PangoContext to lay out the text with
+ * @formatted_text: (element-type ShumateVectorFormatPart): the label
+ * @font: (nullable): a font description string
+ * @size: the font size in pixels
+ * @letter_spacing: the letter spacing in ems
+ * @color: the default text color
+ *
+ * Lays out a label. @context must not be used by any other thread at the
+ * same time.
+ *
+ * Returns: (transfer full): the shaped text
+ */
+ShumateVectorShapedText *
+shumate_vector_shaped_text_new (PangoContext  *context,
+                                GPtrArray     *formatted_text,
+                                const char    *font,
+                                double         size,
+                                double         letter_spacing,
+                                const GdkRGBA *color)
+{
+  ShumateVectorShapedText *self;
+  g_autoptr(PangoLayout) layout = pango_layout_new (context);
+  g_autoptr(PangoAttrList) attrs = pango_attr_list_new ();
+  g_autoptr(PangoLayoutIter) iter = NULL;
+  g_autoptr(GString) string = g_string_new ("");
+  PangoAttribute *attr;
+  PangoRectangle ink_rect;
+
+  g_return_val_if_fail (PANGO_IS_CONTEXT (context), NULL);
+  g_return_val_if_fail (formatted_text != NULL, NULL);
+
+  if (font != NULL)
+    {
+      g_autoptr(PangoFontDescription) desc = pango_font_description_from_string (font);
+      attr = pango_attr_font_desc_new (desc);
+      pango_attr_list_insert (attrs, attr);
+    }
+
+  attr = pango_attr_letter_spacing_new (letter_spacing * size * PANGO_SCALE);
+  pango_attr_list_insert (attrs, attr);
+
+  attr = pango_attr_foreground_new (color->red * 65535,
+                                    color->green * 65535,
+                                    color->blue * 65535);
+  pango_attr_list_insert (attrs, attr);
+
+  attr = pango_attr_foreground_alpha_new (color->alpha * 65535);
+  pango_attr_list_insert (attrs, attr);
+
+  attr = pango_attr_size_new_absolute (size * PANGO_SCALE);
+  pango_attr_list_insert (attrs, attr);
+
+  pango_layout_set_attributes (layout, attrs);
+
+  for (int i = 0; i < formatted_text->len; i ++)
+    {
+      ShumateVectorFormatPart *part = g_ptr_array_index (formatted_text, i);
+
+      if (part->sprite != NULL)
+        {
+          int width = shumate_vector_sprite_get_width (part->sprite);
+          int height = shumate_vector_sprite_get_height (part->sprite);
+          /* For shapes, since we're overriding the ink and logical rects
+             of the glyph, we have to take letter spacing into account ourselves */
+          double spacing = letter_spacing * size;
+
+          PangoRectangle ink_rect = {
+            .x = spacing / 2 * PANGO_SCALE,
+            .y = -height * PANGO_SCALE,
+            .width = width * PANGO_SCALE,
+            .height = height * PANGO_SCALE,
+          };
+          PangoRectangle logical_rect = {
+            .x = 0,
+            .y = -height * PANGO_SCALE,
+            .width = (width + spacing) * PANGO_SCALE,
+            .height = height * PANGO_SCALE,
+          };
+
+          attr = pango_attr_shape_new_with_data (&ink_rect, &logical_rect, g_object_ref (part->sprite), (PangoAttrDataCopyFunc)g_object_ref, g_object_unref);
+          attr->start_index = string->len;
+          attr->end_index = string->len + strlen ("\uFFFC");
+          pango_attr_list_insert (attrs, attr);
+
+          if (spacing != 0)
+            {
+              attr = pango_attr_letter_spacing_new (0);
+              attr->start_index = string->len;
+              attr->end_index = string->len + strlen ("\uFFFC");
+              pango_attr_list_insert (attrs, attr);
+            }
+
+          g_string_append (string, "\uFFFC");
+        }
+      else
+        {
+          if (part->has_font_scale)
+            {
+              attr = pango_attr_size_new_absolute (part->font_scale * size * PANGO_SCALE);
+              attr->start_index = string->len;
+              attr->end_index = string->len + strlen (part->string);
+              pango_attr_list_insert (attrs, attr);
+            }
+
+          if (part->has_text_color)
+            {
+              attr = pango_attr_foreground_new (part->text_color.red * 65535,
+                                                part->text_color.green * 65535,
+                                                part->text_color.blue * 65535);
+              attr->start_index = string->len;
+              attr->end_index = string->len + strlen (part->string);
+              pango_attr_list_insert (attrs, attr);
+
+              attr = pango_attr_foreground_alpha_new (part->text_color.alpha * 65535);
+              attr->start_index = string->len;
+              attr->end_index = string->len + strlen (part->string);
+              pango_attr_list_insert (attrs, attr);
+            }
+
+          g_string_append (string, part->string);
+        }
+    }
+
+  pango_layout_set_text (layout, string->str, string->len);
+
+  self = g_new0 (ShumateVectorShapedText, 1);
+  self->ref_count = 1;
+
+  pango_layout_get_pixel_extents (layout, &ink_rect, NULL);
+  self->layout_width = ink_rect.width;
+  self->layout_height = ink_rect.height;
+  self->layout_y = ink_rect.y;
+  self->baseline = pango_layout_get_baseline (layout) / (double) PANGO_SCALE;
+
+  self->runs = g_array_new (FALSE, TRUE, sizeof (ShumateVectorShapedRun));
+  g_array_set_clear_func (self->runs, (GDestroyNotify)shaped_run_clear);
+
+  iter = pango_layout_get_iter (layout);
+
+  do {
+    PangoGlyphItem *item = pango_layout_iter_get_run (iter);
+    PangoAttrShape *shape;
+    PangoRectangle run_ink, run_logical;
+    ShumateVectorShapedRun run = { 0 };
+
+    if (item == NULL)
+      continue;
+
+    pango_layout_iter_get_run_extents (iter, &run_ink, &run_logical);
+    get_color_from_glyph_item (item, &run.color);
+
+    shape = get_shape_from_glyph_item (item);
+    if (shape != NULL)
+      {
+        run.sprite = g_object_ref (shape->data);
+        run.x = PANGO_PIXELS (run_ink.x);
+        run.y = PANGO_PIXELS (run_ink.y);
+        run.width = PANGO_PIXELS (run_ink.width);
+        run.height = PANGO_PIXELS (run_ink.height);
+        run.advance = shape->logical_rect.width / (double) PANGO_SCALE;
+      }
+    else
+      {
+        run.font = g_object_ref (item->item->analysis.font);
+        run.glyphs = pango_glyph_string_copy (item->glyphs);
+        run.x = run_logical.x / (double) PANGO_SCALE;
+        run.y = pango_layout_iter_get_baseline (iter) / (double) PANGO_SCALE;
+      }
+
+    g_array_append_val (self->runs, run);
+  } while (pango_layout_iter_next_run (iter));
+
+  return self;
+}
+
+
+ShumateVectorShapedText *
+shumate_vector_shaped_text_ref (ShumateVectorShapedText *self)
+{
+  g_return_val_if_fail (self, NULL);
+  g_return_val_if_fail (self->ref_count, NULL);
+
+  g_atomic_int_inc (&self->ref_count);
+
+  return self;
+}
+
+void
+shumate_vector_shaped_text_unref (ShumateVectorShapedText *self)
+{
+  g_return_if_fail (self);
+  g_return_if_fail (self->ref_count);
+
+  if (g_atomic_int_dec_and_test (&self->ref_count))
+    {
+      /* Freeing the runs unrefs their fonts, which may be in use by another
+       * thread */
+      g_mutex_lock (&font_mutex);
+      g_clear_pointer (&self->runs, g_array_unref);
+      g_mutex_unlock (&font_mutex);
+
+      g_free (self);
+    }
+}
+
+
+/* Estimates the heap memory used by the shaped text, for cache accounting.
+ * Fonts are shared with the font map's cache and not counted. */
+gsize
+shumate_vector_shaped_text_get_memory_size (ShumateVectorShapedText *self)
+{
+  gsize size = sizeof (ShumateVectorShapedText);
+
+  for (int i = 0; i < self->runs->len; i ++)
+    {
+      ShumateVectorShapedRun *run = &g_array_index (self->runs, ShumateVectorShapedRun, i);
+
+      size += sizeof (ShumateVectorShapedRun);
+      if (run->glyphs != NULL)
+        size += sizeof (PangoGlyphString)
+                + run->glyphs->num_glyphs * (sizeof (PangoGlyphInfo) + sizeof (int));
+    }
+
+  return size;
+}
+
+
+/*
+ * shumate_vector_shaped_text_lock_fonts:
+ *
+ * Locks the fonts referenced by shaped text runs, which must be held while
+ * anything uses them, such as gsk_text_node_new().
+ */
+void
+shumate_vector_shaped_text_lock_fonts (void)
+{
+  g_mutex_lock (&font_mutex);
+}
+
+void
+shumate_vector_shaped_text_unlock_fonts (void)
+{
+  g_mutex_unlock (&font_mutex);
+}
+
+static gboolean
+font_options_equal (const cairo_font_options_t *a,
+                    const cairo_font_options_t *b)
+{
+  return a == b || (a != NULL && b != NULL && cairo_font_options_equal (a, b));
+}
+
+/* Must be called with font_mutex held */
+static guint
+get_font_options_id (const cairo_font_options_t *options)
+{
+  FontContext font_context;
+
+  if (font_contexts == NULL)
+    {
+      font_map = pango_cairo_font_map_new ();
+      font_contexts = g_array_new (FALSE, FALSE, sizeof (FontContext));
+    }
+
+  for (guint i = 0; i < font_contexts->len; i ++)
+    if (font_options_equal (g_array_index (font_contexts, FontContext, i).options, options))
+      return i;
+
+  font_context.options = options != NULL ? cairo_font_options_copy (options) : NULL;
+  font_context.context = pango_font_map_create_context (font_map);
+  /* Glyphs are drawn at fractional positions along lines anyway */
+  pango_context_set_round_glyph_positions (font_context.context, FALSE);
+  pango_cairo_context_set_font_options (font_context.context, options);
+
+  g_array_append_val (font_contexts, font_context);
+  return font_contexts->len - 1;
+}
+
+/*
+ * shumate_vector_shaped_text_get_font_options_id:
+ * @options: (nullable): cairo font options
+ *
+ * Gets a number that is the same for equal font options and different for
+ * any others, for use in cache keys. May be called from any thread.
+ *
+ * Returns: the ID of the font options
+ */
+guint
+shumate_vector_shaped_text_get_font_options_id (const cairo_font_options_t *options)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&font_mutex);
+
+  return get_font_options_id (options);
+}
+
+
+static ShumateVectorShapedText *
+shape_with_font_options_id (guint          font_options_id,
+                            GPtrArray     *formatted_text,
+                            const char    *font,
+                            double         size,
+                            double         letter_spacing,
+                            const GdkRGBA *color)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&font_mutex);
+  FontContext *font_context = &g_array_index (font_contexts, FontContext, font_options_id);
+
+  return shumate_vector_shaped_text_new (font_context->context, formatted_text,
+                                         font, size, letter_spacing, color);
+}
+
+/*
+ * shumate_vector_shaped_text_shape:
+ * @formatted_text: (element-type ShumateVectorFormatPart): the label
+ * @font: (nullable): a font description string
+ * @size: the font size in pixels
+ * @letter_spacing: the letter spacing in ems
+ * @color: the default text color
+ * @font_options: (nullable): the font options of the widget the label is
+ *   drawn in
+ *
+ * Like shumate_vector_shaped_text_new(), but uses the shared font map for
+ * labels. May be called from any thread.
+ *
+ * Returns: (transfer full): the shaped text
+ */
+ShumateVectorShapedText *
+shumate_vector_shaped_text_shape (GPtrArray                  *formatted_text,
+                                  const char                 *font,
+                                  double                      size,
+                                  double                      letter_spacing,
+                                  const GdkRGBA              *color,
+                                  const cairo_font_options_t *font_options)
+{
+  guint font_options_id = shumate_vector_shaped_text_get_font_options_id (font_options);
+
+  return shape_with_font_options_id (font_options_id, formatted_text,
+                                     font, size, letter_spacing, color);
+}
+
+
+static void
+cache_entry_free (CacheEntry *entry)
+{
+  g_free (entry->key);
+  shumate_vector_shaped_text_unref (entry->shaped_text);
+  g_free (entry);
+}
+
+static void
+cache_evict (gsize max_size)
+{
+  while (cache_size > max_size && cache_lru.tail != NULL)
+    {
+      CacheEntry *entry = g_queue_pop_tail (&cache_lru);
+
+      g_hash_table_remove (cache_entries, entry->key);
+      cache_size -= entry->size;
+      cache_entry_free (entry);
+    }
+}
+
+/* Everything that affects the layout goes into the key. Sprites are keyed by
+ * address, which can't be reused while the cached runs hold a reference to
+ * them. */
+static char *
+get_cache_key (guint          font_options_id,
+               GPtrArray     *formatted_text,
+               const char    *font,
+               double         size,
+               double         letter_spacing,
+               const GdkRGBA *color)
+{
+  GString *key = g_string_new (NULL);
+
+  g_string_append_printf (key, "%u\x1f%s\x1f%g\x1f%g\x1f%g,%g,%g,%g",
+                          font_options_id,
+                          font != NULL ? font : "",
+                          size, letter_spacing,
+                          color->red, color->green, color->blue, color->alpha);
+
+  for (int i = 0; i < formatted_text->len; i ++)
+    {
+      ShumateVectorFormatPart *part = g_ptr_array_index (formatted_text, i);
+
+      g_string_append_c (key, '\x1e');
+
+      if (part->sprite != NULL)
+        g_string_append_printf (key, "i%p", part->sprite);
+      else
+        {
+          if (part->has_font_scale)
+            g_string_append_printf (key, "s%g", part->font_scale);
+          if (part->has_text_color)
+            g_string_append_printf (key, "c%g,%g,%g,%g",
+                                    part->text_color.red, part->text_color.green,
+                                    part->text_color.blue, part->text_color.alpha);
+          g_string_append_c (key, '\x1f');
+          g_string_append (key, part->string);
+        }
+    }
+
+  return g_string_free (key, FALSE);
+}
+
+
+/*
+ * shumate_vector_shaped_text_lookup:
+ * @formatted_text: (element-type ShumateVectorFormatPart): the label
+ * @font: (nullable): a font description string
+ * @size: the font size in pixels
+ * @letter_spacing: the letter spacing in ems
+ * @color: the default text color
+ * @font_options: (nullable): the font options of the widget the label is
+ *   drawn in
+ *
+ * Like shumate_vector_shaped_text_shape(), but returns the cached layout if
+ * the same label was laid out recently. May be called from any thread.
+ *
+ * Returns: (transfer full): the shaped text
+ */
+ShumateVectorShapedText *
+shumate_vector_shaped_text_lookup (GPtrArray                  *formatted_text,
+                                   const char                 *font,
+                                   double                      size,
+                                   double                      letter_spacing,
+                                   const GdkRGBA              *color,
+                                   const cairo_font_options_t *font_options)
+{
+  g_autoptr(GMutexLocker) locker = NULL;
+  g_autofree char *key = NULL;
+  CacheEntry *entry;
+  GList *link;
+  guint font_options_id;
+
+  g_return_val_if_fail (formatted_text != NULL, NULL);
+
+  font_options_id = shumate_vector_shaped_text_get_font_options_id (font_options);
+  key = get_cache_key (font_options_id, formatted_text, font, size, letter_spacing, color);
+
+  locker = g_mutex_locker_new (&cache_mutex);
+
+  if (cache_entries == NULL)
+    cache_entries = g_hash_table_new (g_str_hash, g_str_equal);
+
+  link = g_hash_table_lookup (cache_entries, key);
+  if (link != NULL)
+    {
+      g_queue_unlink (&cache_lru, link);
+      g_queue_push_head_link (&cache_lru, link);
+      entry = link->data;
+      return shumate_vector_shaped_text_ref (entry->shaped_text);
+    }
+
+  g_clear_pointer (&locker, g_mutex_locker_free);
+
+  /* Shape without holding the cache lock, so that other threads can still
+   * get cache hits in the meantime */
+  entry = g_new0 (CacheEntry, 1);
+  entry->shaped_text = shape_with_font_options_id (font_options_id, formatted_text,
+                                                   font, size, letter_spacing, color);
+  entry->size = sizeof (CacheEntry) + strlen (key) + 1
+                + shumate_vector_shaped_text_get_memory_size (entry->shaped_text);
+  entry->key = g_steal_pointer (&key);
+
+  locker = g_mutex_locker_new (&cache_mutex);
+
+  /* Another thread may have shaped the same label at the same time. Keep
+   * the copy that is already in the cache, so that it stays shared. */
+  link = g_hash_table_lookup (cache_entries, entry->key);
+  if (link != NULL)
+    {
+      CacheEntry *existing = link->data;
+      ShumateVectorShapedText *shaped_text = shumate_vector_shaped_text_ref (existing->shaped_text);
+      cache_entry_free (entry);
+      return shaped_text;
+    }
+
+  /* A label too large for the cache is still returned, just not kept */
+  if (entry->size > cache_max_size)
+    {
+      ShumateVectorShapedText *shaped_text = shumate_vector_shaped_text_ref (entry->shaped_text);
+      cache_entry_free (entry);
+      return shaped_text;
+    }
+
+  cache_evict (cache_max_size - entry->size);
+
+  g_queue_push_head (&cache_lru, entry);
+  g_hash_table_insert (cache_entries, entry->key, cache_lru.head);
+  cache_size += entry->size;
+
+  return shumate_vector_shaped_text_ref (entry->shaped_text);
+}
+
+/*
+ * shumate_vector_shaped_text_cache_set_max_size:
+ * @max_size: the maximum estimated size of the cache, in bytes
+ *
+ * Sets the size limit of the cache used by
+ * shumate_vector_shaped_text_lookup(), evicting entries if necessary.
+ */
+void
+shumate_vector_shaped_text_cache_set_max_size (gsize max_size)
+{
+  g_autoptr(GMutexLocker) locker = g_mutex_locker_new (&cache_mutex);
+
+  cache_max_size = max_size;
+  cache_evict (max_size);
+}
@@ -49,4 +49,11 @@ ShumateVectorCollision *shumate_vector_symbol_container_get_collision (ShumateVe
 
 char *shumate_vector_symbol_container_get_debug_text (ShumateVectorSymbolContainer *self);
 
+void shumate_vector_symbol_container_set_placement_time_budget (ShumateVectorSymbolContainer *self,
+                                                                gint64                        budget);
+gboolean shumate_vector_symbol_container_get_placement_pending (ShumateVectorSymbolContainer *self);
+void shumate_vector_symbol_container_get_placement_view (ShumateVectorSymbolContainer *self,
+                                                         double                       *zoom_level,
+                                                         double                       *rotation);
+
 G_END_DECLS
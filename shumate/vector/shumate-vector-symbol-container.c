@@ -22,6 +22,22 @@
 #include "shumate-profiling-private.h"
 #include "shumate-inspector-settings-private.h"
 
+/* How long placement may take per frame while a previous placement is still
+ * good enough to show */
+#define PLACEMENT_TIME_BUDGET (4 * G_TIME_SPAN_MILLISECOND)
+/* How far the zoom level may move from the shown placement before the next
+ * one is made all at once */
+#define PLACEMENT_ZOOM_THRESHOLD 0.5
+/* How many symbols to place between checks of the time budget */
+#define PLACEMENT_CHECK_INTERVAL 32
+/* How many placements in a row may be abandoned because symbols were added or
+ * removed before the next one is made all at once. Otherwise, while tiles keep
+ * loading, a dense view might never finish one. */
+#define PLACEMENT_MAX_RESTARTS 3
+/* How many labels the accessible label reads out. A dense view can show
+ * hundreds, which is far more than is useful to hear in one go. */
+#define MAX_ACCESSIBLE_LABELS 20
+
 typedef struct {
   int layer_idx;
   GPtrArray *symbols;
@@ -34,15 +50,37 @@ struct _ShumateVectorSymbolContainer
   ShumateMapSource *map_source;
 
   GPtrArray *layer_buckets;
+  /* The placement that is shown, which is also used for hit testing */
   ShumateVectorCollision *collision;
 
   int child_count, visible_count;
 
+  /* The text of the visible labels, up to MAX_ACCESSIBLE_LABELS of them,
+   * which is the container's accessible label since the symbols aren't
+   * widgets */
+  char *accessible_label;
+
+  /* The view the shown placement was made for */
   double last_rotation;
   double last_zoom;
   double last_center_x, last_center_y;
   double last_width, last_height;
   gboolean labels_changed : 1;
+  gboolean has_placement : 1;
+
+  /* A placement in progress. It may take several frames, which is why it
+   * has its own collision index, and its own view, which may already be
+   * out of date by the time it is committed. See continue_placement(). */
+  ShumateVectorCollision *pending_collision;
+  gboolean placement_pending : 1;
+  int placement_bucket, placement_index;
+  double placement_rotation;
+  double placement_zoom;
+  double placement_center_x, placement_center_y;
+  double placement_width, placement_height;
+  int placement_restarts;
+  gint64 placement_time_budget;
+  guint placement_tick_id;
 };
 
 G_DEFINE_TYPE (ShumateVectorSymbolContainer, shumate_vector_symbol_container, SHUMATE_TYPE_LAYER)
@@ -67,8 +105,8 @@ static guint signals[LAST_SIGNAL] = { 0, };
 typedef struct {
   graphene_rect_t bounds;
 
-  // do not need to be freed because they're owned by the widget
   ShumateVectorSymbol *symbol;
+  // does not need to be freed because it's owned by the symbol
   ShumateVectorSymbolInfo *symbol_info;
 
   // These are coordinates [0, 1) within the tile
@@ -80,8 +118,16 @@ typedef struct {
   int zoom;
 
   gboolean visible : 1;
+  gboolean pending_visible : 1;
 } ChildInfo;
 
+static void
+child_info_free (ChildInfo *info)
+{
+  g_clear_object (&info->symbol);
+  g_free (info);
+}
+
 static void
 layer_bucket_free (LayerBucket *bucket)
 {
@@ -108,7 +154,7 @@ add_symbol_to_layer_buckets (ShumateVectorSymbolContainer *self,
 
   bucket = g_new0 (LayerBucket, 1);
   bucket->layer_idx = info->symbol_info->details->layer_idx;
-  bucket->symbols = g_ptr_array_new_with_free_func (g_free);
+  bucket->symbols = g_ptr_array_new_with_free_func ((GDestroyNotify)child_info_free);
   g_ptr_array_add (self->layer_buckets, bucket);
 
   g_ptr_array_add (bucket->symbols, info);
@@ -172,6 +218,7 @@ shumate_vector_symbol_container_constructed (GObject *object)
   G_OBJECT_CLASS (shumate_vector_symbol_container_parent_class)->constructed (object);
 
   self->collision = shumate_vector_collision_new ();
+  self->pending_collision = shumate_vector_collision_new ();
 
   viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
   g_signal_connect_swapped (viewport, "changed", G_CALLBACK (on_viewport_changed), self);
@@ -187,6 +234,8 @@ shumate_vector_symbol_container_finalize (GObject *object)
 
   g_clear_pointer (&self->layer_buckets, g_ptr_array_unref);
   g_clear_pointer (&self->collision, shumate_vector_collision_free);
+  g_clear_pointer (&self->pending_collision, shumate_vector_collision_free);
+  g_clear_pointer (&self->accessible_label, g_free);
 
   G_OBJECT_CLASS (shumate_vector_symbol_container_parent_class)->finalize (object);
 }
@@ -197,12 +246,14 @@ shumate_vector_symbol_container_dispose (GObject *object)
 {
   ShumateVectorSymbolContainer *self = (ShumateVectorSymbolContainer *)object;
   ShumateViewport *viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
-  GtkWidget *child;
 
   g_signal_handlers_disconnect_by_data (viewport, self);
 
-  while ((child = gtk_widget_get_first_child (GTK_WIDGET (object))))
-    gtk_widget_unparent (child);
+  if (self->placement_tick_id != 0)
+    {
+      gtk_widget_remove_tick_callback (GTK_WIDGET (self), self->placement_tick_id);
+      self->placement_tick_id = 0;
+    }
 
   G_OBJECT_CLASS (shumate_vector_symbol_container_parent_class)->dispose (object);
 }
@@ -294,6 +345,242 @@ rotate_around_center (double *x,
 }
 
 
+static void
+get_view (ShumateVectorSymbolContainer *self,
+          double                       *zoom_level,
+          double                       *rotation,
+          double                       *center_x,
+          double                       *center_y)
+{
+  ShumateViewport *viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
+
+  *zoom_level = get_effective_zoom_level (self->map_source, viewport);
+  *rotation = shumate_viewport_get_rotation (viewport);
+  *center_x = shumate_map_source_get_x (self->map_source, *zoom_level, shumate_location_get_longitude (SHUMATE_LOCATION (viewport)));
+  *center_y = shumate_map_source_get_y (self->map_source, *zoom_level, shumate_location_get_latitude (SHUMATE_LOCATION (viewport)));
+}
+
+
+static void
+get_child_position (ChildInfo *child,
+                    double     tile_size,
+                    double     zoom_level,
+                    double     rotation,
+                    double     center_x,
+                    double     center_y,
+                    double     width,
+                    double     height,
+                    double    *x,
+                    double    *y)
+{
+  double tile_size_at_zoom = tile_size * pow (2, zoom_level - child->zoom);
+
+  *x = (child->tile_x + child->x) * tile_size_at_zoom - center_x + width/2.0;
+  *y = (child->tile_y + child->y) * tile_size_at_zoom - center_y + height/2.0;
+
+  rotate_around_center (x, y, width, height, rotation);
+}
+
+
+static void
+start_placement (ShumateVectorSymbolContainer *self,
+                 double                        zoom_level,
+                 double                        rotation,
+                 double                        center_x,
+                 double                        center_y,
+                 double                        width,
+                 double                        height)
+{
+  if (self->placement_pending)
+    self->placement_restarts ++;
+
+  shumate_vector_collision_clear (self->pending_collision);
+  self->pending_collision->delta_x = 0;
+  self->pending_collision->delta_y = 0;
+
+  self->placement_zoom = zoom_level;
+  self->placement_rotation = rotation;
+  self->placement_center_x = center_x;
+  self->placement_center_y = center_y;
+  self->placement_width = width;
+  self->placement_height = height;
+
+  /* Higher layers have priority during placement, so iterate the
+     array from back to front */
+  self->placement_bucket = self->layer_buckets->len - 1;
+  self->placement_index = 0;
+  self->placement_pending = TRUE;
+}
+
+
+/* Sets the container's accessible label to the text of the visible labels,
+ * one per line. Only the first MAX_ACCESSIBLE_LABELS distinct labels are
+ * included, taken from the highest layers first since those have priority
+ * during placement too (place names over points of interest, for example). */
+static void
+update_accessible_label (ShumateVectorSymbolContainer *self)
+{
+  g_autoptr(GHashTable) texts = g_hash_table_new (g_str_hash, g_str_equal);
+  g_autoptr(GString) accessible_label = g_string_new ("");
+
+  for (int i = self->layer_buckets->len - 1;
+       i >= 0 && g_hash_table_size (texts) < MAX_ACCESSIBLE_LABELS;
+       i --)
+    {
+      LayerBucket *bucket = g_ptr_array_index (self->layer_buckets, i);
+
+      for (int j = 0;
+           j < bucket->symbols->len && g_hash_table_size (texts) < MAX_ACCESSIBLE_LABELS;
+           j ++)
+        {
+          ChildInfo *child = g_ptr_array_index (bucket->symbols, j);
+          const char *text;
+
+          if (!child->visible)
+            continue;
+
+          /* Line labels repeat along the line, but are only read once */
+          text = shumate_vector_symbol_get_text (child->symbol);
+          if (text != NULL && g_hash_table_add (texts, (char *) text))
+            {
+              if (accessible_label->len > 0)
+                g_string_append_c (accessible_label, '\n');
+              g_string_append (accessible_label, text);
+            }
+        }
+    }
+
+  if (g_strcmp0 (accessible_label->str, self->accessible_label) != 0)
+    {
+      g_free (self->accessible_label);
+      self->accessible_label = g_string_free (g_steal_pointer (&accessible_label), FALSE);
+      gtk_accessible_update_property (GTK_ACCESSIBLE (self),
+                                      GTK_ACCESSIBLE_PROPERTY_LABEL,
+                                      self->accessible_label,
+                                      -1);
+    }
+}
+
+
+static void
+commit_placement (ShumateVectorSymbolContainer *self)
+{
+  ShumateVectorCollision *collision = self->collision;
+
+  self->collision = self->pending_collision;
+  self->pending_collision = collision;
+
+  self->visible_count = 0;
+
+  for (int i = 0; i < self->layer_buckets->len; i ++)
+    {
+      LayerBucket *bucket = g_ptr_array_index (self->layer_buckets, i);
+
+      for (int j = 0; j < bucket->symbols->len; j ++)
+        {
+          ChildInfo *child = g_ptr_array_index (bucket->symbols, j);
+
+          child->visible = child->pending_visible;
+          shumate_vector_symbol_commit_placement (child->symbol);
+
+          if (child->visible)
+            self->visible_count ++;
+        }
+    }
+
+  update_accessible_label (self);
+
+  self->last_zoom = self->placement_zoom;
+  self->last_rotation = self->placement_rotation;
+  self->last_center_x = self->placement_center_x;
+  self->last_center_y = self->placement_center_y;
+  self->last_width = self->placement_width;
+  self->last_height = self->placement_height;
+  self->has_placement = TRUE;
+  self->placement_pending = FALSE;
+  self->placement_restarts = 0;
+}
+
+
+/* Whether the placement in progress, or the one just committed, was made for
+ * a different view than the given one. Moving the center doesn't count, since
+ * the collision index's delta accounts for that. */
+static gboolean
+placement_view_changed (ShumateVectorSymbolContainer *self,
+                        double                        zoom_level,
+                        double                        rotation,
+                        double                        width,
+                        double                        height)
+{
+  return self->placement_zoom != zoom_level
+         || self->placement_rotation != rotation
+         || self->placement_width != width
+         || self->placement_height != height;
+}
+
+
+/* Places symbols until the placement is complete, in which case it is
+ * committed, or until the deadline passes. A deadline of -1 means there is
+ * none. Until the placement is committed, the previous one stays on screen,
+ * so labels don't flicker while a placement is spread over several frames. */
+static void
+continue_placement (ShumateVectorSymbolContainer *self,
+                    double                        tile_size,
+                    gint64                        deadline)
+{
+  int n_placed = 0;
+
+  while (self->placement_bucket >= 0)
+    {
+      LayerBucket *bucket = g_ptr_array_index (self->layer_buckets, self->placement_bucket);
+
+      while (self->placement_index < bucket->symbols->len)
+        {
+          ChildInfo *child = g_ptr_array_index (bucket->symbols, self->placement_index);
+          double tile_size_at_zoom = tile_size * pow (2, self->placement_zoom - child->zoom);
+          double x, y;
+
+          get_child_position (child, tile_size,
+                              self->placement_zoom, self->placement_rotation,
+                              self->placement_center_x, self->placement_center_y,
+                              self->placement_width, self->placement_height,
+                              &x, &y);
+
+          child->pending_visible =
+            shumate_vector_symbol_calculate_collision (child->symbol,
+                                                      self->pending_collision,
+                                                      x,
+                                                      y,
+                                                      tile_size_at_zoom,
+                                                      self->placement_rotation,
+                                                      &child->bounds);
+
+          self->placement_index ++;
+
+          if (deadline >= 0
+              && ++n_placed % PLACEMENT_CHECK_INTERVAL == 0
+              && g_get_monotonic_time () >= deadline)
+            return;
+        }
+
+      self->placement_bucket --;
+      self->placement_index = 0;
+    }
+
+  commit_placement (self);
+}
+
+
+static gboolean
+placement_tick_cb (GtkWidget     *widget,
+                   GdkFrameClock *frame_clock,
+                   gpointer       user_data)
+{
+  gtk_widget_queue_allocate (widget);
+  return G_SOURCE_CONTINUE;
+}
+
+
 static void
 shumate_vector_symbol_container_size_allocate (GtkWidget *widget,
                                                int        width,
@@ -303,105 +590,79 @@ shumate_vector_symbol_container_size_allocate (GtkWidget *widget,
   SHUMATE_PROFILE_START ();
 
   ShumateVectorSymbolContainer *self = SHUMATE_VECTOR_SYMBOL_CONTAINER (widget);
-  GtkAllocation alloc;
   double tile_size;
-  ShumateViewport *viewport;
   double zoom_level;
   double rotation;
   double center_x, center_y;
-
-  gboolean recalc;
+  gboolean view_changed;
 
   if (self->map_source == NULL)
     return;
 
   tile_size = shumate_map_source_get_tile_size (self->map_source);
-  viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
-  zoom_level = get_effective_zoom_level (self->map_source, viewport);
-  rotation = shumate_viewport_get_rotation (viewport);
-  center_x = shumate_map_source_get_x (self->map_source, zoom_level, shumate_location_get_longitude (SHUMATE_LOCATION (viewport)));
-  center_y = shumate_map_source_get_y (self->map_source, zoom_level, shumate_location_get_latitude (SHUMATE_LOCATION (viewport)));
-
-  recalc = self->labels_changed
-            || self->last_zoom != zoom_level
-            || self->last_rotation != rotation
-            || self->last_width != width
-            || self->last_height != height;
-
-  if (recalc)
-    {
-      shumate_vector_collision_clear (self->collision);
-      self->last_center_x = center_x;
-      self->last_center_y = center_y;
-      self->collision->delta_x = 0;
-      self->collision->delta_y = 0;
-      self->visible_count = 0;
-    }
-  else
-    {
-      self->collision->delta_x = center_x - self->last_center_x;
-      self->collision->delta_y = center_y - self->last_center_y;
-      rotate_around_origin (&self->collision->delta_x, &self->collision->delta_y, rotation);
-    }
+  get_view (self, &zoom_level, &rotation, &center_x, &center_y);
 
-  /* Higher layers have priority during placement, so iterate the
-     array from back to front */
-  for (int i = self->layer_buckets->len - 1; i >= 0; i --)
-    {
-      LayerBucket *bucket = g_ptr_array_index (self->layer_buckets, i);
+  view_changed = self->last_zoom != zoom_level
+                 || self->last_rotation != rotation
+                 || self->last_width != width
+                 || self->last_height != height;
 
-      for (int j = 0; j < bucket->symbols->len; j ++)
-        {
-          ChildInfo *child = g_ptr_array_index (bucket->symbols, j);
-          double tile_size_at_zoom = tile_size * pow (2, zoom_level - child->zoom);
-          double x = (child->tile_x + child->x) * tile_size_at_zoom - center_x + width/2.0;
-          double y = (child->tile_y + child->y) * tile_size_at_zoom - center_y + height/2.0;
+  /* A placement in progress carries on even if the view changed since it
+   * started, so that one eventually finishes during a pinch or rotate
+   * gesture. If the view is still different once it is committed, another
+   * one is started. Adding or removing symbols invalidates it, though. */
+  if (self->labels_changed || (view_changed && !self->placement_pending))
+    start_placement (self, zoom_level, rotation, center_x, center_y, width, height);
 
-          rotate_around_center (&x, &y, width, height, rotation);
+  if (self->placement_pending)
+    {
+      if (!self->has_placement
+          || fabs (zoom_level - self->last_zoom) >= PLACEMENT_ZOOM_THRESHOLD
+          || self->placement_restarts >= PLACEMENT_MAX_RESTARTS)
+        {
+          /* The shown placement is too far off to keep showing it, or
+           * placements keep being abandoned, so place everything for the
+           * current view right away */
+          if (placement_view_changed (self, zoom_level, rotation, width, height))
+            start_placement (self, zoom_level, rotation, center_x, center_y, width, height);
 
-          if (recalc)
-            {
-              gboolean now_visible =
-                shumate_vector_symbol_calculate_collision (child->symbol,
-                                                          self->collision,
-                                                          x,
-                                                          y,
-                                                          tile_size_at_zoom,
-                                                          rotation,
-                                                          &child->bounds);
-
-              if (now_visible != child->visible)
-                {
-                  gtk_widget_set_child_visible (GTK_WIDGET (child->symbol), now_visible);
-                  child->visible = now_visible;
-                }
-
-              if (now_visible)
-                self->visible_count ++;
-            }
+          continue_placement (self, tile_size, -1);
+        }
+      else
+        {
+          continue_placement (self, tile_size, g_get_monotonic_time () + self->placement_time_budget);
 
-          if (!child->visible)
-            continue;
+          /* The placement that was just committed may have been made for an
+           * earlier view, so catch up with the current one */
+          if (!self->placement_pending
+              && placement_view_changed (self, zoom_level, rotation, width, height))
+            start_placement (self, zoom_level, rotation, center_x, center_y, width, height);
+        }
+    }
 
-          gtk_widget_measure (GTK_WIDGET (child->symbol), GTK_ORIENTATION_HORIZONTAL, -1, NULL, NULL, NULL, NULL);
-          gtk_widget_measure (GTK_WIDGET (child->symbol), GTK_ORIENTATION_VERTICAL, -1, NULL, NULL, NULL, NULL);
+  /* Keep going on the next frames until the placement is done */
+  if (self->placement_pending && self->placement_tick_id == 0)
+    self->placement_tick_id = gtk_widget_add_tick_callback (widget, placement_tick_cb, NULL, NULL);
+  else if (!self->placement_pending && self->placement_tick_id != 0)
+    {
+      gtk_widget_remove_tick_callback (widget, self->placement_tick_id);
+      self->placement_tick_id = 0;
+    }
 
-          alloc.x = child->bounds.origin.x - self->collision->delta_x;
-          alloc.y = child->bounds.origin.y - self->collision->delta_y;
-          alloc.width = child->bounds.size.width;
-          alloc.height = child->bounds.size.height;
+  /* The collision index is in the coordinates of the view it was made for.
+   * When only the center moved since then, this maps the current view onto
+   * it exactly; otherwise it is close until the next placement is done. The
+   * centers are in pixels at their own zoom levels, so the old one is scaled
+   * to the current zoom level first. */
+  self->collision->delta_x = center_x - self->last_center_x * pow (2, zoom_level - self->last_zoom);
+  self->collision->delta_y = center_y - self->last_center_y * pow (2, zoom_level - self->last_zoom);
+  rotate_around_origin (&self->collision->delta_x, &self->collision->delta_y, rotation);
 
-          gtk_widget_size_allocate (GTK_WIDGET (child->symbol), &alloc, -1);
-          if (child->symbol_info->line != NULL)
-            gtk_widget_queue_draw (GTK_WIDGET (child->symbol));
-        }
-    }
+  /* The symbols are drawn by the container itself, so it has to be redrawn
+   * whenever they move */
+  gtk_widget_queue_draw (widget);
 
   self->labels_changed = FALSE;
-  self->last_rotation = rotation;
-  self->last_zoom = zoom_level;
-  self->last_width = width;
-  self->last_height = height;
 }
 
 
@@ -413,7 +674,24 @@ shumate_vector_symbol_container_snapshot (GtkWidget   *widget,
 
   ShumateVectorSymbolContainer *self = SHUMATE_VECTOR_SYMBOL_CONTAINER (widget);
   ShumateInspectorSettings *settings = shumate_inspector_settings_get_default ();
+  ShumateViewport *viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
+  double zoom_level = shumate_viewport_get_zoom_level (viewport);
+  double effective_zoom_level;
+  double rotation;
+  double center_x, center_y;
+  int width = gtk_widget_get_width (widget);
+  int height = gtk_widget_get_height (widget);
+  double tile_size;
+
+  if (self->map_source == NULL)
+    return;
 
+  tile_size = shumate_map_source_get_tile_size (self->map_source);
+  get_view (self, &effective_zoom_level, &rotation, &center_x, &center_y);
+
+  /* Draw the symbols straight into the container's render nodes, rather than
+   * giving each its own widget, which is far too much overhead for the
+   * thousands of symbols in a dense view */
   for (int i = 0; i < self->layer_buckets->len; i ++)
     {
       LayerBucket *bucket = g_ptr_array_index (self->layer_buckets, i);
@@ -421,24 +699,28 @@ shumate_vector_symbol_container_snapshot (GtkWidget   *widget,
       for (int j = 0; j < bucket->symbols->len; j ++)
         {
           ChildInfo *child = g_ptr_array_index (bucket->symbols, j);
-          double correct_x = child->bounds.origin.x - self->collision->delta_x;
-          double correct_y = child->bounds.origin.y - self->collision->delta_y;
+          double x, y;
+
+          if (!child->visible)
+            continue;
+
+          /* Symbols are shown as the last placement decided, but at their
+           * positions in the current view, which may be ahead of it */
+          get_child_position (child, tile_size, effective_zoom_level, rotation,
+                              center_x, center_y, width, height, &x, &y);
 
           gtk_snapshot_save (snapshot);
-          gtk_snapshot_translate (snapshot,
-                                  &GRAPHENE_POINT_INIT (
-                                    correct_x - (int) correct_x,
-                                    correct_y - (int) correct_y
-                                  ));
-          gtk_widget_snapshot_child (widget, GTK_WIDGET (child->symbol), snapshot);
+          gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (x, y));
+          shumate_vector_symbol_snapshot (child->symbol,
+                                          snapshot,
+                                          tile_size * pow (2, zoom_level - child->symbol_info->details->tile_zoom_level),
+                                          rotation);
           gtk_snapshot_restore (snapshot);
         }
     }
 
   if (shumate_inspector_settings_get_show_collision_boxes (settings))
     {
-      ShumateViewport *viewport = shumate_layer_get_viewport (SHUMATE_LAYER (self));
-      double rotation = shumate_viewport_get_rotation (viewport);
       double delta_x = -self->collision->delta_x;
       double delta_y = -self->collision->delta_y;
 
@@ -466,6 +748,8 @@ shumate_vector_symbol_container_class_init (ShumateVectorSymbolContainerClass *k
   widget_class->size_allocate = shumate_vector_symbol_container_size_allocate;
   widget_class->snapshot = shumate_vector_symbol_container_snapshot;
 
+  gtk_widget_class_set_accessible_role (widget_class, GTK_ACCESSIBLE_ROLE_LABEL);
+
   obj_properties[PROP_MAP_SOURCE] =
     g_param_spec_object ("map-source",
                          "Map source",
@@ -486,32 +770,92 @@ shumate_vector_symbol_container_class_init (ShumateVectorSymbolContainerClass *k
                   SHUMATE_TYPE_SYMBOL_EVENT);
 }
 
-static void
-shumate_vector_symbol_container_init (ShumateVectorSymbolContainer *self)
+static ShumateVectorSymbol *
+find_symbol_at (ShumateVectorSymbolContainer *self,
+                double                        x,
+                double                        y)
 {
-  self->layer_buckets = g_ptr_array_new_with_free_func ((GDestroyNotify)layer_bucket_free);
+  /* Symbols are tagged with themselves in the collision index */
+  return shumate_vector_collision_find_point (self->collision,
+                                              x + self->collision->delta_x,
+                                              y + self->collision->delta_y);
 }
 
 static void
-on_symbol_clicked (ShumateVectorSymbolContainer *self,
-                   ShumateSymbolEvent           *event,
-                   ShumateVectorSymbol          *symbol)
+on_click_released (ShumateVectorSymbolContainer *self,
+                   int                           n_press,
+                   double                        x,
+                   double                        y,
+                   GtkGestureClick              *click)
 {
-  ShumateVectorSymbolInfo *symbol_info = shumate_vector_symbol_get_symbol_info (symbol);
+  ShumateVectorSymbol *symbol;
+  ShumateVectorSymbolInfo *symbol_info;
+  g_autoptr(ShumateSymbolEvent) event = NULL;
+  double tile_size, lat, lon;
+
+  if (self->map_source == NULL || !(symbol = find_symbol_at (self, x, y)))
+    return;
 
-  double tile_size = shumate_map_source_get_tile_size (self->map_source);
-  double lat = shumate_map_source_get_latitude (self->map_source,
-                                                symbol_info->details->tile_zoom_level,
-                                                (symbol_info->details->tile_y + symbol_info->y) * tile_size);
-  double lon = shumate_map_source_get_longitude (self->map_source,
-                                                 symbol_info->details->tile_zoom_level,
-                                                 (symbol_info->details->tile_x + symbol_info->x) * tile_size);
+  symbol_info = shumate_vector_symbol_get_symbol_info (symbol);
+  event = shumate_symbol_event_new_with_n_press (symbol_info->details->layer,
+                                                 symbol_info->details->source_layer,
+                                                 symbol_info->details->feature_id,
+                                                 symbol_info->details->tags,
+                                                 n_press);
+
+  tile_size = shumate_map_source_get_tile_size (self->map_source);
+  lat = shumate_map_source_get_latitude (self->map_source,
+                                         symbol_info->details->tile_zoom_level,
+                                         (symbol_info->details->tile_y + symbol_info->y) * tile_size);
+  lon = shumate_map_source_get_longitude (self->map_source,
+                                          symbol_info->details->tile_zoom_level,
+                                          (symbol_info->details->tile_x + symbol_info->x) * tile_size);
 
   shumate_symbol_event_set_lat_lon (event, lat, lon);
 
   g_signal_emit (self, signals[SYMBOL_CLICKED], 0, event);
 }
 
+static void
+on_motion (ShumateVectorSymbolContainer *self,
+           double                        x,
+           double                        y,
+           GtkEventControllerMotion     *motion)
+{
+  ShumateVectorSymbol *symbol = find_symbol_at (self, x, y);
+  const char *cursor = NULL;
+
+  if (symbol != NULL)
+    cursor = shumate_vector_symbol_get_symbol_info (symbol)->details->cursor;
+
+  gtk_widget_set_cursor_from_name (GTK_WIDGET (self), cursor);
+}
+
+static void
+on_leave (ShumateVectorSymbolContainer *self,
+          GtkEventControllerMotion     *motion)
+{
+  gtk_widget_set_cursor (GTK_WIDGET (self), NULL);
+}
+
+
+static void
+shumate_vector_symbol_container_init (ShumateVectorSymbolContainer *self)
+{
+  GtkGesture *click = gtk_gesture_click_new ();
+  GtkEventController *motion = gtk_event_controller_motion_new ();
+
+  self->layer_buckets = g_ptr_array_new_with_free_func ((GDestroyNotify)layer_bucket_free);
+  self->placement_time_budget = PLACEMENT_TIME_BUDGET;
+
+  g_signal_connect_object (click, "released", G_CALLBACK (on_click_released), self, G_CONNECT_SWAPPED);
+  gtk_widget_add_controller (GTK_WIDGET (self), GTK_EVENT_CONTROLLER (click));
+
+  g_signal_connect_object (motion, "enter", G_CALLBACK (on_motion), self, G_CONNECT_SWAPPED);
+  g_signal_connect_object (motion, "motion", G_CALLBACK (on_motion), self, G_CONNECT_SWAPPED);
+  g_signal_connect_object (motion, "leave", G_CALLBACK (on_leave), self, G_CONNECT_SWAPPED);
+  gtk_widget_add_controller (GTK_WIDGET (self), motion);
+}
 
 void
 shumate_vector_symbol_container_add_symbols (ShumateVectorSymbolContainer *self,
@@ -537,21 +881,15 @@ shumate_vector_symbol_container_add_symbols (ShumateVectorSymbolContainer *self,
       info->tile_x = tile_x;
       info->tile_y = tile_y;
       info->zoom = zoom;
-      info->visible = TRUE;
+      info->visible = FALSE;
 
       add_symbol_to_layer_buckets (self, info);
-      gtk_widget_set_parent (GTK_WIDGET (info->symbol), GTK_WIDGET (self));
       self->child_count ++;
-
-      g_signal_connect_object (info->symbol,
-                               "clicked",
-                               G_CALLBACK (on_symbol_clicked),
-                               self,
-                               G_CONNECT_SWAPPED);
     }
 
   sort_layer_buckets (self);
   self->labels_changed = TRUE;
+  gtk_widget_queue_allocate (GTK_WIDGET (self));
 }
 
 
@@ -563,8 +901,14 @@ shumate_vector_symbol_container_remove_symbols (ShumateVectorSymbolContainer *se
 {
   SHUMATE_PROFILE_START ();
 
+  g_autoptr(GPtrArray) removed = NULL;
+  g_autoptr(GHashTable) removed_symbols = NULL;
+
   g_return_if_fail (SHUMATE_IS_VECTOR_SYMBOL_CONTAINER (self));
 
+  removed = g_ptr_array_new_with_free_func ((GDestroyNotify)child_info_free);
+  removed_symbols = g_hash_table_new (NULL, NULL);
+
   for (int i = 0; i < self->layer_buckets->len; i ++)
     {
       LayerBucket *bucket = g_ptr_array_index (self->layer_buckets, i);
@@ -574,15 +918,16 @@ shumate_vector_symbol_container_remove_symbols (ShumateVectorSymbolContainer *se
         {
           ChildInfo *info = g_ptr_array_index (bucket->symbols, j);
 
+          g_ptr_array_index (bucket->symbols, j) = NULL;
+
           if (info->tile_x == tile_x && info->tile_y == tile_y && info->zoom == zoom)
             {
-              gtk_widget_unparent (GTK_WIDGET (info->symbol));
               self->child_count --;
-              g_clear_pointer (&g_ptr_array_index (bucket->symbols, j), g_free);
+              g_ptr_array_add (removed, info);
+              g_hash_table_add (removed_symbols, info->symbol);
             }
           else
             {
-              g_ptr_array_index (bucket->symbols, j) = NULL;
               g_ptr_array_index (bucket->symbols, k) = info;
               k ++;
             }
@@ -591,7 +936,14 @@ shumate_vector_symbol_container_remove_symbols (ShumateVectorSymbolContainer *se
       g_ptr_array_set_size (bucket->symbols, k);
     }
 
+  /* The shown placement stays in use for drawing and hit testing until the
+   * next one is committed, so only drop the removed symbols from it. They
+   * are freed after that, so the index never points to a freed symbol. A
+   * placement in progress starts over on the next allocation anyway. */
+  shumate_vector_collision_remove_tags (self->collision, removed_symbols);
+  shumate_vector_collision_clear (self->pending_collision);
   self->labels_changed = TRUE;
+  gtk_widget_queue_allocate (GTK_WIDGET (self));
 }
 
 
@@ -628,3 +980,37 @@ shumate_vector_symbol_container_get_debug_text (ShumateVectorSymbolContainer *se
 {
   return g_strdup_printf ("symbols: %d, %d visible\n", self->child_count, self->visible_count);
 }
+
+
+/* For testing: the time one frame may spend on an incremental placement */
+void
+shumate_vector_symbol_container_set_placement_time_budget (ShumateVectorSymbolContainer *self,
+                                                           gint64                        budget)
+{
+  g_return_if_fail (SHUMATE_IS_VECTOR_SYMBOL_CONTAINER (self));
+  self->placement_time_budget = budget;
+}
+
+
+/* For testing: whether a placement is in progress */
+gboolean
+shumate_vector_symbol_container_get_placement_pending (ShumateVectorSymbolContainer *self)
+{
+  g_return_val_if_fail (SHUMATE_IS_VECTOR_SYMBOL_CONTAINER (self), FALSE);
+  return self->placement_pending;
+}
+
+
+/* For testing: the view the shown placement was made for */
+void
+shumate_vector_symbol_container_get_placement_view (ShumateVectorSymbolContainer *self,
+                                                    double                       *zoom_level,
+                                                    double                       *rotation)
+{
+  g_return_if_fail (SHUMATE_IS_VECTOR_SYMBOL_CONTAINER (self));
+
+  if (zoom_level != NULL)
+    *zoom_level = self->last_zoom;
+  if (rotation != NULL)
+    *rotation = self->last_rotation;
+}
@@ -21,6 +21,7 @@
 #include <glib-object.h>
 #include "shumate-vector-utils-private.h"
 #include "shumate-vector-render-scope-private.h"
+#include "shumate-vector-shaped-text-private.h"
 #include "../shumate-vector-sprite.h"
 
 
@@ -72,6 +73,8 @@ typedef struct {
 
   /* Array of ShumateVectorFormatPart */
   GPtrArray *formatted_text;
+  /* formatted_text laid out by the render thread, or NULL */
+  ShumateVectorShapedText *shaped_text;
   ShumateVectorAnchor text_anchor;
   GdkRGBA text_color, icon_color;
   double text_opacity;
@@ -142,6 +145,7 @@ GType                        shumate_vector_symbol_info_get_type (void) G_GNUC_C
 ShumateVectorSymbolInfo     *shumate_vector_symbol_info_ref      (ShumateVectorSymbolInfo *self);
 void                         shumate_vector_symbol_info_unref    (ShumateVectorSymbolInfo *self);
 
+gsize shumate_vector_symbol_info_get_memory_size (ShumateVectorSymbolInfo *self);
 
 int shumate_vector_symbol_info_compare (ShumateVectorSymbolInfo *a,
                                         ShumateVectorSymbolInfo *b);
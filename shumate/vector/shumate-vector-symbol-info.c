@@ -35,6 +35,7 @@ shumate_vector_symbol_details_free (ShumateVectorSymbolDetails *details)
   g_clear_object (&details->icon_image);
 
   g_clear_pointer (&details->formatted_text, g_ptr_array_unref);
+  g_clear_pointer (&details->shaped_text, shumate_vector_shaped_text_unref);
   g_clear_pointer (&details->text_font, g_free);
 
   g_clear_pointer (&details->cursor, g_free);
@@ -73,7 +74,7 @@ shumate_vector_symbol_info_free (ShumateVectorSymbolInfo *self)
 
   g_clear_pointer (&self->details, shumate_vector_symbol_details_unref);
 
-  g_clear_pointer (&self->line, shumate_vector_line_string_free);
+  g_clear_pointer (&self->line, shumate_vector_line_string_unref);
 
   g_free (self);
 }
@@ -106,8 +107,8 @@ shumate_vector_symbol_info_set_line_points (ShumateVectorSymbolInfo *self,
                                             float                    position)
 {
   ShumateVectorPoint center;
-  g_clear_pointer (&self->line, shumate_vector_line_string_free);
-  self->line = linestring;
+  g_clear_pointer (&self->line, shumate_vector_line_string_unref);
+  self->line = shumate_vector_line_string_ref (linestring);
 
   shumate_vector_line_string_bounds (self->line, &self->line_size, &center);
   self->x = center.x;
@@ -116,6 +117,36 @@ shumate_vector_symbol_info_set_line_points (ShumateVectorSymbolInfo *self,
   self->line_position = position;
 }
 
+/* Estimates the heap memory used by the symbol, for cache accounting. The
+ * details and the line are shared between the symbols created from the same
+ * feature, so each symbol only counts its share of them. */
+gsize
+shumate_vector_symbol_info_get_memory_size (ShumateVectorSymbolInfo *self)
+{
+  gsize size = sizeof (ShumateVectorSymbolInfo);
+
+  if (self->line != NULL)
+    size += (sizeof (ShumateVectorLineString) + self->line->n_points * sizeof (ShumateVectorPoint))
+            / MAX (1, g_atomic_int_get (&self->line->ref_count));
+
+  if (self->details != NULL)
+    {
+      gsize details_size = sizeof (ShumateVectorSymbolDetails);
+
+      if (self->details->formatted_text != NULL)
+        details_size += self->details->formatted_text->len * 64;
+      if (self->details->shaped_text != NULL)
+        details_size += shumate_vector_shaped_text_get_memory_size (self->details->shaped_text)
+                        / MAX (1, g_atomic_int_get (&self->details->shaped_text->ref_count));
+      if (self->details->tags != NULL)
+        details_size += g_hash_table_size (self->details->tags) * 64;
+
+      size += details_size / MAX (1, g_atomic_int_get (&self->details->ref_count));
+    }
+
+  return size;
+}
+
 int
 shumate_vector_symbol_info_compare (ShumateVectorSymbolInfo *a,
                                     ShumateVectorSymbolInfo *b)
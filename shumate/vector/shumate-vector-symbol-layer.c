@@ -349,7 +349,7 @@ place_line_label (ShumateVectorSymbolDetails *details,
 {
   ShumateVectorSymbolInfo *symbol_info;
   GPtrArray *lines;
-  g_autoptr(GPtrArray) simplified_lines = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_line_string_free);
+  g_autoptr(GPtrArray) simplified_lines = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_line_string_unref);
   guint i;
   float spacing = details->symbol_spacing / scope->target_size;
   float total_length = 0;
@@ -399,9 +399,8 @@ place_line_label (ShumateVectorSymbolDetails *details,
             {
               symbol_info = create_symbol_info (details, point.x, point.y);
 
-              shumate_vector_symbol_info_set_line_points (symbol_info,
-                                                          shumate_vector_line_string_copy (linestring),
-                                                          distance);
+              /* Every label along the line shares it */
+              shumate_vector_symbol_info_set_line_points (symbol_info, linestring, distance);
 
               g_ptr_array_add (scope->symbols, symbol_info);
             }
@@ -432,8 +431,8 @@ shumate_vector_symbol_layer_render (ShumateVectorLayer *layer, ShumateVectorRend
   g_autoptr(ShumateVectorSymbolDetails) details = NULL;
   g_autoptr(ShumateVectorSprite) icon_image = shumate_vector_expression_eval_image (self->icon_image, scope);
   ShumateVectorGeometryType geometry_type = shumate_vector_render_scope_get_geometry_type (scope);
-  VectorTile__Tile__Layer *layer_struct = shumate_vector_reader_iter_get_layer_struct (scope->reader);
-  VectorTile__Tile__Feature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
+  ShumateVectorMvtLayer *layer_struct = shumate_vector_reader_iter_get_layer_struct (scope->reader);
+  ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (scope->reader);
   double x, y;
 
   shumate_vector_expression_eval (self->text_field, scope, &value);
@@ -556,6 +555,16 @@ shumate_vector_symbol_layer_render (ShumateVectorLayer *layer, ShumateVectorRend
   details->text_color = SHUMATE_VECTOR_COLOR_BLACK;
   shumate_vector_expression_eval_color (self->text_color, scope, &details->text_color);
 
+  /* Lay out the text here, on the render thread, so that creating the
+   * symbol on the main thread only has to build render nodes */
+  if (details->formatted_text != NULL)
+    details->shaped_text = shumate_vector_shaped_text_lookup (details->formatted_text,
+                                                              details->text_font,
+                                                              details->text_size,
+                                                              details->text_letter_spacing,
+                                                              &details->text_color,
+                                                              scope->font_options);
+
   shumate_vector_expression_eval (self->icon_padding, scope, &icon_padding_value);
   if ((icon_padding_array = shumate_vector_value_get_array (&icon_padding_value)) != NULL)
     {
@@ -24,11 +24,12 @@
 G_BEGIN_DECLS
 
 #define SHUMATE_TYPE_VECTOR_SYMBOL (shumate_vector_symbol_get_type())
-G_DECLARE_FINAL_TYPE (ShumateVectorSymbol, shumate_vector_symbol, SHUMATE, VECTOR_SYMBOL, GtkWidget)
+G_DECLARE_FINAL_TYPE (ShumateVectorSymbol, shumate_vector_symbol, SHUMATE, VECTOR_SYMBOL, GObject)
 
 ShumateVectorSymbol *shumate_vector_symbol_new (ShumateVectorSymbolInfo *symbol_info);
 
 ShumateVectorSymbolInfo *shumate_vector_symbol_get_symbol_info (ShumateVectorSymbol *self);
+const char *shumate_vector_symbol_get_text (ShumateVectorSymbol *self);
 
 gboolean shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
                                                     ShumateVectorCollision *collision,
@@ -37,4 +38,10 @@ gboolean shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self
                                                     double                  zoom_level,
                                                     double                  rotation,
                                                     graphene_rect_t        *bounds_out);
+void shumate_vector_symbol_commit_placement (ShumateVectorSymbol *self);
+
+void shumate_vector_symbol_snapshot (ShumateVectorSymbol *self,
+                                     GtkSnapshot         *snapshot,
+                                     double               tile_size_for_zoom,
+                                     double               rotation);
 G_END_DECLS
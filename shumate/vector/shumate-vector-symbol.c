@@ -19,16 +19,14 @@
 #include "shumate-vector-symbol-private.h"
 #include "shumate-vector-utils-private.h"
 #include "shumate-vector-symbol-info-private.h"
-#include "shumate-vector-symbol-container-private.h"
-#include "shumate-layer.h"
-#include "shumate-symbol-event-private.h"
 #include "../shumate-vector-sprite.h"
 
-#define RGBA_BLACK ((GdkRGBA){0, 0, 0, 1})
-
+/* The laid out text and icon of a symbol. Symbols are not widgets: the
+ * symbol container places them, draws them from its own snapshot and does
+ * hit testing for them through the collision index. */
 struct _ShumateVectorSymbol
 {
-  GtkWidget parent_instance;
+  GObject parent_instance;
 
   ShumateVectorSymbolInfo *symbol_info;
 
@@ -37,6 +35,9 @@ struct _ShumateVectorSymbol
   GskRenderNode *glyphs_node;
   int layout_width, layout_height, baseline, layout_y;
 
+  /* The label's plain text, for accessibility. Built when it's first needed. */
+  char *text;
+
   graphene_rect_t bounds;
   double x, y;
 
@@ -46,9 +47,13 @@ struct _ShumateVectorSymbol
 
   uint8_t show_text : 1;
   uint8_t show_icon : 1;
+  /* Set by shumate_vector_symbol_calculate_collision(), and only shown once
+   * the placement is committed */
+  uint8_t pending_show_text : 1;
+  uint8_t pending_show_icon : 1;
 };
 
-G_DEFINE_TYPE (ShumateVectorSymbol, shumate_vector_symbol, GTK_TYPE_WIDGET)
+G_DEFINE_TYPE (ShumateVectorSymbol, shumate_vector_symbol, G_TYPE_OBJECT)
 
 
 enum {
@@ -59,13 +64,6 @@ enum {
 
 static GParamSpec *obj_properties[N_PROPS] = { NULL, };
 
-enum {
-  CLICKED,
-  LAST_SIGNAL
-};
-
-static guint signals[LAST_SIGNAL] = { 0, };
-
 
 typedef struct {
   GskRenderNode *node;
@@ -78,6 +76,7 @@ static void
 glyph_clear (Glyph *glyph)
 {
   g_clear_pointer (&glyph->node, gsk_render_node_unref);
+  g_clear_object (&glyph->sprite);
 }
 
 
@@ -90,274 +89,116 @@ shumate_vector_symbol_new (ShumateVectorSymbolInfo *symbol_info)
 }
 
 
-static PangoAttrShape *
-get_shape_from_glyph_item (PangoGlyphItem *item)
-{
-  for (GSList *list = item->item->analysis.extra_attrs; list != NULL; list = list->next)
-    if (((PangoAttribute*)list->data)->klass->type == PANGO_ATTR_SHAPE)
-      return (PangoAttrShape*)list->data;
-  return NULL;
-}
-
-static void
-get_color_from_glyph_item (PangoGlyphItem *item, GdkRGBA *color)
-{
-  *color = RGBA_BLACK;
-
-  for (GSList *list = item->item->analysis.extra_attrs; list != NULL; list = list->next)
-    {
-      if (((PangoAttribute*)list->data)->klass->type == PANGO_ATTR_FOREGROUND)
-        {
-          PangoColor c = ((PangoAttrColor*)list->data)->color;
-          color->red = c.red / 65535.0;
-          color->green = c.green / 65535.0;
-          color->blue = c.blue / 65535.0;
-        }
-      else if (((PangoAttribute*)list->data)->klass->type == PANGO_ATTR_FOREGROUND_ALPHA)
-        color->alpha = ((PangoAttrInt*)list->data)->value / 65535.0;
-    }
-}
-
-
 static void
 shumate_vector_symbol_constructed (GObject *object)
 {
   ShumateVectorSymbol *self = (ShumateVectorSymbol *)object;
-  g_autofree char *text = NULL;
+  ShumateVectorShapedText *shaped_text = self->symbol_info->details->shaped_text;
 
-  if (self->symbol_info->details->formatted_text != NULL)
+  /* The text was already laid out by the render thread, so all that's left
+   * is to turn its glyph runs into render nodes */
+  if (shaped_text != NULL)
     {
-      PangoContext *context = gtk_widget_get_pango_context (GTK_WIDGET (self));
-      g_autoptr(PangoLayout) layout = pango_layout_new (context);
-      g_autoptr(PangoAttrList) attrs = pango_attr_list_new ();
-      g_autoptr(GString) string = g_string_new ("");
-      PangoAttribute *attr;
-      gboolean any_images = FALSE;
-      PangoRectangle ink_rect;
-
-      if (self->symbol_info->details->text_font != NULL)
-        {
-          g_autoptr(PangoFontDescription) desc = pango_font_description_from_string (self->symbol_info->details->text_font);
-          attr = pango_attr_font_desc_new (desc);
-          pango_attr_list_insert (attrs, attr);
-        }
-
-      attr = pango_attr_letter_spacing_new (self->symbol_info->details->text_letter_spacing * self->symbol_info->details->text_size * PANGO_SCALE);
-      pango_attr_list_insert (attrs, attr);
-
-      attr = pango_attr_foreground_new (self->symbol_info->details->text_color.red * 65535,
-                                        self->symbol_info->details->text_color.green * 65535,
-                                        self->symbol_info->details->text_color.blue * 65535);
-      pango_attr_list_insert (attrs, attr);
-
-      attr = pango_attr_foreground_alpha_new (self->symbol_info->details->text_color.alpha * 65535);
-      pango_attr_list_insert (attrs, attr);
-
-      attr = pango_attr_size_new_absolute (self->symbol_info->details->text_size * PANGO_SCALE);
-      pango_attr_list_insert (attrs, attr);
+      self->layout_width = shaped_text->layout_width;
+      self->layout_height = shaped_text->layout_height;
+      self->layout_y = shaped_text->layout_y;
+      self->baseline = shaped_text->baseline;
 
-      pango_layout_set_attributes (layout, attrs);
+      /* The fonts are shared with the render threads */
+      shumate_vector_shaped_text_lock_fonts ();
 
-      for (int i = 0, n = self->symbol_info->details->formatted_text->len; i < n; i ++)
+      if ((self->symbol_info->details->text_rotation_alignment == SHUMATE_VECTOR_ALIGNMENT_MAP
+          || self->symbol_info->details->text_rotation_alignment == SHUMATE_VECTOR_ALIGNMENT_VIEWPORT_GLYPH)
+          && (self->symbol_info->details->symbol_placement == SHUMATE_VECTOR_PLACEMENT_LINE
+              || self->symbol_info->details->symbol_placement == SHUMATE_VECTOR_PLACEMENT_LINE_CENTER))
         {
-          ShumateVectorFormatPart *part = g_ptr_array_index (self->symbol_info->details->formatted_text, i);
+          self->glyphs = g_array_new (FALSE, FALSE, sizeof (Glyph));
+          g_array_set_clear_func (self->glyphs, (GDestroyNotify)glyph_clear);
 
-          if (part->sprite != NULL)
+          for (int i = 0; i < shaped_text->runs->len; i ++)
             {
-              int width = shumate_vector_sprite_get_width (part->sprite);
-              int height = shumate_vector_sprite_get_height (part->sprite);
-              /* For shapes, since we're overriding the ink and logical rects
-                 of the glyph, we have to take letter spacing into account ourselves */
-              double spacing = self->symbol_info->details->text_letter_spacing * self->symbol_info->details->text_size;
-
-              PangoRectangle ink_rect = {
-                .x = spacing / 2 * PANGO_SCALE,
-                .y = -height * PANGO_SCALE,
-                .width = width * PANGO_SCALE,
-                .height = height * PANGO_SCALE,
-              };
-              PangoRectangle logical_rect = {
-                .x = 0,
-                .y = -height * PANGO_SCALE,
-                .width = (width + spacing) * PANGO_SCALE,
-                .height = height * PANGO_SCALE,
-              };
-
-              attr = pango_attr_shape_new_with_data (&ink_rect, &logical_rect, g_object_ref (part->sprite), (PangoAttrDataCopyFunc)g_object_ref, g_object_unref);
-              attr->start_index = string->len;
-              attr->end_index = string->len + strlen ("\uFFFC");
-              pango_attr_list_insert (attrs, attr);
-
-              if (spacing != 0)
-                {
-                  attr = pango_attr_letter_spacing_new (0);
-                  attr->start_index = string->len;
-                  attr->end_index = string->len + strlen ("\uFFFC");
-                  pango_attr_list_insert (attrs, attr);
-                }
-
-              g_string_append (string, "\uFFFC");
+              ShumateVectorShapedRun *run = &g_array_index (shaped_text->runs, ShumateVectorShapedRun, i);
 
-              any_images = TRUE;
-            }
-          else
-            {
-              if (part->has_font_scale)
+              if (run->sprite != NULL)
                 {
-                  attr = pango_attr_size_new_absolute (part->font_scale * self->symbol_info->details->text_size * PANGO_SCALE);
-                  attr->start_index = string->len;
-                  attr->end_index = string->len + strlen (part->string);
-                  pango_attr_list_insert (attrs, attr);
+                  Glyph glyph = {
+                    .sprite = g_object_ref (run->sprite),
+                    .node = NULL,
+                    .width = run->advance,
+                    .icon_color = run->color,
+                  };
+                  g_array_append_vals (self->glyphs, &glyph, 1);
                 }
-
-              if (part->has_text_color)
+              else
                 {
-                  attr = pango_attr_foreground_new (part->text_color.red * 65535,
-                                                    part->text_color.green * 65535,
-                                                    part->text_color.blue * 65535);
-                  attr->start_index = string->len;
-                  attr->end_index = string->len + strlen (part->string);
-                  pango_attr_list_insert (attrs, attr);
-
-                  attr = pango_attr_foreground_alpha_new (part->text_color.alpha * 65535);
-                  attr->start_index = string->len;
-                  attr->end_index = string->len + strlen (part->string);
-                  pango_attr_list_insert (attrs, attr);
+                  for (int j = 0; j < run->glyphs->num_glyphs; j ++)
+                    {
+                      GskRenderNode *node;
+                      Glyph glyph;
+                      PangoGlyphString *glyph_string;
+
+                      glyph_string = pango_glyph_string_new ();
+                      pango_glyph_string_set_size (glyph_string, 1);
+                      glyph_string->glyphs[0] = run->glyphs->glyphs[j];
+                      glyph_string->log_clusters[0] = 0;
+
+                      node =
+                        gsk_text_node_new (run->font,
+                                           glyph_string,
+                                           &run->color,
+                                           &GRAPHENE_POINT_INIT (0, 0));
+
+                      glyph.node = node;
+                      glyph.sprite = NULL;
+                      glyph.width = glyph_string->glyphs[0].geometry.width / (double) PANGO_SCALE;
+                      g_array_append_vals (self->glyphs, &glyph, 1);
+
+                      pango_glyph_string_free (glyph_string);
+                    }
                 }
-
-              g_string_append (string, part->string);
             }
         }
-
-      text = g_string_free (g_steal_pointer (&string), FALSE);
-      pango_layout_set_text (layout, text, -1);
-
-      pango_layout_get_pixel_extents (layout, &ink_rect, NULL);
-      self->layout_width = ink_rect.width;
-      self->layout_height = ink_rect.height;
-      self->layout_y = ink_rect.y;
-      self->baseline = pango_layout_get_baseline (layout) / (double) PANGO_SCALE;
-
-      if ((self->symbol_info->details->text_rotation_alignment == SHUMATE_VECTOR_ALIGNMENT_MAP
-          || self->symbol_info->details->text_rotation_alignment == SHUMATE_VECTOR_ALIGNMENT_VIEWPORT_GLYPH)
-          && (self->symbol_info->details->symbol_placement == SHUMATE_VECTOR_PLACEMENT_LINE
-              || self->symbol_info->details->symbol_placement == SHUMATE_VECTOR_PLACEMENT_LINE_CENTER))
-        {
-          g_autoptr(PangoLayoutIter) iter = NULL;
-          int i;
-          PangoGlyphItem *current_item;
-
-          self->glyphs = g_array_new (FALSE, FALSE, sizeof (Glyph));
-          g_array_set_clear_func (self->glyphs, (GDestroyNotify)glyph_clear);
-
-          iter = pango_layout_get_iter (layout);
-
-          do {
-            PangoAttrShape *shape = NULL;
-
-            current_item = pango_layout_iter_get_run (iter);
-
-            if (current_item == NULL)
-              continue;
-
-            shape = get_shape_from_glyph_item (current_item);
-
-            if (shape != NULL)
-              {
-                Glyph glyph = {
-                  .sprite = g_object_ref (shape->data),
-                  .node = NULL,
-                  .width = shape->logical_rect.width / (double) PANGO_SCALE,
-                };
-                get_color_from_glyph_item (current_item, &glyph.icon_color);
-                g_array_append_vals (self->glyphs, &glyph, 1);
-              }
-            else
-              {
-                for (i = 0; i < current_item->glyphs->num_glyphs; i ++)
-                  {
-                    GskRenderNode *node;
-                    Glyph glyph;
-                    PangoGlyphString *glyph_string;
-                    GdkRGBA color;
-
-                    glyph_string = pango_glyph_string_new ();
-                    pango_glyph_string_set_size (glyph_string, 1);
-                    glyph_string->glyphs[0] = current_item->glyphs->glyphs[i];
-                    glyph_string->log_clusters[0] = 0;
-
-                    get_color_from_glyph_item (current_item, &color);
-
-                    node =
-                      gsk_text_node_new (current_item->item->analysis.font,
-                                         glyph_string,
-                                         &color,
-                                         &GRAPHENE_POINT_INIT (0, 0));
-
-                    glyph.node = node;
-                    glyph.sprite = NULL;
-                    glyph.width = glyph_string->glyphs[0].geometry.width / (double) PANGO_SCALE;
-                    g_array_append_vals (self->glyphs, &glyph, 1);
-
-                    pango_glyph_string_free (glyph_string);
-                  }
-              }
-          } while (pango_layout_iter_next_run (iter));
-        }
       else
         {
           g_autoptr(GtkSnapshot) snapshot = gtk_snapshot_new ();
 
-          gtk_snapshot_append_layout (snapshot, layout, &RGBA_BLACK);
-
-          if (any_images)
+          for (int i = 0; i < shaped_text->runs->len; i ++)
             {
-              g_autoptr(PangoLayoutIter) iter = NULL;
-
-              iter = pango_layout_get_iter (layout);
-
-              do {
-                PangoGlyphItem *current_item = pango_layout_iter_get_run (iter);
-                PangoAttrShape *shape;
-
-                if (current_item == NULL)
-                  continue;
-
-                shape = get_shape_from_glyph_item (current_item);
-                if (shape != NULL)
-                  {
-                    ShumateVectorSprite *sprite = shape->data;
-                    PangoRectangle extents;
-                    GdkRGBA color;
-
-                    pango_layout_iter_get_run_extents (iter, &extents, NULL);
-                    get_color_from_glyph_item (current_item, &color);
-
-                    gtk_snapshot_save (snapshot);
-                    gtk_snapshot_translate (snapshot,
-                                            &GRAPHENE_POINT_INIT (
-                                              PANGO_PIXELS (extents.x),
-                                              PANGO_PIXELS (extents.y)
-                                            ));
-                    gtk_symbolic_paintable_snapshot_symbolic (
-                      GTK_SYMBOLIC_PAINTABLE (sprite),
-                      snapshot,
-                      PANGO_PIXELS (extents.width),
-                      PANGO_PIXELS (extents.height),
-                      &color,
-                      1
-                    );
-                    gtk_snapshot_restore (snapshot);
-                  }
-              } while (pango_layout_iter_next_run (iter));
+              ShumateVectorShapedRun *run = &g_array_index (shaped_text->runs, ShumateVectorShapedRun, i);
+
+              if (run->sprite != NULL)
+                {
+                  gtk_snapshot_save (snapshot);
+                  gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (run->x, run->y));
+                  gtk_symbolic_paintable_snapshot_symbolic (
+                    GTK_SYMBOLIC_PAINTABLE (run->sprite),
+                    snapshot,
+                    run->width,
+                    run->height,
+                    &run->color,
+                    1
+                  );
+                  gtk_snapshot_restore (snapshot);
+                }
+              else
+                {
+                  /* NULL if the run has nothing to draw, e.g. whitespace */
+                  g_autoptr(GskRenderNode) node =
+                    gsk_text_node_new (run->font,
+                                       run->glyphs,
+                                       &run->color,
+                                       &GRAPHENE_POINT_INIT (run->x, run->y));
+
+                  if (node != NULL)
+                    gtk_snapshot_append_node (snapshot, node);
+                }
             }
 
           self->glyphs_node = gtk_snapshot_free_to_node (g_steal_pointer (&snapshot));
         }
-    }
 
-  if (self->symbol_info->details->cursor != NULL)
-    gtk_widget_set_cursor_from_name (GTK_WIDGET (self), self->symbol_info->details->cursor);
+      shumate_vector_shaped_text_unlock_fonts ();
+    }
 
   if (self->symbol_info->line != NULL)
     {
@@ -375,60 +216,19 @@ shumate_vector_symbol_constructed (GObject *object)
       self->line_length = shumate_vector_line_string_length (self->symbol_info->line);
     }
 
-  gtk_accessible_update_property (GTK_ACCESSIBLE (self),
-                                  GTK_ACCESSIBLE_PROPERTY_LABEL,
-                                  text,
-                                  -1);
-
   G_OBJECT_CLASS (shumate_vector_symbol_parent_class)->constructed (object);
 }
 
 
-static gboolean
-shumate_vector_symbol_contains (GtkWidget *widget,
-                                double     x,
-                                double     y)
-{
-  GtkWidget *parent;
-  graphene_rect_t alloc;
-
-  if (x < 0 || y < 0)
-    return FALSE;
-
-  parent = gtk_widget_get_parent (widget);
-  if (!gtk_widget_compute_bounds (widget, parent, &alloc))
-    return FALSE;
-
-  if (x > alloc.size.width || y > alloc.size.height)
-    return FALSE;
-
-  if (SHUMATE_IS_VECTOR_SYMBOL_CONTAINER (parent))
-    {
-      ShumateVectorCollision *collision =
-        shumate_vector_symbol_container_get_collision ((ShumateVectorSymbolContainer *) (parent));
-
-      return shumate_vector_collision_query_point (collision,
-                                                   alloc.origin.x + x + collision->delta_x,
-                                                   alloc.origin.y + y + collision->delta_y,
-                                                   widget);
-    }
-
-  return TRUE;
-}
-
-
 static void
 shumate_vector_symbol_dispose (GObject *object)
 {
   ShumateVectorSymbol *self = (ShumateVectorSymbol *)object;
-  GtkWidget *child;
-
-  while ((child = gtk_widget_get_first_child (GTK_WIDGET (object))))
-    gtk_widget_unparent (child);
 
   g_clear_pointer (&self->symbol_info, shumate_vector_symbol_info_unref);
   g_clear_pointer (&self->glyphs, g_array_unref);
   g_clear_pointer (&self->glyphs_node, gsk_render_node_unref);
+  g_clear_pointer (&self->text, g_free);
 
   G_OBJECT_CLASS (shumate_vector_symbol_parent_class)->dispose (object);
 }
@@ -482,50 +282,6 @@ positive_mod (double i, double n)
 }
 
 
-static void
-shumate_vector_symbol_measure (GtkWidget      *widget,
-                               GtkOrientation  orientation,
-                               int             for_size,
-                               int            *minimum,
-                               int            *natural,
-                               int            *minimum_baseline,
-                               int            *natural_baseline)
-{
-  ShumateVectorSymbol *self = SHUMATE_VECTOR_SYMBOL (widget);
-
-  if (self->symbol_info->line != NULL)
-    {
-      if (minimum)
-        *minimum = 0;
-      if (natural)
-        *natural = 0;
-    }
-  else
-    {
-      if (orientation == GTK_ORIENTATION_HORIZONTAL)
-        {
-          if (minimum)
-            *minimum = self->layout_width;
-          if (natural)
-            *natural = self->layout_width;
-        }
-      else if (orientation == GTK_ORIENTATION_VERTICAL)
-        {
-          if (minimum)
-            *minimum = self->layout_height;
-          if (natural)
-            *natural = self->layout_height;
-        }
-    }
-}
-
-static GtkSizeRequestMode
-shumate_vector_symbol_get_request_mode (GtkWidget *widget)
-{
-  return GTK_SIZE_REQUEST_CONSTANT_SIZE;
-}
-
-
 static void
 add_anchor_offset (ShumateVectorAnchor anchor,
                    double *offset_x,
@@ -555,31 +311,28 @@ add_anchor_offset (ShumateVectorAnchor anchor,
 }
 
 
-static void
-shumate_vector_symbol_snapshot (GtkWidget   *widget,
-                                GtkSnapshot *snapshot)
+/*
+ * shumate_vector_symbol_snapshot:
+ * @self: a #ShumateVectorSymbol
+ * @snapshot: a #GtkSnapshot
+ * @tile_size_for_zoom: the size of the symbol's tile at the current zoom level
+ * @rotation: the map's rotation
+ *
+ * Draws the symbol, with the origin at the point it was placed at, as of the
+ * last call to shumate_vector_symbol_commit_placement().
+ */
+void
+shumate_vector_symbol_snapshot (ShumateVectorSymbol *self,
+                                GtkSnapshot         *snapshot,
+                                double               tile_size_for_zoom,
+                                double               rotation)
 {
-  ShumateVectorSymbol *self = SHUMATE_VECTOR_SYMBOL (widget);
-  double rotation = 0.0;
-  double tile_size_for_zoom = 512.0;
-  GtkWidget *parent = gtk_widget_get_parent (widget);
   ShumateVectorPointIter iter;
 
-  if (SHUMATE_IS_VECTOR_SYMBOL_CONTAINER (parent))
-    {
-      ShumateViewport *viewport = shumate_layer_get_viewport (SHUMATE_LAYER (parent));
-      ShumateMapSource *map_source = shumate_vector_symbol_container_get_map_source (SHUMATE_VECTOR_SYMBOL_CONTAINER (parent));
-      double zoom_level = shumate_viewport_get_zoom_level (viewport);
-      tile_size_for_zoom = shumate_map_source_get_tile_size (map_source) * pow (2, zoom_level - self->symbol_info->details->tile_zoom_level);
-      rotation = shumate_viewport_get_rotation (viewport);
-    }
+  g_return_if_fail (SHUMATE_IS_VECTOR_SYMBOL (self));
 
   gtk_snapshot_save (snapshot);
 
-  /* Translate so the origin is at the origin point of the symbol */
-  gtk_snapshot_translate (snapshot, &GRAPHENE_POINT_INIT (self->x - self->bounds.origin.x,
-                                                          self->y - self->bounds.origin.y));
-
   if (self->show_icon && self->symbol_info->details->icon_image && self->symbol_info->details->icon_opacity > 0.0)
     {
       double angle = 0;
@@ -769,18 +522,12 @@ static void
 shumate_vector_symbol_class_init (ShumateVectorSymbolClass *klass)
 {
   GObjectClass *object_class = G_OBJECT_CLASS (klass);
-  GtkWidgetClass *widget_class = GTK_WIDGET_CLASS (klass);
 
   object_class->constructed = shumate_vector_symbol_constructed;
   object_class->dispose = shumate_vector_symbol_dispose;
   object_class->get_property = shumate_vector_symbol_get_property;
   object_class->set_property = shumate_vector_symbol_set_property;
 
-  widget_class->contains = shumate_vector_symbol_contains;
-  widget_class->get_request_mode = shumate_vector_symbol_get_request_mode;
-  widget_class->snapshot = shumate_vector_symbol_snapshot;
-  widget_class->measure = shumate_vector_symbol_measure;
-
   obj_properties[PROP_SYMBOL_INFO] =
     g_param_spec_boxed ("symbol-info",
                         "Symbol info",
@@ -789,43 +536,11 @@ shumate_vector_symbol_class_init (ShumateVectorSymbolClass *klass)
                         G_PARAM_STATIC_STRINGS | G_PARAM_READWRITE | G_PARAM_CONSTRUCT_ONLY);
 
   g_object_class_install_properties (object_class, N_PROPS, obj_properties);
-
-  signals[CLICKED] =
-    g_signal_new ("clicked",
-                  G_OBJECT_CLASS_TYPE (object_class),
-                  G_SIGNAL_RUN_LAST,
-                  0, NULL, NULL,
-                  g_cclosure_marshal_VOID__OBJECT,
-                  G_TYPE_NONE,
-                  1,
-                  SHUMATE_TYPE_SYMBOL_EVENT);
-
-  gtk_widget_class_set_accessible_role (widget_class, GTK_ACCESSIBLE_ROLE_LABEL);
-}
-
-static void
-on_clicked (ShumateVectorSymbol *self,
-            gint                 n_press,
-            double               x,
-            double               y,
-            GtkGestureClick     *click)
-{
-  g_autoptr(ShumateSymbolEvent) event =
-    shumate_symbol_event_new_with_n_press (self->symbol_info->details->layer,
-                                           self->symbol_info->details->source_layer,
-                                           self->symbol_info->details->feature_id,
-                                           self->symbol_info->details->tags,
-                                           n_press);
-
-  g_signal_emit (self, signals[CLICKED], 0, event);
 }
 
 static void
 shumate_vector_symbol_init (ShumateVectorSymbol *self)
 {
-  GtkGesture *click = gtk_gesture_click_new ();
-  g_signal_connect_object (click, "released", G_CALLBACK (on_clicked), self, G_CONNECT_SWAPPED);
-  gtk_widget_add_controller (GTK_WIDGET (self), GTK_EVENT_CONTROLLER (click));
 }
 
 
@@ -837,6 +552,38 @@ shumate_vector_symbol_get_symbol_info (ShumateVectorSymbol *self)
   return self->symbol_info;
 }
 
+
+/* Returns the text of the label if it is shown, without formatting or inline
+ * images, or NULL */
+const char *
+shumate_vector_symbol_get_text (ShumateVectorSymbol *self)
+{
+  GPtrArray *formatted_text;
+
+  g_return_val_if_fail (SHUMATE_IS_VECTOR_SYMBOL (self), NULL);
+
+  formatted_text = self->symbol_info->details->formatted_text;
+  if (!self->show_text || formatted_text == NULL)
+    return NULL;
+
+  if (self->text == NULL)
+    {
+      g_autoptr(GString) string = g_string_new ("");
+
+      for (int i = 0; i < formatted_text->len; i ++)
+        {
+          ShumateVectorFormatPart *part = g_ptr_array_index (formatted_text, i);
+
+          if (part->sprite == NULL && part->string != NULL)
+            g_string_append (string, part->string);
+        }
+
+      self->text = g_string_free (g_steal_pointer (&string), FALSE);
+    }
+
+  return self->text[0] != '\0' ? self->text : NULL;
+}
+
 static void
 rotate_around_center (double *x,
                       double *y,
@@ -892,14 +639,14 @@ shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
 
       if (length > line_length - start_pos)
         {
-          self->show_text = FALSE;
+          self->pending_show_text = FALSE;
           return FALSE;
         }
 
       shumate_vector_point_iter_init (&iter, self->symbol_info->line);
       shumate_vector_point_iter_advance (&iter, start_pos);
 
-      self->show_text = TRUE;
+      self->pending_show_text = TRUE;
 
       do
         {
@@ -933,7 +680,7 @@ shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
               if (self->symbol_info->details->text_optional)
                 {
                   shumate_vector_collision_rollback_pending (collision, save);
-                  self->show_text = FALSE;
+                  self->pending_show_text = FALSE;
                   break;
                 }
               else
@@ -956,7 +703,7 @@ shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
 
       rotate_around_center (&offset_x, &offset_y, angle);
 
-      self->show_text = TRUE;
+      self->pending_show_text = TRUE;
 
       check = shumate_vector_collision_check (
         collision,
@@ -975,7 +722,7 @@ shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
           if (self->symbol_info->details->text_optional)
             {
               shumate_vector_collision_rollback_pending (collision, save);
-              self->show_text = FALSE;
+              self->pending_show_text = FALSE;
             }
           else
             return FALSE;
@@ -995,7 +742,7 @@ shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
       double offset_x = self->symbol_info->details->icon_offset_x * self->symbol_info->details->icon_size;
       double offset_y = self->symbol_info->details->icon_offset_y * self->symbol_info->details->icon_size;
 
-      self->show_icon = TRUE;
+      self->pending_show_icon = TRUE;
 
       add_anchor_offset (self->symbol_info->details->icon_anchor, &offset_x, &offset_y, icon_width, icon_height);
 
@@ -1023,14 +770,14 @@ shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
           if (self->symbol_info->details->icon_optional)
             {
               shumate_vector_collision_rollback_pending (collision, save);
-              self->show_icon = FALSE;
+              self->pending_show_icon = FALSE;
             }
           else
             return FALSE;
         }
     }
 
-  if (!self->show_icon && !self->show_text)
+  if (!self->pending_show_icon && !self->pending_show_text)
     return FALSE;
 
   shumate_vector_collision_commit_pending (collision, &self->bounds);
@@ -1040,3 +787,21 @@ shumate_vector_symbol_calculate_collision (ShumateVectorSymbol    *self,
   return TRUE;
 }
 
+
+/*
+ * shumate_vector_symbol_commit_placement:
+ * @self: a #ShumateVectorSymbol
+ *
+ * Makes the parts of the symbol that the last call to
+ * shumate_vector_symbol_calculate_collision() placed the ones that are drawn.
+ * This lets the container keep showing a previous placement until a new one
+ * is complete.
+ */
+void
+shumate_vector_symbol_commit_placement (ShumateVectorSymbol *self)
+{
+  g_return_if_fail (SHUMATE_IS_VECTOR_SYMBOL (self));
+
+  self->show_text = self->pending_show_text;
+  self->show_icon = self->pending_show_icon;
+}
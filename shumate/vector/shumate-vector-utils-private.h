@@ -29,9 +29,12 @@ struct _ShumateVectorPoint {
   double y;
 };
 
+/* Line strings are refcounted so that the symbols placed along a line can
+ * share it. They must not be modified once shared. */
 struct _ShumateVectorLineString {
   gsize n_points;
   ShumateVectorPoint *points;
+  guint ref_count;
 };
 
 struct _ShumateVectorPointIter {
@@ -94,15 +97,17 @@ void   shumate_vector_point_iter_advance              (ShumateVectorPointIter *i
                                                        double                  distance);
 double shumate_vector_point_iter_get_current_angle    (ShumateVectorPointIter *iter);
 
+ShumateVectorLineString *shumate_vector_line_string_new (gsize n_points);
 ShumateVectorLineString *shumate_vector_line_string_copy (ShumateVectorLineString *linestring);
-void   shumate_vector_line_string_free                (ShumateVectorLineString *linestring);
+ShumateVectorLineString *shumate_vector_line_string_ref (ShumateVectorLineString *linestring);
+void   shumate_vector_line_string_unref               (ShumateVectorLineString *linestring);
 double shumate_vector_line_string_length              (ShumateVectorLineString *linestring);
 void   shumate_vector_line_string_bounds              (ShumateVectorLineString *linestring,
                                                        ShumateVectorPoint      *radius_out,
                                                        ShumateVectorPoint      *center_out);
 GPtrArray *shumate_vector_line_string_simplify        (ShumateVectorLineString *linestring);
 
-G_DEFINE_AUTOPTR_CLEANUP_FUNC (ShumateVectorLineString, shumate_vector_line_string_free)
+G_DEFINE_AUTOPTR_CLEANUP_FUNC (ShumateVectorLineString, shumate_vector_line_string_unref)
 
 typedef enum {
   SHUMATE_VECTOR_GEOMETRY_OP_MOVE_TO = 1,
@@ -111,7 +116,8 @@ typedef enum {
 } ShumateVectorGeometryOp;
 
 typedef struct {
-  VectorTile__Tile__Feature *feature;
+  const guint32 *geometry;
+  guint n_geometry;
   int i, j;
   int op, repeat;
   int x, y;
@@ -357,20 +357,45 @@ shumate_vector_point_iter_get_average_angle (ShumateVectorPointIter *iter,
 }
 
 
+ShumateVectorLineString *
+shumate_vector_line_string_new (gsize n_points)
+{
+  ShumateVectorLineString *self = g_new0 (ShumateVectorLineString, 1);
+  self->ref_count = 1;
+  self->n_points = n_points;
+  self->points = g_new (ShumateVectorPoint, n_points);
+  return self;
+}
+
 ShumateVectorLineString *
 shumate_vector_line_string_copy (ShumateVectorLineString *linestring)
 {
-  ShumateVectorLineString *copy = g_new0 (ShumateVectorLineString, 1);
-  copy->n_points = linestring->n_points;
-  copy->points = g_memdup2 (linestring->points, linestring->n_points * sizeof (ShumateVectorPoint));
+  ShumateVectorLineString *copy = shumate_vector_line_string_new (linestring->n_points);
+  memcpy (copy->points, linestring->points, linestring->n_points * sizeof (ShumateVectorPoint));
   return copy;
 }
 
+ShumateVectorLineString *
+shumate_vector_line_string_ref (ShumateVectorLineString *linestring)
+{
+  g_return_val_if_fail (linestring != NULL, NULL);
+  g_return_val_if_fail (linestring->ref_count, NULL);
+
+  g_atomic_int_inc (&linestring->ref_count);
+  return linestring;
+}
+
 void
-shumate_vector_line_string_free (ShumateVectorLineString *linestring)
+shumate_vector_line_string_unref (ShumateVectorLineString *linestring)
 {
-  g_clear_pointer (&linestring->points, g_free);
-  g_free (linestring);
+  g_return_if_fail (linestring != NULL);
+  g_return_if_fail (linestring->ref_count);
+
+  if (g_atomic_int_dec_and_test (&linestring->ref_count))
+    {
+      g_clear_pointer (&linestring->points, g_free);
+      g_free (linestring);
+    }
 }
 
 
@@ -500,11 +525,10 @@ shumate_vector_line_string_simplify (ShumateVectorLineString *linestring)
 
       if (angle < 120 * G_PI / 180)
         {
-          ShumateVectorLineString *new_line = g_new (ShumateVectorLineString, 1);
+          ShumateVectorLineString *new_line = shumate_vector_line_string_new (linestring->n_points - i);
 
           /* Copy from the current point until the end of the line */
-          new_line->n_points = linestring->n_points - i;
-          new_line->points = g_memdup2 (&linestring->points[i], new_line->n_points * sizeof (ShumateVectorPoint));
+          memcpy (new_line->points, &linestring->points[i], new_line->n_points * sizeof (ShumateVectorPoint));
 
           linestring->n_points = i + 1;
 
@@ -530,10 +554,10 @@ shumate_vector_geometry_iter (ShumateVectorGeometryIter *iter)
     {
       iter->j = 0;
 
-      if (iter->i >= iter->feature->n_geometry)
+      if (iter->i >= iter->n_geometry)
         return FALSE;
 
-      cmd = iter->feature->geometry[iter->i];
+      cmd = iter->geometry[iter->i];
       iter->i ++;
 
       iter->op = cmd & 0x7;
@@ -544,11 +568,11 @@ shumate_vector_geometry_iter (ShumateVectorGeometryIter *iter)
     {
     case SHUMATE_VECTOR_GEOMETRY_OP_MOVE_TO:
     case SHUMATE_VECTOR_GEOMETRY_OP_LINE_TO:
-      if (iter->i + 1 >= iter->feature->n_geometry)
+      if (iter->i + 1 >= iter->n_geometry)
         return FALSE;
 
-      iter->dx = zigzag (iter->feature->geometry[iter->i]);
-      iter->dy = zigzag (iter->feature->geometry[iter->i + 1]);
+      iter->dx = zigzag (iter->geometry[iter->i]);
+      iter->dy = zigzag (iter->geometry[iter->i + 1]);
       iter->cursor_x += iter->dx;
       iter->cursor_y += iter->dy;
       iter->x = iter->cursor_x;
@@ -1,6 +1,7 @@
 #undef G_DISABLE_ASSERT
 
 #include <shumate/shumate.h>
+#include <sqlite3.h>
 
 #define TEST_ETAG "0123456789ABCDEFG"
 #define TEST_DATA "The quick brown fox \0 jumps over the lazy dog"
@@ -93,6 +94,176 @@ test_file_cache_miss ()
 }
 
 
+static ShumateFileCache *
+create_database_cache (void)
+{
+  return g_object_new (SHUMATE_TYPE_FILE_CACHE,
+                       "size-limit", 100000000,
+                       "cache-key", "test",
+                       "storage", SHUMATE_FILE_CACHE_STORAGE_DATABASE,
+                       NULL);
+}
+
+/* Test that storing and retrieving a tile works when tiles are stored in the
+ * database */
+static void
+test_file_cache_store_retrieve_database ()
+{
+  g_autoptr(ShumateFileCache) cache = create_database_cache ();
+  g_autoptr(GBytes) bytes = g_bytes_new_static (TEST_DATA, sizeof TEST_DATA);
+  g_autoptr(GMainLoop) loop = NULL;
+  g_autofree char *filename = NULL;
+
+  loop = g_main_loop_new (NULL, TRUE);
+  shumate_file_cache_store_tile_async (cache, 0, 0, 256, bytes, TEST_ETAG, NULL, on_tile_stored, loop);
+  g_main_loop_run (loop);
+
+  /* No file should have been created for the tile */
+  filename = g_build_filename (shumate_file_cache_get_cache_dir (cache), "test", "256", "0", "0.png", NULL);
+  g_assert_false (g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  g_main_loop_unref (loop);
+  loop = g_main_loop_new (NULL, TRUE);
+  shumate_file_cache_get_tile_async (cache, 0, 0, 256, NULL, on_tile_retrieved, loop);
+  g_main_loop_run (loop);
+
+  g_main_loop_unref (loop);
+  loop = g_main_loop_new (NULL, TRUE);
+  shumate_file_cache_get_tile_async (cache, 1, 0, 256, NULL, on_no_tile_retrieved, loop);
+  g_main_loop_run (loop);
+}
+
+/* Test that tiles stored as files are moved into the database when switching
+ * to database storage */
+static void
+test_file_cache_migrate ()
+{
+  g_autoptr(ShumateFileCache) cache = shumate_file_cache_new_full (100000000, "test", NULL);
+  g_autoptr(GBytes) bytes = g_bytes_new_static (TEST_DATA, sizeof TEST_DATA);
+  g_autoptr(GMainLoop) loop = NULL;
+  g_autofree char *filename = NULL;
+
+  loop = g_main_loop_new (NULL, TRUE);
+  shumate_file_cache_store_tile_async (cache, 0, 0, 256, bytes, TEST_ETAG, NULL, on_tile_stored, loop);
+  g_main_loop_run (loop);
+
+  filename = g_build_filename (shumate_file_cache_get_cache_dir (cache), "test", "256", "0", "0.png", NULL);
+  g_assert_true (g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  g_clear_object (&cache);
+  cache = create_database_cache ();
+
+  /* Writes are applied in order, so once this one is done the migration
+   * queued when the cache was created has finished too */
+  g_main_loop_unref (loop);
+  loop = g_main_loop_new (NULL, TRUE);
+  shumate_file_cache_store_tile_async (cache, 1, 0, 256, bytes, TEST_ETAG, NULL, on_tile_stored, loop);
+  g_main_loop_run (loop);
+
+  /* The tile was moved into the database, so it is gone from disk but can
+   * still be retrieved */
+  g_assert_false (g_file_test (filename, G_FILE_TEST_EXISTS));
+
+  g_main_loop_unref (loop);
+  loop = g_main_loop_new (NULL, TRUE);
+  shumate_file_cache_get_tile_async (cache, 0, 0, 256, NULL, on_tile_retrieved, loop);
+  g_main_loop_run (loop);
+}
+
+
+static void
+store_tile (ShumateFileCache *cache,
+            int               x,
+            int               y)
+{
+  g_autoptr(GBytes) bytes = g_bytes_new_static (TEST_DATA, sizeof TEST_DATA);
+  g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, TRUE);
+
+  shumate_file_cache_store_tile_async (cache, x, y, 256, bytes, TEST_ETAG, NULL, on_tile_stored, loop);
+  g_main_loop_run (loop);
+}
+
+static void
+on_purged (GObject *object, GAsyncResult *res, gpointer user_data)
+{
+  g_autoptr(GError) error = NULL;
+  GMainLoop *loop = user_data;
+
+  g_assert_true (shumate_file_cache_purge_cache_finish ((ShumateFileCache *) object, res, &error));
+  g_assert_no_error (error);
+
+  g_main_loop_quit (loop);
+}
+
+/* Checks the number of tiles in the cache's database, and that the size total
+ * kept in its metadata table matches the tiles that are actually there */
+static void
+assert_tiles_in_database (ShumateFileCache *cache,
+                          int               n_tiles)
+{
+  g_autofree char *filename = g_build_filename (shumate_file_cache_get_cache_dir (cache), "cache.db", NULL);
+  sqlite3 *db = NULL;
+  sqlite3_stmt *stmt = NULL;
+
+  g_assert_cmpint (sqlite3_open_v2 (filename, &db, SQLITE_OPEN_READONLY, NULL), ==, SQLITE_OK);
+  g_assert_cmpint (sqlite3_prepare_v2 (db,
+                                       "SELECT COUNT (*), COALESCE (SUM (size), 0), "
+                                       "(SELECT value FROM metadata WHERE key = 'size') FROM tiles",
+                                       -1, &stmt, NULL), ==, SQLITE_OK);
+  g_assert_cmpint (sqlite3_step (stmt), ==, SQLITE_ROW);
+
+  g_assert_cmpint (sqlite3_column_int (stmt, 0), ==, n_tiles);
+  g_assert_cmpint (sqlite3_column_int64 (stmt, 2), ==, sqlite3_column_int64 (stmt, 1));
+
+  sqlite3_finalize (stmt);
+  sqlite3_close (db);
+}
+
+static void
+retrieve_tile (ShumateFileCache    *cache,
+               int                  x,
+               int                  y,
+               GAsyncReadyCallback  callback)
+{
+  g_autoptr(GMainLoop) loop = g_main_loop_new (NULL, TRUE);
+
+  shumate_file_cache_get_tile_async (cache, x, y, 256, NULL, callback, loop);
+  g_main_loop_run (loop);
+}
+
+/* Test that purging removes the least popular tiles until the cache fits */
+static void
+test_file_cache_purge ()
+{
+  g_autoptr(ShumateFileCache) cache = shumate_file_cache_new_full (2 * sizeof TEST_DATA, "test", NULL);
+  g_autoptr(GMainLoop) loop = NULL;
+
+  store_tile (cache, 0, 0);
+
+  /* Make the first tile more popular than the others */
+  for (int i = 0; i < 2; i ++)
+    retrieve_tile (cache, 0, 0, on_tile_retrieved);
+
+  store_tile (cache, 1, 0);
+  store_tile (cache, 2, 0);
+
+  /* ...and the last one more popular than the second, so that the second is
+   * the only one to go */
+  retrieve_tile (cache, 2, 0, on_tile_retrieved);
+
+  assert_tiles_in_database (cache, 3);
+
+  loop = g_main_loop_new (NULL, TRUE);
+  shumate_file_cache_purge_cache_async (cache, NULL, on_purged, loop);
+  g_main_loop_run (loop);
+
+  assert_tiles_in_database (cache, 2);
+
+  retrieve_tile (cache, 0, 0, on_tile_retrieved);
+  retrieve_tile (cache, 1, 0, on_no_tile_retrieved);
+  retrieve_tile (cache, 2, 0, on_tile_retrieved);
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -100,6 +271,9 @@ main (int argc, char *argv[])
 
   g_test_add_func ("/file-cache/store-retrieve", test_file_cache_store_retrieve);
   g_test_add_func ("/file-cache/miss", test_file_cache_miss);
+  g_test_add_func ("/file-cache/store-retrieve-database", test_file_cache_store_retrieve_database);
+  g_test_add_func ("/file-cache/migrate", test_file_cache_migrate);
+  g_test_add_func ("/file-cache/purge", test_file_cache_purge);
 
   return g_test_run ();
 }
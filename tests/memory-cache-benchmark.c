@@ -0,0 +1,115 @@
+#undef G_DISABLE_ASSERT
+
+#include <shumate/shumate.h>
+#include "shumate/shumate-memory-cache-private.h"
+
+/* Compares the per-tile lookup cost of ShumateMemoryCache against the string
+ * keyed scheme it used previously (a g_strdup_printf()-ed key hashed with
+ * g_str_hash, pointing into a GQueue). The grid approximates the visible
+ * tiles of a full-screen 4K map, which recompute_grid() looks up on every
+ * viewport change. */
+
+#define GRID_SIZE 12
+#define ZOOM_LEVEL 17
+#define ITERATIONS 20000
+
+
+static char *
+legacy_key (int         x,
+            int         y,
+            int         zoom_level,
+            const char *source_id)
+{
+  return g_strdup_printf ("%d/%d/%d/%s", zoom_level, x, y, source_id);
+}
+
+static gboolean
+legacy_lookup (GHashTable *hash_table,
+               GQueue     *queue,
+               int         x,
+               int         y,
+               int         zoom_level,
+               const char *source_id)
+{
+  g_autofree char *key = legacy_key (x, y, zoom_level, source_id);
+  GList *link = g_hash_table_lookup (hash_table, key);
+
+  if (link == NULL)
+    return FALSE;
+
+  g_queue_unlink (queue, link);
+  g_queue_push_head_link (queue, link);
+  return TRUE;
+}
+
+static double
+benchmark_legacy (int base_x,
+                  int base_y)
+{
+  g_autoptr(GHashTable) hash_table = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+  GQueue *queue = g_queue_new ();
+  gint64 start, end;
+  int hits = 0;
+
+  for (int x = 0; x < GRID_SIZE; x ++)
+    for (int y = 0; y < GRID_SIZE; y ++)
+      {
+        g_queue_push_head (queue, NULL);
+        g_hash_table_insert (hash_table,
+                             legacy_key (base_x + x, base_y + y, ZOOM_LEVEL, "osm-liberty"),
+                             g_queue_peek_head_link (queue));
+      }
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < ITERATIONS; i ++)
+    for (int x = 0; x < GRID_SIZE; x ++)
+      for (int y = 0; y < GRID_SIZE; y ++)
+        hits += legacy_lookup (hash_table, queue, base_x + x, base_y + y, ZOOM_LEVEL, "osm-liberty");
+  end = g_get_monotonic_time ();
+
+  g_assert_cmpint (hits, ==, ITERATIONS * GRID_SIZE * GRID_SIZE);
+  g_queue_free (queue);
+
+  return (end - start) * 1000.0 / hits;
+}
+
+static double
+benchmark_memory_cache (int base_x,
+                        int base_y)
+{
+  g_autoptr(ShumateMemoryCache) cache = shumate_memory_cache_new_full (GRID_SIZE * GRID_SIZE);
+  gint64 start, end;
+  int hits = 0;
+
+  for (int x = 0; x < GRID_SIZE; x ++)
+    for (int y = 0; y < GRID_SIZE; y ++)
+      shumate_memory_cache_store (cache, base_x + x, base_y + y, ZOOM_LEVEL, "osm-liberty", NULL, NULL);
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < ITERATIONS; i ++)
+    for (int x = 0; x < GRID_SIZE; x ++)
+      for (int y = 0; y < GRID_SIZE; y ++)
+        hits += shumate_memory_cache_lookup (cache, base_x + x, base_y + y, ZOOM_LEVEL, "osm-liberty", NULL, NULL);
+  end = g_get_monotonic_time ();
+
+  g_assert_cmpint (hits, ==, ITERATIONS * GRID_SIZE * GRID_SIZE);
+
+  return (end - start) * 1000.0 / hits;
+}
+
+int
+main (int argc, char *argv[])
+{
+  /* Somewhere in the middle of a city at zoom 17 */
+  int base_x = 70406, base_y = 42987;
+  double legacy, current;
+
+  legacy = benchmark_legacy (base_x, base_y);
+  current = benchmark_memory_cache (base_x, base_y);
+
+  g_print ("string keys + GQueue:    %8.1f ns per tile lookup\n", legacy);
+  g_print ("packed keys + LRU list:  %8.1f ns per tile lookup\n", current);
+  g_print ("speedup:                 %8.2fx\n", legacy / current);
+
+  return 0;
+}
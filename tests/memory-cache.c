@@ -29,6 +29,27 @@ test_memory_cache_store_retrieve ()
 }
 
 
+/* Test that entries can be stored and looked up without a tile */
+static void
+test_memory_cache_lookup ()
+{
+  g_autoptr(ShumateMemoryCache) cache = shumate_memory_cache_new_full (100);
+  g_autoptr(GdkPaintable) paintable = create_paintable ();
+  g_autoptr(GPtrArray) symbols = g_ptr_array_new ();
+  g_autoptr(GdkPaintable) out_paintable = NULL;
+  g_autoptr(GPtrArray) out_symbols = NULL;
+
+  shumate_memory_cache_store (cache, 1, 2, 3, "A", paintable, symbols);
+
+  g_assert_false (shumate_memory_cache_lookup (cache, 1, 2, 3, "B", NULL, NULL));
+  g_assert_false (shumate_memory_cache_lookup (cache, 2, 1, 3, "A", NULL, NULL));
+
+  g_assert_true (shumate_memory_cache_lookup (cache, 1, 2, 3, "A", &out_paintable, &out_symbols));
+  g_assert_true (out_paintable == paintable);
+  g_assert_true (out_symbols == symbols);
+}
+
+
 /* Test that cache misses work properly */
 static void
 test_memory_cache_miss ()
@@ -73,6 +94,71 @@ test_memory_cache_source_id ()
 }
 
 
+/* Test that tiles without a source ID are cached separately from every
+ * source */
+static void
+test_memory_cache_null_source_id ()
+{
+  g_autoptr(ShumateMemoryCache) cache = shumate_memory_cache_new_full (100);
+  g_autoptr(ShumateTile) tile = shumate_tile_new_full (0, 0, 256, 0);
+  g_autoptr(GdkPaintable) paintable = create_paintable ();
+
+  g_assert_false (shumate_memory_cache_lookup (cache, 0, 0, 0, NULL, NULL, NULL));
+
+  shumate_tile_set_paintable (tile, paintable);
+  shumate_memory_cache_store_tile (cache, tile, NULL);
+  g_assert_true (shumate_memory_cache_try_fill_tile (cache, tile, NULL));
+  g_assert_false (shumate_memory_cache_try_fill_tile (cache, tile, "(null)"));
+
+  shumate_memory_cache_store_tile (cache, tile, "A");
+  g_assert_true (shumate_memory_cache_try_fill_tile (cache, tile, "A"));
+
+  /* The NULL ID stays usable after its entries are evicted */
+  shumate_memory_cache_clean (cache);
+  g_assert_false (shumate_memory_cache_try_fill_tile (cache, tile, NULL));
+  shumate_memory_cache_store_tile (cache, tile, NULL);
+  g_assert_true (shumate_memory_cache_try_fill_tile (cache, tile, NULL));
+}
+
+
+static void
+on_memory_used_notify (ShumateMemoryCache  *cache,
+                       GParamSpec          *pspec,
+                       GThread            **thread)
+{
+  *thread = g_thread_self ();
+}
+
+static gpointer
+store_in_thread (gpointer user_data)
+{
+  ShumateMemoryCache *cache = user_data;
+  g_autoptr(GdkPaintable) paintable = create_paintable ();
+
+  shumate_memory_cache_store (cache, 0, 0, 0, "A", paintable, NULL);
+  return NULL;
+}
+
+/* Test that notify::memory-used is emitted in the cache's main context, even
+ * when the cache is used from another thread */
+static void
+test_memory_cache_notify_thread ()
+{
+  g_autoptr(ShumateMemoryCache) cache = shumate_memory_cache_new_full (100);
+  GThread *notify_thread = NULL;
+  GThread *thread;
+
+  g_signal_connect (cache, "notify::memory-used", G_CALLBACK (on_memory_used_notify), &notify_thread);
+
+  thread = g_thread_new ("store", store_in_thread, cache);
+  g_thread_join (thread);
+  g_assert_null (notify_thread);
+
+  while (g_main_context_iteration (NULL, FALSE));
+  g_assert_true (notify_thread == g_thread_self ());
+}
+
+
 /* Test that the cache is purged properly */
 static void
 test_memory_cache_purge ()
@@ -102,6 +188,34 @@ test_memory_cache_purge ()
 }
 
 
+/* Test that the cache stays under its memory limit */
+static void
+test_memory_cache_memory_limit ()
+{
+  g_autoptr(ShumateMemoryCache) cache = shumate_memory_cache_new_full (100);
+  g_autoptr(ShumateTile) tile = shumate_tile_new_full (0, 0, 256, 0);
+  g_autoptr(GdkPaintable) paintable = create_paintable ();
+  const char *ids[] = { "A", "B", "C", "D", "E" };
+
+  /* Each 256x256 texture counts as 256 KiB */
+  shumate_memory_cache_set_memory_limit (cache, 1);
+  shumate_tile_set_paintable (tile, paintable);
+
+  for (int i = 0; i < G_N_ELEMENTS (ids); i ++)
+    {
+      shumate_memory_cache_store_tile (cache, tile, ids[i]);
+      g_assert_cmpuint (shumate_memory_cache_get_memory_used (cache), <=, 1024 * 1024);
+    }
+
+  g_assert_cmpuint (shumate_memory_cache_get_memory_used (cache), >, 0);
+  g_assert_false (shumate_memory_cache_try_fill_tile (cache, tile, "A"));
+  g_assert_true (shumate_memory_cache_try_fill_tile (cache, tile, "E"));
+
+  shumate_memory_cache_clean (cache);
+  g_assert_cmpuint (shumate_memory_cache_get_memory_used (cache), ==, 0);
+}
+
+
 /* Test that cleaning the cache works */
 static void
 test_memory_cache_clean ()
@@ -126,9 +240,13 @@ main (int argc, char *argv[])
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/file-cache/store-retrieve", test_memory_cache_store_retrieve);
+  g_test_add_func ("/file-cache/lookup", test_memory_cache_lookup);
   g_test_add_func ("/file-cache/miss", test_memory_cache_miss);
   g_test_add_func ("/file-cache/source-id", test_memory_cache_source_id);
+  g_test_add_func ("/file-cache/null-source-id", test_memory_cache_null_source_id);
+  g_test_add_func ("/file-cache/notify-thread", test_memory_cache_notify_thread);
   g_test_add_func ("/file-cache/purge", test_memory_cache_purge);
+  g_test_add_func ("/file-cache/memory-limit", test_memory_cache_memory_limit);
   g_test_add_func ("/file-cache/clean", test_memory_cache_clean);
 
   return g_test_run ();
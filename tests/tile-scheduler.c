@@ -0,0 +1,254 @@
+#undef G_DISABLE_ASSERT
+
+#include <shumate/shumate.h>
+#include "shumate/shumate-tile-scheduler-private.h"
+
+/* A map source that never finishes a request by itself, so the test can see
+ * which requests have been started and complete them in any order */
+
+#define TEST_TYPE_SOURCE test_source_get_type ()
+G_DECLARE_FINAL_TYPE (TestSource, test_source, TEST, SOURCE, ShumateMapSource)
+
+struct _TestSource
+{
+  ShumateMapSource parent_instance;
+
+  GPtrArray *started;
+};
+
+G_DEFINE_TYPE (TestSource, test_source, SHUMATE_TYPE_MAP_SOURCE)
+
+static void
+test_source_fill_tile_async (ShumateMapSource    *source,
+                             ShumateTile         *tile,
+                             GCancellable        *cancellable,
+                             GAsyncReadyCallback  callback,
+                             gpointer             user_data)
+{
+  TestSource *self = (TestSource *)source;
+  GTask *task = g_task_new (self, cancellable, callback, user_data);
+
+  g_task_set_task_data (task, g_object_ref (tile), g_object_unref);
+  g_ptr_array_add (self->started, task);
+}
+
+static gboolean
+test_source_fill_tile_finish (ShumateMapSource  *source,
+                              GAsyncResult      *result,
+                              GError           **error)
+{
+  return g_task_propagate_boolean (G_TASK (result), error);
+}
+
+static void
+test_source_finalize (GObject *object)
+{
+  TestSource *self = (TestSource *)object;
+
+  g_clear_pointer (&self->started, g_ptr_array_unref);
+
+  G_OBJECT_CLASS (test_source_parent_class)->finalize (object);
+}
+
+static void
+test_source_class_init (TestSourceClass *klass)
+{
+  GObjectClass *object_class = G_OBJECT_CLASS (klass);
+  ShumateMapSourceClass *source_class = SHUMATE_MAP_SOURCE_CLASS (klass);
+
+  object_class->finalize = test_source_finalize;
+  source_class->fill_tile_async = test_source_fill_tile_async;
+  source_class->fill_tile_finish = test_source_fill_tile_finish;
+}
+
+static void
+test_source_init (TestSource *self)
+{
+  self->started = g_ptr_array_new_with_free_func (g_object_unref);
+}
+
+/* Completes the oldest started request */
+static ShumateTile *
+complete_next (TestSource *source)
+{
+  g_autoptr(GTask) task = g_ptr_array_steal_index (source->started, 0);
+  ShumateTile *tile = g_task_get_task_data (task);
+
+  g_task_return_boolean (task, TRUE);
+  return tile;
+}
+
+
+static void
+run_main_loop (void)
+{
+  while (g_main_context_iteration (NULL, FALSE));
+}
+
+static void
+on_tile_filled (GObject      *object,
+                GAsyncResult *res,
+                gpointer      user_data)
+{
+  g_autoptr(GError) error = NULL;
+  int *n_filled = user_data;
+
+  if (shumate_tile_scheduler_fill_tile_finish ((ShumateTileScheduler *)object, res, &error))
+    (*n_filled) ++;
+  else
+    g_assert_error (error, G_IO_ERROR, G_IO_ERROR_CANCELLED);
+}
+
+static ShumateTile *
+request_tile (ShumateTileScheduler *scheduler,
+              TestSource           *source,
+              int                   x,
+              int                   y,
+              int                   zoom,
+              GCancellable         *cancellable,
+              int                  *n_filled)
+{
+  ShumateGridPosition pos = SHUMATE_GRID_POSITION_INIT (x, y, zoom);
+  ShumateTile *tile = shumate_tile_new_full (x, y, 256, zoom);
+
+  shumate_tile_scheduler_fill_tile_async (scheduler, SHUMATE_MAP_SOURCE (source), tile, &pos,
+                                          cancellable, on_tile_filled, n_filled);
+  return tile;
+}
+
+
+/* Test that tiles closest to the center are requested first, and that no
+ * more than the maximum number of requests run at once */
+static void
+test_tile_scheduler_order ()
+{
+  g_autoptr(ShumateTileScheduler) scheduler = shumate_tile_scheduler_new (2);
+  g_autoptr(TestSource) source = g_object_new (TEST_TYPE_SOURCE, NULL);
+  g_autoptr(GPtrArray) tiles = g_ptr_array_new_with_free_func (g_object_unref);
+  ShumateTile *tile;
+  int n_filled = 0;
+
+  /* Center of tile (2, 2) */
+  shumate_tile_scheduler_set_center (scheduler, 2.5, 2.5, 3);
+
+  for (int x = 0; x < 5; x ++)
+    for (int y = 0; y < 5; y ++)
+      g_ptr_array_add (tiles, request_tile (scheduler, source, x, y, 3, NULL, &n_filled));
+
+  /* A tile on another zoom level comes after all tiles on the center's zoom
+   * level, even though it covers the center */
+  g_ptr_array_add (tiles, request_tile (scheduler, source, 1, 1, 2, NULL, &n_filled));
+
+  /* Nothing starts until the main loop runs */
+  g_assert_cmpint (source->started->len, ==, 0);
+  run_main_loop ();
+  g_assert_cmpint (source->started->len, ==, 2);
+  g_assert_cmpint (shumate_tile_scheduler_get_n_in_flight (scheduler), ==, 2);
+  g_assert_cmpint (shumate_tile_scheduler_get_n_pending (scheduler), ==, 24);
+
+  tile = complete_next (source);
+  g_assert_cmpint (shumate_tile_get_x (tile), ==, 2);
+  g_assert_cmpint (shumate_tile_get_y (tile), ==, 2);
+  run_main_loop ();
+  g_assert_cmpint (n_filled, ==, 1);
+
+  /* Move the center to the top left corner. The remaining tiles are
+   * reordered. */
+  shumate_tile_scheduler_set_center (scheduler, 0.5, 0.5, 3);
+
+  /* Finish whatever was started before the center moved */
+  while (source->started->len > 0)
+    complete_next (source);
+  run_main_loop ();
+  g_assert_cmpint (n_filled, ==, 3);
+
+  tile = complete_next (source);
+  g_assert_cmpint (shumate_tile_get_x (tile), ==, 0);
+  g_assert_cmpint (shumate_tile_get_y (tile), ==, 0);
+  g_assert_cmpint (shumate_tile_get_zoom_level (tile), ==, 3);
+
+  while (source->started->len > 0)
+    {
+      tile = complete_next (source);
+      run_main_loop ();
+    }
+
+  g_assert_cmpint (shumate_tile_get_zoom_level (tile), ==, 2);
+  g_assert_cmpint (n_filled, ==, 26);
+}
+
+
+/* Test that requests cancelled before they start never reach the source */
+static void
+test_tile_scheduler_cancel ()
+{
+  g_autoptr(ShumateTileScheduler) scheduler = shumate_tile_scheduler_new (1);
+  g_autoptr(TestSource) source = g_object_new (TEST_TYPE_SOURCE, NULL);
+  g_autoptr(GCancellable) cancellable = g_cancellable_new ();
+  g_autoptr(ShumateTile) tile1 = NULL;
+  g_autoptr(ShumateTile) tile2 = NULL;
+  int n_filled = 0;
+
+  tile1 = request_tile (scheduler, source, 0, 0, 0, NULL, &n_filled);
+  tile2 = request_tile (scheduler, source, 0, 0, 1, cancellable, &n_filled);
+  run_main_loop ();
+
+  g_assert_cmpint (source->started->len, ==, 1);
+  g_cancellable_cancel (cancellable);
+
+  complete_next (source);
+  run_main_loop ();
+
+  g_assert_cmpint (source->started->len, ==, 0);
+  g_assert_cmpint (shumate_tile_scheduler_get_n_pending (scheduler), ==, 0);
+  g_assert_cmpint (n_filled, ==, 1);
+}
+
+
+/* Test that the limit on requests in flight is shared by all the schedulers
+ * requesting tiles from the same source */
+static void
+test_tile_scheduler_shared_source ()
+{
+  g_autoptr(ShumateTileScheduler) scheduler1 = shumate_tile_scheduler_new (2);
+  g_autoptr(ShumateTileScheduler) scheduler2 = shumate_tile_scheduler_new (2);
+  g_autoptr(TestSource) source = g_object_new (TEST_TYPE_SOURCE, NULL);
+  g_autoptr(GPtrArray) tiles = g_ptr_array_new_with_free_func (g_object_unref);
+  int n_filled = 0;
+
+  for (int x = 0; x < 2; x ++)
+    g_ptr_array_add (tiles, request_tile (scheduler1, source, x, 0, 1, NULL, &n_filled));
+  for (int x = 0; x < 2; x ++)
+    g_ptr_array_add (tiles, request_tile (scheduler2, source, x, 1, 1, NULL, &n_filled));
+
+  run_main_loop ();
+  g_assert_cmpint (source->started->len, ==, 2);
+  g_assert_cmpint (shumate_tile_scheduler_get_n_in_flight (scheduler1)
+                   + shumate_tile_scheduler_get_n_in_flight (scheduler2), ==, 2);
+
+  /* A finished request lets a waiting scheduler start one, whichever
+   * scheduler it belonged to */
+  while (source->started->len > 0)
+    {
+      complete_next (source);
+      run_main_loop ();
+      g_assert_cmpint (source->started->len, <=, 2);
+    }
+
+  g_assert_cmpint (n_filled, ==, 4);
+  g_assert_cmpint (shumate_tile_scheduler_get_n_pending (scheduler1), ==, 0);
+  g_assert_cmpint (shumate_tile_scheduler_get_n_pending (scheduler2), ==, 0);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/tile-scheduler/order", test_tile_scheduler_order);
+  g_test_add_func ("/tile-scheduler/cancel", test_tile_scheduler_cancel);
+  g_test_add_func ("/tile-scheduler/shared-source", test_tile_scheduler_shared_source);
+
+  return g_test_run ();
+}
@@ -0,0 +1,120 @@
+#undef G_DISABLE_ASSERT
+
+#include <gtk/gtk.h>
+#include "shumate/vector/shumate-vector-collision-private.h"
+
+static int tag_a, tag_b;
+
+
+static void
+add_box (ShumateVectorCollision *collision,
+         double                  x,
+         double                  y,
+         double                  xextent,
+         double                  yextent,
+         double                  rotation,
+         gpointer                tag)
+{
+  graphene_rect_t bounds;
+
+  g_assert_true (shumate_vector_collision_check (collision, x, y, xextent, yextent, rotation,
+                                                 SHUMATE_VECTOR_OVERLAP_NEVER, FALSE, tag));
+  shumate_vector_collision_commit_pending (collision, &bounds);
+}
+
+
+/* Test that find_point() returns the tag of the box under a point */
+static void
+test_vector_collision_find_point (void)
+{
+  ShumateVectorCollision *collision = shumate_vector_collision_new ();
+
+  add_box (collision, 100, 100, 20, 10, 0, &tag_a);
+  add_box (collision, 300, 100, 20, 10, 0, &tag_b);
+
+  g_assert_true (shumate_vector_collision_find_point (collision, 100, 100) == &tag_a);
+  g_assert_true (shumate_vector_collision_find_point (collision, 115, 105) == &tag_a);
+  g_assert_true (shumate_vector_collision_find_point (collision, 290, 95) == &tag_b);
+
+  g_assert_null (shumate_vector_collision_find_point (collision, 200, 100));
+  g_assert_null (shumate_vector_collision_find_point (collision, 100, 115));
+  g_assert_null (shumate_vector_collision_find_point (collision, -100, -100));
+
+  shumate_vector_collision_free (collision);
+}
+
+
+/* Test that find_point() takes the rotation of boxes into account */
+static void
+test_vector_collision_find_point_rotated (void)
+{
+  ShumateVectorCollision *collision = shumate_vector_collision_new ();
+
+  add_box (collision, 100, 100, 20, 2, G_PI / 2, &tag_a);
+
+  /* The box is now tall and narrow */
+  g_assert_true (shumate_vector_collision_find_point (collision, 100, 115) == &tag_a);
+  g_assert_null (shumate_vector_collision_find_point (collision, 115, 100));
+
+  shumate_vector_collision_free (collision);
+}
+
+
+/* Test that boxes are only found once they are committed, and not after the
+ * index is cleared */
+static void
+test_vector_collision_find_point_pending (void)
+{
+  ShumateVectorCollision *collision = shumate_vector_collision_new ();
+  graphene_rect_t bounds;
+
+  g_assert_true (shumate_vector_collision_check (collision, 100, 100, 20, 10, 0,
+                                                 SHUMATE_VECTOR_OVERLAP_NEVER, FALSE, &tag_a));
+  g_assert_null (shumate_vector_collision_find_point (collision, 100, 100));
+
+  shumate_vector_collision_commit_pending (collision, &bounds);
+  g_assert_true (shumate_vector_collision_find_point (collision, 100, 100) == &tag_a);
+
+  shumate_vector_collision_clear (collision);
+  g_assert_null (shumate_vector_collision_find_point (collision, 100, 100));
+
+  shumate_vector_collision_free (collision);
+}
+
+
+/* Test that removing tags only removes the boxes with those tags */
+static void
+test_vector_collision_remove_tags (void)
+{
+  ShumateVectorCollision *collision = shumate_vector_collision_new ();
+  g_autoptr(GHashTable) tags = g_hash_table_new (NULL, NULL);
+
+  add_box (collision, 100, 100, 20, 10, 0, &tag_a);
+  add_box (collision, 300, 100, 20, 10, 0, &tag_b);
+
+  g_hash_table_add (tags, &tag_a);
+  shumate_vector_collision_remove_tags (collision, tags);
+
+  g_assert_null (shumate_vector_collision_find_point (collision, 100, 100));
+  g_assert_true (shumate_vector_collision_find_point (collision, 300, 100) == &tag_b);
+
+  /* The space is free again */
+  g_assert_true (shumate_vector_collision_check (collision, 100, 100, 20, 10, 0,
+                                                 SHUMATE_VECTOR_OVERLAP_NEVER, FALSE, &tag_a));
+
+  shumate_vector_collision_free (collision);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+
+  g_test_add_func ("/vector-collision/find-point", test_vector_collision_find_point);
+  g_test_add_func ("/vector-collision/find-point-rotated", test_vector_collision_find_point_rotated);
+  g_test_add_func ("/vector-collision/find-point-pending", test_vector_collision_find_point_pending);
+  g_test_add_func ("/vector-collision/remove-tags", test_vector_collision_remove_tags);
+
+  return g_test_run ();
+}
@@ -1,9 +1,11 @@
 #undef G_DISABLE_ASSERT
 
+#include <math.h>
 #include <gtk/gtk.h>
 #include <shumate/shumate.h>
 #include "shumate/vector/shumate-vector-expression-interpolate-private.h"
 #include "shumate/vector/shumate-vector-expression-filter-private.h"
+#include "shumate/vector/shumate-vector-expression-program-private.h"
 
 static void
 test_vector_expression_parse (void)
@@ -82,7 +84,7 @@ test_vector_expression_nested_array_literal (void)
 static void
 check_interpolate (ShumateVectorExpression *expression)
 {
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
 
   /* Test that exact stop values work */
   scope.zoom_level = 12;
@@ -141,7 +143,7 @@ test_vector_expression_interpolate_filter (void)
 static void
 check_interpolate_color (ShumateVectorExpression *expression)
 {
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
   GdkRGBA color, correct_color;
 
   /* Test that exact stop values work */
@@ -404,7 +406,7 @@ test_vector_expression_variable_binding (void)
 static void
 test_vector_expression_global_state (void)
 {
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
   ShumateVectorValue* value;
   g_autoptr(GHashTable) global_state = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, (GDestroyNotify)shumate_vector_value_free);
 
@@ -424,7 +426,7 @@ test_vector_expression_image (void)
   g_autoptr(GdkTexture) texture = NULL;
   g_autoptr(GBytes) json_data = NULL;
   GError *error = NULL;
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
 
   texture = gdk_texture_new_from_resource ("/org/gnome/shumate/Tests/sprites.png");
   g_assert_no_error (error);
@@ -449,7 +451,7 @@ test_vector_expression_feature_filter (void)
   GError *error = NULL;
   g_autoptr(GBytes) vector_data = NULL;
   g_autoptr(ShumateVectorReader) reader = NULL;
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
 
   vector_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
   g_assert_no_error (error);
@@ -492,6 +494,292 @@ test_vector_expression_feature_filter (void)
 }
 
 
+static ShumateVectorExpression *
+parse_expression (const char *json)
+{
+  g_autoptr(GError) error = NULL;
+  g_autoptr(JsonNode) node = json_from_string (json, &error);
+  ShumateVectorExpression *expression;
+
+  g_assert_no_error (error);
+  expression = shumate_vector_expression_from_json (node, &error);
+  g_assert_no_error (error);
+  return expression;
+}
+
+/* Property keys are compared by atom, including keys that are interned after
+ * the tile's layer was decoded */
+static void
+test_vector_expression_key_atoms (void)
+{
+  g_autoptr(ShumateVectorExpression) get_name = parse_expression ("[\"==\", [\"get\", \"name\"], \"Hello, world!\"]");
+  g_autoptr(ShumateVectorExpression) has_name = parse_expression ("[\"has\", \"name\"]");
+  g_autoptr(ShumateVectorExpression) in_name = parse_expression ("[\"in\", \"name\", [\"literal\", [\"Hello, world!\", true, 3]]]");
+  g_autoptr(ShumateVectorExpression) has_new_key = NULL;
+  g_autoptr(GBytes) vector_data = NULL;
+  g_autoptr(ShumateVectorReader) reader = NULL;
+  ShumateVectorRenderScope scope = { 0 };
+
+  vector_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  reader = shumate_vector_reader_new (vector_data);
+  scope.reader = shumate_vector_reader_iterate (reader);
+  scope.zoom_level = 10;
+
+  g_assert_true (shumate_vector_reader_iter_read_layer_by_name (scope.reader, "helloworld"));
+  g_assert_true (shumate_vector_reader_iter_next_feature (scope.reader));
+
+  g_assert_true (shumate_vector_expression_eval_boolean (get_name, &scope, FALSE));
+  g_assert_true (shumate_vector_expression_eval_boolean (has_name, &scope, FALSE));
+  g_assert_true (shumate_vector_expression_eval_boolean (in_name, &scope, FALSE));
+
+  /* Interning a key the layer doesn't have doesn't change the results */
+  has_new_key = parse_expression ("[\"has\", \"vector-expression-test-new-key\"]");
+  g_assert_false (shumate_vector_expression_eval_boolean (has_new_key, &scope, FALSE));
+  g_assert_true (shumate_vector_expression_eval_boolean (get_name, &scope, FALSE));
+  g_assert_true (shumate_vector_expression_eval_boolean (has_name, &scope, FALSE));
+
+  g_clear_object (&scope.reader);
+}
+
+/* A layer decoded before one of its keys was interned picks up the key's atom
+ * when it is next used, rather than comparing strings from then on */
+static void
+test_vector_expression_key_atoms_update (void)
+{
+  g_autoptr(GBytes) vector_data = NULL;
+  g_autoptr(ShumateVectorReader) reader = NULL;
+  g_autoptr(ShumateVectorReaderIter) iter = NULL;
+  ShumateVectorMvtLayer *layer;
+  GQuark atom;
+  int key = -1;
+
+  vector_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  reader = shumate_vector_reader_new (vector_data);
+  iter = shumate_vector_reader_iterate (reader);
+
+  for (int i = 0; key < 0 && i < shumate_vector_reader_iter_get_layer_count (iter); i ++)
+    {
+      shumate_vector_reader_iter_read_layer (iter, i);
+      layer = shumate_vector_reader_iter_get_layer_struct (iter);
+      shumate_vector_mvt_layer_update_key_atoms (layer);
+
+      for (int j = 0; key < 0 && j < layer->n_keys; j ++)
+        if (layer->key_atoms[j] == 0)
+          key = j;
+    }
+
+  if (key < 0)
+    {
+      g_test_skip ("Every key in the test tile is already interned");
+      return;
+    }
+
+  atom = shumate_vector_mvt_intern_key (layer->keys[key]);
+  shumate_vector_mvt_layer_update_key_atoms (layer);
+  g_assert_cmpuint (layer->key_atoms[key], ==, atom);
+}
+
+
+/* Expressions that compile to bytecode. Each one is checked against the tree
+ * evaluator at several zoom levels. */
+static const char *compiled_expressions[] = {
+  "[\"+\", 1, 2, [\"zoom\"]]",
+  "[\"-\", [\"zoom\"]]",
+  "[\"-\", 10, [\"zoom\"]]",
+  "[\"*\", 2, [\"zoom\"], 0.5]",
+  "[\"/\", [\"zoom\"], 4]",
+  "[\"/\", [\"zoom\"], 0]",
+  "[\"/\", [\"-\", [\"zoom\"], 10], 0]",
+  "[\"%\", [\"zoom\"], 3]",
+  "[\"^\", 2, [\"zoom\"]]",
+  "[\"min\", [\"zoom\"], 12, 14]",
+  "[\"max\", [\"zoom\"], 12]",
+  "[\"abs\", [\"-\", 10, [\"zoom\"]]]",
+  "[\"sqrt\", [\"-\", [\"zoom\"], 10]]",
+  "[\"ln\", [\"zoom\"]]",
+  "[\"floor\", [\"zoom\"]]",
+  "[\"round\", [\"*\", [\"zoom\"], 1.5]]",
+  "[\"+\", 1, \"not a number\"]",
+  "[\"<\", [\"zoom\"], 10]",
+  "[\">=\", [\"zoom\"], 10]",
+  "[\"<\", [\"concat\", \"abc\", [\"zoom\"]], \"abd\"]",
+  "[\"<\", 1, \"abc\"]",
+  "[\"<=\", [\"get\", \"name\"], \"Hello\"]",
+  "[\"==\", [\"zoom\"], 10]",
+  "[\"!=\", [\"zoom\"], 10]",
+  "[\"==\", true, [\">\", [\"zoom\"], 8]]",
+  "[\"==\", [\"zoom\"], \"10\"]",
+  "[\"!\", [\"<\", [\"zoom\"], 10]]",
+  "[\"any\", [\"<\", [\"zoom\"], 5], [\">\", [\"zoom\"], 14]]",
+  "[\"all\", [\"<\", [\"zoom\"], 14], [\">\", [\"zoom\"], 5]]",
+  "[\"none\", [\"<\", [\"zoom\"], 5], [\">\", [\"zoom\"], 14]]",
+  "[\"any\"]",
+  "[\"all\", [\"<\", [\"zoom\"], 14], \"not a boolean\"]",
+  "[\"case\", [\"<\", [\"zoom\"], 5], 1, [\"<\", [\"zoom\"], 12], 2, 3]",
+  "[\"case\", [\"<\", [\"zoom\"], 5], 1, [\"<\", [\"zoom\"], 12], \"two\", true]",
+  "[\"case\", [\"<\", [\"zoom\"], 5], 1]",
+  "[\"match\", [\"floor\", [\"zoom\"]], [4, 10], \"a\", 12, \"b\", \"c\"]",
+  "[\"match\", [\"floor\", [\"zoom\"]], 10, 1, 15, 2]",
+  "[\"match\", [\"get\", \"name\"], \"Hello, world!\", \"#ff0000\", \"#00ff00\"]",
+  "[\"interpolate\", [\"linear\"], [\"zoom\"], 5, 1, 10, 2, 15, 8]",
+  "[\"interpolate\", [\"exponential\", 1.5], [\"zoom\"], 5, 1, 10, 2, 15, 8]",
+  "[\"interpolate\", [\"linear\"], [\"*\", 2, [\"zoom\"]], 5, 1, 10, 2]",
+  "[\"interpolate\", [\"linear\"], [\"zoom\"], 5, \"#ff0000\", 15, \"rgba(0, 0, 255, 0.5)\"]",
+  "[\"step\", [\"zoom\"], 0, 8, 1, 13, 2]",
+  "[\"step\", [\"zoom\"], \"#000000\", 8, \"#ffffff\"]",
+  "[\"interpolate\", [\"linear\"], \"not a number\", 5, 1, 10, 2]",
+  "{\"stops\": [[5, 1], [10, 2], [15, 8]], \"base\": 1.2}",
+  "[\"+\", 1, [\"length\", [\"get\", \"name\"]]]",
+  "[\"+\", 1, [\"coalesce\", [\"get\", \"does-not-exist\"], [\"zoom\"]]]",
+  NULL
+};
+
+static void
+assert_same_result (const char               *json,
+                    ShumateVectorExpression  *expression,
+                    ShumateVectorRenderScope *scope)
+{
+  ShumateVectorExpressionProgram *program = shumate_vector_expression_get_program (expression);
+  g_auto(ShumateVectorValue) tree_value = SHUMATE_VECTOR_VALUE_INIT;
+  g_auto(ShumateVectorValue) program_value = SHUMATE_VECTOR_VALUE_INIT;
+  gboolean tree_ok, program_ok;
+  double tree_number, number;
+
+  tree_ok = shumate_vector_expression_eval (expression, scope, &tree_value);
+  program_ok = shumate_vector_expression_program_eval (program, scope, &program_value);
+
+  if (tree_ok != program_ok)
+    g_error ("%s at zoom %g: tree returned %d, program returned %d", json, scope->zoom_level, tree_ok, program_ok);
+
+  if (!tree_ok)
+    return;
+
+  if (tree_value.type == SHUMATE_VECTOR_VALUE_TYPE_COLOR || program_value.type == SHUMATE_VECTOR_VALUE_TYPE_COLOR)
+    {
+      /* The program always interpolates colors, while the tree evaluator
+       * returns the stop unchanged outside the stops */
+      GdkRGBA tree_color, program_color;
+
+      g_assert_true (shumate_vector_value_get_color (&tree_value, &tree_color));
+      g_assert_true (shumate_vector_value_get_color (&program_value, &program_color));
+      g_assert_true (gdk_rgba_equal (&tree_color, &program_color));
+    }
+  else if (!(tree_value.type == SHUMATE_VECTOR_VALUE_TYPE_NUMBER && isnan (tree_value.number)
+             && program_value.type == SHUMATE_VECTOR_VALUE_TYPE_NUMBER && isnan (program_value.number)))
+    {
+      if (!shumate_vector_value_equal (&tree_value, &program_value))
+        {
+          g_autofree char *tree_string = shumate_vector_value_as_string (&tree_value);
+          g_autofree char *program_string = shumate_vector_value_as_string (&program_value);
+          g_error ("%s at zoom %g: tree returned %s, program returned %s", json, scope->zoom_level, tree_string, program_string);
+        }
+    }
+
+  /* The typed helpers go through the program */
+  if (!shumate_vector_value_get_number (&tree_value, &tree_number))
+    tree_number = -1;
+  number = shumate_vector_expression_eval_number (expression, scope, -1);
+  g_assert_true (number == tree_number || (isnan (number) && isnan (tree_number)));
+}
+
+static void
+test_vector_expression_program (void)
+{
+  static const double zoom_levels[] = { 0, 4.5, 8, 10, 12, 13.25, 15, 22 };
+  g_autoptr(GBytes) vector_data = NULL;
+  g_autoptr(ShumateVectorReader) reader = NULL;
+  ShumateVectorRenderScope scope = { 0 };
+
+  vector_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  reader = shumate_vector_reader_new (vector_data);
+  scope.reader = shumate_vector_reader_iterate (reader);
+
+  g_assert_true (shumate_vector_reader_iter_read_layer_by_name (scope.reader, "helloworld"));
+  g_assert_true (shumate_vector_reader_iter_next_feature (scope.reader));
+
+  for (int i = 0; compiled_expressions[i] != NULL; i ++)
+    {
+      g_autoptr(ShumateVectorExpression) expression = parse_expression (compiled_expressions[i]);
+
+      if (shumate_vector_expression_get_program (expression) == NULL)
+        g_error ("%s was not compiled", compiled_expressions[i]);
+
+      for (int j = 0; j < G_N_ELEMENTS (zoom_levels); j ++)
+        {
+          scope.zoom_level = zoom_levels[j];
+          assert_same_result (compiled_expressions[i], expression, &scope);
+        }
+    }
+
+  /* Expressions that don't benefit from compiling are left to the tree
+   * evaluator */
+  {
+    g_autoptr(ShumateVectorExpression) get_name = parse_expression ("[\"get\", \"name\"]");
+    g_autoptr(ShumateVectorExpression) coalesce = parse_expression ("[\"coalesce\", [\"get\", \"name\"], \"\"]");
+    g_autoptr(ShumateVectorExpression) has_name = parse_expression ("[\"has\", \"name\"]");
+    g_autoptr(ShumateVectorExpression) name_eq = parse_expression ("[\"==\", [\"get\", \"name\"], \"Hello, world!\"]");
+
+    g_assert_null (shumate_vector_expression_get_program (get_name));
+    g_assert_null (shumate_vector_expression_get_program (coalesce));
+    g_assert_null (shumate_vector_expression_get_program (has_name));
+    g_assert_null (shumate_vector_expression_get_program (name_eq));
+  }
+
+  g_clear_object (&scope.reader);
+}
+
+
+static ShumateVectorDependency
+get_dependency (const char *json)
+{
+  g_autoptr(ShumateVectorExpression) expression = parse_expression (json);
+  return shumate_vector_expression_get_dependency (expression);
+}
+
+static void
+test_vector_expression_dependency (void)
+{
+  g_autoptr(ShumateVectorExpression) folded = NULL;
+  g_autoptr(ShumateVectorExpression) failing = NULL;
+  g_autoptr(ShumateVectorExpression) width = NULL;
+  ShumateVectorRenderScope scope = { 0 };
+
+  g_assert_cmpint (get_dependency ("1"), ==, SHUMATE_VECTOR_DEPENDENCY_CONSTANT);
+  g_assert_cmpint (get_dependency ("[\"*\", 2, [\"+\", 1, 2]]"), ==, SHUMATE_VECTOR_DEPENDENCY_CONSTANT);
+  g_assert_cmpint (get_dependency ("[\"zoom\"]"), ==, SHUMATE_VECTOR_DEPENDENCY_ZOOM);
+  g_assert_cmpint (get_dependency ("{\"stops\": [[12, 1], [13, 2]]}"), ==, SHUMATE_VECTOR_DEPENDENCY_ZOOM);
+  g_assert_cmpint (get_dependency ("[\"interpolate\", [\"linear\"], [\"zoom\"], 5, 1, 10, [\"*\", 2, 3]]"), ==, SHUMATE_VECTOR_DEPENDENCY_ZOOM);
+  g_assert_cmpint (get_dependency ("[\"match\", [\"floor\", [\"zoom\"]], 10, 1, 2]"), ==, SHUMATE_VECTOR_DEPENDENCY_ZOOM);
+  g_assert_cmpint (get_dependency ("[\"match\", 10, 10, [\"get\", \"name\"], 2]"), ==, SHUMATE_VECTOR_DEPENDENCY_FEATURE);
+  g_assert_cmpint (get_dependency ("[\"interpolate\", [\"linear\"], [\"get\", \"rank\"], 5, 1, 10, 2]"), ==, SHUMATE_VECTOR_DEPENDENCY_FEATURE);
+  g_assert_cmpint (get_dependency ("[\"+\", [\"zoom\"], [\"get\", \"rank\"]]"), ==, SHUMATE_VECTOR_DEPENDENCY_FEATURE);
+  g_assert_cmpint (get_dependency ("[\"global-state\", \"x\"]"), ==, SHUMATE_VECTOR_DEPENDENCY_FEATURE);
+
+  /* Constant operators are folded into literals, unless they fail */
+  folded = parse_expression ("[\"case\", [\"<\", 1, 2], [\"*\", 2, 3], 0]");
+  g_assert_nonnull (shumate_vector_expression_filter_get_literal (folded));
+  g_assert_cmpfloat (shumate_vector_expression_eval_number (folded, &scope, -1), ==, 6);
+
+  failing = parse_expression ("[\"+\", 1, \"a\"]");
+  g_assert_null (shumate_vector_expression_filter_get_literal (failing));
+  g_assert_cmpfloat (shumate_vector_expression_eval_number (failing, &scope, -1), ==, -1);
+
+  /* Zoom-dependent values are evaluated once per scope */
+  width = parse_expression ("[\"interpolate\", [\"linear\"], [\"zoom\"], 10, 1, 20, 11]");
+  scope.zoom_values = g_hash_table_new_full (NULL, NULL, NULL, (GDestroyNotify)shumate_vector_value_free);
+
+  scope.zoom_level = 12;
+  g_assert_cmpfloat (shumate_vector_expression_eval_number (width, &scope, -1), ==, 3);
+  g_assert_true (g_hash_table_contains (scope.zoom_values, width));
+
+  scope.zoom_level = 14;
+  g_assert_cmpfloat (shumate_vector_expression_eval_number (width, &scope, -1), ==, 3);
+
+  g_clear_pointer (&scope.zoom_values, g_hash_table_unref);
+  g_assert_cmpfloat (shumate_vector_expression_eval_number (width, &scope, -1), ==, 5);
+}
+
+
 static void
 filter_expect_error (const char *filter)
 {
@@ -526,7 +814,7 @@ test_vector_expression_format ()
   GError *error = NULL;
   g_autoptr(GBytes) vector_data = NULL;
   g_autoptr(ShumateVectorReader) reader = NULL;
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
   g_autoptr(JsonNode) node = json_from_string ("\"***** {name} *****\"", NULL);
   g_autoptr(ShumateVectorExpression) expression;
   g_autofree char *result = NULL;
@@ -669,6 +957,10 @@ main (int argc, char *argv[])
   g_test_add_func ("/vector/expression/global-state", test_vector_expression_global_state);
   g_test_add_func ("/vector/expression/image", test_vector_expression_image);
   g_test_add_func ("/vector/expression/feature-filter", test_vector_expression_feature_filter);
+  g_test_add_func ("/vector/expression/key-atoms", test_vector_expression_key_atoms);
+  g_test_add_func ("/vector/expression/key-atoms-update", test_vector_expression_key_atoms_update);
+  g_test_add_func ("/vector/expression/program", test_vector_expression_program);
+  g_test_add_func ("/vector/expression/dependency", test_vector_expression_dependency);
   g_test_add_func ("/vector/expression/filter-errors", test_vector_expression_filter_errors);
   g_test_add_func ("/vector/expression/format", test_vector_expression_format);
   g_test_add_func ("/vector/expression/array", test_vector_expression_array);
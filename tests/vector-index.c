@@ -80,7 +80,7 @@ static ShumateVectorIndexBitset *
 compute_bitset (ShumateVectorReader *reader, char *json, const char *layer, ShumateVectorIndexDescription **index_description_out)
 {
   GError *error = NULL;
-  ShumateVectorRenderScope scope;
+  ShumateVectorRenderScope scope = { 0 };
   g_autoptr(JsonNode) node1 = NULL;
   g_autoptr(ShumateVectorExpression) expr1 = NULL;
   g_autoptr(ShumateVectorIndexBitset) bitset1 = NULL;
@@ -0,0 +1,172 @@
+#undef G_DISABLE_ASSERT
+
+#include <shumate/shumate.h>
+#include "shumate/vector/shumate-vector-render-scope-private.h"
+#include "shumate/vector/vector_tile.pb-c.h"
+
+/* Compares looking up feature properties by string against looking them up
+ * by interned atom, which is what EXPR_FAST_GET and friends do. The tile is
+ * a synthetic stand-in for a dense urban tile: thousands of features, each
+ * with many tags, including a long tail of localized names that come before
+ * the keys styles usually ask for. */
+
+#define N_FEATURES 8000
+#define ITERATIONS 20
+
+static const char *tile_keys[] = {
+  "name:ar", "name:de", "name:en", "name:es", "name:fr", "name:it", "name:ja",
+  "name:ko", "name:latin", "name:nonlatin", "name:ru", "name:zh", "name_de",
+  "name_en", "name_int", "class", "subclass", "brunnel", "oneway", "ramp",
+  "layer", "level", "indoor", "service", "access", "toll", "expressway",
+  "surface", "bicycle", "foot", "horse", "mtb_scale", "network", "ref",
+  "ref_length", "route", "name", NULL
+};
+
+/* Keys a typical street style looks up for each feature, some of which are
+ * not in the tile */
+static const char *style_keys[] = {
+  "class", "subclass", "brunnel", "ramp", "oneway", "layer", "network",
+  "ref", "name", "name:en", "name:latin", "colour", "capital", "rank", NULL
+};
+
+
+static GBytes *
+create_dense_tile (void)
+{
+  VectorTile__Tile tile = VECTOR_TILE__TILE__INIT;
+  VectorTile__Tile__Layer layer = VECTOR_TILE__TILE__LAYER__INIT;
+  VectorTile__Tile__Layer *layers[] = { &layer };
+  guint n_keys = g_strv_length ((char **)tile_keys);
+  g_autoptr(GPtrArray) strings = g_ptr_array_new_with_free_func (g_free);
+  uint8_t *out;
+  size_t out_len;
+
+  tile.n_layers = 1;
+  tile.layers = layers;
+
+  layer.name = (char *)"transportation";
+  layer.version = 2;
+  layer.n_keys = n_keys;
+  layer.keys = (char **)tile_keys;
+
+  /* A pool of distinct string values */
+  layer.n_values = 500;
+  layer.values = g_new0 (VectorTile__Tile__Value *, layer.n_values);
+  for (int i = 0; i < layer.n_values; i ++)
+    {
+      char *string = g_strdup_printf ("value %d", i);
+
+      g_ptr_array_add (strings, string);
+      layer.values[i] = g_new0 (VectorTile__Tile__Value, 1);
+      vector_tile__tile__value__init (layer.values[i]);
+      layer.values[i]->string_value = string;
+    }
+
+  layer.n_features = N_FEATURES;
+  layer.features = g_new0 (VectorTile__Tile__Feature *, N_FEATURES);
+  for (int i = 0; i < N_FEATURES; i ++)
+    {
+      VectorTile__Tile__Feature *feature = g_new0 (VectorTile__Tile__Feature, 1);
+
+      vector_tile__tile__feature__init (feature);
+      feature->type = VECTOR_TILE__TILE__GEOM_TYPE__LINESTRING;
+      feature->has_type = TRUE;
+
+      /* Every feature has most keys, with a few left out */
+      feature->tags = g_new0 (uint32_t, n_keys * 2);
+      for (int k = 0; k < n_keys; k ++)
+        {
+          if ((i + k) % 4 == 0)
+            continue;
+
+          feature->tags[feature->n_tags++] = k;
+          feature->tags[feature->n_tags++] = (i * 31 + k) % layer.n_values;
+        }
+
+      layer.features[i] = feature;
+    }
+
+  out_len = vector_tile__tile__get_packed_size (&tile);
+  out = g_new0 (uint8_t, out_len);
+  vector_tile__tile__pack (&tile, out);
+
+  for (int i = 0; i < layer.n_values; i ++)
+    g_free (layer.values[i]);
+  g_free (layer.values);
+  for (int i = 0; i < N_FEATURES; i ++)
+    {
+      g_free (layer.features[i]->tags);
+      g_free (layer.features[i]);
+    }
+  g_free (layer.features);
+
+  return g_bytes_new_take (out, out_len);
+}
+
+static double
+benchmark_lookups (ShumateVectorRenderScope *scope,
+                   GQuark                   *atoms,
+                   int                      *found)
+{
+  gint64 start, end;
+  int n_lookups = 0;
+
+  *found = 0;
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < ITERATIONS; i ++)
+    {
+      g_assert_true (shumate_vector_reader_iter_read_layer_by_name (scope->reader, "transportation"));
+
+      while (shumate_vector_reader_iter_next_feature (scope->reader))
+        {
+          for (int k = 0; style_keys[k] != NULL; k ++)
+            {
+              g_auto(ShumateVectorValue) value = SHUMATE_VECTOR_VALUE_INIT;
+
+              if (atoms != NULL)
+                shumate_vector_render_scope_get_variable_atom (scope, atoms[k], style_keys[k], &value);
+              else
+                shumate_vector_render_scope_get_variable (scope, style_keys[k], &value);
+
+              *found += !shumate_vector_value_is_null (&value);
+              n_lookups ++;
+            }
+        }
+    }
+  end = g_get_monotonic_time ();
+
+  return (end - start) * 1000.0 / n_lookups;
+}
+
+int
+main (int argc, char *argv[])
+{
+  GQuark atoms[G_N_ELEMENTS (style_keys)];
+  g_autoptr(GBytes) tile_data = NULL;
+  g_autoptr(ShumateVectorReader) reader = NULL;
+  ShumateVectorRenderScope scope = { 0 };
+  double strings, interned;
+  int found_strings, found_interned;
+
+  /* The style is loaded before any tiles are decoded */
+  for (int k = 0; style_keys[k] != NULL; k ++)
+    atoms[k] = shumate_vector_mvt_intern_key (style_keys[k]);
+
+  tile_data = create_dense_tile ();
+  reader = shumate_vector_reader_new (tile_data);
+  scope.reader = shumate_vector_reader_iterate (reader);
+
+  strings = benchmark_lookups (&scope, NULL, &found_strings);
+  interned = benchmark_lookups (&scope, atoms, &found_interned);
+
+  /* Both must find the same properties */
+  g_assert_cmpint (found_strings, ==, found_interned);
+
+  g_print ("strcmp over tag keys:   %8.1f ns per property lookup\n", strings);
+  g_print ("interned key atoms:     %8.1f ns per property lookup\n", interned);
+  g_print ("speedup:                %8.2fx\n", strings / interned);
+
+  g_clear_object (&scope.reader);
+  return 0;
+}
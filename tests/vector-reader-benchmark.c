@@ -0,0 +1,205 @@
+#undef G_DISABLE_ASSERT
+
+#include <shumate/shumate.h>
+#include "shumate/shumate-vector-reader-iter-private.h"
+#include "shumate/vector/vector_tile.pb-c.h"
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+#include <malloc.h>
+#define HAVE_MALLINFO2
+#endif
+
+/* Compares ShumateVectorReader's lazy decoder against the protobuf-c
+ * vector_tile__tile__unpack() it replaced. Each iteration parses the tile
+ * and then reads the type and every tag of every feature, which is roughly
+ * what indexing a tile for rendering does. The geometry is not read, since
+ * most passes over a layer don't need it.
+ *
+ * Pass paths to other .pbf files to benchmark them as well. */
+
+#define ITERATIONS 200
+
+
+static gsize
+heap_in_use (void)
+{
+#ifdef HAVE_MALLINFO2
+  return mallinfo2 ().uordblks;
+#else
+  return 0;
+#endif
+}
+
+static guint64
+scan_unpacked (VectorTile__Tile *tile)
+{
+  guint64 checksum = 0;
+
+  for (int i = 0; i < tile->n_layers; i ++)
+    {
+      VectorTile__Tile__Layer *layer = tile->layers[i];
+
+      for (int j = 0; j < layer->n_features; j ++)
+        {
+          VectorTile__Tile__Feature *feature = layer->features[j];
+
+          checksum += feature->type;
+
+          for (int k = 0; k + 1 < feature->n_tags; k += 2)
+            {
+              VectorTile__Tile__Value *value;
+
+              if (feature->tags[k] >= layer->n_keys || feature->tags[k + 1] >= layer->n_values)
+                continue;
+
+              value = layer->values[feature->tags[k + 1]];
+              checksum += strlen (layer->keys[feature->tags[k]]);
+              if (value->string_value != NULL)
+                checksum += strlen (value->string_value);
+              else
+                checksum += value->has_bool_value + value->has_int_value + value->has_uint_value
+                            + value->has_sint_value + value->has_float_value + value->has_double_value;
+            }
+        }
+    }
+
+  return checksum;
+}
+
+static guint64
+scan_reader (ShumateVectorReaderIter *iter)
+{
+  guint64 checksum = 0;
+
+  for (int i = 0; i < shumate_vector_reader_iter_get_layer_count (iter); i ++)
+    {
+      ShumateVectorMvtLayer *layer;
+
+      shumate_vector_reader_iter_read_layer (iter, i);
+      layer = shumate_vector_reader_iter_get_layer_struct (iter);
+
+      while (shumate_vector_reader_iter_next_feature (iter))
+        {
+          ShumateVectorMvtFeature *feature = shumate_vector_reader_iter_get_feature_struct (iter);
+
+          checksum += feature->type;
+
+          for (int k = 0; k + 1 < feature->n_tags; k += 2)
+            {
+              ShumateVectorMvtValue value;
+
+              if (feature->tags[k] >= layer->n_keys
+                  || !shumate_vector_mvt_layer_get_value (layer, feature->tags[k + 1], &value))
+                continue;
+
+              checksum += strlen (layer->keys[feature->tags[k]]);
+              if (value.has_string_value)
+                checksum += value.string_len;
+              else
+                checksum += value.has_bool_value + value.has_int_value + value.has_uint_value
+                            + value.has_sint_value + value.has_float_value + value.has_double_value;
+            }
+        }
+    }
+
+  return checksum;
+}
+
+static void
+benchmark_tile (const char *name,
+                GBytes     *bytes)
+{
+  gsize len;
+  const guint8 *data = g_bytes_get_data (bytes, &len);
+  guint64 checksum_unpacked = 0, checksum_reader = 0;
+  gint64 start, unpacked_time, reader_time;
+  gsize heap_before, unpacked_heap, reader_heap;
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < ITERATIONS; i ++)
+    {
+      VectorTile__Tile *tile = vector_tile__tile__unpack (NULL, len, data);
+
+      g_assert_nonnull (tile);
+      checksum_unpacked += scan_unpacked (tile);
+      vector_tile__tile__free_unpacked (tile, NULL);
+    }
+  unpacked_time = g_get_monotonic_time () - start;
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < ITERATIONS; i ++)
+    {
+      g_autoptr(ShumateVectorReader) reader = shumate_vector_reader_new (bytes);
+      g_autoptr(ShumateVectorReaderIter) iter = NULL;
+
+      g_assert_nonnull (reader);
+      iter = shumate_vector_reader_iterate (reader);
+      checksum_reader += scan_reader (iter);
+    }
+  reader_time = g_get_monotonic_time () - start;
+
+  /* Both decoders must have seen the same tags */
+  g_assert_cmpuint (checksum_unpacked, ==, checksum_reader);
+
+  /* Heap used while a decoded tile is alive, after a full scan */
+  {
+    VectorTile__Tile *tile;
+
+    heap_before = heap_in_use ();
+    tile = vector_tile__tile__unpack (NULL, len, data);
+    scan_unpacked (tile);
+    unpacked_heap = heap_in_use () - heap_before;
+    vector_tile__tile__free_unpacked (tile, NULL);
+  }
+
+  {
+    g_autoptr(ShumateVectorReader) reader = NULL;
+    g_autoptr(ShumateVectorReaderIter) iter = NULL;
+
+    heap_before = heap_in_use ();
+    reader = shumate_vector_reader_new (bytes);
+    iter = shumate_vector_reader_iterate (reader);
+    scan_reader (iter);
+    reader_heap = heap_in_use () - heap_before;
+  }
+
+  g_print ("%s (%" G_GSIZE_FORMAT " bytes)\n", name, len);
+  g_print ("  protobuf-c unpack:  %8.1f us per tile", (double) unpacked_time / ITERATIONS);
+#ifdef HAVE_MALLINFO2
+  g_print (", %8" G_GSIZE_FORMAT " bytes of heap", unpacked_heap);
+#endif
+  g_print ("\n");
+  g_print ("  lazy decoder:       %8.1f us per tile", (double) reader_time / ITERATIONS);
+#ifdef HAVE_MALLINFO2
+  g_print (", %8" G_GSIZE_FORMAT " bytes of heap", reader_heap);
+#endif
+  g_print ("\n");
+  g_print ("  speedup:            %8.2fx\n", (double) unpacked_time / reader_time);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr(GBytes) test_tile = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+
+  g_assert_nonnull (test_tile);
+  benchmark_tile ("0.pbf", test_tile);
+
+  for (int i = 1; i < argc; i ++)
+    {
+      g_autoptr(GError) error = NULL;
+      g_autoptr(GMappedFile) file = g_mapped_file_new (argv[i], FALSE, &error);
+      g_autoptr(GBytes) bytes = NULL;
+
+      if (file == NULL)
+        {
+          g_printerr ("%s: %s\n", argv[i], error->message);
+          return 1;
+        }
+
+      bytes = g_mapped_file_get_bytes (file);
+      benchmark_tile (argv[i], bytes);
+    }
+
+  return 0;
+}
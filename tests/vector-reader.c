@@ -1,6 +1,7 @@
 #undef G_DISABLE_ASSERT
 
 #include <shumate/shumate.h>
+#include "shumate/shumate-vector-reader-iter-private.h"
 #include "shumate/vector/vector_tile.pb-c.h"
 
 #define MOVE_TO 1
@@ -227,6 +228,13 @@ test_vector_reader_layers (void)
   g_assert_cmpstr (shumate_vector_reader_iter_get_layer_name (iter), ==, "helloworld2");
   g_assert_cmpint (shumate_vector_reader_iter_get_layer_extent (iter), ==, 100);
   g_assert_cmpint (shumate_vector_reader_iter_get_layer_feature_count (iter), ==, 0);
+
+  g_assert_true (shumate_vector_reader_iter_read_layer_by_name (iter, "helloworld2"));
+  g_assert_cmpint (shumate_vector_reader_iter_get_layer_index (iter), ==, 1);
+  g_assert_true (shumate_vector_reader_iter_read_layer_by_name (iter, "helloworld"));
+  g_assert_cmpint (shumate_vector_reader_iter_get_layer_index (iter), ==, 0);
+  g_assert_false (shumate_vector_reader_iter_read_layer_by_name (iter, "hello"));
+  g_assert_cmpint (shumate_vector_reader_iter_get_layer_index (iter), ==, -1);
 }
 
 static void
@@ -329,6 +337,141 @@ test_vector_reader_geometry (void)
   g_assert_false (shumate_vector_reader_iter_feature_contains_point (iter, 100, 401));
 }
 
+static GBytes *
+create_values_tile (void)
+{
+  VectorTile__Tile *tile;
+  VectorTile__Tile__Layer *layer;
+  VectorTile__Tile__Value *values[8];
+  uint8_t *out;
+  size_t out_len;
+
+  tile = g_new0 (VectorTile__Tile, 1);
+  vector_tile__tile__init (tile);
+
+  for (int i = 0; i < 7; i ++)
+    {
+      values[i] = g_new0 (VectorTile__Tile__Value, 1);
+      vector_tile__tile__value__init (values[i]);
+    }
+  values[7] = NULL;
+
+  values[0]->has_int_value = TRUE;
+  values[0]->int_value = -12;
+  values[1]->has_uint_value = TRUE;
+  values[1]->uint_value = G_MAXUINT64;
+  values[2]->has_sint_value = TRUE;
+  values[2]->sint_value = -34;
+  values[3]->has_float_value = TRUE;
+  values[3]->float_value = 0.5;
+  values[4]->has_double_value = TRUE;
+  values[4]->double_value = 1.25;
+  values[5]->has_bool_value = TRUE;
+  values[5]->bool_value = TRUE;
+  values[6]->string_value = g_strdup ("");
+
+  layer = add_layer (tile, "values", 4096,
+    (char*[]){"int", "uint", "sint", "float", "double", "bool", "string", NULL},
+    values
+  );
+
+  /* The last two tags refer to a key and a value that don't exist */
+  add_feature (layer, 1, (uint32_t[]){0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 0, 0, 7}, 18);
+
+  out_len = vector_tile__tile__get_packed_size (tile);
+  out = g_new0 (uint8_t, out_len);
+  vector_tile__tile__pack (tile, out);
+
+  vector_tile__tile__free_unpacked (tile, NULL);
+
+  return g_bytes_new_take (out, out_len);
+}
+
+static void
+test_vector_reader_values (void)
+{
+  g_autoptr(ShumateVectorReader) reader = NULL;
+  g_autoptr(ShumateVectorReaderIter) iter = NULL;
+  g_autoptr(GBytes) tile_data = create_values_tile ();
+  g_auto(GValue) value = G_VALUE_INIT;
+  g_autofree const char **keys = NULL;
+
+  reader = shumate_vector_reader_new (tile_data);
+  g_assert_nonnull (reader);
+
+  iter = shumate_vector_reader_iterate (reader);
+  g_assert_true (shumate_vector_reader_iter_read_layer_by_name (iter, "values"));
+  g_assert_true (shumate_vector_reader_iter_next_feature (iter));
+
+  g_assert_true (shumate_vector_reader_iter_get_feature_tag (iter, "int", &value));
+  g_assert_cmpint (g_value_get_int64 (&value), ==, -12);
+  g_value_unset (&value);
+
+  g_assert_true (shumate_vector_reader_iter_get_feature_tag (iter, "uint", &value));
+  g_assert_cmpuint (g_value_get_uint64 (&value), ==, G_MAXUINT64);
+  g_value_unset (&value);
+
+  g_assert_true (shumate_vector_reader_iter_get_feature_tag (iter, "sint", &value));
+  g_assert_cmpint (g_value_get_int64 (&value), ==, -34);
+  g_value_unset (&value);
+
+  g_assert_true (shumate_vector_reader_iter_get_feature_tag (iter, "float", &value));
+  g_assert_cmpfloat (g_value_get_float (&value), ==, 0.5);
+  g_value_unset (&value);
+
+  g_assert_true (shumate_vector_reader_iter_get_feature_tag (iter, "double", &value));
+  g_assert_cmpfloat (g_value_get_double (&value), ==, 1.25);
+  g_value_unset (&value);
+
+  g_assert_true (shumate_vector_reader_iter_get_feature_tag (iter, "bool", &value));
+  g_assert_true (g_value_get_boolean (&value));
+  g_value_unset (&value);
+
+  g_assert_true (shumate_vector_reader_iter_get_feature_tag (iter, "string", &value));
+  g_assert_cmpstr (g_value_get_string (&value), ==, "");
+  g_value_unset (&value);
+
+  g_assert_false (shumate_vector_reader_iter_get_feature_tag (iter, "missing", &value));
+
+  keys = shumate_vector_reader_iter_get_feature_keys (iter);
+  g_assert_cmpint (g_strv_length ((char **)keys), ==, 8);
+  g_assert_cmpstr (keys[7], ==, "int");
+}
+
+/* Truncated tiles must either fail to load or read as (partially) empty,
+ * never read out of bounds */
+static void
+test_vector_reader_malformed (void)
+{
+  g_autoptr(GBytes) tile_data = create_test_tile ();
+  gsize len = g_bytes_get_size (tile_data);
+
+  for (gsize cut = 0; cut < len; cut ++)
+    {
+      g_autoptr(GBytes) truncated = g_bytes_new_from_bytes (tile_data, 0, cut);
+      g_autoptr(ShumateVectorReader) reader = shumate_vector_reader_new (truncated);
+      g_autoptr(ShumateVectorReaderIter) iter = NULL;
+
+      if (reader == NULL)
+        continue;
+
+      iter = shumate_vector_reader_iterate (reader);
+      for (int i = 0; i < shumate_vector_reader_iter_get_layer_count (iter); i ++)
+        {
+          shumate_vector_reader_iter_read_layer (iter, i);
+          while (shumate_vector_reader_iter_next_feature (iter))
+            {
+              g_auto(GValue) value = G_VALUE_INIT;
+              g_autofree const char **keys = shumate_vector_reader_iter_get_feature_keys (iter);
+
+              shumate_vector_reader_iter_get_feature_tag (iter, "hello", &value);
+              shumate_vector_reader_iter_get_feature_geometry_type (iter);
+              shumate_vector_reader_iter_feature_contains_point (iter, 0, 0);
+            }
+        }
+    }
+}
+
 int
 main (int argc, char *argv[])
 {
@@ -337,6 +480,8 @@ main (int argc, char *argv[])
   g_test_add_func ("/vector-reader/layers", test_vector_reader_layers);
   g_test_add_func ("/vector-reader/tags", test_vector_reader_tags);
   g_test_add_func ("/vector-reader/geometry", test_vector_reader_geometry);
+  g_test_add_func ("/vector-reader/values", test_vector_reader_values);
+  g_test_add_func ("/vector-reader/malformed", test_vector_reader_malformed);
 
   return g_test_run ();
 }
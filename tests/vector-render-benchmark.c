@@ -0,0 +1,286 @@
+#undef G_DISABLE_ASSERT
+
+#include <shumate/shumate.h>
+#include "shumate/shumate-vector-renderer-private.h"
+#include "shumate/vector/vector_tile.pb-c.h"
+
+/* Measures how long ShumateVectorRenderer takes to render a tile with the
+ * osm-liberty style from demos/. The default tile is a synthetic stand-in
+ * for a dense urban tile: a street grid in a few road classes and a field
+ * of buildings and landuse polygons, which is where drawing features that
+ * share a paint as one path pays off.
+ *
+ * Every tile is rendered with batching and then without it, which draws each
+ * feature by itself like the renderer did before batching was added.
+ *
+ * Pass paths to other .pbf files to benchmark them as well. They are
+ * rendered as zoom level 14 tiles. */
+
+#define GRID_SIZE 64
+#define EXTENT 4096
+#define ZOOM_LEVEL 14
+#define ITERATIONS 20
+
+static const char *road_classes[] = {
+  "minor", "minor", "minor", "service", "secondary", "tertiary", "primary", "path",
+};
+
+enum {
+  KEY_CLASS,
+  KEY_BRUNNEL,
+  N_KEYS,
+};
+
+static const char *tile_keys[] = { "class", "brunnel" };
+
+
+static guint32
+command (int op, int count)
+{
+  return (op & 0x7) | (count << 3);
+}
+
+static guint32
+zigzag (int value)
+{
+  return (value << 1) ^ (value >> 31);
+}
+
+static VectorTile__Tile__Value *
+string_value (const char *string)
+{
+  VectorTile__Tile__Value *value = g_new0 (VectorTile__Tile__Value, 1);
+
+  vector_tile__tile__value__init (value);
+  value->string_value = (char *)string;
+  return value;
+}
+
+static VectorTile__Tile__Feature *
+new_feature (VectorTile__Tile__GeomType type,
+             guint32                    class_value)
+{
+  VectorTile__Tile__Feature *feature = g_new0 (VectorTile__Tile__Feature, 1);
+
+  vector_tile__tile__feature__init (feature);
+  feature->type = type;
+  feature->has_type = TRUE;
+  feature->n_tags = 2;
+  feature->tags = g_new0 (uint32_t, 2);
+  feature->tags[0] = KEY_CLASS;
+  feature->tags[1] = class_value;
+  return feature;
+}
+
+static void
+free_layer (VectorTile__Tile__Layer *layer)
+{
+  for (int i = 0; i < layer->n_values; i ++)
+    g_free (layer->values[i]);
+  g_free (layer->values);
+
+  for (int i = 0; i < layer->n_features; i ++)
+    {
+      g_free (layer->features[i]->tags);
+      g_free (layer->features[i]->geometry);
+      g_free (layer->features[i]);
+    }
+  g_free (layer->features);
+}
+
+static GBytes *
+create_dense_tile (void)
+{
+  VectorTile__Tile tile = VECTOR_TILE__TILE__INIT;
+  VectorTile__Tile__Layer transportation = VECTOR_TILE__TILE__LAYER__INIT;
+  VectorTile__Tile__Layer building = VECTOR_TILE__TILE__LAYER__INIT;
+  VectorTile__Tile__Layer landuse = VECTOR_TILE__TILE__LAYER__INIT;
+  VectorTile__Tile__Layer *layers[] = { &landuse, &transportation, &building };
+  int cell = EXTENT / GRID_SIZE;
+  uint8_t *out;
+  size_t out_len;
+
+  tile.n_layers = G_N_ELEMENTS (layers);
+  tile.layers = layers;
+
+  for (int i = 0; i < G_N_ELEMENTS (layers); i ++)
+    {
+      layers[i]->version = 2;
+      layers[i]->extent = EXTENT;
+      layers[i]->has_extent = TRUE;
+      layers[i]->n_keys = N_KEYS;
+      layers[i]->keys = (char **)tile_keys;
+    }
+
+  transportation.name = (char *)"transportation";
+  building.name = (char *)"building";
+  landuse.name = (char *)"landuse";
+
+  /* One horizontal and one vertical street per grid line, each a polyline
+   * with a vertex at every crossing */
+  transportation.n_values = G_N_ELEMENTS (road_classes);
+  transportation.values = g_new0 (VectorTile__Tile__Value *, transportation.n_values);
+  for (int i = 0; i < transportation.n_values; i ++)
+    transportation.values[i] = string_value (road_classes[i]);
+
+  transportation.n_features = GRID_SIZE * 2;
+  transportation.features = g_new0 (VectorTile__Tile__Feature *, transportation.n_features);
+  for (int i = 0; i < transportation.n_features; i ++)
+    {
+      VectorTile__Tile__Feature *feature = new_feature (VECTOR_TILE__TILE__GEOM_TYPE__LINESTRING,
+                                                        (i * 7) % transportation.n_values);
+      gboolean vertical = i % 2;
+      int line = i / 2 * cell + cell / 2;
+      int n = 0;
+
+      feature->n_geometry = 4 + GRID_SIZE * 2;
+      feature->geometry = g_new0 (uint32_t, feature->n_geometry);
+      feature->geometry[n++] = command (1, 1);
+      feature->geometry[n++] = zigzag (vertical ? line : 0);
+      feature->geometry[n++] = zigzag (vertical ? 0 : line);
+      feature->geometry[n++] = command (2, GRID_SIZE);
+      for (int j = 0; j < GRID_SIZE; j ++)
+        {
+          feature->geometry[n++] = zigzag (vertical ? 0 : cell);
+          feature->geometry[n++] = zigzag (vertical ? cell : 0);
+        }
+
+      transportation.features[i] = feature;
+    }
+
+  /* A building in every grid cell, and a residential area under each block
+   * of four cells */
+  building.n_features = GRID_SIZE * GRID_SIZE;
+  building.features = g_new0 (VectorTile__Tile__Feature *, building.n_features);
+  landuse.n_values = 1;
+  landuse.values = g_new0 (VectorTile__Tile__Value *, 1);
+  landuse.values[0] = string_value ("residential");
+  landuse.n_features = GRID_SIZE * GRID_SIZE / 4;
+  landuse.features = g_new0 (VectorTile__Tile__Feature *, landuse.n_features);
+
+  for (int i = 0; i < building.n_features + landuse.n_features; i ++)
+    {
+      gboolean is_building = i < building.n_features;
+      int index = is_building ? i : i - building.n_features;
+      int columns = is_building ? GRID_SIZE : GRID_SIZE / 2;
+      int size = is_building ? cell : cell * 2;
+      int x = (index % columns) * size + size / 4;
+      int y = (index / columns) * size + size / 4;
+      VectorTile__Tile__Feature *feature = new_feature (VECTOR_TILE__TILE__GEOM_TYPE__POLYGON, 0);
+      int n = 0;
+
+      if (is_building)
+        feature->n_tags = 0;
+
+      /* A square exterior ring, clockwise in tile coordinates */
+      feature->n_geometry = 10;
+      feature->geometry = g_new0 (uint32_t, feature->n_geometry);
+      feature->geometry[n++] = command (1, 1);
+      feature->geometry[n++] = zigzag (x);
+      feature->geometry[n++] = zigzag (y);
+      feature->geometry[n++] = command (2, 3);
+      feature->geometry[n++] = zigzag (size / 2);
+      feature->geometry[n++] = zigzag (0);
+      feature->geometry[n++] = zigzag (0);
+      feature->geometry[n++] = zigzag (size / 2);
+      feature->geometry[n++] = zigzag (-size / 2);
+      feature->geometry[n++] = command (7, 1);
+      feature->n_geometry = n;
+
+      if (is_building)
+        building.features[index] = feature;
+      else
+        landuse.features[index] = feature;
+    }
+
+  out_len = vector_tile__tile__get_packed_size (&tile);
+  out = g_new0 (uint8_t, out_len);
+  vector_tile__tile__pack (&tile, out);
+
+  for (int i = 0; i < G_N_ELEMENTS (layers); i ++)
+    free_layer (layers[i]);
+
+  return g_bytes_new_take (out, out_len);
+}
+
+/* Returns the average time to render the tile, in microseconds */
+static double
+time_render (ShumateVectorRenderer *renderer,
+             GBytes                *bytes)
+{
+  ShumateGridPosition source_position = { 0, 0, ZOOM_LEVEL };
+  gint64 start, elapsed;
+
+  start = g_get_monotonic_time ();
+  for (int i = 0; i < ITERATIONS; i ++)
+    {
+      g_autoptr(ShumateTile) tile = shumate_tile_new_full (0, 0, 512, ZOOM_LEVEL);
+      g_autoptr(GdkPaintable) paintable = NULL;
+      g_autoptr(GPtrArray) symbols = NULL;
+
+      shumate_vector_renderer_render (renderer, tile, bytes, &source_position, &paintable, &symbols);
+      g_assert_true (GDK_IS_PAINTABLE (paintable));
+    }
+  elapsed = g_get_monotonic_time () - start;
+
+  return (double) elapsed / ITERATIONS;
+}
+
+static void
+benchmark_tile (ShumateVectorRenderer *renderer,
+                const char            *name,
+                GBytes                *bytes)
+{
+  double batched, unbatched;
+
+  shumate_vector_renderer_set_batching (renderer, TRUE);
+  batched = time_render (renderer, bytes);
+  shumate_vector_renderer_set_batching (renderer, FALSE);
+  unbatched = time_render (renderer, bytes);
+  shumate_vector_renderer_set_batching (renderer, TRUE);
+
+  g_print ("%s (%" G_GSIZE_FORMAT " bytes)\n", name, g_bytes_get_size (bytes));
+  g_print ("  batched:   %8.1f us per tile\n", batched);
+  g_print ("  unbatched: %8.1f us per tile (%.2fx)\n", unbatched, unbatched / batched);
+}
+
+int
+main (int argc, char *argv[])
+{
+  g_autoptr(GError) error = NULL;
+  g_autofree char *style_path = NULL;
+  g_autofree char *style_json = NULL;
+  g_autoptr(ShumateVectorRenderer) renderer = NULL;
+  g_autoptr(GBytes) dense_tile = NULL;
+  const char *srcdir = g_getenv ("G_TEST_SRCDIR");
+
+  style_path = g_build_filename (srcdir != NULL ? srcdir : ".", "..", "demos", "osm-liberty", "style.json", NULL);
+  if (!g_file_get_contents (style_path, &style_json, NULL, &error))
+    {
+      g_printerr ("%s: %s\n", style_path, error->message);
+      return 1;
+    }
+
+  renderer = shumate_vector_renderer_new ("osm-liberty", style_json, &error);
+  g_assert_no_error (error);
+
+  dense_tile = create_dense_tile ();
+  benchmark_tile (renderer, "synthetic dense tile", dense_tile);
+
+  for (int i = 1; i < argc; i ++)
+    {
+      g_autoptr(GMappedFile) file = g_mapped_file_new (argv[i], FALSE, &error);
+      g_autoptr(GBytes) bytes = NULL;
+
+      if (file == NULL)
+        {
+          g_printerr ("%s: %s\n", argv[i], error->message);
+          return 1;
+        }
+
+      bytes = g_mapped_file_get_bytes (file);
+      benchmark_tile (renderer, argv[i], bytes);
+    }
+
+  return 0;
+}
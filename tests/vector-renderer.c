@@ -6,6 +6,9 @@
 #include "shumate/shumate-vector-renderer-private.h"
 #include "shumate/shumate-utils-private.h"
 #include "shumate/shumate-vector-value-private.h"
+#include "shumate/vector/shumate-vector-decoded-tile-private.h"
+#include "shumate/vector/shumate-vector-render-scope-private.h"
+#include "shumate/vector/shumate-vector-symbol-info-private.h"
 
 static void
 test_vector_renderer_render (void)
@@ -34,6 +37,156 @@ test_vector_renderer_render (void)
   g_assert_nonnull (symbols);
 }
 
+/* Test that data that isn't a vector tile, like an error page served in
+ * place of a tile, renders as an empty tile */
+static void
+test_vector_renderer_render_invalid (void)
+{
+  GError *error = NULL;
+  g_autoptr(GBytes) style_json = NULL;
+  g_autoptr(GBytes) tile_data = NULL;
+  g_autoptr(ShumateVectorRenderer) renderer = NULL;
+  g_autoptr(ShumateTile) tile = shumate_tile_new_full (0, 0, 512, 0);
+  g_autoptr(GdkPaintable) paintable = NULL;
+  g_autoptr(GPtrArray) symbols = NULL;
+  ShumateGridPosition source_position = { 0, 0, 0 };
+  const char *html = "<html><body>404 Not Found</body></html>";
+
+  style_json = g_resources_lookup_data ("/org/gnome/shumate/Tests/style.json", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  renderer = shumate_vector_renderer_new ("", g_bytes_get_data (style_json, NULL), &error);
+  g_assert_no_error (error);
+
+  tile_data = g_bytes_new_static (html, strlen (html));
+  shumate_vector_renderer_render (renderer, tile, tile_data, &source_position, &paintable, &symbols);
+  g_assert_true (GDK_IS_PAINTABLE (paintable));
+  g_assert_nonnull (symbols);
+  g_assert_cmpuint (symbols->len, ==, 0);
+}
+
+/* Test that labels come out of the render thread already laid out */
+static void
+test_vector_renderer_shaped_labels (void)
+{
+  GError *error = NULL;
+  g_autoptr(GBytes) style_json = NULL;
+  g_autoptr(GBytes) tile_data = NULL;
+  g_autoptr(ShumateVectorRenderer) renderer = NULL;
+  g_autoptr(ShumateTile) tile = shumate_tile_new_full (0, 0, 512, 0);
+  g_autoptr(GdkPaintable) paintable = NULL;
+  g_autoptr(GPtrArray) symbols = NULL;
+  ShumateGridPosition source_position = { 0, 0, 0 };
+  int n_labels = 0;
+
+  style_json = g_resources_lookup_data ("/org/gnome/shumate/Tests/style.json", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  renderer = shumate_vector_renderer_new ("", g_bytes_get_data (style_json, NULL), &error);
+  g_assert_no_error (error);
+
+  tile_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  shumate_vector_renderer_render (renderer, tile, tile_data, &source_position, &paintable, &symbols);
+  g_assert_nonnull (symbols);
+
+  for (int i = 0; i < symbols->len; i ++)
+    {
+      ShumateVectorSymbolInfo *symbol_info = g_ptr_array_index (symbols, i);
+      ShumateVectorShapedText *shaped_text = symbol_info->details->shaped_text;
+
+      if (symbol_info->details->formatted_text == NULL)
+        continue;
+
+      g_assert_nonnull (shaped_text);
+      g_assert_cmpuint (shaped_text->runs->len, >, 0);
+
+      for (int j = 0; j < shaped_text->runs->len; j ++)
+        {
+          ShumateVectorShapedRun *run = &g_array_index (shaped_text->runs, ShumateVectorShapedRun, j);
+          g_assert_true (run->sprite != NULL || (run->font != NULL && run->glyphs != NULL));
+        }
+
+      n_labels ++;
+    }
+
+  g_assert_cmpint (n_labels, >, 0);
+}
+
+static void
+test_vector_renderer_shaped_text_cache (void)
+{
+  g_autoptr(GPtrArray) text = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_format_part_free);
+  ShumateVectorFormatPart *part = g_new0 (ShumateVectorFormatPart, 1);
+  GdkRGBA black = SHUMATE_VECTOR_COLOR_BLACK;
+  g_autoptr(ShumateVectorShapedText) shaped1 = NULL;
+  g_autoptr(ShumateVectorShapedText) shaped2 = NULL;
+  g_autoptr(ShumateVectorShapedText) shaped3 = NULL;
+  g_autoptr(ShumateVectorShapedText) shaped4 = NULL;
+
+  part->string = g_strdup ("Main Street");
+  g_ptr_array_add (text, part);
+
+  /* The same label is only laid out once */
+  shaped1 = shumate_vector_shaped_text_lookup (text, "Sans", 16, 0, &black, NULL);
+  shaped2 = shumate_vector_shaped_text_lookup (text, "Sans", 16, 0, &black, NULL);
+  g_assert_true (shaped1 == shaped2);
+
+  /* A different style is a different entry */
+  shaped3 = shumate_vector_shaped_text_lookup (text, "Sans", 12, 0, &black, NULL);
+  g_assert_true (shaped3 != shaped1);
+
+  /* Shrinking the cache evicts entries, but existing references stay valid */
+  shumate_vector_shaped_text_cache_set_max_size (0);
+  shaped4 = shumate_vector_shaped_text_lookup (text, "Sans", 16, 0, &black, NULL);
+  g_assert_true (shaped4 != shaped1);
+  g_assert_cmpuint (shaped1->runs->len, ==, shaped4->runs->len);
+
+  shumate_vector_shaped_text_cache_set_max_size (4 * 1024 * 1024);
+}
+
+static void
+test_vector_renderer_shaped_text_font_options (void)
+{
+  g_autoptr(GPtrArray) text = g_ptr_array_new_with_free_func ((GDestroyNotify)shumate_vector_format_part_free);
+  ShumateVectorFormatPart *part = g_new0 (ShumateVectorFormatPart, 1);
+  GdkRGBA black = SHUMATE_VECTOR_COLOR_BLACK;
+  cairo_font_options_t *unhinted = cairo_font_options_create ();
+  cairo_font_options_t *unhinted_copy = NULL;
+  cairo_font_options_t *hinted = cairo_font_options_create ();
+  g_autoptr(ShumateVectorShapedText) shaped1 = NULL;
+  g_autoptr(ShumateVectorShapedText) shaped2 = NULL;
+  g_autoptr(ShumateVectorShapedText) shaped3 = NULL;
+  g_autoptr(ShumateVectorShapedText) shaped4 = NULL;
+
+  part->string = g_strdup ("Font Options Avenue");
+  g_ptr_array_add (text, part);
+
+  cairo_font_options_set_hint_style (unhinted, CAIRO_HINT_STYLE_NONE);
+  cairo_font_options_set_hint_style (hinted, CAIRO_HINT_STYLE_FULL);
+  unhinted_copy = cairo_font_options_copy (unhinted);
+
+  /* Equal options share cache entries */
+  g_assert_cmpuint (shumate_vector_shaped_text_get_font_options_id (unhinted), ==,
+                    shumate_vector_shaped_text_get_font_options_id (unhinted_copy));
+  g_assert_cmpuint (shumate_vector_shaped_text_get_font_options_id (unhinted), !=,
+                    shumate_vector_shaped_text_get_font_options_id (hinted));
+  g_assert_cmpuint (shumate_vector_shaped_text_get_font_options_id (unhinted), !=,
+                    shumate_vector_shaped_text_get_font_options_id (NULL));
+
+  shaped1 = shumate_vector_shaped_text_lookup (text, "Sans", 16, 0, &black, unhinted);
+  shaped2 = shumate_vector_shaped_text_lookup (text, "Sans", 16, 0, &black, unhinted_copy);
+  g_assert_true (shaped1 == shaped2);
+
+  /* Different options are a different entry... */
+  shaped3 = shumate_vector_shaped_text_lookup (text, "Sans", 16, 0, &black, hinted);
+  g_assert_true (shaped3 != shaped1);
+
+  /* ...which doesn't replace the first one, so maps with different font
+   * options don't keep evicting each other's labels */
+  shaped4 = shumate_vector_shaped_text_lookup (text, "Sans", 16, 0, &black, unhinted);
+  g_assert_true (shaped4 == shaped1);
+
+  cairo_font_options_destroy (unhinted);
+  cairo_font_options_destroy (unhinted_copy);
+  cairo_font_options_destroy (hinted);
+}
+
 void
 test_vector_renderer_global_state (void)
 {
@@ -70,13 +223,188 @@ test_vector_renderer_global_state (void)
   g_assert_null (out_value);
 }
 
+static void
+test_vector_renderer_overzoom (void)
+{
+  GError *error = NULL;
+  g_autoptr(GBytes) style_json = NULL;
+  g_autoptr(GBytes) tile_data = NULL;
+  g_autoptr(ShumateVectorRenderer) renderer = NULL;
+  ShumateGridPosition source_position = { 0, 0, 0 };
+
+  style_json = g_resources_lookup_data ("/org/gnome/shumate/Tests/style.json", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  renderer = shumate_vector_renderer_new ("", g_bytes_get_data (style_json, NULL), &error);
+  g_assert_no_error (error);
+
+  tile_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+
+  /* Render all four pieces of the source tile, one zoom level past it */
+  for (int x = 0; x < 2; x ++)
+    for (int y = 0; y < 2; y ++)
+      {
+        g_autoptr(ShumateTile) tile = shumate_tile_new_full (x, y, 512, 1);
+        g_autoptr(GdkPaintable) paintable = NULL;
+        g_autoptr(GPtrArray) symbols = NULL;
+
+        shumate_vector_renderer_render (renderer, tile, tile_data, &source_position, &paintable, &symbols);
+        g_assert_true (GDK_IS_PAINTABLE (paintable));
+        g_assert_nonnull (symbols);
+      }
+}
+
+static void
+test_vector_renderer_decoded_tile_cache (void)
+{
+  ShumateVectorDecodedTileCache *cache = shumate_vector_decoded_tile_cache_new (1);
+  ShumateVectorIndexDescription *index_description = shumate_vector_index_description_new ();
+  g_autoptr(GBytes) tile_data = NULL;
+  g_autoptr(GBytes) tile_data_copy = NULL;
+  g_autoptr(ShumateVectorDecodedTile) decoded1 = NULL;
+  g_autoptr(ShumateVectorDecodedTile) decoded2 = NULL;
+  g_autoptr(ShumateVectorDecodedTile) decoded3 = NULL;
+  g_autoptr(ShumateVectorDecodedTile) decoded4 = NULL;
+  ShumateGridPosition pos = { 0, 0, 0 };
+  ShumateGridPosition other_pos = { 1, 0, 1 };
+
+  tile_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  tile_data_copy = g_bytes_new (g_bytes_get_data (tile_data, NULL), g_bytes_get_size (tile_data));
+
+  decoded1 = shumate_vector_decoded_tile_cache_lookup (cache, &pos, tile_data, index_description);
+  g_assert_nonnull (shumate_vector_decoded_tile_get_reader (decoded1));
+  g_assert_nonnull (shumate_vector_decoded_tile_get_index (decoded1));
+
+  /* Equal data at the same position is shared */
+  decoded2 = shumate_vector_decoded_tile_cache_lookup (cache, &pos, tile_data_copy, index_description);
+  g_assert_true (decoded1 == decoded2);
+
+  /* Another position evicts it, but the existing references stay valid */
+  decoded3 = shumate_vector_decoded_tile_cache_lookup (cache, &other_pos, tile_data, index_description);
+  g_assert_true (decoded3 != decoded1);
+  g_assert_nonnull (shumate_vector_decoded_tile_get_reader (decoded1));
+
+  decoded4 = shumate_vector_decoded_tile_cache_lookup (cache, &pos, tile_data, index_description);
+  g_assert_true (decoded4 != decoded1);
+
+  shumate_vector_decoded_tile_cache_free (cache);
+  shumate_vector_index_description_free (index_description);
+}
+
+/* Test that geometry outside the visible part of an overzoomed tile doesn't
+ * reach cairo */
+static void
+test_vector_renderer_clip_geometry (void)
+{
+  g_autoptr(GBytes) tile_data = NULL;
+  g_autoptr(ShumateVectorReader) reader = NULL;
+  cairo_surface_t *surface = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 256, 256);
+  ShumateVectorRenderScope scope = { 0 };
+  int n_points = 0;
+
+  tile_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  reader = shumate_vector_reader_new (tile_data);
+  scope.reader = shumate_vector_reader_iterate (reader);
+  scope.cr = cairo_create (surface);
+  scope.target_size = 256;
+  scope.scale_factor = 1;
+  scope.overzoom_scale = 2;
+
+  for (int x = 0; x < 2; x ++)
+    for (int y = 0; y < 2; y ++)
+      {
+        scope.overzoom_x = x / 2.0;
+        scope.overzoom_y = y / 2.0;
+
+        for (int i = 0; i < shumate_vector_reader_iter_get_layer_count (scope.reader); i ++)
+          {
+            ShumateVectorMvtLayer *layer;
+            double min_x, min_y, max_x, max_y;
+
+            shumate_vector_reader_iter_read_layer (scope.reader, i);
+            layer = shumate_vector_reader_iter_get_layer_struct (scope.reader);
+            scope.scale = (double) layer->extent / scope.target_size / scope.overzoom_scale;
+
+            /* The visible quarter of the tile, plus the one pixel margin
+             * fills get for antialiasing */
+            min_x = scope.overzoom_x * layer->extent - scope.scale;
+            min_y = scope.overzoom_y * layer->extent - scope.scale;
+            max_x = min_x + layer->extent / 2.0 + 2 * scope.scale;
+            max_y = min_y + layer->extent / 2.0 + 2 * scope.scale;
+
+            while (shumate_vector_reader_iter_next_feature (scope.reader))
+              {
+                cairo_path_t *path;
+
+                if (shumate_vector_render_scope_get_geometry_type (&scope) != SHUMATE_VECTOR_GEOMETRY_POLYGON)
+                  continue;
+
+                shumate_vector_render_scope_exec_geometry (&scope);
+                path = cairo_copy_path (scope.cr);
+
+                for (int j = 0; j < path->num_data; j += path->data[j].header.length)
+                  {
+                    cairo_path_data_t *data = &path->data[j];
+
+                    if (data->header.type == CAIRO_PATH_CLOSE_PATH)
+                      continue;
+
+                    g_assert_cmpfloat (data[1].point.x, >=, min_x - 0.001);
+                    g_assert_cmpfloat (data[1].point.x, <=, max_x + 0.001);
+                    g_assert_cmpfloat (data[1].point.y, >=, min_y - 0.001);
+                    g_assert_cmpfloat (data[1].point.y, <=, max_y + 0.001);
+                    n_points ++;
+                  }
+
+                cairo_path_destroy (path);
+              }
+          }
+      }
+
+  g_assert_cmpint (n_points, >, 0);
+
+  g_clear_object (&scope.reader);
+  cairo_destroy (scope.cr);
+  cairo_surface_destroy (surface);
+}
+
+static void
+test_vector_renderer_render_threads (void)
+{
+  GError *error = NULL;
+  g_autoptr(GBytes) style_json = NULL;
+  g_autoptr(ShumateVectorRenderer) renderer = NULL;
+  guint render_threads;
+
+  style_json = g_resources_lookup_data ("/org/gnome/shumate/Tests/style.json", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  g_assert_no_error (error);
+
+  renderer = shumate_vector_renderer_new ("", g_bytes_get_data (style_json, NULL), &error);
+  g_assert_no_error (error);
+
+  g_assert_cmpuint (shumate_vector_renderer_get_render_threads (renderer), ==, 0);
+
+  shumate_vector_renderer_set_render_threads (renderer, 2);
+  g_object_get (renderer, "render-threads", &render_threads, NULL);
+  g_assert_cmpuint (render_threads, ==, 2);
+
+  g_object_set (renderer, "render-threads", 0, NULL);
+  g_assert_cmpuint (shumate_vector_renderer_get_render_threads (renderer), ==, 0);
+}
+
 int
 main (int argc, char *argv[])
 {
   g_test_init (&argc, &argv, NULL);
 
   g_test_add_func ("/vector-renderer/render", test_vector_renderer_render);
+  g_test_add_func ("/vector-renderer/render-invalid", test_vector_renderer_render_invalid);
   g_test_add_func ("/vector-renderer/global-state", test_vector_renderer_global_state);
+  g_test_add_func ("/vector-renderer/shaped-labels", test_vector_renderer_shaped_labels);
+  g_test_add_func ("/vector-renderer/shaped-text-cache", test_vector_renderer_shaped_text_cache);
+  g_test_add_func ("/vector-renderer/shaped-text-font-options", test_vector_renderer_shaped_text_font_options);
+  g_test_add_func ("/vector-renderer/render-threads", test_vector_renderer_render_threads);
+  g_test_add_func ("/vector-renderer/overzoom", test_vector_renderer_overzoom);
+  g_test_add_func ("/vector-renderer/decoded-tile-cache", test_vector_renderer_decoded_tile_cache);
+  g_test_add_func ("/vector-renderer/clip-geometry", test_vector_renderer_clip_geometry);
 
   return g_test_run ();
 }
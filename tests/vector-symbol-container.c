@@ -0,0 +1,256 @@
+#undef G_DISABLE_ASSERT
+
+#include <gtk/gtk.h>
+#include <shumate/shumate.h>
+#include "shumate/shumate-tile-private.h"
+#include "shumate/shumate-utils-private.h"
+#include "shumate/shumate-vector-renderer-private.h"
+#include "shumate/vector/shumate-vector-symbol-container-private.h"
+
+#define N_TILES 8
+#define TILE_ZOOM 3
+
+typedef struct {
+  ShumateVectorRenderer *renderer;
+  ShumateViewport *viewport;
+  ShumateVectorSymbolContainer *container;
+  GPtrArray *symbols;
+} Fixture;
+
+
+static void
+fixture_setup (Fixture       *fixture,
+               gconstpointer  user_data)
+{
+  GError *error = NULL;
+  g_autoptr(GBytes) style_json = NULL;
+  g_autoptr(GBytes) tile_data = NULL;
+  g_autoptr(ShumateTile) tile = shumate_tile_new_full (0, 0, 512, 0);
+  g_autoptr(GdkPaintable) paintable = NULL;
+  ShumateGridPosition source_position = { 0, 0, 0 };
+
+  style_json = g_resources_lookup_data ("/org/gnome/shumate/Tests/style.json", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  fixture->renderer = shumate_vector_renderer_new ("", g_bytes_get_data (style_json, NULL), &error);
+  g_assert_no_error (error);
+
+  tile_data = g_resources_lookup_data ("/org/gnome/shumate/Tests/0.pbf", G_RESOURCE_LOOKUP_FLAGS_NONE, NULL);
+  shumate_vector_renderer_render (fixture->renderer, tile, tile_data, &source_position, &paintable, &fixture->symbols);
+  g_assert_nonnull (fixture->symbols);
+  g_assert_cmpuint (fixture->symbols->len, >, 0);
+
+  fixture->viewport = shumate_viewport_new ();
+  shumate_viewport_set_reference_map_source (fixture->viewport, SHUMATE_MAP_SOURCE (fixture->renderer));
+  shumate_viewport_set_zoom_level (fixture->viewport, TILE_ZOOM);
+  shumate_location_set_location (SHUMATE_LOCATION (fixture->viewport), 10, 20);
+
+  fixture->container = g_object_ref_sink (shumate_vector_symbol_container_new (SHUMATE_MAP_SOURCE (fixture->renderer),
+                                                                               fixture->viewport));
+
+  /* Use the same symbols for many tiles, so that there are enough of them
+   * for a placement to span several frames */
+  for (int x = 0; x < N_TILES; x ++)
+    for (int y = 0; y < N_TILES; y ++)
+      shumate_vector_symbol_container_add_symbols (fixture->container, fixture->symbols, x, y, TILE_ZOOM);
+
+  /* The first placement is always made all at once */
+  gtk_widget_allocate (GTK_WIDGET (fixture->container), 512, 512, -1, NULL);
+  g_assert_false (shumate_vector_symbol_container_get_placement_pending (fixture->container));
+
+  /* Place as few symbols per frame as possible from now on */
+  shumate_vector_symbol_container_set_placement_time_budget (fixture->container, 0);
+}
+
+static void
+fixture_teardown (Fixture       *fixture,
+                  gconstpointer  user_data)
+{
+  g_clear_object (&fixture->container);
+  g_clear_object (&fixture->viewport);
+  g_clear_object (&fixture->renderer);
+  g_clear_pointer (&fixture->symbols, g_ptr_array_unref);
+}
+
+/* Runs one frame of placement, like the container's tick callback does */
+static void
+allocate (Fixture *fixture)
+{
+  gtk_widget_queue_allocate (GTK_WIDGET (fixture->container));
+  gtk_widget_allocate (GTK_WIDGET (fixture->container), 512, 512, -1, NULL);
+}
+
+/* Runs frames until the placement in progress is committed */
+static void
+finish_placement (Fixture *fixture)
+{
+  for (int i = 0; i < 10000; i ++)
+    {
+      if (!shumate_vector_symbol_container_get_placement_pending (fixture->container))
+        return;
+
+      allocate (fixture);
+    }
+
+  g_assert_not_reached ();
+}
+
+
+/* Test that a small view change is placed over several frames */
+static void
+test_vector_symbol_container_incremental (Fixture       *fixture,
+                                          gconstpointer  user_data)
+{
+  double rotation;
+
+  shumate_viewport_set_rotation (fixture->viewport, 0.1);
+  allocate (fixture);
+  g_assert_true (shumate_vector_symbol_container_get_placement_pending (fixture->container));
+
+  /* The previous placement is shown until the new one is done */
+  shumate_vector_symbol_container_get_placement_view (fixture->container, NULL, &rotation);
+  g_assert_cmpfloat (rotation, ==, 0);
+
+  finish_placement (fixture);
+  shumate_vector_symbol_container_get_placement_view (fixture->container, NULL, &rotation);
+  g_assert_cmpfloat (rotation, ==, 0.1);
+}
+
+
+/* Test that when a placement made for an earlier view is committed, another
+ * one is made for the current view */
+static void
+test_vector_symbol_container_stale_placement (Fixture       *fixture,
+                                              gconstpointer  user_data)
+{
+  double rotation;
+
+  shumate_viewport_set_rotation (fixture->viewport, 0.1);
+  allocate (fixture);
+  g_assert_true (shumate_vector_symbol_container_get_placement_pending (fixture->container));
+
+  shumate_viewport_set_rotation (fixture->viewport, 0.2);
+  finish_placement (fixture);
+
+  shumate_vector_symbol_container_get_placement_view (fixture->container, NULL, &rotation);
+  g_assert_cmpfloat (rotation, ==, 0.2);
+}
+
+
+/* Test that symbols being added and removed all the time can't keep a
+ * placement from ever finishing */
+static void
+test_vector_symbol_container_restarts (Fixture       *fixture,
+                                       gconstpointer  user_data)
+{
+  double rotation;
+  gboolean finished = FALSE;
+
+  shumate_viewport_set_rotation (fixture->viewport, 0.1);
+  allocate (fixture);
+  g_assert_true (shumate_vector_symbol_container_get_placement_pending (fixture->container));
+
+  for (int i = 0; i < 10 && !finished; i ++)
+    {
+      shumate_vector_symbol_container_remove_symbols (fixture->container, 0, 0, TILE_ZOOM);
+      shumate_vector_symbol_container_add_symbols (fixture->container, fixture->symbols, 0, 0, TILE_ZOOM);
+      allocate (fixture);
+
+      finished = !shumate_vector_symbol_container_get_placement_pending (fixture->container);
+    }
+
+  g_assert_true (finished);
+  shumate_vector_symbol_container_get_placement_view (fixture->container, NULL, &rotation);
+  g_assert_cmpfloat (rotation, ==, 0.1);
+}
+
+
+/* Test that the visible labels are exposed to accessibility */
+static void
+test_vector_symbol_container_accessible (Fixture       *fixture,
+                                         gconstpointer  user_data)
+{
+  gtk_test_accessible_assert_role (fixture->container, GTK_ACCESSIBLE_ROLE_LABEL);
+  g_assert_true (gtk_test_accessible_has_property (GTK_ACCESSIBLE (fixture->container),
+                                                   GTK_ACCESSIBLE_PROPERTY_LABEL));
+}
+
+
+/* Test that the shown placement lines up with the current view while a
+ * placement for a slightly different zoom level is in progress */
+static void
+test_vector_symbol_container_zoom_delta (Fixture       *fixture,
+                                         gconstpointer  user_data)
+{
+  ShumateVectorCollision *collision;
+
+  shumate_viewport_set_zoom_level (fixture->viewport, TILE_ZOOM + 0.25);
+  allocate (fixture);
+  g_assert_true (shumate_vector_symbol_container_get_placement_pending (fixture->container));
+
+  /* The center didn't move, so there is nothing to make up for */
+  collision = shumate_vector_symbol_container_get_collision (fixture->container);
+  g_assert_cmpfloat_with_epsilon (collision->delta_x, 0, 0.001);
+  g_assert_cmpfloat_with_epsilon (collision->delta_y, 0, 0.001);
+}
+
+
+/* Counts the points on a grid over the view where the shown placement has a
+ * symbol, like hit testing does */
+static int
+count_hits (Fixture *fixture)
+{
+  ShumateVectorCollision *collision = shumate_vector_symbol_container_get_collision (fixture->container);
+  int hits = 0;
+
+  for (int x = 0; x < 512; x += 4)
+    for (int y = 0; y < 512; y += 4)
+      if (shumate_vector_collision_find_point (collision,
+                                               x + collision->delta_x,
+                                               y + collision->delta_y) != NULL)
+        hits ++;
+
+  return hits;
+}
+
+
+/* Test that removing symbols keeps the rest of the shown placement usable for
+ * hit testing, instead of clearing it until the next placement is done */
+static void
+test_vector_symbol_container_remove (Fixture       *fixture,
+                                     gconstpointer  user_data)
+{
+  int hits = count_hits (fixture);
+
+  g_assert_cmpint (hits, >, 0);
+
+  shumate_vector_symbol_container_remove_symbols (fixture->container, 0, 0, TILE_ZOOM);
+  g_assert_cmpint (count_hits (fixture), >, 0);
+  g_assert_cmpint (count_hits (fixture), <=, hits);
+
+  for (int x = 0; x < N_TILES; x ++)
+    for (int y = 0; y < N_TILES; y ++)
+      shumate_vector_symbol_container_remove_symbols (fixture->container, x, y, TILE_ZOOM);
+  g_assert_cmpint (count_hits (fixture), ==, 0);
+}
+
+
+int
+main (int argc, char *argv[])
+{
+  g_test_init (&argc, &argv, NULL);
+  gtk_init ();
+
+  g_test_add ("/vector-symbol-container/incremental", Fixture, NULL,
+              fixture_setup, test_vector_symbol_container_incremental, fixture_teardown);
+  g_test_add ("/vector-symbol-container/stale-placement", Fixture, NULL,
+              fixture_setup, test_vector_symbol_container_stale_placement, fixture_teardown);
+  g_test_add ("/vector-symbol-container/restarts", Fixture, NULL,
+              fixture_setup, test_vector_symbol_container_restarts, fixture_teardown);
+  g_test_add ("/vector-symbol-container/accessible", Fixture, NULL,
+              fixture_setup, test_vector_symbol_container_accessible, fixture_teardown);
+  g_test_add ("/vector-symbol-container/zoom-delta", Fixture, NULL,
+              fixture_setup, test_vector_symbol_container_zoom_delta, fixture_teardown);
+  g_test_add ("/vector-symbol-container/remove", Fixture, NULL,
+              fixture_setup, test_vector_symbol_container_remove, fixture_teardown);
+
+  return g_test_run ();
+}